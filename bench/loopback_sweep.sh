@@ -0,0 +1,94 @@
+#!/bin/sh
+#
+# @file loopback_sweep.sh
+# Verteilte Systeme - TCP/IP
+#
+# Sweeps socket tuning settings over loopback: for every setting the
+# server is started on its own port, POSTS requests are sent with
+# CONCURRENCY clients in parallel and the throughput is printed.
+#
+# usage: bench/loopback_sweep.sh [settings-file]
+#
+# Every non-empty line of the settings file (default: the list below) is
+# "<server options> | <client options>", e.g.
+#   --nodelay --defer-accept 1 | --nodelay
+#
+# Environment: POSTS (default 500), CONCURRENCY (default 8),
+#              THREADS (server worker threads, default 4, 0 -> fork mode),
+#              PORT (first port, default 15000), BIN (directory of the binaries)
+#
+
+POSTS=${POSTS:-500}
+CONCURRENCY=${CONCURRENCY:-8}
+THREADS=${THREADS:-4}
+PORT=${PORT:-15000}
+BIN=${BIN:-$(cd "$(dirname "$0")/.." && pwd)}
+
+DEFAULT_SETTINGS='|
+--nodelay | --nodelay
+--defer-accept 1 |
+--fastopen 16 | --fastopen
+--sndbuf 262144 --rcvbuf 262144 | --sndbuf 262144 --rcvbuf 262144
+--busy-poll 50 | --busy-poll 50
+--backlog 1024 --nodelay --defer-accept 1 | --nodelay'
+
+if [ $# -gt 0 ]; then
+	SETTINGS=$(cat "$1")
+else
+	SETTINGS=$DEFAULT_SETTINGS
+fi
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# one client loop, run CONCURRENCY times in parallel
+client_loop()
+{
+	mkdir -p "$WORKDIR/c$1" && cd "$WORKDIR/c$1" || exit 1
+	i=0
+	while [ $i -lt $((POSTS / CONCURRENCY)) ]; do
+		# shellcheck disable=SC2086
+		"$BIN/simple_message_client" -s localhost -p "$2" -u "bench$1" -m "post $i" $3 > /dev/null || echo fail >> "$WORKDIR/failures"
+		i=$((i + 1))
+	done
+}
+
+printf '%-50s %-30s %10s %8s\n' "server options" "client options" "posts/s" "failed"
+echo "$SETTINGS" | while IFS='|' read -r serverOptions clientOptions; do
+	# shellcheck disable=SC2086
+	serverOptions=$(echo $serverOptions)
+	# shellcheck disable=SC2086
+	clientOptions=$(echo $clientOptions)
+	if [ "$THREADS" -gt 0 ]; then
+		mode="-t $THREADS"
+	else
+		mode=""
+	fi
+	: > "$WORKDIR/failures"
+
+	# shellcheck disable=SC2086
+	"$BIN/simple_message_server" -p "$PORT" $mode $serverOptions 2> "$WORKDIR/server.err" &
+	serverPid=$!
+	sleep 0.2
+
+	start=$(date +%s.%N)
+	clients=""
+	c=0
+	while [ $c -lt "$CONCURRENCY" ]; do
+		client_loop $c "$PORT" "$clientOptions" &
+		clients="$clients $!"
+		c=$((c + 1))
+	done
+	# shellcheck disable=SC2086
+	wait $clients
+	end=$(date +%s.%N)
+
+	kill "$serverPid" 2> /dev/null
+	wait "$serverPid" 2> /dev/null
+
+	total=$(( (POSTS / CONCURRENCY) * CONCURRENCY ))
+	awk -v s="${serverOptions:--}" -v c="${clientOptions:--}" -v n="$total" -v t0="$start" -v t1="$end" \
+		-v f="$(wc -l < "$WORKDIR/failures")" \
+		'BEGIN { printf "%-50s %-30s %10.0f %8d\n", s, c, n / (t1 - t0), f }'
+	PORT=$((PORT + 1))
+done
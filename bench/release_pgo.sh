@@ -0,0 +1,81 @@
+#!/bin/sh
+#
+# @file release_pgo.sh
+# Verteilte Systeme - TCP/IP
+#
+# Profile guided release build of client, server and agent:
+#   1. plain optimized build, throughput measured over loopback
+#   2. instrumented build (-fprofile-generate), trained with the same
+#      workload: forked logic processes (the installed stand-in logic)
+#      and the in-process handler with worker threads
+#   3. rebuild with the profile and link time optimization
+#      (-fprofile-use -flto), throughput measured again
+# The throughput of both builds and the change is printed at the end.
+#
+# usage: bench/release_pgo.sh (or make release-pgo)
+#
+# Environment: POSTS (posts per measurement, default 2000),
+#              CONCURRENCY (default 8), THREADS (worker threads of the
+#              threaded runs, default 4), PORT (first port, default 15200)
+#
+
+POSTS=${POSTS:-2000}
+CONCURRENCY=${CONCURRENCY:-8}
+THREADS=${THREADS:-4}
+PORT=${PORT:-15200}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+
+PGO_GENERATE="-fprofile-generate -fprofile-update=atomic"
+# Functions the workload never reaches (e.g. the agent) have no profile
+PGO_USE="-fprofile-use -fprofile-correction -Wno-missing-profile -flto=auto"
+
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+printf '|\n' > "$WORKDIR/settings"
+
+# posts/s of one loopback run: measure <label> <threads>
+measure()
+{
+	result=$(POSTS=$POSTS CONCURRENCY=$CONCURRENCY THREADS=$2 PORT=$PORT BIN="$ROOT" \
+		"$ROOT/bench/loopback_sweep.sh" "$WORKDIR/settings" | awk 'NR == 2 { print $(NF - 1) " " $NF }')
+	PORT=$((PORT + 1))
+	set -- "$1" "$2" $result
+	if [ "$4" != "0" ]; then
+		echo "release_pgo.sh: $4 posts failed in the $1 run" >&2
+		exit 1
+	fi
+	echo "$3"
+}
+
+build()
+{
+	make -C "$ROOT" -B all PGO_FLAGS="$1" > "$WORKDIR/build.log" 2>&1 || {
+		cat "$WORKDIR/build.log" >&2
+		exit 1
+	}
+}
+
+cd "$ROOT" || exit 1
+rm -f ./*.gcda
+
+echo "building the plain release ..."
+build ""
+forkBefore=$(measure "plain fork" 0) || exit 1
+threadsBefore=$(measure "plain threaded" "$THREADS") || exit 1
+
+echo "building instrumented, training ..."
+build "$PGO_GENERATE"
+measure "training fork" 0 > /dev/null || exit 1
+measure "training threaded" "$THREADS" > /dev/null || exit 1
+
+echo "building with the profile ..."
+build "$PGO_USE"
+forkAfter=$(measure "pgo fork" 0) || exit 1
+threadsAfter=$(measure "pgo threaded" "$THREADS") || exit 1
+rm -f ./*.gcda
+
+printf '%-24s %12s %12s %8s\n' "workload" "plain" "pgo+lto" "change"
+awk -v b="$forkBefore" -v a="$forkAfter" \
+	'BEGIN { printf "%-24s %10.0f/s %10.0f/s %+7.1f%%\n", "fork (stand-in logic)", b, a, (a - b) * 100 / b }'
+awk -v b="$threadsBefore" -v a="$threadsAfter" -v t="$THREADS" \
+	'BEGIN { printf "%-24s %10.0f/s %10.0f/s %+7.1f%%\n", "threaded (" t " threads)", b, a, (a - b) * 100 / b }'
@@ -0,0 +1,610 @@
+/*
+ * @file simple_message_bench.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Microbenchmarks of the protocol code of client and server. Every
+ * benchmark runs one operation in several rounds (default 5) of the
+ * measuring time each and reports the time, the bytes allocated and the
+ * allocations per operation of the best round: noise on the machine only
+ * ever adds time, so the minimum is what the code costs and stays the
+ * same from run to run. Allocations are counted by taking over malloc()
+ * and friends of the whole process, C library included.
+ *
+ * With --baseline the results are compared to a saved run: an operation
+ * is a regression if it allocates more than 1% more bytes or more often.
+ * The change of the time is reported; it only counts as regression with
+ * --tolerance, as even the best round of a shared machine varies by tens
+ * of percent from run to run. The
+ * benchmarks run in a temporary directory, files written by the client
+ * end up there.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include "simple_message_bench.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+#define BENCH_NAME_SIZE 64
+#define BENCH_MAX_RESULTS 64
+#define BENCH_DEFAULT_TIME 100			/* milliseconds per round */
+#define BENCH_DEFAULT_ROUNDS 5
+#define BENCH_MEMORY_TOLERANCE 1		/* percent of the bytes and allocations */
+#define BENCH_MAX_ITERATIONS 100000000UL
+#define BENCH_PAYLOAD_TEXT "The quick brown fox jumps over the lazy dog & <friends>. "
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* What one benchmark measured per operation */
+typedef struct
+{
+	char name[BENCH_NAME_SIZE];
+	double nanoseconds;
+	double bytes;
+	double allocations;
+} BenchResult;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * pointer, size_t size);
+extern void __libc_free(void * pointer);
+
+static atomic_ulong allocationCount = 0;
+static atomic_ulong allocationBytes = 0;
+
+static const char * filter = NULL;
+static long measuringTime = BENCH_DEFAULT_TIME;
+static long rounds = BENCH_DEFAULT_ROUNDS;
+static long tolerance = -1;				/* percent of the time per operation, -1 -> not checked */
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int resultCount = 0;
+static BenchResult baseline[BENCH_MAX_RESULTS];
+static int baselineCount = -1;			/* -1 -> no baseline loaded */
+static int regressions = 0;
+
+static const char * const usageText = "usage: simple_message_bench [options]\n"
+							"options:\n"
+							"\t-b, --baseline <path>	compare with the results saved in the file\n"
+							"\t-s, --save <path>	save the results to the file\n"
+							"\t-f, --filter <text>	run only the benchmarks with the text in their name\n"
+							"\t-t, --time <ms>		measuring time per round (default 100)\n"
+							"\t-r, --rounds <n>	rounds per benchmark, the best one counts (default 5)\n"
+							"\t--tolerance <percent>	fail on a slowdown beyond this against the baseline\n"
+							"\t			(default: the time is only reported)\n"
+							"\t-h, --help\n";
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void CountAllocation(size_t size);
+static double Now(void);
+static void MeasureRound(BenchOperation operation, void * context, unsigned long iterations, BenchResult * round);
+static const BenchResult * FindBaseline(const char * name);
+static bool Exceeds(double value, double reference, long percent, double slack);
+static int LoadBaseline(const char * path);
+static int SaveResults(const char * path);
+static char * CreateWorkDirectory(void);
+static void RemoveWorkDirectory(const char * path);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for counting an allocation of the process
+ *
+ * \param size the number of bytes requested
+ *
+ */
+static void CountAllocation(size_t size)
+{
+	atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&allocationBytes, size, memory_order_relaxed);
+}
+
+/* The allocation functions of the process, counted on their way to the C library */
+void * malloc(size_t size)
+{
+	CountAllocation(size);
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+	CountAllocation(count * size);
+	return __libc_calloc(count, size);
+}
+
+void * realloc(void * pointer, size_t size)
+{
+	CountAllocation(size);
+	return __libc_realloc(pointer, size);
+}
+
+void free(void * pointer)
+{
+	__libc_free(pointer);
+}
+
+/**
+ *
+ * \brief Function for reading the monotonic clock
+ *
+ * \return the time in nanoseconds
+ *
+ */
+static double Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+/**
+ *
+ * \brief Function for stopping the run because a benchmark failed
+ *
+ * \param name the name of the benchmark
+ * \param message what went wrong
+ *
+ */
+void BenchFail(const char * name, const char * message)
+{
+	fprintf(stderr, "simple_message_bench: %s: %s\n", name, message);
+	exit(EXIT_FAILURE);
+}
+
+/**
+ *
+ * \brief Function for creating a message text of a given length
+ *
+ * \param length the number of characters
+ *
+ * \return the text (allocated, terminated)
+ *
+ */
+char * BenchPayload(size_t length)
+{
+	static const char text[] = BENCH_PAYLOAD_TEXT;
+	char * payload = malloc(length + 1);
+
+	if(payload == NULL)
+	{
+		BenchFail("BenchPayload()", strerror(errno));
+	}
+	for(size_t i = 0; i < length; i++)
+	{
+		payload[i] = text[i % (sizeof(text) - 1)];
+	}
+	payload[length] = '\0';
+	return payload;
+}
+
+/**
+ *
+ * \brief Function for finding the saved result of a benchmark
+ *
+ * \param name the name of the benchmark
+ *
+ * \return the saved result, NULL if the baseline has none
+ *
+ */
+static const BenchResult * FindBaseline(const char * name)
+{
+	for(int i = 0; i < baselineCount; i++)
+	{
+		if(strcmp(baseline[i].name, name) == 0)
+		{
+			return &baseline[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for checking a measured value against the baseline
+ *
+ * \param value the measured value
+ * \param reference the value of the baseline
+ * \param percent the allowed increase in percent
+ * \param slack the allowed absolute increase (rounding of small values)
+ *
+ * \return true if the value is a regression
+ *
+ */
+static bool Exceeds(double value, double reference, long percent, double slack)
+{
+	return value > reference + reference * (double) percent / 100.0 + slack;
+}
+
+/**
+ *
+ * \brief Function for measuring one round of a benchmark
+ *
+ * \param operation the operation that is measured
+ * \param context passed to the operation
+ * \param iterations the number of times the operation runs
+ * \param round receives the time, bytes and allocations per operation
+ *
+ */
+static void MeasureRound(BenchOperation operation, void * context, unsigned long iterations, BenchResult * round)
+{
+	double start = 0;
+
+	atomic_store(&allocationCount, 0);
+	atomic_store(&allocationBytes, 0);
+	start = Now();
+	for(unsigned long i = 0; i < iterations; i++)
+	{
+		operation(context);
+	}
+	round->nanoseconds = (Now() - start) / (double) iterations;
+	round->bytes = (double) atomic_load(&allocationBytes) / (double) iterations;
+	round->allocations = (double) atomic_load(&allocationCount) / (double) iterations;
+}
+
+/**
+ *
+ * \brief Function for running one benchmark
+ *
+ * The operation runs once to warm up, then with a growing number of
+ * iterations until one round takes the measuring time. That round is the
+ * first of --rounds rounds with the same number of iterations, the lowest
+ * value of each column is kept.
+ *
+ * \param name the name of the benchmark
+ * \param operation the operation that is measured
+ * \param context passed to the operation
+ *
+ */
+void BenchRun(const char * name, BenchOperation operation, void * context)
+{
+	const BenchResult * saved = NULL;
+	BenchResult * result = NULL;
+	BenchResult round;
+	unsigned long iterations = 1;
+	double target = (double) measuringTime * 1e6;
+	double elapsed = 0;
+	bool regression = false;
+
+	if(filter != NULL && strstr(name, filter) == NULL)
+	{
+		return;
+	}
+	if(resultCount == BENCH_MAX_RESULTS)
+	{
+		BenchFail(name, "too many benchmarks");
+	}
+
+	operation(context);
+	for(;;)
+	{
+		MeasureRound(operation, context, iterations, &round);
+		elapsed = round.nanoseconds * (double) iterations;
+		if(elapsed >= target || iterations >= BENCH_MAX_ITERATIONS)
+		{
+			break;
+		}
+
+		// Aim a bit beyond the target, but grow at most a hundredfold per round
+		double next = elapsed > 0 ? (double) iterations * target * 1.2 / elapsed : (double) iterations * 100;
+		iterations = next > (double) iterations * 100 ? iterations * 100 :
+					next < (double) iterations + 1 ? iterations + 1 : (unsigned long) next;
+	}
+
+	result = &results[resultCount++];
+	*result = round;
+	snprintf(result->name, sizeof(result->name), "%s", name);
+	for(long i = 1; i < rounds; i++)
+	{
+		MeasureRound(operation, context, iterations, &round);
+		result->nanoseconds = round.nanoseconds < result->nanoseconds ? round.nanoseconds : result->nanoseconds;
+		result->bytes = round.bytes < result->bytes ? round.bytes : result->bytes;
+		result->allocations = round.allocations < result->allocations ? round.allocations : result->allocations;
+	}
+
+	printf("%-40s %12.0f ns/op %10.0f B/op %8.2f allocs/op", name, result->nanoseconds,
+			result->bytes, result->allocations);
+
+	saved = baselineCount >= 0 ? FindBaseline(name) : NULL;
+	if(saved != NULL)
+	{
+		regression = (tolerance >= 0 && Exceeds(result->nanoseconds, saved->nanoseconds, tolerance, 0)) ||
+					Exceeds(result->bytes, saved->bytes, BENCH_MEMORY_TOLERANCE, 1) ||
+					Exceeds(result->allocations, saved->allocations, BENCH_MEMORY_TOLERANCE, 0.01);
+		printf("  %+6.1f%%%s", saved->nanoseconds > 0 ?
+				(result->nanoseconds - saved->nanoseconds) * 100 / saved->nanoseconds : 0,
+				regression ? "  REGRESSION" : "");
+		regressions += regression ? 1 : 0;
+	}
+	else if(baselineCount >= 0)
+	{
+		printf("  (new)");
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+/**
+ *
+ * \brief Function for loading the results of a saved run
+ *
+ * Lines are "<name> <ns/op> <bytes/op> <allocs/op>", lines starting
+ * with '#' are comments.
+ *
+ * \param path the file
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int LoadBaseline(const char * path)
+{
+	FILE * file = fopen(path, "r");
+	char line[256];
+
+	if(file == NULL)
+	{
+		fprintf(stderr, "simple_message_bench: %s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	baselineCount = 0;
+	while(fgets(line, sizeof(line), file) != NULL && baselineCount < BENCH_MAX_RESULTS)
+	{
+		BenchResult * saved = &baseline[baselineCount];
+
+		if(line[0] == '#' || line[0] == '\n')
+		{
+			continue;
+		}
+		if(sscanf(line, "%63s %lf %lf %lf", saved->name, &saved->nanoseconds, &saved->bytes,
+				&saved->allocations) != 4)
+		{
+			fprintf(stderr, "simple_message_bench: %s: malformed line: %s", path, line);
+			fclose(file);
+			return EXIT_FAILURE;
+		}
+		baselineCount++;
+	}
+	fclose(file);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for saving the results of this run as baseline
+ *
+ * \param path the file
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int SaveResults(const char * path)
+{
+	FILE * file = fopen(path, "w");
+	int r = EXIT_SUCCESS;
+
+	if(file == NULL)
+	{
+		fprintf(stderr, "simple_message_bench: %s: %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	fprintf(file, "# name ns/op bytes/op allocs/op\n");
+	for(int i = 0; i < resultCount; i++)
+	{
+		fprintf(file, "%s %.0f %.0f %.2f\n", results[i].name, results[i].nanoseconds,
+				results[i].bytes, results[i].allocations);
+	}
+	if(fclose(file) != 0)
+	{
+		fprintf(stderr, "simple_message_bench: %s: %s\n", path, strerror(errno));
+		r = EXIT_FAILURE;
+	}
+	return r;
+}
+
+/**
+ *
+ * \brief Function for creating the directory the benchmarks run in
+ *
+ * \return the path (allocated), NULL in case of failure
+ *
+ */
+static char * CreateWorkDirectory(void)
+{
+	const char * base = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+	char * path = NULL;
+
+	if(asprintf(&path, "%s/simple_message_bench.XXXXXX", base) == -1)
+	{
+		return NULL;
+	}
+	if(mkdtemp(path) == NULL)
+	{
+		fprintf(stderr, "simple_message_bench: mkdtemp(%s): %s\n", path, strerror(errno));
+		free(path);
+		return NULL;
+	}
+	return path;
+}
+
+/**
+ *
+ * \brief Function for removing the directory the benchmarks ran in
+ *
+ * \param path the directory (it contains files only)
+ *
+ */
+static void RemoveWorkDirectory(const char * path)
+{
+	DIR * directory = opendir(path);
+	struct dirent * entry = NULL;
+
+	if(directory != NULL)
+	{
+		while((entry = readdir(directory)) != NULL)
+		{
+			if(strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			{
+				unlinkat(dirfd(directory), entry->d_name, 0);
+			}
+		}
+		closedir(directory);
+	}
+	rmdir(path);
+}
+
+/**
+ *
+ * \brief The main function
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return EXIT_SUCCESS if no benchmark regressed
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+int main(int argc, char * argv[])
+{
+	const char * baselinePath = NULL;
+	const char * savePath = NULL;
+	char * workDirectory = NULL;
+	char * end = NULL;
+	int startDirectory = -1;
+	int r = EXIT_SUCCESS;
+	int c;
+
+	struct option long_options[] =
+	{
+		{"baseline", 1, NULL, 'b'},
+		{"save", 1, NULL, 's'},
+		{"filter", 1, NULL, 'f'},
+		{"time", 1, NULL, 't'},
+		{"rounds", 1, NULL, 'r'},
+		{"tolerance", 1, NULL, 'T'},
+		{"help", 0, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while((c = getopt_long(argc, argv, "b:s:f:t:r:h", long_options, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'b':
+				baselinePath = optarg;
+				break;
+
+			case 's':
+				savePath = optarg;
+				break;
+
+			case 'f':
+				filter = optarg;
+				break;
+
+			case 't':
+			case 'r':
+			case 'T':
+				errno = 0;
+				*(c == 't' ? &measuringTime : c == 'r' ? &rounds : &tolerance) = strtol(optarg, &end, 10);
+				if(errno != 0 || end == optarg || *end != '\0' ||
+					(c == 't' ? measuringTime < 1 : c == 'r' ? rounds < 1 : tolerance < 0))
+				{
+					fprintf(stderr, "%s", usageText);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'h':
+				printf("%s", usageText);
+				return EXIT_SUCCESS;
+
+			default:
+				fprintf(stderr, "%s", usageText);
+				return EXIT_FAILURE;
+		}
+	}
+	if(optind < argc)
+	{
+		fprintf(stderr, "%s", usageText);
+		return EXIT_FAILURE;
+	}
+
+	if(baselinePath != NULL && LoadBaseline(baselinePath) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	// The start directory is kept for the relative path of --save
+	startDirectory = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	workDirectory = CreateWorkDirectory();
+	if(startDirectory == -1 || workDirectory == NULL || chdir(workDirectory) == -1)
+	{
+		fprintf(stderr, "simple_message_bench: cannot enter the work directory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	ClientBenchmarks();
+	ServerBenchmarks();
+
+	if(fchdir(startDirectory) == -1)
+	{
+		fprintf(stderr, "simple_message_bench: fchdir(): %s\n", strerror(errno));
+		r = EXIT_FAILURE;
+	}
+	close(startDirectory);
+	RemoveWorkDirectory(workDirectory);
+	free(workDirectory);
+
+	if(r == EXIT_SUCCESS && savePath != NULL)
+	{
+		r = SaveResults(savePath);
+	}
+	if(regressions > 0)
+	{
+		fprintf(stderr, "simple_message_bench: %d benchmark(s) regressed against %s\n", regressions, baselinePath);
+		r = EXIT_FAILURE;
+	}
+	return r;
+}
+
+/*
+ * =================================================================== eof ==
+ */
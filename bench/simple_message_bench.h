@@ -0,0 +1,41 @@
+/*
+ * @file simple_message_bench.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_BENCH_H
+#define SIMPLE_MESSAGE_BENCH_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* One operation of a benchmark, run over and over */
+typedef void (* BenchOperation)(void * context);
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void BenchRun(const char * name, BenchOperation operation, void * context);
+void BenchFail(const char * name, const char * message);
+char * BenchPayload(size_t length);
+
+void ClientBenchmarks(void);
+void ServerBenchmarks(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
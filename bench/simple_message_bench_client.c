@@ -0,0 +1,307 @@
+/*
+ * @file simple_message_bench_client.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Benchmarks of the client: serializing the request in sendMessage(),
+ * parsing a file of the response from an in-memory stream into a file on
+ * disk, and the whole response in readResponse(). The client is compiled
+ * into this file, its main() renamed, so its functions are used as they
+ * are. Connections are socket pairs within the process.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define main SimpleMessageClientMain
+#include "../simple_message_client.c"
+#undef main
+#include <inttypes.h>
+#include "simple_message_bench.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define BENCH_USER "bench"
+#define BENCH_DRAIN_SIZE 65536
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* A request that is sent */
+typedef struct
+{
+    char *message;
+} sendContext;
+
+/* A response that is read, as it comes from the server */
+typedef struct
+{
+    const char *name;
+    char *response;
+    size_t length;
+    int crc;
+    int skipUnchanged;
+} readContext;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void openPair(const char *name, int pair[2]);
+static void buildResponse(readContext *context, size_t size, bool status, bool deflate, bool crc, bool png);
+static void sendRequestOperation(void *context);
+static void readFileOperation(void *context);
+static void readResponseOperation(void *context);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for connecting two sockets within the process
+ *
+ * \param name the name of the benchmark (for the error message)
+ * \param pair receives the two sockets
+ *
+ */
+static void openPair(const char *name, int pair[2])
+{
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1)
+    {
+        BenchFail(name, strerror(errno));
+    }
+}
+
+/**
+ *
+ * \brief Function for building a response the way the server sends it
+ *
+ * \param context receives the response
+ * \param size the number of bytes of the HTML file
+ * \param status true if the response starts with "status=0"
+ * \param deflate true if the HTML file is compressed
+ * \param crc true if the files are announced with their CRC-32C
+ * \param png true if the PNG file follows the HTML file
+ *
+ */
+static void buildResponse(readContext *context, size_t size, bool status, bool deflate, bool crc, bool png)
+{
+    static const unsigned char image[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    char *html = BenchPayload(size);
+    unsigned char *body = (unsigned char *) html;
+    uLongf bodyLength = size;
+    char crcLine[32] = "";
+    char *header = NULL;
+    int headerLength = 0;
+
+    if(deflate)
+    {
+        bodyLength = compressBound(size);
+        body = malloc(bodyLength);
+        if(body == NULL || compress2(body, &bodyLength, (const Bytef *) html, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            BenchFail(context->name, "compress2() failed");
+        }
+    }
+
+    if(crc)
+    {
+        snprintf(crcLine, sizeof(crcLine), "crc=%08" PRIx32 "\n", Crc32c(0, body, bodyLength));
+    }
+    headerLength = asprintf(&header, "%sfile=bulletin_board.html\n%s%slen=%lu\n", status ? "status=0\n" : "",
+                            deflate ? "enc=deflate\n" : "", crcLine, (unsigned long) bodyLength);
+    if(headerLength == -1)
+    {
+        BenchFail(context->name, "asprintf() failed");
+    }
+
+    context->length = headerLength + bodyLength;
+    context->response = malloc(context->length + 128);
+    if(context->response == NULL)
+    {
+        BenchFail(context->name, strerror(errno));
+    }
+    memcpy(context->response, header, headerLength);
+    memcpy(context->response + headerLength, body, bodyLength);
+    if(png)
+    {
+        if(crc)
+        {
+            snprintf(crcLine, sizeof(crcLine), "crc=%08" PRIx32 "\n", Crc32c(0, image, sizeof(image)));
+        }
+        context->length += snprintf(context->response + context->length, 64, "file=bulletin_board.png\n%slen=%zu\n",
+                                    crcLine, sizeof(image));
+        memcpy(context->response + context->length, image, sizeof(image));
+        context->length += sizeof(image);
+    }
+
+    free(header);
+    if(body != (unsigned char *) html)
+    {
+        free(body);
+    }
+    free(html);
+}
+
+/**
+ *
+ * \brief Function for sending one request and draining it from the peer
+ *
+ * \param context the request (sendContext)
+ *
+ */
+static void sendRequestOperation(void *context)
+{
+    const sendContext *request = context;
+    char buffer[BENCH_DRAIN_SIZE];
+    int pair[2];
+
+    openPair("client/send_request", pair);
+    sendMessage(pair[0], BENCH_USER, request->message, NULL);
+    while(read(pair[1], buffer, sizeof(buffer)) > 0)
+    {
+    }
+    close(pair[0]);
+    close(pair[1]);
+}
+
+/**
+ *
+ * \brief Function for parsing one file of a response from memory to disk
+ *
+ * \param context the response (readContext)
+ *
+ */
+static void readFileOperation(void *context)
+{
+    const readContext *file = context;
+    FILE *fpr = fmemopen(file->response, file->length, "r");
+    fileHeader header;
+    int result = EXIT_FAILURE;
+
+    if(fpr == NULL)
+    {
+        BenchFail(file->name, strerror(errno));
+    }
+    options.crc = file->crc;
+    options.skipUnchanged = file->skipUnchanged;
+    if(readFileHeader(fpr, NULL, &header) == EXIT_SUCCESS)
+    {
+        result = readFileBody(fpr, &header);
+        free(header.filename);
+        free(header.encoding);
+    }
+    fclose(fpr);
+    if(result == EXIT_FAILURE)
+    {
+        BenchFail(file->name, "the file was not read");
+    }
+}
+
+/**
+ *
+ * \brief Function for reading one whole response from a connection
+ *
+ * \param context the response (readContext)
+ *
+ */
+static void readResponseOperation(void *context)
+{
+    const readContext *response = context;
+    int pair[2];
+
+    openPair(response->name, pair);
+    options.crc = response->crc;
+    options.skipUnchanged = response->skipUnchanged;
+    if(write(pair[0], response->response, response->length) != (ssize_t) response->length)
+    {
+        BenchFail(response->name, "write() failed");
+    }
+    shutdown(pair[0], SHUT_WR);
+    if(readResponse(pair[1]) != EXIT_SUCCESS)
+    {
+        BenchFail(response->name, "the response was not read");
+    }
+    close(pair[0]);
+}
+
+/**
+ *
+ * \brief Function for running the benchmarks of the client
+ *
+ */
+void ClientBenchmarks(void)
+{
+    static const size_t sizes[] = { 64, 4096, 65536 };
+    static const struct
+    {
+        const char *name;
+        bool deflate;
+        bool crc;
+        bool skipUnchanged;
+    } variants[] =
+    {
+        { "client/read_file", false, false, false },
+        { "client/read_file_crc", false, true, false },
+        { "client/read_file_deflate", true, false, false },
+        { "client/read_file_unchanged", false, false, true }
+    };
+    char name[64];
+
+    programName = "simple_message_bench";
+    verbose = false;
+
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        sendContext request;
+
+        request.message = BenchPayload(sizes[i]);
+        snprintf(name, sizeof(name), "client/send_request/%zu", sizes[i]);
+        BenchRun(name, sendRequestOperation, &request);
+        free(request.message);
+    }
+
+    for(size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+    {
+        for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            readContext file;
+
+            snprintf(name, sizeof(name), "%s/%zu", variants[v].name, sizes[i]);
+            file.name = name;
+            file.crc = variants[v].crc;
+            file.skipUnchanged = variants[v].skipUnchanged;
+            buildResponse(&file, sizes[i], false, variants[v].deflate, variants[v].crc, false);
+            BenchRun(name, readFileOperation, &file);
+            free(file.response);
+        }
+    }
+
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        readContext response;
+
+        snprintf(name, sizeof(name), "client/read_response/%zu", sizes[i]);
+        response.name = name;
+        response.crc = 1;
+        response.skipUnchanged = 0;
+        buildResponse(&response, sizes[i], true, false, true, true);
+        BenchRun(name, readResponseOperation, &response);
+        free(response.response);
+    }
+
+    options.crc = 0;
+    options.skipUnchanged = 0;
+}
+
+/*
+ * =================================================================== eof ==
+ */
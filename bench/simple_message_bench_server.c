@@ -0,0 +1,295 @@
+/*
+ * @file simple_message_bench_server.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Benchmarks of the in-process request handling of the server: parsing a
+ * request in memory, and a whole connection in HandleConnection() from
+ * reading the request to sending the response. The board is kept in
+ * memory and retains a fixed number of messages, so the page stays the
+ * same size while the benchmark posts. The client side of a connection is
+ * a socket pair, its response is drained by a helper thread.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "../simple_message_server.h"
+#include "../simple_message_server_handler.h"
+#include "../simple_message_server_pool.h"
+#include "simple_message_bench.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define BENCH_RETAIN 16
+#define BENCH_DRAIN_SIZE 65536
+#define BENCH_IMAGE_URL "http://www.example.com/images/bench.png"
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* A request as the client sends it */
+typedef struct
+{
+	const char * name;
+	char * request;
+	size_t length;
+	char * scratch;		/* ParseRequest() works in place */
+} RequestContext;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static int drainRequests[2] = { -1, -1 };	/* client sockets to drain */
+static int drainDone[2] = { -1, -1 };		/* one byte per drained socket */
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void BuildRequest(RequestContext * context, size_t size, const char * img, const char * accept);
+static void * DrainMain(void * argument);
+static void ParseRequestOperation(void * context);
+static void HandleConnectionOperation(void * context);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for printing an error message
+ *
+ * \param funcName the name of the function that throws an error
+ * \param evalErrno for specifying if the error number shall be printed out
+ * \param message the message that shall be printed out
+ *
+ */
+void PrintError(char * funcName, bool evalErrno, const char * message)
+{
+	fprintf(stderr, "Error in program %s: function %s", programName, funcName);
+	if(message != NULL)
+	{
+		fprintf(stderr, ": %s", message);
+	}
+	if(evalErrno)
+	{
+		fprintf(stderr, ": %s", strerror(errno));
+	}
+	fprintf(stderr, "\n");
+}
+
+/**
+ *
+ * \brief Function for building a request the way the client sends it
+ *
+ * \param context receives the request
+ * \param size the number of bytes of the message
+ * \param img the image URL, NULL -> none
+ * \param accept the features of the "accept=" line of the header block, NULL -> no block
+ *
+ */
+static void BuildRequest(RequestContext * context, size_t size, const char * img, const char * accept)
+{
+	char * message = BenchPayload(size);
+	int length = asprintf(&context->request, "%s%s%suser=bench\n%s%s%s%s\n",
+						accept != NULL ? "version=1\naccept=" : "", accept != NULL ? accept : "", accept != NULL ? "\n\n" : "",
+						img != NULL ? "img=" : "", img != NULL ? img : "", img != NULL ? "\n" : "",
+						message);
+
+	if(length == -1)
+	{
+		BenchFail(context->name, "asprintf() failed");
+	}
+	context->length = length;
+	context->scratch = malloc(context->length);
+	if(context->scratch == NULL)
+	{
+		BenchFail(context->name, strerror(errno));
+	}
+	free(message);
+}
+
+/**
+ *
+ * \brief Main function of the thread reading the responses
+ *
+ * Takes one client socket after the other from drainRequests, reads it
+ * up to EOF, closes it and reports on drainDone.
+ *
+ * \param argument unused
+ *
+ * \return NULL
+ *
+ */
+static void * DrainMain(void * argument)
+{
+	char buffer[BENCH_DRAIN_SIZE];
+	int socketDescriptor = -1;
+	char done = 1;
+
+	(void) argument;
+	while(read(drainRequests[0], &socketDescriptor, sizeof(socketDescriptor)) == sizeof(socketDescriptor))
+	{
+		while(read(socketDescriptor, buffer, sizeof(buffer)) > 0)
+		{
+		}
+		close(socketDescriptor);
+		if(write(drainDone[1], &done, sizeof(done)) != sizeof(done))
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for parsing one request in memory
+ *
+ * \param context the request (RequestContext)
+ *
+ */
+static void ParseRequestOperation(void * context)
+{
+	RequestContext * request = context;
+	Request parsed;
+
+	memcpy(request->scratch, request->request, request->length);
+	if(ParseRequest(request->scratch, request->length, &parsed) == EXIT_FAILURE)
+	{
+		BenchFail(request->name, "the request was not parsed");
+	}
+}
+
+/**
+ *
+ * \brief Function for serving one connection carrying the request
+ *
+ * \param context the request (RequestContext)
+ *
+ */
+static void HandleConnectionOperation(void * context)
+{
+	const RequestContext * request = context;
+	int pair[2];
+	char done = 0;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1)
+	{
+		BenchFail(request->name, strerror(errno));
+	}
+	if(write(pair[0], request->request, request->length) != (ssize_t) request->length ||
+		shutdown(pair[0], SHUT_WR) == -1 ||
+		write(drainRequests[1], &pair[0], sizeof(pair[0])) != sizeof(pair[0]))
+	{
+		BenchFail(request->name, "the request was not sent");
+	}
+	HandleConnection(pair[1]);
+	if(read(drainDone[0], &done, sizeof(done)) != sizeof(done))
+	{
+		BenchFail(request->name, "the response was not drained");
+	}
+}
+
+/**
+ *
+ * \brief Function for running the benchmarks of the server
+ *
+ */
+void ServerBenchmarks(void)
+{
+	static const size_t sizes[] = { 64, 4096, 65536 };
+	static const struct
+	{
+		const char * name;
+		const char * accept;
+	} variants[] =
+	{
+		{ "server/handle_connection", NULL },
+		{ "server/handle_connection_crc", "crc32c" },
+		{ "server/handle_connection_deflate", "deflate,crc32c" }
+	};
+	char name[64];
+	pthread_t drainThread;
+
+	programName = "simple_message_bench";
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		RequestContext request;
+
+		snprintf(name, sizeof(name), "server/parse_request/%zu", sizes[i]);
+		request.name = name;
+		BuildRequest(&request, sizes[i], BENCH_IMAGE_URL, "deflate,crc32c");
+		BenchRun(name, ParseRequestOperation, &request);
+		free(request.request);
+		free(request.scratch);
+	}
+
+	if(pipe2(drainRequests, O_CLOEXEC) == -1 || pipe2(drainDone, O_CLOEXEC) == -1 ||
+		pthread_create(&drainThread, NULL, DrainMain, NULL) != 0)
+	{
+		BenchFail("server/handle_connection", "the drain thread was not started");
+	}
+	if(BoardOpen(NULL, BENCH_RETAIN) == EXIT_FAILURE)
+	{
+		BenchFail("server/handle_connection", "BoardOpen() failed");
+	}
+	if(ConnectionPoolOpen(1) == EXIT_FAILURE)
+	{
+		BenchFail("server/handle_connection", "ConnectionPoolOpen() failed");
+	}
+	HandlerKeepAlive(0);
+
+	for(size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+	{
+		for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		{
+			RequestContext request;
+
+			snprintf(name, sizeof(name), "%s/%zu", variants[v].name, sizes[i]);
+			request.name = name;
+			BuildRequest(&request, sizes[i], NULL, variants[v].accept);
+
+			// The board is filled with messages of this size before measuring
+			for(int j = 0; j < BENCH_RETAIN; j++)
+			{
+				HandleConnectionOperation(&request);
+			}
+			BenchRun(name, HandleConnectionOperation, &request);
+			free(request.request);
+			free(request.scratch);
+		}
+	}
+
+	close(drainRequests[1]);
+	pthread_join(drainThread, NULL);
+	close(drainRequests[0]);
+	close(drainDone[0]);
+	close(drainDone[1]);
+	ConnectionPoolClose();
+	BoardClose();
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,1000 @@
+/*
+ * @file simple_message_agent.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Local agent of simple_message_client. It keeps warm connections to the
+ * servers, so a client started with --agent only pays a round trip over a
+ * Unix domain socket instead of resolving and connecting every time.
+ *
+ * The client sends "server=<host>\n", "port=<port>\n" and the frame line
+ * "reqlen=<bytes>\n" followed by its usual request. The agent streams the
+ * frame through to the server on a kept connection, holding no more than
+ * one buffer of it, and streams the response back; the connection goes
+ * back to the pool once both files went through. A request without frame
+ * line (a message piped into the client) is streamed up to EOF on a new
+ * connection that is closed afterwards. Keeping connections needs a
+ * threaded server (--threads).
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "simple_message_resolver.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define AGENT_DEFAULT_CONNECTIONS 4
+#define AGENT_DEFAULT_IDLE 4
+#define AGENT_MAX_POOLED 64
+#define AGENT_HOST_SIZE 256
+#define AGENT_PORT_SIZE 32
+#define AGENT_BUFFER_SIZE 65536
+#define AGENT_BACKLOG 64
+#define AGENT_TARGET_LINES 3
+#define RESPONSE_FILES 2
+#define RESPONSE_LINE_SIZE 512
+#define ACCEPT_BACKOFF_MS 100
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+typedef struct
+{
+	const char * listenPath;	/* NULL -> the default socket of the user */
+	int connections;		/* idle connections kept per server */
+	int idle;				/* seconds an idle connection is kept */
+} AgentOptions;
+
+/* An idle connection to a server */
+typedef struct
+{
+	char host[AGENT_HOST_SIZE];
+	char port[AGENT_PORT_SIZE];
+	int descriptor;
+	time_t lastUsed;		/* CLOCK_MONOTONIC seconds */
+} PooledConnection;
+
+/* Where the response of the server ends */
+typedef struct
+{
+	int files;				/* files completely passed on */
+	bool inBody;
+	size_t remaining;		/* bytes of the current file still to come */
+	char line[RESPONSE_LINE_SIZE];
+	size_t lineLength;
+} ResponseTracker;
+
+/* How relaying a request ended */
+typedef enum
+{
+	RELAY_DONE,				/* the connection may be used again */
+	RELAY_STALE,			/* writing to a kept connection failed, the server has no request */
+	RELAY_FAILED
+} RelayResult;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+const char * programName;
+const char * usageText = 	"usage: simple_message_agent options\n"
+							"options:\n"
+							"\t-l, --listen <path>	Unix domain socket of the agent\n"
+							"\t			(default $XDG_RUNTIME_DIR/simple_message_agent.sock)\n"
+							"\t-c, --connections <n>	idle connections kept per server (default 4)\n"
+							"\t--idle <s>		seconds an idle connection is kept (default 4,\n"
+							"\t			below the keep-alive time of the server)\n"
+							"\t-h, --help\n";
+
+static AgentOptions options;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static PooledConnection pool[AGENT_MAX_POOLED];
+static int pooledCount = 0;
+/* The resolver works with static buffers */
+static pthread_mutex_t resolverLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void PrintError(char * funcName, bool evalErrno, const char * message);
+int ParseCommandLine(int argc, const char * const argv[], AgentOptions * agentOptions);
+int ParseNumber(const char * text, int minimum, int maximum, int * number);
+time_t MonotonicSeconds(void);
+int CreateAndBindUnixSocket(const char * path, int * socketDescriptor);
+int ConnectServer(const char * host, const char * port);
+int AcquireConnection(const char * host, const char * port, bool fresh, bool * reused);
+void ReleaseConnection(const char * host, const char * port, int descriptor);
+int ReadTarget(int descriptor, char * buffer, size_t size, size_t * length);
+int WriteAll(int descriptor, struct iovec * iov, int iovcnt);
+int ParseTarget(const char * buffer, size_t length, char * host, char * port, long long * requestLength,
+				size_t * headerLength);
+ssize_t TrackResponse(ResponseTracker * tracker, const char * data, size_t length);
+RelayResult Relay(int clientDescriptor, int serverDescriptor, const char * start, size_t startLength,
+				long long requestLength, bool reused);
+void ServeClient(int clientDescriptor);
+void * ClientMain(void * argument);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for printing an error message
+ *
+ * \param funcName the name of the function that throws an error
+ * \param evalErrno for specifying if the error number shall be printed out
+ * \param message the message that shall be printed out
+ *
+ */
+void PrintError(char * funcName, bool evalErrno, const char * message)
+{
+	fprintf(stderr, "Error in program ");
+	fprintf(stderr, "%s" ,programName);
+	fprintf(stderr, ": function ");
+	fprintf(stderr, "%s" ,funcName);
+
+	if(message != NULL)
+	{
+		fprintf(stderr, ": ");
+		fprintf(stderr, "%s" ,message);
+	}
+
+	if(evalErrno)
+	{
+		fprintf(stderr, ": ");
+		fprintf(stderr, "%s" ,strerror(errno));
+	}
+
+	fprintf(stderr, "\n");
+}
+
+/**
+ *
+ * \brief Function for parsing a decimal number within a range
+ *
+ * \param text the text that shall be parsed
+ * \param minimum the smallest allowed value
+ * \param maximum the biggest allowed value
+ * \param number the parsed number
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ParseNumber(const char * text, int minimum, int maximum, int * number)
+{
+	char * end = NULL;
+	long value = 0;
+
+	errno = 0;
+	value = strtol(text, &end, 10);
+	if(errno != 0 || end == text || *end != '\0' || value < minimum || value > maximum)
+	{
+		return EXIT_FAILURE;
+	}
+	*number = (int) value;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for parsing the command line arguments
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves
+ * \param agentOptions the parsed options
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ParseCommandLine(int argc, const char * const argv[], AgentOptions * agentOptions)
+{
+	int c;
+
+	memset(agentOptions, 0, sizeof(AgentOptions));
+	agentOptions->connections = AGENT_DEFAULT_CONNECTIONS;
+	agentOptions->idle = AGENT_DEFAULT_IDLE;
+
+	struct option long_options[] =
+	{
+		{"listen", 1, NULL, 'l'},
+		{"connections", 1, NULL, 'c'},
+		{"idle", 1, NULL, 'i'},
+		{"help", 0, NULL, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while((c = getopt_long(argc, (char ** const) argv, "l:c:h", long_options, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'l':
+				agentOptions->listenPath = optarg;
+				break;
+
+			case 'c':
+			case 'i':
+				if(ParseNumber(optarg, c == 'c' ? 0 : 1, c == 'c' ? AGENT_MAX_POOLED : 3600,
+								c == 'c' ? &agentOptions->connections : &agentOptions->idle) == EXIT_FAILURE)
+				{
+					fprintf(stderr, "%s" ,usageText);
+					return EXIT_FAILURE;
+				}
+				break;
+
+			case 'h':
+				fprintf(stdout, "%s" ,usageText);
+				return EXIT_FAILURE;
+
+			case '?':
+			default:
+				fprintf(stderr, "%s" ,usageText);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(optind != argc)
+	{
+		fprintf(stderr, "%s" ,usageText);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for reading a clock that does not jump
+ *
+ * \return the seconds of CLOCK_MONOTONIC
+ *
+ */
+time_t MonotonicSeconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+/**
+ *
+ * \brief Function for creating the listening socket of the agent
+ *
+ * Only the user running the agent may connect to it.
+ *
+ * \param path the file system path of the socket
+ * \param socketDescriptor the descriptor of the listening socket
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int CreateAndBindUnixSocket(const char * path, int * socketDescriptor)
+{
+	struct sockaddr_un address;
+	struct stat fileStatus;
+
+	if(strlen(path) >= sizeof(address.sun_path))
+	{
+		PrintError("CreateAndBindUnixSocket()", false, "Path of the socket is too long");
+		return EXIT_FAILURE;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if(lstat(path, &fileStatus) == 0 && S_ISSOCK(fileStatus.st_mode))
+	{
+		unlink(path);
+	}
+
+	*socketDescriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(*socketDescriptor == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> socket()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	if(bind(*socketDescriptor, (struct sockaddr *) &address, sizeof(address)) == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> bind()", true, path);
+		close(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	if(chmod(path, S_IRUSR | S_IWUSR) == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> chmod()", true, path);
+		close(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	if(listen(*socketDescriptor, AGENT_BACKLOG) == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> listen()", true, NULL);
+		close(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for opening a new connection to a server
+ *
+ * \param host the name or address of the server
+ * \param port the port of the server
+ *
+ * \return the descriptor of the connection
+ * \return -1 in case of failure
+ *
+ */
+int ConnectServer(const char * host, const char * port)
+{
+	Resolution resolution;
+	int descriptor = -1;
+	int one = 1;
+	int r = 0;
+
+	pthread_mutex_lock(&resolverLock);
+	r = ResolverLookup(host, port, &resolution);
+	pthread_mutex_unlock(&resolverLock);
+	if(r == EXIT_FAILURE)
+	{
+		PrintError("ConnectServer() -> ResolverLookup()", false, host);
+		return -1;
+	}
+
+	for(int i = 0; i < resolution.count && descriptor == -1; i++)
+	{
+		const ResolvedAddress * address = &resolution.addresses[i];
+
+		descriptor = socket(address->family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(descriptor == -1)
+			continue;
+
+		// Requests and responses are whole messages, nothing to coalesce
+		setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		if(connect(descriptor, (const struct sockaddr *) &address->address, address->length) == -1)
+		{
+			close(descriptor);
+			descriptor = -1;
+		}
+	}
+
+	if(descriptor == -1)
+	{
+		PrintError("ConnectServer() -> connect()", true, host);
+		if(resolution.cached)
+		{
+			pthread_mutex_lock(&resolverLock);
+			ResolverForget(host, port);
+			pthread_mutex_unlock(&resolverLock);
+		}
+	}
+	return descriptor;
+}
+
+/**
+ *
+ * \brief Function for getting a connection to a server, a kept one if possible
+ *
+ * Kept connections the server may already have closed (idle too long, or
+ * readable while no request is outstanding) are dropped on the way.
+ *
+ * \param host the name or address of the server
+ * \param port the port of the server
+ * \param fresh set to skip the kept connections
+ * \param reused set if a kept connection is returned
+ *
+ * \return the descriptor of the connection
+ * \return -1 in case of failure
+ *
+ */
+int AcquireConnection(const char * host, const char * port, bool fresh, bool * reused)
+{
+	time_t now = MonotonicSeconds();
+	int descriptor = -1;
+
+	*reused = false;
+	while(!fresh && descriptor == -1)
+	{
+		PooledConnection connection;
+		struct pollfd pollDescriptor;
+		int found = -1;
+
+		pthread_mutex_lock(&poolLock);
+		for(int i = pooledCount - 1; i >= 0 && found == -1; i--)
+		{
+			if(strcmp(pool[i].host, host) == 0 && strcmp(pool[i].port, port) == 0)
+			{
+				found = i;
+			}
+		}
+		if(found != -1)
+		{
+			connection = pool[found];
+			pool[found] = pool[--pooledCount];
+		}
+		pthread_mutex_unlock(&poolLock);
+
+		if(found == -1)
+		{
+			break;
+		}
+
+		pollDescriptor.fd = connection.descriptor;
+		pollDescriptor.events = POLLIN | POLLRDHUP;
+		if(now - connection.lastUsed >= options.idle || poll(&pollDescriptor, 1, 0) != 0)
+		{
+			close(connection.descriptor);
+			continue;
+		}
+		descriptor = connection.descriptor;
+		*reused = true;
+	}
+
+	if(descriptor == -1)
+	{
+		descriptor = ConnectServer(host, port);
+	}
+	return descriptor;
+}
+
+/**
+ *
+ * \brief Function for putting a connection back into the pool
+ *
+ * \param host the name or address of the server
+ * \param port the port of the server
+ * \param descriptor the descriptor of the connection (closed if the pool is full)
+ *
+ */
+void ReleaseConnection(const char * host, const char * port, int descriptor)
+{
+	int kept = 0;
+
+	pthread_mutex_lock(&poolLock);
+	for(int i = 0; i < pooledCount; i++)
+	{
+		if(strcmp(pool[i].host, host) == 0 && strcmp(pool[i].port, port) == 0)
+		{
+			kept++;
+		}
+	}
+	if(kept < options.connections && pooledCount < AGENT_MAX_POOLED)
+	{
+		PooledConnection * connection = &pool[pooledCount++];
+
+		strcpy(connection->host, host);
+		strcpy(connection->port, port);
+		connection->descriptor = descriptor;
+		connection->lastUsed = MonotonicSeconds();
+		descriptor = -1;
+	}
+	pthread_mutex_unlock(&poolLock);
+
+	if(descriptor != -1)
+	{
+		close(descriptor);
+	}
+}
+
+/**
+ *
+ * \brief Function for reading the lines naming the server and the length of the request
+ *
+ * Reads until the buffer holds AGENT_TARGET_LINES lines, the client
+ * reached EOF or the buffer is full; what comes after them is the start
+ * of the request.
+ *
+ * \param descriptor the descriptor to read from
+ * \param buffer the buffer receiving the bytes
+ * \param size the size of the buffer
+ * \param length the number of bytes read
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ReadTarget(int descriptor, char * buffer, size_t size, size_t * length)
+{
+	int lines = 0;
+	ssize_t r = 0;
+
+	*length = 0;
+	while(lines < AGENT_TARGET_LINES && *length < size)
+	{
+		r = read(descriptor, buffer + *length, size - *length);
+		if(r == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PrintError("ReadTarget() -> read()", true, NULL);
+			return EXIT_FAILURE;
+		}
+		if(r == 0)
+		{
+			break;
+		}
+		for(ssize_t i = 0; i < r; i++)
+		{
+			lines += buffer[*length + i] == '\n';
+		}
+		*length += r;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for writing a gather list completely
+ *
+ * \param descriptor the descriptor to write to
+ * \param iov the parts (modified while writing)
+ * \param iovcnt the number of parts
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int WriteAll(int descriptor, struct iovec * iov, int iovcnt)
+{
+	while(iovcnt > 0)
+	{
+		ssize_t written = writev(descriptor, iov, iovcnt);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return EXIT_FAILURE;
+		}
+		while(iovcnt > 0 && (size_t) written >= iov->iov_len)
+		{
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0)
+		{
+			iov->iov_base = (char *) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for taking "server=", "port=" and "reqlen=" off the request of a client
+ *
+ * \param buffer the start of the request of the client
+ * \param length the length of the start
+ * \param host receives the server (AGENT_HOST_SIZE bytes)
+ * \param port receives the port (AGENT_PORT_SIZE bytes)
+ * \param requestLength receives the length of the request, -1 if it has no frame line
+ * \param headerLength receives the length of the lines
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of a malformed request
+ *
+ */
+int ParseTarget(const char * buffer, size_t length, char * host, char * port, long long * requestLength,
+				size_t * headerLength)
+{
+	const char * keys[] = { "server=", "port=" };
+	char * values[] = { host, port };
+	size_t sizes[] = { AGENT_HOST_SIZE, AGENT_PORT_SIZE };
+	size_t offset = 0;
+
+	for(int i = 0; i < 2; i++)
+	{
+		size_t keyLength = strlen(keys[i]);
+		const char * newline = memchr(buffer + offset, '\n', length - offset);
+
+		if(newline == NULL || length - offset < keyLength || memcmp(buffer + offset, keys[i], keyLength) != 0 ||
+			(size_t) (newline - buffer) - offset - keyLength == 0 ||
+			(size_t) (newline - buffer) - offset - keyLength >= sizes[i])
+		{
+			return EXIT_FAILURE;
+		}
+		memcpy(values[i], buffer + offset + keyLength, (newline - buffer) - offset - keyLength);
+		values[i][(newline - buffer) - offset - keyLength] = '\0';
+		offset = newline - buffer + 1;
+	}
+
+	*requestLength = -1;
+	if(length - offset > strlen("reqlen=") && memcmp(buffer + offset, "reqlen=", strlen("reqlen=")) == 0)
+	{
+		const char * newline = memchr(buffer + offset, '\n', length - offset);
+		char * end = NULL;
+
+		if(newline == NULL)
+		{
+			return EXIT_FAILURE;
+		}
+		// The client may not send more than it announced
+		errno = 0;
+		*requestLength = strtoll(buffer + offset + strlen("reqlen="), &end, 10);
+		if(errno != 0 || end != newline || end == buffer + offset + strlen("reqlen=") || *requestLength < 0 ||
+			(unsigned long long) *requestLength < length - (newline - buffer + 1))
+		{
+			return EXIT_FAILURE;
+		}
+		offset = newline - buffer + 1;
+	}
+	*headerLength = offset;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for following the response of the server to find its end
+ *
+ * \param tracker the state of the response so far
+ * \param data the next bytes of the response
+ * \param length the number of bytes
+ *
+ * \return the number of bytes that still belong to the response
+ * \return -1 if the response is malformed
+ *
+ */
+ssize_t TrackResponse(ResponseTracker * tracker, const char * data, size_t length)
+{
+	size_t used = 0;
+
+	while(used < length && tracker->files < RESPONSE_FILES)
+	{
+		if(tracker->inBody)
+		{
+			size_t chunk = length - used < tracker->remaining ? length - used : tracker->remaining;
+
+			used += chunk;
+			tracker->remaining -= chunk;
+		}
+		else
+		{
+			char c = data[used++];
+
+			if(c != '\n')
+			{
+				if(tracker->lineLength + 1 == sizeof(tracker->line))
+				{
+					return -1;
+				}
+				tracker->line[tracker->lineLength++] = c;
+				continue;
+			}
+			tracker->line[tracker->lineLength] = '\0';
+			tracker->lineLength = 0;
+			if(strncmp(tracker->line, "len=", 4) == 0)
+			{
+				char * end = NULL;
+
+				errno = 0;
+				tracker->remaining = strtoull(tracker->line + 4, &end, 10);
+				if(errno != 0 || end == tracker->line + 4 || *end != '\0')
+				{
+					return -1;
+				}
+				tracker->inBody = true;
+			}
+		}
+
+		if(tracker->inBody && tracker->remaining == 0)
+		{
+			tracker->inBody = false;
+			tracker->files++;
+		}
+	}
+	return used;
+}
+
+/**
+ *
+ * \brief Function for streaming a request to the server and the response to the client
+ *
+ * Only the start of the request read with the target lines is held; the
+ * rest is passed on as it comes from the client. Once that start went out
+ * the server may apply the request, so a kept connection is only reported
+ * stale if writing the start failed.
+ *
+ * \param clientDescriptor the connection of the client
+ * \param serverDescriptor the connection of the server
+ * \param start the start of the request without the target lines
+ * \param startLength the length of the start
+ * \param requestLength the length of the whole request, -1 -> streamed up to EOF of the client
+ * \param reused set if the connection was kept from an earlier request
+ *
+ * \return RELAY_DONE if the response went through and the connection may be kept
+ * \return RELAY_STALE if a kept connection turned out to be closed before the request was sent
+ * \return RELAY_FAILED otherwise
+ *
+ */
+RelayResult Relay(int clientDescriptor, int serverDescriptor, const char * start, size_t startLength,
+				long long requestLength, bool reused)
+{
+	char buffer[AGENT_BUFFER_SIZE];
+	char frame[32];
+	struct iovec iov[2];
+	ResponseTracker tracker;
+	long long remaining = requestLength - (long long) startLength;
+	bool clientGone = false;
+
+	memset(&tracker, 0, sizeof(tracker));
+	iov[0].iov_base = frame;
+	iov[0].iov_len = requestLength < 0 ? 0 : snprintf(frame, sizeof(frame), "reqlen=%lld\n", requestLength);
+	iov[1].iov_base = (void *) start;
+	iov[1].iov_len = startLength;
+	if(WriteAll(serverDescriptor, iov, 2) == EXIT_FAILURE)
+	{
+		if(reused && (errno == EPIPE || errno == ECONNRESET))
+		{
+			return RELAY_STALE;
+		}
+		PrintError("Relay() -> WriteAll()", true, NULL);
+		return RELAY_FAILED;
+	}
+
+	while(requestLength < 0 || remaining > 0)
+	{
+		size_t wanted = requestLength < 0 || remaining > (long long) sizeof(buffer) ? sizeof(buffer) : (size_t) remaining;
+		ssize_t r = read(clientDescriptor, buffer, wanted);
+
+		if(r == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r == 0 && requestLength < 0)
+		{
+			break;
+		}
+		if(r <= 0)
+		{
+			PrintError("Relay() -> read()", r == -1, "Request of the client is incomplete");
+			return RELAY_FAILED;
+		}
+		iov[0].iov_base = buffer;
+		iov[0].iov_len = r;
+		if(WriteAll(serverDescriptor, iov, 1) == EXIT_FAILURE)
+		{
+			PrintError("Relay() -> WriteAll()", true, NULL);
+			return RELAY_FAILED;
+		}
+		remaining -= r;
+	}
+	// A request without frame is ended like the one of the client
+	if(requestLength < 0 && shutdown(serverDescriptor, SHUT_WR) == -1)
+	{
+		PrintError("Relay() -> shutdown()", true, NULL);
+		return RELAY_FAILED;
+	}
+
+	while(tracker.files < RESPONSE_FILES)
+	{
+		ssize_t r = read(serverDescriptor, buffer, sizeof(buffer));
+		ssize_t used = 0;
+
+		if(r == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r <= 0)
+		{
+			// The server may have applied the request, it is not sent again
+			PrintError("Relay() -> read()", r == -1, "Response of the server is incomplete");
+			return RELAY_FAILED;
+		}
+
+		used = TrackResponse(&tracker, buffer, r);
+		if(used != r)
+		{
+			PrintError("Relay() -> TrackResponse()", false, "Malformed response of the server");
+			return RELAY_FAILED;
+		}
+
+		// A client that went away does not spoil the connection, the response is read to its end
+		iov[0].iov_base = buffer;
+		iov[0].iov_len = r;
+		if(!clientGone && WriteAll(clientDescriptor, iov, 1) == EXIT_FAILURE)
+		{
+			clientGone = true;
+		}
+	}
+	return RELAY_DONE;
+}
+
+/**
+ *
+ * \brief Function for serving one client of the agent
+ *
+ * \param clientDescriptor the accepted connection of the client (closed)
+ *
+ */
+void ServeClient(int clientDescriptor)
+{
+	char host[AGENT_HOST_SIZE];
+	char port[AGENT_PORT_SIZE];
+	char buffer[AGENT_BUFFER_SIZE];
+	size_t length = 0;
+	size_t headerLength = 0;
+	long long requestLength = -1;
+	RelayResult result = RELAY_STALE;
+
+	if(ReadTarget(clientDescriptor, buffer, sizeof(buffer), &length) == EXIT_FAILURE)
+	{
+		PrintError("ServeClient() -> ReadTarget()", false, NULL);
+		close(clientDescriptor);
+		return;
+	}
+	if(ParseTarget(buffer, length, host, port, &requestLength, &headerLength) == EXIT_FAILURE)
+	{
+		PrintError("ServeClient() -> ParseTarget()", false, "Malformed request");
+		close(clientDescriptor);
+		return;
+	}
+
+	// A stale kept connection is retried once on a new one, a request without frame always takes a new one
+	for(int attempt = 0; attempt < 2 && result == RELAY_STALE; attempt++)
+	{
+		bool reused = false;
+		int serverDescriptor = AcquireConnection(host, port, attempt > 0 || requestLength < 0, &reused);
+
+		if(serverDescriptor == -1)
+		{
+			result = RELAY_FAILED;
+			break;
+		}
+		result = Relay(clientDescriptor, serverDescriptor, buffer + headerLength, length - headerLength,
+						requestLength, reused);
+		if(result == RELAY_DONE && requestLength >= 0)
+		{
+			ReleaseConnection(host, port, serverDescriptor);
+		}
+		else
+		{
+			close(serverDescriptor);
+		}
+	}
+
+	close(clientDescriptor);
+}
+
+/**
+ *
+ * \brief Function for the thread serving one client
+ *
+ * \param argument the accepted connection of the client
+ *
+ * \return NULL
+ *
+ */
+void * ClientMain(void * argument)
+{
+	ServeClient((int) (intptr_t) argument);
+	return NULL;
+}
+
+/**
+ *
+ * \brief Main function of the agent
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return EXIT_FAILURE if the agent could not be set up
+ *
+ */
+int main(int argc, const char * const argv[])
+{
+	char defaultPath[sizeof(((struct sockaddr_un *) NULL)->sun_path)];
+	const char * runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+	pthread_attr_t attributes;
+	int listeningDescriptor = -1;
+	bool exhausted = false;
+
+	programName = argv[0];
+
+	if(ParseCommandLine(argc, argv, &options) == EXIT_FAILURE)
+	{
+		PrintError("main() -> ParseCommandLine()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	if(options.listenPath == NULL)
+	{
+		if(runtimeDirectory != NULL && runtimeDirectory[0] == '/')
+			snprintf(defaultPath, sizeof(defaultPath), "%s/simple_message_agent.sock", runtimeDirectory);
+		else
+			snprintf(defaultPath, sizeof(defaultPath), "/tmp/simple_message_agent-%u.sock", (unsigned int) geteuid());
+		options.listenPath = defaultPath;
+	}
+
+	// A client going away must not take the agent down
+	signal(SIGPIPE, SIG_IGN);
+
+	if(ResolverOpen(NULL, RESOLVER_DEFAULT_TTL) == EXIT_FAILURE)
+	{
+		PrintError("main() -> ResolverOpen()", false, NULL);
+	}
+	if(CreateAndBindUnixSocket(options.listenPath, &listeningDescriptor) == EXIT_FAILURE)
+	{
+		PrintError("main() -> CreateAndBindUnixSocket()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	pthread_attr_init(&attributes);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	for(;;)
+	{
+		pthread_t thread;
+		int clientDescriptor = accept4(listeningDescriptor, NULL, NULL, SOCK_CLOEXEC);
+
+		if(clientDescriptor == -1)
+		{
+			// Out of descriptors the client stays queued, it is taken once a served one closed its own
+			if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+			{
+				if(!exhausted)
+				{
+					PrintError("main() -> accept4()", true, "backing off");
+				}
+				exhausted = true;
+				poll(NULL, 0, ACCEPT_BACKOFF_MS);
+			}
+			else if(errno != EINTR && errno != ECONNABORTED)
+			{
+				PrintError("main() -> accept4()", true, NULL);
+			}
+			continue;
+		}
+		exhausted = false;
+		if(pthread_create(&thread, &attributes, ClientMain, (void *) (intptr_t) clientDescriptor) != 0)
+		{
+			PrintError("main() -> pthread_create()", false, NULL);
+			close(clientDescriptor);
+		}
+	}
+}
+
+/*
+ * =================================================================== eof ==
+ */
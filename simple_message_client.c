@@ -11,17 +11,32 @@
  * -------------------------------------------------------------- includes --
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <string.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/xattr.h>
 #include <errno.h>
 #include <limits.h>
+#include <zlib.h>
+#include "simple_message_xxh64.h"
+#include "simple_message_crc32c.h"
+#include "simple_message_resolver.h"
+#include "simple_message_probes.h"
 #include "/usr/local/include/simple_message_client_commandline_handling.h"
 
 /*
@@ -30,6 +45,62 @@
 
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
+#define UNIX_SERVER_PREFIX "unix:"
+#define RESPONSE_BUFFER_SIZE 65536
+#define REQUEST_PARTS 20
+#define MESSAGE_WINDOW_SIZE (4 * 1024 * 1024)
+#define HASH_ATTRIBUTE "user.simple_message.xxh64"
+#define HASH_RECORD_SIZE 64
+#define AGENT_HEADER_SIZE 512
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* options of this client on top of the ones of smc_parsecommandline() */
+typedef struct
+{
+    int noDelay;
+    int fastOpen;
+    int sendBuffer;
+    int receiveBuffer;
+    int busyPoll;
+    int compress;
+    const char *imageFile;  /* NULL -> no image is uploaded */
+    int imageDescriptor;
+    off_t imageSize;
+    const char *messageFile;  /* NULL -> the message is the argument of -m, "-" -> stdin */
+    int messageDescriptor;
+    off_t messageSize;        /* 0 -> the message file is streamed */
+    int skipUnchanged;
+    int crc;
+    const char *resolveCache;  /* NULL -> the default cache file of the user */
+    int resolveTtl;            /* 0 -> no cache file */
+    const char *agent;         /* NULL -> connect to the server directly */
+    char agentHeader[AGENT_HEADER_SIZE];  /* server and port for the agent */
+    const char *subscribe;     /* NULL -> post, "page" or "messages" -> follow the board */
+} clientOptions;
+
+/* what the server announced about a file of the response */
+typedef struct
+{
+    char *filename;     /* allocated */
+    char *encoding;     /* allocated, NULL if not announced */
+    bool messages;      /* new messages of a subscription instead of a file */
+    bool hasCrc;
+    uint32_t crc;       /* CRC-32C of the bytes on the connection */
+    size_t length;
+} fileHeader;
+
+/* a file of the response being written */
+typedef struct
+{
+    FILE *file;
+    const char *filename;
+    bool replace;                   /* written aside, renamed only if the content changed */
+    char temporary[PATH_MAX];       /* name of the file written aside, "" -> none (O_TMPFILE) */
+    Xxh64State hash;
+} outputFile;
 
 /*
  * --------------------------------------------------------------- globals --
@@ -37,6 +108,7 @@
 
 const char * programName;
 int verbose = false;
+clientOptions options;
 
 /*
  * ------------------------------------------------------------- prototypes --
@@ -45,7 +117,24 @@ int verbose = false;
 void printError(char * funcName, bool evalErrno, const char * message);
 void usagefunc(FILE *outputStream, const char *programName, int exitCode);
 void initSocketAndConnect(const char *server, const char *port, int *sfd);
+void connectUnixSocket(const char *path, int *sfd);
+int extractClientOptions(int argc, const char **argv, const char **remaining);
+int applyClientOption(const char *name, const char *value, int *consumesValue);
+void applySocketOptions(int sfd);
+void openImageFile(const char *path);
+void openMessageFile(const char *path);
+int addPart(struct iovec *iov, int count, const char *text);
+void writeParts(int sfd, struct iovec *iov, int count);
+void sendImageFile(int sfd);
+void sendMappedMessage(int sfd, struct iovec *iov, int count);
+void streamMessage(int sfd);
 void sendMessage(int sfd, const char* user, const char* message, const char* img_url);
+int readFileHeader(FILE *fpr, int *status, fileHeader *header);
+int existingFileHash(const char *filename, uint64_t *hash);
+int openOutputFile(outputFile *output, const char *filename);
+int writeOutputFile(outputFile *output, const void *data, size_t length);
+int closeOutputFile(outputFile *output, bool complete);
+int readFileBody(FILE *fpr, const fileHeader *header);
 int readResponse(int sfd);
 void verboseOutput(const char* text);
 
@@ -97,296 +186,1310 @@ void usagefunc(FILE *outputStream, const char *programName, int exitCode){
     fprintf(outputStream, "usage: %s\n", programName);
     fprintf(outputStream, "options:\n");
     fprintf(outputStream, "-s, --server \t <server> full qualified domain name or IP address of the server\n");
+    fprintf(outputStream, "            \t or unix:<path> of a local Unix domain socket (the port is ignored then)\n");
     fprintf(outputStream, "-p, --port \t <port> well-known port of the server [0..65535]\n");
     fprintf(outputStream, "-u, --user \t <name> name of the posting user\n");
     fprintf(outputStream, "-i, --image \t <URL> URL pointing to an image of the posting user\n");
-    fprintf(outputStream, "-m, --message \t <message> message to be added to the bulletin board\n");
+    fprintf(outputStream, "-m, --message \t <message> message to be added to the bulletin board (- -> read from stdin)\n");
     fprintf(outputStream, "-v, --verbose \t verbose output\n");
+    fprintf(outputStream, "--nodelay \t disable Nagle's algorithm (TCP_NODELAY)\n");
+    fprintf(outputStream, "--fastopen \t send the request with the SYN (TCP Fast Open)\n");
+    fprintf(outputStream, "--sndbuf \t <bytes> size of the socket send buffer\n");
+    fprintf(outputStream, "--rcvbuf \t <bytes> size of the socket receive buffer\n");
+    fprintf(outputStream, "--busy-poll \t <us> busy poll the device queue on reads (SO_BUSY_POLL)\n");
+    fprintf(outputStream, "--compress \t accept the HTML file compressed (needs a threaded server)\n");
+    fprintf(outputStream, "--image-file \t <path> upload the image with the post (needs a threaded server)\n");
+    fprintf(outputStream, "--message-file \t <path> post the content of the file instead of -m\n");
+    fprintf(outputStream, "--skip-unchanged \t leave files alone whose content did not change\n");
+    fprintf(outputStream, "--crc \t\t verify the files with the CRC-32C announced by the server (fails without one)\n");
+    fprintf(outputStream, "--agent \t <path> post through the agent listening on the Unix domain socket\n");
+    fprintf(outputStream, "--subscribe \t <page|messages> keep the page up to date or print new messages\n");
+    fprintf(outputStream, "            \t instead of posting, until the server closes (needs a threaded server)\n");
+    fprintf(outputStream, "--resolve \t <host:port:address> connect to address instead of resolving host\n");
+    fprintf(outputStream, "--resolve-cache \t <path> file sharing resolved addresses between runs\n");
+    fprintf(outputStream, "--resolve-ttl \t <s> seconds resolved addresses are reused (default %d, 0 -> off)\n", RESOLVER_DEFAULT_TTL);
     fprintf(outputStream, "-h, --help");
 
     exit(exitCode);
 }
 
+/**
+ *
+ * \brief Function for recognising one of the options of this client
+ *
+ * \param name the option without the leading "--" and without "=value"
+ * \param value the value of the option (NULL if none is available)
+ * \param consumesValue set to 1 if the option takes a value
+ *
+ * \return EXIT_SUCCESS if the option is known (and its value is valid)
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+int applyClientOption(const char *name, const char *value, int *consumesValue)
+{
+    int *number = NULL;
+    char *end = NULL;
+    long parsed = 0;
+
+    *consumesValue = 0;
+    if(strcmp(name, "nodelay") == 0)
+    {
+        options.noDelay = 1;
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(name, "fastopen") == 0)
+    {
+        options.fastOpen = 1;
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(name, "compress") == 0)
+    {
+        options.compress = 1;
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(name, "skip-unchanged") == 0)
+    {
+        options.skipUnchanged = 1;
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(name, "crc") == 0)
+    {
+        options.crc = 1;
+        return EXIT_SUCCESS;
+    }
+    if(strcmp(name, "image-file") == 0 || strcmp(name, "message-file") == 0 ||
+       strcmp(name, "resolve-cache") == 0 || strcmp(name, "agent") == 0)
+    {
+        *consumesValue = 1;
+        if(name[0] == 'i')
+            options.imageFile = value;
+        else if(name[0] == 'm')
+            options.messageFile = value;
+        else if(name[0] == 'a')
+            options.agent = value;
+        else
+            options.resolveCache = value;
+        return value != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(strcmp(name, "subscribe") == 0)
+    {
+        *consumesValue = 1;
+        options.subscribe = value;
+        return value != NULL && (strcmp(value, "page") == 0 || strcmp(value, "messages") == 0) ?
+               EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(strcmp(name, "resolve") == 0)
+    {
+        *consumesValue = 1;
+        return value != NULL ? ResolverAddOverride(value) : EXIT_FAILURE;
+    }
+
+    if(strcmp(name, "sndbuf") == 0)
+        number = &options.sendBuffer;
+    else if(strcmp(name, "rcvbuf") == 0)
+        number = &options.receiveBuffer;
+    else if(strcmp(name, "busy-poll") == 0)
+        number = &options.busyPoll;
+    else if(strcmp(name, "resolve-ttl") == 0)
+        number = &options.resolveTtl;
+    else
+        return EXIT_FAILURE;
+
+    *consumesValue = 1;
+    if(value == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    errno = 0;
+    parsed = strtol(value, &end, 10);
+    if(errno != 0 || end == value || *end != '\0' || parsed < 0 || parsed > INT_MAX)
+    {
+        return EXIT_FAILURE;
+    }
+    *number = (int) parsed;
+    return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for removing the options of this client from the command line
+ *
+ * smc_parsecommandline() rejects unknown options, so the long options of
+ * this client are taken out first. Arguments of the parser's own options
+ * are copied unchanged, even if they start with "--".
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ * \param remaining the arguments left for smc_parsecommandline() (argc + 3 entries)
+ *
+ * \return the number of remaining arguments
+ *
+ */
+int extractClientOptions(int argc, const char **argv, const char **remaining)
+{
+    int count = 0;
+    int consumesValue = 0;
+    bool message = false;
+
+    remaining[count++] = argv[0];
+    for(int i = 1; i < argc; i++)
+    {
+        const char *argument = argv[i];
+
+        if(strncmp(argument, "--", 2) == 0 && argument[2] != '\0')
+        {
+            char name[32];
+            const char *equals = strchr(argument, '=');
+            size_t nameLength = equals != NULL ? (size_t) (equals - argument - 2) : strlen(argument + 2);
+
+            if(nameLength < sizeof(name))
+            {
+                memcpy(name, argument + 2, nameLength);
+                name[nameLength] = '\0';
+
+                const char *value = equals != NULL ? equals + 1 : (i + 1 < argc ? argv[i + 1] : NULL);
+                if(applyClientOption(name, value, &consumesValue) == EXIT_SUCCESS)
+                {
+                    if(consumesValue && equals == NULL)
+                        i++;
+                    continue;
+                }
+                if(consumesValue)
+                {
+                    usagefunc(stderr, argv[0], EXIT_FAILURE);
+                }
+            }
+        }
+
+        remaining[count++] = argument;
+        if(strcmp(argument, "-m") == 0 || strcmp(argument, "--message") == 0 ||
+           strncmp(argument, "--message=", 10) == 0)
+        {
+            message = true;
+        }
+
+        /* keep the argument of the parser's options, e.g. -m --nodelay */
+        if((strcmp(argument, "-s") == 0 || strcmp(argument, "-p") == 0 ||
+            strcmp(argument, "-u") == 0 || strcmp(argument, "-i") == 0 ||
+            strcmp(argument, "-m") == 0 || strcmp(argument, "--server") == 0 ||
+            strcmp(argument, "--port") == 0 || strcmp(argument, "--user") == 0 ||
+            strcmp(argument, "--image") == 0 || strcmp(argument, "--message") == 0) &&
+           i + 1 < argc)
+        {
+            remaining[count++] = argv[++i];
+        }
+    }
+
+    /* smc_parsecommandline() insists on -m, the message file takes its place */
+    if(options.messageFile != NULL)
+    {
+        remaining[count++] = "-m";
+        remaining[count++] = "-";
+    }
+    /* ... and a subscription posts nothing */
+    else if(options.subscribe != NULL && !message)
+    {
+        remaining[count++] = "-m";
+        remaining[count++] = "";
+    }
+    remaining[count] = NULL;
+    return count;
+}
+
+/**
+ *
+ * \brief Function for applying the tuning options to a TCP socket before connect()
+ *
+ * \param sfd the descriptor of the socket
+ *
+ */
+void applySocketOptions(int sfd)
+{
+    int one = 1;
+
+    if(options.sendBuffer > 0 &&
+       setsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &options.sendBuffer, sizeof(options.sendBuffer)) != 0)
+    {
+        printError("applySocketOptions()", true, "error setsockopt(SO_SNDBUF)");
+    }
+    if(options.receiveBuffer > 0 &&
+       setsockopt(sfd, SOL_SOCKET, SO_RCVBUF, &options.receiveBuffer, sizeof(options.receiveBuffer)) != 0)
+    {
+        printError("applySocketOptions()", true, "error setsockopt(SO_RCVBUF)");
+    }
+    if(options.busyPoll > 0 &&
+       setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &options.busyPoll, sizeof(options.busyPoll)) != 0)
+    {
+        printError("applySocketOptions()", true, "error setsockopt(SO_BUSY_POLL)");
+    }
+    if(options.noDelay &&
+       setsockopt(sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0)
+    {
+        printError("applySocketOptions()", true, "error setsockopt(TCP_NODELAY)");
+    }
+#ifdef TCP_FASTOPEN_CONNECT
+    /* connect() returns at once, the SYN leaves with the first write */
+    if(options.fastOpen &&
+       setsockopt(sfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &one, sizeof(one)) != 0)
+    {
+        printError("applySocketOptions()", true, "error setsockopt(TCP_FASTOPEN_CONNECT)");
+    }
+#endif
+}
+
+/**
+ *
+ * \brief Function for connecting to a server on the same host via Unix domain socket
+ *
+ * \param path the file system path of the server's socket
+ * \param sfd the descriptor of the connected socket
+ *
+ */
+void connectUnixSocket(const char *path, int *sfd)
+{
+    struct sockaddr_un address;
+
+    verboseOutput("function connectUnixSocket() :: check length of the socket path.");
+    if(strlen(path) >= sizeof(address.sun_path))
+    {
+        printError("connectUnixSocket()", false, "path of the socket is too long");
+        exit(EXIT_FAILURE);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    verboseOutput("function connectUnixSocket() :: create socket.");
+    *sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(*sfd == -1)
+    {
+        printError("connectUnixSocket()", true, "error socket()");
+        exit(EXIT_FAILURE);
+    }
+
+    verboseOutput("function connectUnixSocket() :: connect to the server.");
+    if(connect(*sfd, (struct sockaddr *) &address, sizeof(address)) == -1)
+    {
+        printError("connectUnixSocket()", true, "error connect()");
+        close(*sfd);
+        exit(EXIT_FAILURE);
+    }
+    verboseOutput("function connectUnixSocket() :: connected successfully.");
+}
+
 /**
  *
  * \brief Function for initalising socket and connecting to server
  *
  * \param server the name or address of the server the client shall connect with
+ *               (or unix:<path> for a server on the same host)
  * \param port the port of the server the client shall connect with
  * \param sfd the descriptor of the connected socket
  *
  */
 void initSocketAndConnect(const char *server, const char *port, int *sfd)
 {
-    verboseOutput("function initSocketAndConnect() :: init some addrinfo structs.");
-    struct addrinfo hints, *res, *rp;
+    if(strncmp(server, UNIX_SERVER_PREFIX, strlen(UNIX_SERVER_PREFIX)) == 0)
+    {
+        verboseOutput("function initSocketAndConnect() :: server is a local Unix domain socket.");
+        connectUnixSocket(server + strlen(UNIX_SERVER_PREFIX), sfd);
+        return;
+    }
 
-    verboseOutput("function initSocketAndConnect() :: reseting values for hints.");
-    memset(&hints, 0, sizeof(hints));
-    verboseOutput("function initSocketAndConnect() :: specifying some filters for hints.");
-    hints.ai_family = AF_UNSPEC;
-    /* only tcp */
-    hints.ai_socktype = SOCK_STREAM;
+    Resolution resolution;
 
     verboseOutput("function initSocketAndConnect() :: Get all available addresses (possible sockets).");
-    if((getaddrinfo(server,port, &hints, &res)) != 0)
+    if(ResolverLookup(server, port, &resolution) == EXIT_FAILURE)
     {
-        printError("initSocket", true, "Error getaddrinfo()");
+        printError("initSocketAndConnect()", false, gai_strerror(resolution.error));
+        exit(EXIT_FAILURE);
+    }
+    if(resolution.cached)
+    {
+        verboseOutput("function initSocketAndConnect() :: addresses taken from --resolve or the cache file.");
     }
 
     verboseOutput("function initSocketAndConnect() :: Try to connect to a socket (loop).");
-    /* copy & paste man page from getaddrinfo(3) */
-    for (rp = res; rp != NULL; rp = rp->ai_next)
+    *sfd = -1;
+    for(int i = 0; i < resolution.count && *sfd == -1; i++)
     {
-        *sfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (*sfd == -1)
+        const ResolvedAddress *address = &resolution.addresses[i];
+
+        *sfd = socket(address->family, SOCK_STREAM, 0);
+        if(*sfd == -1)
             continue;
 
-        if (connect(*sfd, rp->ai_addr, rp->ai_addrlen) != -1)
-            break;                  /* Success */
+        applySocketOptions(*sfd);
 
-        close(*sfd);
+        if(connect(*sfd, (const struct sockaddr *) &address->address, address->length) == -1)
+        {
+            close(*sfd);
+            *sfd = -1;
+        }
     }
 
-    verboseOutput("function initSocketAndConnect() :: cleanup with structs.");
-    freeaddrinfo(res);
+    if(*sfd == -1)
+    {
+        printError("initSocketAndConnect()", true, "error connect()");
+        if(resolution.cached)
+        {
+            /* the next run asks the resolver again */
+            ResolverForget(server, port);
+        }
+        exit(EXIT_FAILURE);
+    }
 }
 
 /**
  *
- * \brief Function for initalising socket and connecting to server
+ * \brief Function for opening the image file before anything is sent
+ *
+ * \param path the path of the image file
+ *
+ */
+void openImageFile(const char *path)
+{
+    struct stat status;
+
+    options.imageDescriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if(options.imageDescriptor == -1 || fstat(options.imageDescriptor, &status) == -1)
+    {
+        printError("openImageFile()", true, "error open(path)");
+        exit(EXIT_FAILURE);
+    }
+    if(!S_ISREG(status.st_mode))
+    {
+        printError("openImageFile()", false, "the image file is not a regular file");
+        exit(EXIT_FAILURE);
+    }
+    options.imageSize = status.st_size;
+}
+
+/**
+ *
+ * \brief Function for opening the message file (or stdin) before anything is sent
+ *
+ * Regular files are mapped window by window, so the message goes out
+ * without being copied; pipes are spliced to the socket.
+ *
+ * \param path the path of the message file, "-" -> stdin
+ *
+ */
+void openMessageFile(const char *path)
+{
+    struct stat status;
+
+    options.messageDescriptor = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if(options.messageDescriptor == -1 || fstat(options.messageDescriptor, &status) == -1)
+    {
+        printError("openMessageFile()", true, "error open(path)");
+        exit(EXIT_FAILURE);
+    }
+    if(S_ISREG(status.st_mode))
+    {
+        options.messageSize = status.st_size;
+    }
+}
+
+/**
+ *
+ * \brief Function for adding a string to the parts of the request
+ *
+ * \param iov the parts of the request
+ * \param count the number of parts so far
+ * \param text the string
+ *
+ * \return the number of parts
+ *
+ */
+int addPart(struct iovec *iov, int count, const char *text)
+{
+    iov[count].iov_base = (void *) text;
+    iov[count].iov_len = strlen(text);
+    return count + 1;
+}
+
+/**
+ *
+ * \brief Function for writing the parts of the request completely
+ *
+ * \param sfd the descriptor of the connected socket
+ * \param iov the parts of the request (consumed)
+ * \param count the number of parts
+ *
+ */
+void writeParts(int sfd, struct iovec *iov, int count)
+{
+    ssize_t written = 0;
+
+    while(count > 0)
+    {
+        written = writev(sfd, iov, count);
+        if(written == -1 && errno == EINTR)
+            continue;
+        if(written == -1)
+        {
+            printError("writeParts()", true, "error writev()");
+            exit(EXIT_FAILURE);
+        }
+        while(count > 0 && (size_t) written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+/**
+ *
+ * \brief Function for uploading the image file as part of the request
+ *
+ * The file follows the header block announcing it with "imglen=<bytes>" and is copied to the socket
+ * by the kernel with sendfile(). The length is announced up front, so a
+ * file that cannot be sent completely ends the client.
+ *
+ * \param sfd the descriptor of the connected socket
+ *
+ */
+void sendImageFile(int sfd)
+{
+    off_t offset = 0;
+    ssize_t sent = 0;
+
+    while(offset < options.imageSize)
+    {
+        sent = sendfile(sfd, options.imageDescriptor, &offset, options.imageSize - offset);
+        if(sent == -1 && errno == EINTR)
+            continue;
+        if(sent <= 0)
+        {
+            printError("sendImageFile()", sent == -1, "error sendfile(), the image file is incomplete");
+            exit(EXIT_FAILURE);
+        }
+    }
+    close(options.imageDescriptor);
+}
+
+/**
+ *
+ * \brief Function for sending a message file through windows mapped one after another
+ *
+ * The first window leaves together with the header lines. Only one window
+ * is mapped at a time, so memory stays flat for any message size.
+ *
+ * \param sfd the descriptor of the connected socket
+ * \param iov the header lines not sent yet (one entry must be left)
+ * \param count the number of header lines
+ *
+ */
+void sendMappedMessage(int sfd, struct iovec *iov, int count)
+{
+    off_t offset = 0;
+
+    while(offset < options.messageSize)
+    {
+        size_t window = options.messageSize - offset < MESSAGE_WINDOW_SIZE ?
+                        (size_t) (options.messageSize - offset) : MESSAGE_WINDOW_SIZE;
+        void *mapping = mmap(NULL, window, PROT_READ, MAP_PRIVATE, options.messageDescriptor, offset);
+        if(mapping == MAP_FAILED)
+        {
+            printError("sendMappedMessage()", true, "error mmap()");
+            exit(EXIT_FAILURE);
+        }
+        madvise(mapping, window, MADV_SEQUENTIAL);
+
+        iov[count].iov_base = mapping;
+        iov[count++].iov_len = window;
+        writeParts(sfd, iov, count);
+        munmap(mapping, window);
+        count = 0;
+        offset += window;
+    }
+}
+
+/**
+ *
+ * \brief Function for streaming a message that is neither an argument nor a file
+ *
+ * Pipes are spliced to the socket, anything else is copied through a
+ * fixed buffer, so memory stays flat for any message size.
+ *
+ * \param sfd the descriptor of the connected socket
+ *
+ */
+void streamMessage(int sfd)
+{
+    char buffer[RESPONSE_BUFFER_SIZE];
+    ssize_t moved = 0;
+    struct iovec iov;
+
+    for(;;)
+    {
+        moved = splice(options.messageDescriptor, NULL, sfd, NULL, RESPONSE_BUFFER_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(moved == -1 && errno == EINTR)
+            continue;
+        if(moved <= 0)
+            break;
+    }
+    if(moved == 0)
+        return;
+    if(errno != EINVAL)
+    {
+        printError("streamMessage()", true, "error splice()");
+        exit(EXIT_FAILURE);
+    }
+
+    verboseOutput("function streamMessage() :: splice() not possible, copy the message.");
+    for(;;)
+    {
+        moved = read(options.messageDescriptor, buffer, sizeof(buffer));
+        if(moved == -1 && errno == EINTR)
+            continue;
+        if(moved == -1)
+        {
+            printError("streamMessage()", true, "error read()");
+            exit(EXIT_FAILURE);
+        }
+        if(moved == 0)
+            break;
+        iov.iov_base = buffer;
+        iov.iov_len = moved;
+        writeParts(sfd, &iov, 1);
+    }
+}
+
+/**
+ *
+ * \brief Function for sending the request to the server
+ *
+ * All parts of the request are assembled as iovec pointing to the
+ * arguments first, the files only as their length. The parts up to a file
+ * are sent with one writev(), together with the message (or its first
+ * window); the files are sent by the kernel. A subscription is sent in a
+ * frame "reqlen=<bytes>\n" instead of being ended by shutting down the
+ * writing side, so the server sees the EOF of the client when it goes
+ * away. The agent gets its frame line after "server=" and "port=", so it
+ * can stream the request to the server; only a message streamed from a
+ * pipe has no length, the agent reads it up to EOF then.
  *
  * \param sfd the descriptor of the connected socket
  * \param user the name of the user that uses the client
- * \param message the text the user posts
+ * \param message the text the user posts (unused with a message file)
  * \param img_url the URL of the image the user posts
  *
  */
 void sendMessage(int sfd, const char* user, const char* message, const char* img_url)
 {
-    verboseOutput("function sendMessage() :: duplicate socket descriptor for write access.");
-    int sdw = dup(sfd);
-    if(sdw == -1)
+    struct iovec iov[REQUEST_PARTS];
+    char imageLength[32];
+    char acceptLine[32];
+    char subscribeLine[32];
+    char frameLine[32];
+    long long frameLength = 0;
+    int count = 0;
+    int sent = 0;
+    int framePart = -1;
+    int imagePart = -1;
+    int messagePart = -1;
+
+    if(options.agent != NULL)
     {
-        printError("sendMessage()", true, "error with dup(sfd)");
-        return;
+        count = addPart(iov, count, options.agentHeader);
+    }
+    /* the frame line is filled in once the length of the parts behind it is known */
+    if(options.agent != NULL || options.subscribe != NULL)
+    {
+        framePart = count;
+        count = addPart(iov, count, "");
     }
-    verboseOutput("function sendMessage() :: dup was successfully.");
 
-    verboseOutput("function sendMessage() :: try to fdopen with our new sdw(SocketDescirptorWrite).");
-    FILE *fpw = fdopen(sdw, "w");
-    if (fpw == NULL)
+    /* features beyond the classic request are negotiated in a header block in front of it */
+    if(options.subscribe != NULL || options.imageFile != NULL || options.compress || options.crc)
     {
-        printError("sendMessage()", true, "fdopen with w doesn't work");
-	    return;
+        verboseOutput("function sendMessage() :: assemble the header block.");
+        count = addPart(iov, count, "version=1\n");
+
+        /* subscription instead of a post */
+        if(options.subscribe != NULL)
+        {
+            verboseOutput("function sendMessage() :: You call this program with subscribe parameter.");
+            snprintf(subscribeLine, sizeof(subscribeLine), "subscribe=%s\n", options.subscribe);
+            count = addPart(iov, count, subscribeLine);
+        }
+        if(options.imageFile != NULL)
+        {
+            snprintf(imageLength, sizeof(imageLength), "imglen=%lld\n", (long long) options.imageSize);
+            count = addPart(iov, count, imageLength);
+        }
+        if(options.compress || options.crc)
+        {
+            snprintf(acceptLine, sizeof(acceptLine), "accept=%s%s%s\n", options.compress ? "deflate" : "",
+                     options.compress && options.crc ? "," : "", options.crc ? "crc32c" : "");
+            count = addPart(iov, count, acceptLine);
+        }
+        count = addPart(iov, count, "\n");
+
+        /* request with uploaded image file, its bytes follow the block */
+        if(options.imageFile != NULL)
+        {
+            imagePart = count;
+            iov[count].iov_base = NULL;
+            iov[count++].iov_len = options.imageSize;
+        }
     }
-    verboseOutput("function sendMessage() :: fdopen was successful.");
+
+    verboseOutput("function sendMessage() :: assemble the header.");
+    count = addPart(iov, count, "user=");
+    count = addPart(iov, count, user);
+    count = addPart(iov, count, "\n");
 
     /* request with image url */
     if (!(img_url == NULL))
     {
         verboseOutput("function sendMessage() :: You call this program with img_url parameter.");
-        verboseOutput("function sendMessage() :: Try to send message.");
-        if(fprintf(fpw, "user=%s\nimg=%s\n%s\n", user, img_url, message) < 0)
+        count = addPart(iov, count, "img=");
+        count = addPart(iov, count, img_url);
+        count = addPart(iov, count, "\n");
+    }
+
+    if(options.subscribe != NULL)
+    {
+        /* nothing to post, the request ends with the header */
+    }
+    else if(options.messageFile == NULL)
+    {
+        count = addPart(iov, count, message);
+    }
+    else
+    {
+        messagePart = count;
+        iov[count].iov_base = NULL;
+        iov[count++].iov_len = options.messageSize;
+    }
+    if(options.subscribe == NULL)
+    {
+        count = addPart(iov, count, "\n");
+    }
+
+    /* a streamed message has no length, its frame line stays empty */
+    if(framePart != -1 && (messagePart == -1 || options.messageSize > 0))
+    {
+        for(int i = framePart + 1; i < count; i++)
         {
-            printError("sendMessage()", true, "error fprintf(fpw, \"user=%s\\nimg=%s\\n%s\\n\", user, img_url, message)");
+            frameLength += iov[i].iov_len;
         }
-        verboseOutput("function sendMessage() :: message sent successful.");
+        snprintf(frameLine, sizeof(frameLine), "reqlen=%lld\n", frameLength);
+        iov[framePart].iov_base = frameLine;
+        iov[framePart].iov_len = strlen(frameLine);
     }
-    else
+
+    verboseOutput("function sendMessage() :: Try to send message.");
+    for(int i = 0; i < count; i++)
     {
-        verboseOutput("function sendMessage() :: You call this program not with img_url parameter.");
-        verboseOutput("function sendMessage() :: Try to send message.");
-        if(fprintf(fpw, "user=%s\n%s\n", user, message) < 0)
+        if(i == imagePart)
+        {
+            verboseOutput("function sendMessage() :: Try to upload the image file.");
+            writeParts(sfd, iov + sent, i - sent);
+            sendImageFile(sfd);
+            sent = i + 1;
+            verboseOutput("function sendMessage() :: image file uploaded successful.");
+        }
+        else if(i == messagePart && options.messageSize > 0)
+        {
+            sendMappedMessage(sfd, iov + sent, i - sent);
+            sent = i + 1;
+        }
+        else if(i == messagePart)
         {
-            printError("sendMessage()", true, "error fprintf(fpw, \"user=%s\\n%s\\n\", user, message)");
+            writeParts(sfd, iov + sent, i - sent);
+            streamMessage(sfd);
+            sent = i + 1;
         }
-        verboseOutput("function sendMessage() :: message sent successful.");
     }
+    writeParts(sfd, iov + sent, count - sent);
 
-    verboseOutput("function sendMessage() :: fflush fpw.");
-    fflush(fpw);
-    verboseOutput("function sendMessage() :: shutdown the sdw.");
-    if(shutdown(sdw, SHUT_WR) != 0)
+    if(options.subscribe != NULL)
     {
-	    printError("sendMessage()", true, "error shutdown(sdw, SHUT_WR)");
+        verboseOutput("function sendMessage() :: subscription sent in a frame.");
+        return;
     }
-    verboseOutput("function sendMessage() :: shutdown sdw successful.");
-    verboseOutput("function sendMessage() :: fclose the fpw.");
-    if(fclose(fpw) != 0)
+    verboseOutput("function sendMessage() :: message sent successful.");
+
+    verboseOutput("function sendMessage() :: shutdown the sfd.");
+    if(shutdown(sfd, SHUT_WR) != 0)
     {
-	    printError("sendMessage()", true, "error fclose(fpw)");
+	    printError("sendMessage()", true, "error shutdown(sfd, SHUT_WR)");
     }
-    verboseOutput("function sendMessage() :: fclose fpw successful.");
+    verboseOutput("function sendMessage() :: shutdown sfd successful.");
 }
 
 /**
  *
- * \brief main function for creating a simple message client
+ * \brief Function for reading the header lines announcing one file of the response
  *
- * \param sdf the descriptor of the connected socket
+ * Reads "key=value" lines up to and including "len=". Unknown keys are
+ * skipped, so a server may announce more about a file than this client
+ * understands.
  *
- * \return status
+ * \param fpr the stream of the connection
+ * \param status receives the value of "status=" (NULL if the file has no status)
+ * \param header receives "file=" (or "messages=" of a subscription), "enc=", "crc=" and "len=" of the file
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
  *
  */
-int readResponse(int sfd)
+int readFileHeader(FILE *fpr, int *status, fileHeader *header)
 {
-    verboseOutput("Function readResponse() :: Create file pointer with socketdescriptor in read.");
-    FILE *fpr = fdopen(sfd, "r");
-    if (fpr == NULL)
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read = 0;
+    int result = EXIT_FAILURE;
+
+    memset(header, 0, sizeof(fileHeader));
+    while((read = getline(&line, &len, fpr)) != -1)
     {
-        printError("readResponse()", true, "fdopen with r doesn't work");
-    }
+        if(line[read - 1] == '\n')
+        {
+            line[read - 1] = '\0';
+        }
+        char *value = strchr(line, '=');
+        if(value == NULL)
+        {
+            printError("readFileHeader()", false, "malformed header line");
+            break;
+        }
+        *value++ = '\0';
 
-    char * line = NULL;
-    size_t len = 0;
-    int i = 0;
-    int status = 0;
-    char *filenameHtml = NULL;
-    char *filenamePng = NULL;
-    int lengthPng = 0;
-    int lengthHtml = 0;
-    int read = 0;
-
-    verboseOutput("Function readResponse() :: Trying to read first 3 parameters (status, file, len)");
-    /* read first 3 lines */
-    for (i = 0; i < 3; i++)
-    {
-        read = getline(&line, &len, fpr);
-        if(read == -1)
-        {
-        	printError("readResponse()", true, "getline() failed");
-        }
-
-        switch(i)
-        {
-        	case 0:
-				if(sscanf(line, "status=%d", &status) == EOF)
-				{
-					printError("readResponse()", true, "sscanf() for status failed");
-				}
-                verboseOutput("Function readResponse() :: read successfully status.");
-				break;
-        	case 1:
-				filenameHtml = (char*)realloc(filenameHtml, read);
-				if(filenameHtml == NULL)
-				{
-					printError("readResponse()", true, "no memory for realloc filenameHtml");
-				}
-				if(sscanf(line, "file=%s", filenameHtml) == EOF)
-				{
-					printError("readResponse()", true, "sscanf() for filenameHtml failed");
-				}
-                verboseOutput("Function readResponse() :: read successfully filenameHtml.");
-                break;
-        	case 2:
-				if(sscanf(line, "len=%d", &lengthHtml) == EOF)
-				{
-					printError("readResponse()", true, "sscanf() for lengthHtml failed");
-				}
-                verboseOutput("Function readResponse() :: read successfully lengthHtml.");
+        if(status != NULL && strcmp(line, "status") == 0)
+        {
+            *status = atoi(value);
+            verboseOutput("Function readFileHeader() :: read successfully status.");
+        }
+        else if(strcmp(line, "messages") == 0)
+        {
+            header->messages = true;
+            verboseOutput("Function readFileHeader() :: read successfully new messages.");
+        }
+        else if(strcmp(line, "file") == 0)
+        {
+            free(header->filename);
+            header->filename = strdup(value);
+            verboseOutput("Function readFileHeader() :: read successfully filename.");
+        }
+        else if(strcmp(line, "enc") == 0)
+        {
+            free(header->encoding);
+            header->encoding = strdup(value);
+            verboseOutput("Function readFileHeader() :: read successfully encoding.");
+        }
+        else if(strcmp(line, "crc") == 0)
+        {
+            char *end = NULL;
+            header->crc = (uint32_t) strtoul(value, &end, 16);
+            header->hasCrc = end != value && *end == '\0';
+            verboseOutput("Function readFileHeader() :: read successfully crc.");
+        }
+        else if(strcmp(line, "len") == 0)
+        {
+            char *end = NULL;
+            errno = 0;
+            header->length = strtoull(value, &end, 10);
+            if(errno != 0 || end == value || *end != '\0')
+            {
+                printError("readFileHeader()", false, "invalid length");
                 break;
+            }
+            verboseOutput("Function readFileHeader() :: read successfully length.");
+            result = EXIT_SUCCESS;
+            break;
         }
     }
-	verboseOutput("Function readResponse() :: 3 parameters read successully. Now I try to read the whole html file.");
-    verboseOutput("Function readResponse() :: Create file pointer to the new HTML file.");
-	FILE *fpResponseHtmlFile = fopen(filenameHtml, "w");
-	if(fpResponseHtmlFile == NULL)
-	{
-		printError("readResponse()", true, "fopen(filenameHtml, 'w') failed");
-	}
+    if(read == -1)
+    {
+        printError("readFileHeader()", ferror(fpr) != 0, "getline() failed");
+    }
+    free(line);
 
-	char buffer[lengthHtml];
+    /* the file is created in the working directory only */
+    if(result == EXIT_SUCCESS && !header->messages &&
+       (header->filename == NULL || header->filename[0] == '\0' || header->filename[0] == '.' ||
+        strchr(header->filename, '/') != NULL))
+    {
+        printError("readFileHeader()", false, "missing or invalid file name");
+        result = EXIT_FAILURE;
+    }
+    if(result == EXIT_FAILURE)
+    {
+        free(header->filename);
+        free(header->encoding);
+        memset(header, 0, sizeof(fileHeader));
+    }
+    return result;
+}
 
-    verboseOutput("Function readResponse() :: Read from socket for HTML file.");
-	if(fread(buffer, 1, lengthHtml, fpr) != lengthHtml)
-	{
-		printError("readResponse()", true, "fread() failed");
-	}
+/**
+ *
+ * \brief Function for getting the recorded or computed hash of an existing file
+ *
+ * The hash is recorded in an extended attribute together with the
+ * modification time it belongs to. Without a valid record (other file
+ * system, file changed by somebody else) the content is hashed.
+ *
+ * \param filename the name of the file
+ * \param hash receives the hash of the content
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE if the file does not exist or cannot be read
+ *
+ */
+int existingFileHash(const char *filename, uint64_t *hash)
+{
+    unsigned char buffer[RESPONSE_BUFFER_SIZE];
+    char recorded[HASH_RECORD_SIZE];
+    unsigned long long recordedHash = 0;
+    long long seconds = 0;
+    long nanoseconds = 0;
+    struct stat status;
+    Xxh64State state;
+    ssize_t got = 0;
 
-    verboseOutput("Function readResponse() :: Write from buffer to file.");
-	if(fwrite(buffer, lengthHtml, 1, fpResponseHtmlFile) != 1)
-	{
-		printError("readResponse()", true, "fwrite() failed");
-	}
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if(fd == -1 || fstat(fd, &status) == -1)
+    {
+        if(fd != -1)
+            close(fd);
+        return EXIT_FAILURE;
+    }
+
+    got = fgetxattr(fd, HASH_ATTRIBUTE, recorded, sizeof(recorded) - 1);
+    if(got > 0)
+    {
+        recorded[got] = '\0';
+        if(sscanf(recorded, "%llx %lld.%ld", &recordedHash, &seconds, &nanoseconds) == 3 &&
+           seconds == (long long) status.st_mtim.tv_sec && nanoseconds == status.st_mtim.tv_nsec)
+        {
+            verboseOutput("Function existingFileHash() :: hash recorded with the file.");
+            close(fd);
+            *hash = recordedHash;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    verboseOutput("Function existingFileHash() :: no valid record, hash the content.");
+    Xxh64Reset(&state, 0);
+    while((got = read(fd, buffer, sizeof(buffer))) != 0)
+    {
+        if(got == -1 && errno == EINTR)
+            continue;
+        if(got == -1)
+            break;
+        Xxh64Update(&state, buffer, got);
+    }
+    close(fd);
+    *hash = Xxh64Digest(&state);
+    return got == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Function for creating a file of the response
+ *
+ * With --skip-unchanged the content is written aside (an unnamed file
+ * if the file system supports O_TMPFILE) and hashed on the way. A
+ * subscription does the same, so the file is never seen half written.
+ *
+ * \param output the file that shall be written
+ * \param filename the name of the file (NULL -> standard output)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int openOutputFile(outputFile *output, const char *filename)
+{
+    int fd = -1;
 
-    verboseOutput("Function readResponse() :: HTML File completed.");
-    verboseOutput("Function readResponse() :: PNG File starting.");
-    verboseOutput("Function readResponse() :: Try to read 2 parameters (filenamePng and lengthPng).");
-	for (i = 0; i < 2; i++) {
-		read = getline(&line, &len, fpr);
-		if (i == 0)
-		{
-			filenamePng = (char*)realloc(filenamePng, read);
-			if(filenamePng == NULL)
-			{
-					printError("readResponse()", true, "no memory for realloc filenamePng");
-                    return EXIT_FAILURE;
-			}
-			if(sscanf(line, "file=%s", filenamePng) == EOF)
+    output->filename = filename;
+    output->replace = options.skipUnchanged || options.subscribe != NULL;
+    output->temporary[0] = '\0';
+    if(filename == NULL)
+    {
+        output->file = stdout;
+        output->replace = false;
+        return EXIT_SUCCESS;
+    }
+    if(!output->replace)
+    {
+        output->file = fopen(filename, "w");
+        if(output->file == NULL)
+        {
+            printError("openOutputFile()", true, "fopen(filename, 'w') failed");
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    Xxh64Reset(&output->hash, 0);
+    fd = open(".", O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666);
+    if(fd == -1)
+    {
+        mode_t mask = umask(0);
+
+        umask(mask);
+        snprintf(output->temporary, sizeof(output->temporary), ".%s.XXXXXX", filename);
+        fd = mkstemp(output->temporary);
+        if(fd == -1 || fchmod(fd, 0666 & ~mask) == -1)
+        {
+            printError("openOutputFile()", true, "error mkstemp()");
+            if(fd != -1)
             {
-                printError("readResponse()", true, "sscanf() for filenamePng failed");
-                return EXIT_FAILURE;
+                close(fd);
+                unlink(output->temporary);
             }
-            verboseOutput("Function readResponse() :: read successfully filenamePng.");
-		}
-		if (i == 1)
-		{
-			if(sscanf(line, "len=%d", &lengthPng) == EOF)
+            return EXIT_FAILURE;
+        }
+    }
+
+    output->file = fdopen(fd, "w");
+    if(output->file == NULL)
+    {
+        printError("openOutputFile()", true, "fdopen with w doesn't work");
+        close(fd);
+        if(output->temporary[0] != '\0')
+            unlink(output->temporary);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for writing the next bytes of a file of the response
+ *
+ * \param output the file
+ * \param data the bytes
+ * \param length the number of bytes
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int writeOutputFile(outputFile *output, const void *data, size_t length)
+{
+    if(output->replace)
+    {
+        Xxh64Update(&output->hash, data, length);
+    }
+    if(length > 0 && fwrite(data, length, 1, output->file) != 1)
+    {
+        printError("writeOutputFile()", true, "fwrite() failed");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for finishing a file of the response
+ *
+ * With --skip-unchanged the file written aside replaces the existing one
+ * by rename() only if it is complete and its content changed; otherwise
+ * the existing file is not touched at all. Without, an incomplete file is
+ * removed. Standard output is only flushed.
+ *
+ * \param output the file
+ * \param complete false if the content is incomplete and shall be dropped
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int closeOutputFile(outputFile *output, bool complete)
+{
+    char record[HASH_RECORD_SIZE];
+    char path[PATH_MAX];
+    uint64_t hash = 0;
+    uint64_t existing = 0;
+    struct stat status;
+    int result = EXIT_SUCCESS;
+    int fd = fileno(output->file);
+
+    if(output->filename == NULL)
+    {
+        if(fflush(output->file) != 0)
+        {
+            printError("closeOutputFile()", true, "error fflush(stdout)");
+            complete = false;
+        }
+        return complete ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(!output->replace)
+    {
+        if(fclose(output->file) != 0)
+        {
+            printError("closeOutputFile()", true, "error fclose(file)");
+            complete = false;
+        }
+        if(!complete)
+        {
+            unlink(output->filename);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    hash = Xxh64Digest(&output->hash);
+    if(complete && existingFileHash(output->filename, &existing) == EXIT_SUCCESS && existing == hash)
+    {
+        verboseOutput("Function closeOutputFile() :: content unchanged, keep the existing file.");
+        complete = false;
+    }
+    else if(complete)
+    {
+        verboseOutput("Function closeOutputFile() :: content changed, replace the file.");
+        if(fflush(output->file) != 0 || fstat(fd, &status) == -1)
+        {
+            printError("closeOutputFile()", true, "error fflush(file)");
+            result = EXIT_FAILURE;
+        }
+        else
+        {
+            /* file systems without user attributes hash the content next time */
+            snprintf(record, sizeof(record), "%016llx %lld.%09ld", (unsigned long long) hash,
+                     (long long) status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+            fsetxattr(fd, HASH_ATTRIBUTE, record, strlen(record), 0);
+
+            if(output->temporary[0] == '\0')
+            {
+                snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+                snprintf(output->temporary, sizeof(output->temporary), ".%s.%ld", output->filename, (long) getpid());
+                if(linkat(AT_FDCWD, path, AT_FDCWD, output->temporary, AT_SYMLINK_FOLLOW) == -1)
+                {
+                    printError("closeOutputFile()", true, "error linkat()");
+                    output->temporary[0] = '\0';
+                    result = EXIT_FAILURE;
+                }
+            }
+            if(result == EXIT_SUCCESS && rename(output->temporary, output->filename) == -1)
             {
-                printError("readResponse()", true, "sscanf() for lengthPng failed");
-                return EXIT_FAILURE;
+                printError("closeOutputFile()", true, "error rename()");
+                result = EXIT_FAILURE;
+            }
+            else if(result == EXIT_SUCCESS)
+            {
+                output->temporary[0] = '\0';
             }
-            verboseOutput("Function readResponse() :: read successfully lengthPng.");
         }
-	}
+    }
+
+    if(fclose(output->file) != 0)
+    {
+        printError("closeOutputFile()", true, "error fclose(file)");
+        result = EXIT_FAILURE;
+    }
+    if(output->temporary[0] != '\0')
+    {
+        unlink(output->temporary);
+    }
+    return result;
+}
+
+/**
+ *
+ * \brief Function for copying one file of the response from the connection
+ *
+ * The file is streamed through a fixed buffer, compressed files are
+ * inflated on the way. With --crc the announced checksum is verified on
+ * the way as well; a file failing it, or announced without a checksum,
+ * is not kept. The new messages of a
+ * subscription go to standard output as they arrive, a checksum failure
+ * is reported after them.
+ *
+ * \param fpr the stream of the connection
+ * \param header what the server announced about the file
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int readFileBody(FILE *fpr, const fileHeader *header)
+{
+    const char *encoding = header->encoding;
+    size_t length = header->length;
+    uint32_t crc = 0;
+    unsigned char buffer[RESPONSE_BUFFER_SIZE];
+    unsigned char inflated[RESPONSE_BUFFER_SIZE];
+    bool deflate = encoding != NULL && strcmp(encoding, "deflate") == 0;
+    z_stream stream;
+    outputFile output;
+    int zresult = Z_OK;
+    int result = EXIT_SUCCESS;
+
+    if(encoding != NULL && !deflate && strcmp(encoding, "identity") != 0)
+    {
+        printError("readFileBody()", false, "unknown encoding");
+        return EXIT_FAILURE;
+    }
+
+    /* the user asked for verification, a file that cannot be verified is not accepted */
+    if(options.crc && !header->hasCrc)
+    {
+        printError("readFileBody()", false, "the server announced no checksum, the file cannot be verified");
+        return EXIT_FAILURE;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    if(deflate && inflateInit(&stream) != Z_OK)
+    {
+        printError("readFileBody()", false, "inflateInit() failed");
+        return EXIT_FAILURE;
+    }
+
+    verboseOutput("Function readFileBody() :: Create the new file.");
+    if(openOutputFile(&output, header->messages ? NULL : header->filename) == EXIT_FAILURE)
+    {
+        if(deflate)
+            inflateEnd(&stream);
+        return EXIT_FAILURE;
+    }
+
+    verboseOutput("Function readFileBody() :: Copy from socket to file.");
+    while(length > 0 && result == EXIT_SUCCESS)
+    {
+        size_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+
+        if(fread(buffer, 1, chunk, fpr) != chunk)
+        {
+            printError("readFileBody()", ferror(fpr) != 0, "fread() failed, the file is incomplete");
+            result = EXIT_FAILURE;
+            break;
+        }
+        length -= chunk;
+        if(options.crc && header->hasCrc)
+        {
+            crc = Crc32c(crc, buffer, chunk);
+        }
+
+        if(!deflate)
+        {
+            result = writeOutputFile(&output, buffer, chunk);
+            continue;
+        }
 
-    verboseOutput("Function readResponse() :: create File pointer for png file.");
+        stream.next_in = buffer;
+        stream.avail_in = chunk;
+        do
+        {
+            stream.next_out = inflated;
+            stream.avail_out = sizeof(inflated);
+            zresult = inflate(&stream, Z_NO_FLUSH);
+            if(zresult != Z_OK && zresult != Z_STREAM_END && zresult != Z_BUF_ERROR)
+            {
+                printError("readFileBody()", false, "inflate() failed");
+                result = EXIT_FAILURE;
+                break;
+            }
+            result = writeOutputFile(&output, inflated, sizeof(inflated) - stream.avail_out);
+            if(result == EXIT_FAILURE)
+                break;
+        } while(stream.avail_out == 0);
+    }
 
-    FILE *fpResponseHtmlPng = fopen(filenamePng, "w");
-    if(fpResponseHtmlPng == NULL)
+    if(deflate)
     {
-        printError("readResponse()", true, "fopen(filenamePng, 'w') failed");
+        if(result == EXIT_SUCCESS && zresult != Z_STREAM_END)
+        {
+            printError("readFileBody()", false, "compressed file is truncated");
+            result = EXIT_FAILURE;
+        }
+        inflateEnd(&stream);
     }
-	char bufferPng[lengthPng];
 
-    verboseOutput("Function readResponse() :: read from socket to buffer (png).");
-	if(fread(bufferPng, 1, lengthPng, fpr) != lengthPng)
+    if(result == EXIT_SUCCESS && options.crc && header->hasCrc && crc != header->crc)
     {
-        printError("readResponse()", true, "fread() for png failed");
+        printError("readFileBody()", false, "checksum mismatch, the file is corrupted");
+        result = EXIT_FAILURE;
     }
-    verboseOutput("Function readResponse() :: write from buffer to file (png).");
-    if(fwrite(bufferPng, lengthPng, 1, fpResponseHtmlPng) != 1)
+
+    if(closeOutputFile(&output, result == EXIT_SUCCESS) == EXIT_FAILURE)
     {
-        printError("readResponse()", true, "fwrite() for png failed");
+        result = EXIT_FAILURE;
     }
+    verboseOutput("Function readFileBody() :: file completed.");
+    return result;
+}
 
-    /* Free allocated memory */
-    free(filenameHtml);
-    free(filenamePng);
-    verboseOutput("Function readResponse() :: Freed filenameHtml and filenamePng");
-    
-    /* Closing file pointers */
-    if(fclose(fpResponseHtmlFile) != 0)
+/**
+ *
+ * \brief Function for reading the response of the server into the announced files
+ *
+ * A subscription reads update frames until the server closes the
+ * connection; the end of the stream between two frames is the regular end.
+ *
+ * \param sfd the descriptor of the connected socket
+ *
+ * \return the status sent by the server
+ * \return EXIT_FAILURE if the response cannot be read
+ *
+ */
+int readResponse(int sfd)
+{
+    verboseOutput("Function readResponse() :: Create file pointer with socketdescriptor in read.");
+    FILE *fpr = fdopen(sfd, "r");
+    if (fpr == NULL)
     {
-    	printError("readResponse()", true, "error fclose(fpResponseHtmlFile)");
+        printError("readResponse()", true, "fdopen with r doesn't work");
+        return EXIT_FAILURE;
     }
-    verboseOutput("Function readResponse() :: closed fpResponseHtmlFile");
-    
-    if(fclose(fpResponseHtmlPng) != 0)
+
+    int status = EXIT_FAILURE;
+    int result = EXIT_SUCCESS;
+    fileHeader header;
+
+    /* the HTML file (with the status in front) and the PNG file, or the updates of a subscription */
+    for(int i = 0; (i < 2 || options.subscribe != NULL) && result == EXIT_SUCCESS; i++)
     {
-    	printError("readResponse()", true, "error fclose(fpResponseHtmlPng)");
+        if(options.subscribe != NULL && i > 0)
+        {
+            int next = getc(fpr);
+            if(next == EOF)
+            {
+                verboseOutput("Function readResponse() :: the server ended the subscription.");
+                break;
+            }
+            ungetc(next, fpr);
+        }
+
+        verboseOutput("Function readResponse() :: Trying to read the header of the next file.");
+        result = readFileHeader(fpr, i == 0 ? &status : NULL, &header);
+        if(result == EXIT_SUCCESS && i == 0)
+        {
+            PROBE1(client_response_first_byte, sfd);
+        }
+        if(result == EXIT_SUCCESS)
+        {
+            verboseOutput("Function readResponse() :: Header read successfully. Now I try to read the whole file.");
+            result = readFileBody(fpr, &header);
+            free(header.filename);
+            free(header.encoding);
+        }
     }
-	verboseOutput("Function readResponse() :: closed fpResponseHtmlPng");
 
 	if(fclose(fpr) != 0)
 	{
-		printError("readResponse()", true, "error fclose(fpr)");	
+		printError("readResponse()", true, "error fclose(fpr)");
 	}
 	verboseOutput("Function readResponse() :: closed fpr");
-	
+
     verboseOutput("Function readResponse() :: everything done. return with right exit value.");
-    return status;
+    return result == EXIT_SUCCESS ? status : EXIT_FAILURE;
 }
 
 /**
@@ -417,6 +1520,8 @@ void verboseOutput(const char *text)
 int main(int argc, const char **argv) {
 
     int sfd;
+    const char *remainingArgv[argc + 3];
+    int remainingArgc = 0;
     programName = argv[0];
 
     /* check parameter */
@@ -427,20 +1532,72 @@ int main(int argc, const char **argv) {
     const char *img_url = NULL;
     int verboseParam = -1;
 
+    options.resolveTtl = RESOLVER_DEFAULT_TTL;
+
     verboseOutput("Checking parameter...");
-    smc_parsecommandline(argc, argv, &usagefunc, &server, &port, &user, &message, &img_url, &verboseParam);
+    remainingArgc = extractClientOptions(argc, argv, remainingArgv);
+    smc_parsecommandline(remainingArgc, remainingArgv, &usagefunc, &server, &port, &user, &message, &img_url, &verboseParam);
     verboseOutput("parameter checking successfully.");
 
     verbose = verboseParam;
 
-    verboseOutput("Entering function initSocketAndConnect().");
-    initSocketAndConnect(server, port, &sfd);
-    verboseOutput("Leaving function initSocketAndConnect().");
+    if(ResolverOpen(options.resolveCache, (unsigned int) options.resolveTtl) == EXIT_FAILURE)
+    {
+        printError("main()", false, "path of the resolver cache is too long");
+        return EXIT_FAILURE;
+    }
+
+    if(options.subscribe != NULL &&
+       (message[0] != '\0' || img_url != NULL || options.imageFile != NULL ||
+        options.messageFile != NULL || options.agent != NULL))
+    {
+        printError("main()", false, "--subscribe posts nothing and does not go through the agent");
+        usagefunc(stderr, programName, EXIT_FAILURE);
+    }
+
+    if(options.imageFile != NULL)
+    {
+        verboseOutput("Opening the image file.");
+        openImageFile(options.imageFile);
+    }
+    if(options.messageFile == NULL && strcmp(message, "-") == 0)
+    {
+        options.messageFile = "-";
+    }
+    if(options.messageFile != NULL)
+    {
+        verboseOutput("Opening the message file.");
+        openMessageFile(options.messageFile);
+    }
+
+    PROBE2(client_connect, server, port);
+    if(options.agent != NULL)
+    {
+        int length = snprintf(options.agentHeader, sizeof(options.agentHeader), "server=%s\nport=%s\n", server, port);
+        if(length < 0 || (size_t) length >= sizeof(options.agentHeader) ||
+           strchr(server, '\n') != NULL || strchr(port, '\n') != NULL)
+        {
+            printError("main()", false, "server or port cannot be passed to the agent");
+            return EXIT_FAILURE;
+        }
+        verboseOutput("Connecting to the agent.");
+        connectUnixSocket(options.agent, &sfd);
+    }
+    else
+    {
+        verboseOutput("Entering function initSocketAndConnect().");
+        initSocketAndConnect(server, port, &sfd);
+        verboseOutput("Leaving function initSocketAndConnect().");
+    }
+    PROBE1(client_connected, sfd);
     verboseOutput("Entering function sendMessage().");
     sendMessage(sfd, user, message, img_url);
     verboseOutput("Leaving function sendMessage().");
+    PROBE1(client_request_sent, sfd);
     verboseOutput("Entering function readResponse(). return value of function readResponse() is the return value for main program.");
-    return readResponse(sfd);
+    int status = readResponse(sfd);
+    PROBE1(client_response_complete, status);
+    return status;
 }
 
 /*
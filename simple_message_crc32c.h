@@ -0,0 +1,32 @@
+/*
+ * @file simple_message_crc32c.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_CRC32C_H
+#define SIMPLE_MESSAGE_CRC32C_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+uint32_t Crc32c(uint32_t crc, const void * data, size_t length);
+uint32_t Crc32cShift(size_t length);
+uint32_t Crc32cCombine(uint32_t first, uint32_t second, uint32_t shift);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
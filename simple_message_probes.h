@@ -0,0 +1,56 @@
+/*
+ * @file simple_message_probes.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Static tracepoints (USDT) of client and server, provider "simple_message".
+ * With <sys/sdt.h> (systemtap-sdt-dev) a probe is a single nop and a note
+ * in the binary until a tracer such as bpftrace attaches to it; see trace/
+ * for scripts. Without the header, or built with -DSIMPLE_MESSAGE_NO_PROBES,
+ * the probes compile to nothing.
+ *
+ * Server:  server_accept(fd), connection_resumed(fd), spawn_start(fd),
+ *          spawn_exec(fd, pid), spawn_exit(pid, status),
+ *          request_parsed(fd, bytes, status),
+ *          response_first_byte(fd, bytes), response_complete(fd, status, bytes)
+ * Client:  client_connect(server, port), client_connected(fd),
+ *          client_request_sent(fd), client_response_first_byte(fd),
+ *          client_response_complete(status)
+ */
+
+#ifndef SIMPLE_MESSAGE_PROBES_H
+#define SIMPLE_MESSAGE_PROBES_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#if !defined(SIMPLE_MESSAGE_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SIMPLE_MESSAGE_PROBES
+#endif
+#endif
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#ifdef SIMPLE_MESSAGE_PROBES
+#define PROBE1(name, a) DTRACE_PROBE1(simple_message, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(simple_message, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(simple_message, name, a, b, c)
+#else
+#define PROBE1(name, a) do { (void) (a); } while(0)
+#define PROBE2(name, a, b) do { (void) (a); (void) (b); } while(0)
+#define PROBE3(name, a, b, c) do { (void) (a); (void) (b); (void) (c); } while(0)
+#endif
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,656 @@
+/*
+ * @file simple_message_resolver.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Resolving of server names for short lived clients. Answers are kept in
+ * a small text file shared by all invocations of the same user, one line
+ * per name:
+ *
+ *   <host> <port> <expires> <EAI error> [<address>/<port> ...]
+ *
+ * The file is locked with flock(); readers share the lock, a writer
+ * rewrites the whole file under the exclusive one. getaddrinfo() does not
+ * tell the TTL of the DNS records, so answers are kept for a fixed time
+ * and names that do not exist for a shorter one.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "simple_message_resolver.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define RESOLVER_MAX_OVERRIDES 8
+#define RESOLVER_CACHE_SIZE 65536
+#define RESOLVER_MAX_ENTRIES 128
+#define RESOLVER_LINE_SIZE 1024
+#define RESOLVER_HOST_SIZE 256
+#define RESOLVER_PORT_SIZE 32
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* An address given with --resolve host:port:address */
+typedef struct
+{
+	char host[RESOLVER_HOST_SIZE];
+	char port[RESOLVER_PORT_SIZE];
+	ResolvedAddress address;
+} Override;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static char cachePath[PATH_MAX];
+static unsigned int cacheTtl = RESOLVER_DEFAULT_TTL;
+static Override overrides[RESOLVER_MAX_OVERRIDES];
+static int overrideCount = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int NumericAddress(const char * address, const char * port, ResolvedAddress * resolved);
+static int Cacheable(const char * host, const char * port);
+static int OpenCache(int operation);
+static size_t ReadCache(int descriptor, char * buffer, size_t size);
+static int ParseEntry(const char * line, size_t length, const char * host, const char * port, time_t now,
+	Resolution * resolution);
+static int FormatEntry(char * line, size_t size, const char * host, const char * port, time_t expires,
+	const Resolution * resolution);
+static void RewriteCache(const char * host, const char * port, const char * entry);
+static void Resolve(const char * host, const char * port, Resolution * resolution);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for choosing the cache file and how long answers are kept
+ *
+ * \param cacheFile the path of the cache file (NULL -> one per user in
+ *                  $XDG_RUNTIME_DIR or /tmp)
+ * \param ttl the seconds an answer is kept (0 -> no cache file)
+ *
+ * \return EXIT_SUCCESS if the path fits
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+int ResolverOpen(const char * cacheFile, unsigned int ttl)
+{
+	const char * runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+	int length = 0;
+
+	cacheTtl = ttl;
+	if(cacheFile != NULL)
+		length = snprintf(cachePath, sizeof(cachePath), "%s", cacheFile);
+	else if(runtimeDirectory != NULL && runtimeDirectory[0] == '/')
+		length = snprintf(cachePath, sizeof(cachePath), "%s/simple_message_client.resolve", runtimeDirectory);
+	else
+		length = snprintf(cachePath, sizeof(cachePath), "/tmp/simple_message_client-%u.resolve", (unsigned int) geteuid());
+
+	if(length < 0 || (size_t) length >= sizeof(cachePath))
+	{
+		cachePath[0] = '\0';
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for pinning a name to an address, bypassing resolver and cache
+ *
+ * \param override host:port:address, an IPv6 address may be put in brackets
+ *
+ * \return EXIT_SUCCESS if the override is well-formed
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+int ResolverAddOverride(const char * override)
+{
+	const char * hostEnd = strchr(override, ':');
+	const char * portEnd = hostEnd != NULL ? strchr(hostEnd + 1, ':') : NULL;
+	char address[NI_MAXHOST];
+	Override * entry = &overrides[overrideCount];
+	const char * start = NULL;
+	size_t length = 0;
+
+	if(overrideCount == RESOLVER_MAX_OVERRIDES || hostEnd == NULL || portEnd == NULL ||
+		hostEnd == override || (size_t) (hostEnd - override) >= sizeof(entry->host) ||
+		portEnd == hostEnd + 1 || (size_t) (portEnd - hostEnd - 1) >= sizeof(entry->port))
+	{
+		return EXIT_FAILURE;
+	}
+	memcpy(entry->host, override, hostEnd - override);
+	entry->host[hostEnd - override] = '\0';
+	memcpy(entry->port, hostEnd + 1, portEnd - hostEnd - 1);
+	entry->port[portEnd - hostEnd - 1] = '\0';
+
+	start = portEnd + 1;
+	length = strlen(start);
+	if(length > 1 && start[0] == '[' && start[length - 1] == ']')
+	{
+		start++;
+		length -= 2;
+	}
+	if(length == 0 || length >= sizeof(address))
+	{
+		return EXIT_FAILURE;
+	}
+	memcpy(address, start, length);
+	address[length] = '\0';
+
+	if(NumericAddress(address, entry->port, &entry->address) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+	overrideCount++;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for converting a numeric address without asking the resolver
+ *
+ * \param address the IPv4 or IPv6 address
+ * \param port the port number
+ * \param resolved receives the address
+ *
+ * \return EXIT_SUCCESS if both are numeric
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+static int NumericAddress(const char * address, const char * port, ResolvedAddress * resolved)
+{
+	struct addrinfo hints;
+	struct addrinfo * result = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+	if(getaddrinfo(address, port, &hints, &result) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	resolved->family = result->ai_family;
+	resolved->length = result->ai_addrlen;
+	memcpy(&resolved->address, result->ai_addr, result->ai_addrlen);
+	freeaddrinfo(result);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for checking whether a name fits into a line of the cache file
+ *
+ * \param host the name of the server
+ * \param port the port of the server
+ *
+ * \return 1 if it fits
+ * \return 0 otherwise
+ *
+ */
+static int Cacheable(const char * host, const char * port)
+{
+	if(cacheTtl == 0 || cachePath[0] == '\0' || host[0] == '\0' || port[0] == '\0' ||
+		strlen(host) >= RESOLVER_HOST_SIZE || strlen(port) >= RESOLVER_PORT_SIZE)
+	{
+		return 0;
+	}
+	for(const char * c = host; *c != '\0'; c++)
+	{
+		if(isspace((unsigned char) *c))
+			return 0;
+	}
+	for(const char * c = port; *c != '\0'; c++)
+	{
+		if(isspace((unsigned char) *c))
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ *
+ * \brief Function for opening and locking the cache file
+ *
+ * The file lives in a directory others may write to, so it must be a
+ * regular file of this user and is never followed through a symlink.
+ *
+ * \param operation LOCK_SH for reading, LOCK_EX for rewriting
+ *
+ * \return the descriptor of the locked file
+ * \return -1 if there is no usable cache file
+ *
+ */
+static int OpenCache(int operation)
+{
+	struct stat status;
+	int descriptor = open(cachePath, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+
+	if(descriptor == -1)
+	{
+		return -1;
+	}
+	if(fstat(descriptor, &status) == -1 || !S_ISREG(status.st_mode) || status.st_uid != geteuid())
+	{
+		close(descriptor);
+		return -1;
+	}
+	while(flock(descriptor, operation) == -1)
+	{
+		if(errno != EINTR)
+		{
+			close(descriptor);
+			return -1;
+		}
+	}
+	return descriptor;
+}
+
+/**
+ *
+ * \brief Function for reading the cache file into a buffer
+ *
+ * \param descriptor the descriptor of the locked cache file
+ * \param buffer the buffer (terminated with '\0')
+ * \param size the size of the buffer
+ *
+ * \return the number of bytes read
+ *
+ */
+static size_t ReadCache(int descriptor, char * buffer, size_t size)
+{
+	size_t length = 0;
+	ssize_t got = 0;
+
+	while(length < size - 1 && (got = pread(descriptor, buffer + length, size - 1 - length, length)) != 0)
+	{
+		if(got == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		length += got;
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+/**
+ *
+ * \brief Function for parsing one line of the cache file
+ *
+ * \param line the line (not terminated)
+ * \param length the length of the line
+ * \param host the name looked for (NULL -> any)
+ * \param port the port looked for
+ * \param now the current time
+ * \param resolution receives the answer if the line is about host and port
+ *                   (NULL -> the line is only checked)
+ *
+ * \return 1 if the line is about host and port and still valid
+ * \return 0 if the line is about another name and still valid
+ * \return -1 if the line is expired or malformed
+ *
+ */
+static int ParseEntry(const char * line, size_t length, const char * host, const char * port, time_t now,
+	Resolution * resolution)
+{
+	char copy[RESOLVER_LINE_SIZE];
+	char * state = NULL;
+	char * end = NULL;
+	char * entryHost = NULL;
+	char * entryPort = NULL;
+	char * field = NULL;
+	long long expires = 0;
+	long error = 0;
+	int matches = 0;
+
+	if(length >= sizeof(copy))
+	{
+		return -1;
+	}
+	memcpy(copy, line, length);
+	copy[length] = '\0';
+
+	entryHost = strtok_r(copy, " ", &state);
+	entryPort = strtok_r(NULL, " ", &state);
+	field = strtok_r(NULL, " ", &state);
+	if(entryHost == NULL || entryPort == NULL || field == NULL)
+	{
+		return -1;
+	}
+	expires = strtoll(field, &end, 10);
+	if(end == field || *end != '\0' || expires <= (long long) now)
+	{
+		return -1;
+	}
+	field = strtok_r(NULL, " ", &state);
+	if(field == NULL)
+	{
+		return -1;
+	}
+	error = strtol(field, &end, 10);
+	if(end == field || *end != '\0')
+	{
+		return -1;
+	}
+
+	matches = host != NULL && strcasecmp(entryHost, host) == 0 && strcmp(entryPort, port) == 0;
+	if(!matches || resolution == NULL)
+	{
+		return matches;
+	}
+
+	memset(resolution, 0, sizeof(Resolution));
+	resolution->error = (int) error;
+	while((field = strtok_r(NULL, " ", &state)) != NULL && resolution->count < RESOLVER_MAX_ADDRESSES)
+	{
+		char * separator = strrchr(field, '/');
+
+		if(separator == NULL)
+			return -1;
+		*separator = '\0';
+		if(NumericAddress(field, separator + 1, &resolution->addresses[resolution->count]) == EXIT_FAILURE)
+			return -1;
+		resolution->count++;
+	}
+	if(resolution->error == 0 && resolution->count == 0)
+	{
+		return -1;
+	}
+	return 1;
+}
+
+/**
+ *
+ * \brief Function for formatting an answer as a line of the cache file
+ *
+ * \param line the buffer of the line (terminated with '\n')
+ * \param size the size of the buffer
+ * \param host the name of the server
+ * \param port the port of the server
+ * \param expires the time the answer expires
+ * \param resolution the answer
+ *
+ * \return EXIT_SUCCESS if the line fits into the buffer
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+static int FormatEntry(char * line, size_t size, const char * host, const char * port, time_t expires,
+	const Resolution * resolution)
+{
+	int length = snprintf(line, size, "%s %s %lld %d", host, port, (long long) expires, resolution->error);
+
+	for(int i = 0; i < resolution->count && length > 0 && (size_t) length < size; i++)
+	{
+		char address[NI_MAXHOST];
+		char service[NI_MAXSERV];
+
+		if(getnameinfo((const struct sockaddr *) &resolution->addresses[i].address, resolution->addresses[i].length,
+			address, sizeof(address), service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+		{
+			return EXIT_FAILURE;
+		}
+		length += snprintf(line + length, size - length, " %s/%s", address, service);
+	}
+	if(length <= 0 || (size_t) length + 1 >= size)
+	{
+		return EXIT_FAILURE;
+	}
+	line[length++] = '\n';
+	line[length] = '\0';
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for rewriting the cache file without its expired lines
+ *
+ * \param host the name whose line is replaced
+ * \param port the port whose line is replaced
+ * \param entry the new line of the name (NULL -> the name is dropped)
+ *
+ */
+static void RewriteCache(const char * host, const char * port, const char * entry)
+{
+	static char buffer[RESOLVER_CACHE_SIZE];
+	static char content[RESOLVER_CACHE_SIZE];
+	const char * lines[RESOLVER_MAX_ENTRIES];
+	size_t lengths[RESOLVER_MAX_ENTRIES];
+	int count = 0;
+	int first = 0;
+	size_t length = 0;
+	time_t now = time(NULL);
+	int descriptor = OpenCache(LOCK_EX);
+
+	if(descriptor == -1)
+	{
+		return;
+	}
+	ReadCache(descriptor, buffer, sizeof(buffer));
+
+	/* keep the newest valid lines, the new one is appended last */
+	for(char * line = buffer; *line != '\0'; )
+	{
+		char * end = strchr(line, '\n');
+		size_t lineLength = end != NULL ? (size_t) (end - line) : strlen(line);
+
+		if(end != NULL && ParseEntry(line, lineLength, host, port, now, NULL) == 0)
+		{
+			lines[count % RESOLVER_MAX_ENTRIES] = line;
+			lengths[count % RESOLVER_MAX_ENTRIES] = lineLength + 1;
+			count++;
+		}
+		line += end != NULL ? lineLength + 1 : lineLength;
+	}
+	if(entry != NULL && count >= RESOLVER_MAX_ENTRIES - 1)
+	{
+		first = count - (RESOLVER_MAX_ENTRIES - 1);
+	}
+	else if(count > RESOLVER_MAX_ENTRIES)
+	{
+		first = count - RESOLVER_MAX_ENTRIES;
+	}
+	for(int i = first; i < count; i++)
+	{
+		memcpy(content + length, lines[i % RESOLVER_MAX_ENTRIES], lengths[i % RESOLVER_MAX_ENTRIES]);
+		length += lengths[i % RESOLVER_MAX_ENTRIES];
+	}
+	if(entry != NULL && length + strlen(entry) <= sizeof(content))
+	{
+		memcpy(content + length, entry, strlen(entry));
+		length += strlen(entry);
+	}
+
+	if(pwrite(descriptor, content, length, 0) != (ssize_t) length || ftruncate(descriptor, length) == -1)
+	{
+		/* a damaged file only costs lookups, its lines do not parse */
+		if(ftruncate(descriptor, 0) == -1)
+		{
+			unlink(cachePath);
+		}
+	}
+	close(descriptor);
+}
+
+/**
+ *
+ * \brief Function for asking the resolver
+ *
+ * \param host the name of the server
+ * \param port the port of the server
+ * \param resolution receives the answer
+ *
+ */
+static void Resolve(const char * host, const char * port, Resolution * resolution)
+{
+	struct addrinfo hints;
+	struct addrinfo * result = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	/* only tcp */
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+
+	resolution->error = getaddrinfo(host, port, &hints, &result);
+	if(resolution->error != 0)
+	{
+		return;
+	}
+	for(struct addrinfo * current = result; current != NULL && resolution->count < RESOLVER_MAX_ADDRESSES;
+		current = current->ai_next)
+	{
+		ResolvedAddress * address = &resolution->addresses[resolution->count];
+
+		if(current->ai_addrlen > sizeof(address->address))
+			continue;
+		address->family = current->ai_family;
+		address->length = current->ai_addrlen;
+		memcpy(&address->address, current->ai_addr, current->ai_addrlen);
+		resolution->count++;
+	}
+	freeaddrinfo(result);
+	if(resolution->count == 0)
+	{
+		resolution->error = EAI_NONAME;
+	}
+}
+
+/**
+ *
+ * \brief Function for resolving the name of a server
+ *
+ * Overrides and numeric addresses come first, then the cache file, only
+ * then the resolver. Answers and names that definitely do not exist are
+ * written to the cache file; temporary failures are not.
+ *
+ * \param host the name or address of the server
+ * \param port the port of the server
+ * \param resolution receives the addresses or the error of getaddrinfo()
+ *
+ * \return EXIT_SUCCESS if there is at least one address
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+int ResolverLookup(const char * host, const char * port, Resolution * resolution)
+{
+	static char buffer[RESOLVER_CACHE_SIZE];
+	char entry[RESOLVER_LINE_SIZE];
+	time_t now = time(NULL);
+	int descriptor = -1;
+	int found = 0;
+
+	memset(resolution, 0, sizeof(Resolution));
+	for(int i = 0; i < overrideCount; i++)
+	{
+		if(strcasecmp(overrides[i].host, host) == 0 && strcmp(overrides[i].port, port) == 0)
+		{
+			resolution->addresses[0] = overrides[i].address;
+			resolution->count = 1;
+			resolution->cached = 1;
+			return EXIT_SUCCESS;
+		}
+	}
+	if(NumericAddress(host, port, &resolution->addresses[0]) == EXIT_SUCCESS)
+	{
+		resolution->count = 1;
+		return EXIT_SUCCESS;
+	}
+	if(!Cacheable(host, port))
+	{
+		Resolve(host, port, resolution);
+		return resolution->error == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	descriptor = OpenCache(LOCK_SH);
+	if(descriptor != -1)
+	{
+		size_t length = ReadCache(descriptor, buffer, sizeof(buffer));
+
+		close(descriptor);
+		for(char * line = buffer; line < buffer + length && !found; )
+		{
+			char * end = strchr(line, '\n');
+			size_t lineLength = end != NULL ? (size_t) (end - line) : strlen(line);
+
+			found = end != NULL && ParseEntry(line, lineLength, host, port, now, resolution) == 1;
+			line += lineLength + 1;
+		}
+	}
+	if(found)
+	{
+		resolution->cached = 1;
+		return resolution->error == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	memset(resolution, 0, sizeof(Resolution));
+	Resolve(host, port, resolution);
+	if(resolution->error == 0 || resolution->error == EAI_NONAME || resolution->error == EAI_FAIL
+#ifdef EAI_NODATA
+		|| resolution->error == EAI_NODATA
+#endif
+		)
+	{
+		unsigned int ttl = resolution->error == 0 || cacheTtl < RESOLVER_NEGATIVE_TTL ? cacheTtl : RESOLVER_NEGATIVE_TTL;
+
+		if(FormatEntry(entry, sizeof(entry), host, port, now + ttl, resolution) == EXIT_SUCCESS)
+		{
+			RewriteCache(host, port, entry);
+		}
+	}
+	return resolution->error == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Function for dropping the cached answer of a name
+ *
+ * Called when none of the cached addresses accepted a connection, so the
+ * next invocation asks the resolver again.
+ *
+ * \param host the name of the server
+ * \param port the port of the server
+ *
+ */
+void ResolverForget(const char * host, const char * port)
+{
+	if(Cacheable(host, port))
+	{
+		RewriteCache(host, port, NULL);
+	}
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,62 @@
+/*
+ * @file simple_message_resolver.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_RESOLVER_H
+#define SIMPLE_MESSAGE_RESOLVER_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define RESOLVER_MAX_ADDRESSES 8
+#define RESOLVER_DEFAULT_TTL 60
+#define RESOLVER_NEGATIVE_TTL 10
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* One address a host name resolved to, port included */
+typedef struct
+{
+	int family;
+	socklen_t length;
+	struct sockaddr_storage address;
+} ResolvedAddress;
+
+/* Result of a lookup */
+typedef struct
+{
+	int count;
+	ResolvedAddress addresses[RESOLVER_MAX_ADDRESSES];
+	int error;					/* EAI_* of getaddrinfo(), 0 on success */
+	int cached;					/* taken from an override or the cache file */
+} Resolution;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int ResolverOpen(const char * cacheFile, unsigned int ttl);
+int ResolverAddOverride(const char * override);
+int ResolverLookup(const char * host, const char * port, Resolution * resolution);
+void ResolverForget(const char * host, const char * port);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -11,18 +11,39 @@
  * -------------------------------------------------------------- includes --
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <getopt.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <spawn.h>
+#include <pthread.h>
+#include "simple_message_server.h"
+#include "simple_message_server_threadpool.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_affinity.h"
+#include "simple_message_server_master.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_accesslog.h"
+#include "simple_message_server_image.h"
+#include "simple_message_server_subscribe.h"
+#include "simple_message_server_pool.h"
+#include "simple_message_server_park.h"
+#include "simple_message_probes.h"
 
 /*
  * --------------------------------------------------------------- defines --
@@ -34,14 +55,121 @@
 #define SERVER_LOGIC_PATH "/usr/local/bin/simple_message_server_logic"
 #define SERVER_LOGIC_FILE "simple_message_server_logic"
 
+enum
+{
+	OPTION_ACCEPTOR_CPUS = 256,
+	OPTION_WORKER_CPUS,
+	OPTION_CHILD_CPUS,
+	OPTION_INCOMING_CPU,
+	OPTION_UNIX,
+	OPTION_BACKLOG,
+	OPTION_NODELAY,
+	OPTION_FASTOPEN,
+	OPTION_DEFER_ACCEPT,
+	OPTION_SNDBUF,
+	OPTION_RCVBUF,
+	OPTION_BUSY_POLL,
+	OPTION_ACCESS_LOG,
+	OPTION_DATA_DIR,
+	OPTION_RETAIN,
+	OPTION_IMAGE_CACHE,
+	OPTION_IMAGE_ROOT,
+	OPTION_IMAGE_MEMORY,
+	OPTION_KEEP_ALIVE,
+	OPTION_MAX_CONNECTIONS,
+	OPTION_MAX_REQUEST,
+	OPTION_IO_TIMEOUT
+};
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+typedef struct
+{
+	const char * port;		/* NULL -> no TCP listener */
+	const char * unixPath;	/* NULL -> no Unix domain listener */
+	int workers;	/* 0 -> no master process, serve in this process */
+	int threads;	/* 0 -> fork a logic process per connection */
+	int acceptors;
+	cpu_set_t acceptorCpus;	/* empty -> no pinning */
+	cpu_set_t workerCpus;	/* worker i is pinned to the i-th CPU of the set */
+	cpu_set_t childCpus;
+	bool incomingCpu;		/* steer connections by SO_INCOMING_CPU */
+	int backlog;
+	bool noDelay;
+	int fastOpen;			/* queue length of TCP Fast Open, 0 -> off */
+	int deferAccept;		/* seconds, 0 -> off */
+	int sendBuffer;			/* bytes, 0 -> kernel default */
+	int receiveBuffer;		/* bytes, 0 -> kernel default */
+	int busyPoll;			/* microseconds, 0 -> off */
+	const char * accessLog;	/* NULL -> no access log */
+	const char * dataDirectory;	/* NULL -> the board is kept in memory */
+	int retain;				/* newest messages kept in the store, 0 -> all */
+	const char * imageCache;	/* NULL -> processed images are kept in memory only */
+	const char * imageRoot;	/* NULL -> no local images are served */
+	int imageMemory;		/* MiB, 0 -> default */
+	int keepAlive;			/* seconds a framed connection waits for the next request */
+	int maxConnections;		/* connection objects of the pool, 0 -> one per worker thread */
+	int maxRequest;			/* bytes of the largest request served in-process */
+	int ioTimeout;			/* seconds to read a request and to send its response */
+} ServerOptions;
+
+/* Range and target of a numeric long option */
+typedef struct
+{
+	int option;
+	int minimum;
+	int maximum;
+	int * number;
+} NumericOption;
+
+typedef struct
+{
+	const Listeners * listeners;
+	ThreadPool * pool;
+	const ServerOptions * options;
+	int cpuToWorker[CPU_SETSIZE];	/* -1 if no worker is pinned to the CPU */
+} AcceptorArguments;
+
 /*
  * --------------------------------------------------------------- globals --
  */
 
+extern char ** environ;
+
 const char * programName;
 const char * usageText = 	"usage: simple_message_server options\n"
 							"options:\n"
 							"\t-p, --port <port>	port of the server [0..65535]\n"
+							"\t--unix <path>		listen on a Unix domain socket (alone or besides --port)\n"
+							"\t-w, --workers <n>	run a master process supervising n worker processes\n"
+							"\t			(SIGHUP/SIGUSR2: hot upgrade of the binary, SIGTERM: graceful stop)\n"
+							"\t-t, --threads <n>	serve in-process with n worker threads instead of forking\n"
+							"\t			(keeps the board in the process, at most one worker process)\n"
+							"\t-a, --acceptors <n>	number of accepting threads in threaded mode (default 1)\n"
+							"\t--acceptor-cpus <list>	pin accepting threads to a CPU list (e.g. 0-3,8 or node:0)\n"
+							"\t--worker-cpus <list>	pin each worker thread to one CPU of the list\n"
+							"\t--child-cpus <list>	pin spawned logic processes to a CPU list\n"
+							"\t--incoming-cpu		serve each connection on the CPU that received it (SO_INCOMING_CPU)\n"
+							"\t--backlog <n>		length of the listen queue (default 10)\n"
+							"\t--nodelay		disable Nagle's algorithm (TCP_NODELAY)\n"
+							"\t--fastopen <qlen>	enable TCP Fast Open with the given queue length\n"
+							"\t--defer-accept <s>	only accept connections once request data arrived (TCP_DEFER_ACCEPT)\n"
+							"\t--sndbuf <bytes>	size of the socket send buffer (SO_SNDBUF)\n"
+							"\t--rcvbuf <bytes>	size of the socket receive buffer (SO_RCVBUF)\n"
+							"\t--busy-poll <us>	busy poll the device queue on reads (SO_BUSY_POLL)\n"
+							"\t--access-log <path>	append one line per connection to the file\n"
+							"\t			(SIGUSR1: dump the counters of the process to stderr)\n"
+							"\t--data-dir <path>	persist the board in a store in the directory (needs --threads)\n"
+							"\t--retain <n>		keep only the newest n messages on the board\n"
+							"\t--image-root <path>	serve posted image paths below the directory (needs --threads)\n"
+							"\t--image-cache <path>	keep processed images in the directory across restarts\n"
+							"\t--image-memory <MiB>	bytes of processed images kept in memory (default 64)\n"
+							"\t--keep-alive <s>	keep connections of framed requests open while idle (default 5)\n"
+							"\t--max-connections <n>	preallocated connection objects (needs --threads, default: --threads)\n"
+							"\t--max-request <bytes>	largest request served in-process (default 16 MiB)\n"
+							"\t--io-timeout <s>	time to read a request and to send its response in-process (default 30)\n"
 							"\t-h, --help\n";
 
 /*
@@ -49,14 +177,23 @@ const char * usageText = 	"usage: simple_message_server options\n"
  */
 
 void PrintError(char * funcName, bool evalErrno, const char * message);
-int ParseCommandLine(int argc, const char * const argv[], const char **port);
+int ParseCommandLine(int argc, const char * const argv[], ServerOptions * options);
+int ParseNumber(const char * text, int minimum, int maximum, int * number);
 int CreateSignalHandler(void);
 void SignalHandler(int signal);
 int SpecifyAddrInfo(struct addrinfo * hints);
 int CloseSocketDescriptor(int socketDescriptor);
-int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, struct addrinfo ** addrInfoResultsPtr);
-int AcceptIncomingConnections(int socketDescriptor , struct addrinfo ** addrInfoResultsPtr);
-int Spawn(int socketDescriptor, int acceptedSocketDescriptor);
+int SetSocketOption(int socketDescriptor, int level, int name, int value, char * funcName);
+int ApplySocketOptions(int socketDescriptor, bool tcp, const ServerOptions * options);
+int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, struct addrinfo ** addrInfoResultsPtr, const ServerOptions * options);
+int CreateAndBindUnixSocket(const char * path, int * socketDescriptor, const ServerOptions * options);
+int AcceptConnection(const Listeners * listeners, int * listeningSocketDescriptor);
+int AcceptIncomingConnections(const Listeners * listeners, const ServerOptions * options);
+int Spawn(int socketDescriptor, int acceptedSocketDescriptor, const ServerOptions * options);
+bool ChildCpuSet(int acceptedSocketDescriptor, const ServerOptions * options, cpu_set_t * cpus);
+int AcceptIncomingConnectionsThreaded(const Listeners * listeners, const ServerOptions * options);
+void * AcceptorMain(void * argument);
+int ServeListeners(const Listeners * listeners, void * argument);
 
 /*
  * ------------------------------------------------------------- functions --
@@ -93,24 +230,99 @@ void PrintError(char * funcName, bool evalErrno, const char * message)
 	fprintf(stderr, "\n");
 }
 
+/**
+ *
+ * \brief Function for parsing a decimal number within a range
+ *
+ * \param text the text that shall be parsed
+ * \param minimum the smallest allowed value
+ * \param maximum the biggest allowed value
+ * \param number the parsed number
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ParseNumber(const char * text, int minimum, int maximum, int * number)
+{
+	char * end = NULL;
+	long value = 0;
+
+	errno = 0;
+	value = strtol(text, &end, 10);
+	if(errno != 0 || end == text || *end != '\0' || value < minimum || value > maximum)
+	{
+		return EXIT_FAILURE;
+	}
+	*number = (int) value;
+	return EXIT_SUCCESS;
+}
+
 /**
  *
  * \brief Function for parsing the command line arguments
  *
  * \param argc the number of arguments
  * \param argv the arguments itselves
- * \param port the port the server shall be bound to
+ * \param options the parsed options (port, threading mode)
  *
  */
-int ParseCommandLine(int argc, const char * const argv[], const char **port)
+int ParseCommandLine(int argc, const char * const argv[], ServerOptions * options)
 {
     int c;
+    size_t i = 0;
+    const NumericOption numericOptions[] =
+    {
+        {OPTION_BACKLOG, 1, INT_MAX, &options->backlog},
+        {OPTION_FASTOPEN, 0, INT_MAX, &options->fastOpen},
+        {OPTION_DEFER_ACCEPT, 0, INT_MAX, &options->deferAccept},
+        {OPTION_SNDBUF, 0, INT_MAX, &options->sendBuffer},
+        {OPTION_RCVBUF, 0, INT_MAX, &options->receiveBuffer},
+        {OPTION_BUSY_POLL, 0, INT_MAX, &options->busyPoll},
+        {OPTION_RETAIN, 0, INT_MAX, &options->retain},
+        {OPTION_IMAGE_MEMORY, 0, 65536, &options->imageMemory},
+        {OPTION_KEEP_ALIVE, 0, 3600, &options->keepAlive},
+        {OPTION_MAX_CONNECTIONS, 1, 65536, &options->maxConnections},
+        {OPTION_MAX_REQUEST, 1024, INT_MAX, &options->maxRequest},
+        {OPTION_IO_TIMEOUT, 1, 3600, &options->ioTimeout}
+    };
 
-    *port = NULL;
+    memset(options, 0, sizeof(ServerOptions));
+    options->acceptors = 1;
+    options->backlog = BACKLOG;
+    options->keepAlive = KEEP_ALIVE_DEFAULT;
+    options->maxRequest = REQUEST_MAX_DEFAULT;
+    options->ioTimeout = IO_TIMEOUT_DEFAULT;
 
     struct option long_options[] =
     {
         {"port", 1, NULL, 'p'},
+        {"unix", 1, NULL, OPTION_UNIX},
+        {"backlog", 1, NULL, OPTION_BACKLOG},
+        {"nodelay", 0, NULL, OPTION_NODELAY},
+        {"fastopen", 1, NULL, OPTION_FASTOPEN},
+        {"defer-accept", 1, NULL, OPTION_DEFER_ACCEPT},
+        {"sndbuf", 1, NULL, OPTION_SNDBUF},
+        {"rcvbuf", 1, NULL, OPTION_RCVBUF},
+        {"busy-poll", 1, NULL, OPTION_BUSY_POLL},
+        {"access-log", 1, NULL, OPTION_ACCESS_LOG},
+        {"data-dir", 1, NULL, OPTION_DATA_DIR},
+        {"retain", 1, NULL, OPTION_RETAIN},
+        {"image-cache", 1, NULL, OPTION_IMAGE_CACHE},
+        {"image-root", 1, NULL, OPTION_IMAGE_ROOT},
+        {"image-memory", 1, NULL, OPTION_IMAGE_MEMORY},
+        {"keep-alive", 1, NULL, OPTION_KEEP_ALIVE},
+        {"max-connections", 1, NULL, OPTION_MAX_CONNECTIONS},
+        {"max-request", 1, NULL, OPTION_MAX_REQUEST},
+        {"io-timeout", 1, NULL, OPTION_IO_TIMEOUT},
+        {"workers", 1, NULL, 'w'},
+        {"threads", 1, NULL, 't'},
+        {"acceptors", 1, NULL, 'a'},
+        {"acceptor-cpus", 1, NULL, OPTION_ACCEPTOR_CPUS},
+        {"worker-cpus", 1, NULL, OPTION_WORKER_CPUS},
+        {"child-cpus", 1, NULL, OPTION_CHILD_CPUS},
+        {"incoming-cpu", 0, NULL, OPTION_INCOMING_CPU},
+        {"help", 0, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
@@ -118,7 +330,7 @@ int ParseCommandLine(int argc, const char * const argv[], const char **port)
         (c = getopt_long(
              argc,
              (char ** const) argv,
-             "p:h",
+             "p:w:t:a:h",
              long_options,
              NULL
              )
@@ -128,7 +340,96 @@ int ParseCommandLine(int argc, const char * const argv[], const char **port)
         switch (c)
         {
             case 'p':
-                *port = optarg;
+                options->port = optarg;
+                break;
+
+            case 'w':
+                if(ParseNumber(optarg, 1, 4096, &options->workers) == EXIT_FAILURE)
+                {
+                	fprintf(stderr, "%s" ,usageText);
+                	return EXIT_FAILURE;
+                }
+                break;
+
+            case 't':
+                if(ParseNumber(optarg, 1, 4096, &options->threads) == EXIT_FAILURE)
+                {
+                	fprintf(stderr, "%s" ,usageText);
+                	return EXIT_FAILURE;
+                }
+                break;
+
+            case 'a':
+                if(ParseNumber(optarg, 1, 64, &options->acceptors) == EXIT_FAILURE)
+                {
+                	fprintf(stderr, "%s" ,usageText);
+                	return EXIT_FAILURE;
+                }
+                break;
+
+            case OPTION_ACCEPTOR_CPUS:
+            case OPTION_WORKER_CPUS:
+            case OPTION_CHILD_CPUS:
+                if(ParseCpuList(optarg,
+                				c == OPTION_ACCEPTOR_CPUS ? &options->acceptorCpus :
+                				c == OPTION_WORKER_CPUS ? &options->workerCpus : &options->childCpus) == EXIT_FAILURE)
+                {
+                	fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+                	fprintf(stderr, "%s" ,usageText);
+                	return EXIT_FAILURE;
+                }
+                break;
+
+            case OPTION_INCOMING_CPU:
+                options->incomingCpu = true;
+                break;
+
+            case OPTION_UNIX:
+                options->unixPath = optarg;
+                break;
+
+            case OPTION_NODELAY:
+                options->noDelay = true;
+                break;
+
+            case OPTION_ACCESS_LOG:
+                options->accessLog = optarg;
+                break;
+
+            case OPTION_DATA_DIR:
+                options->dataDirectory = optarg;
+                break;
+
+            case OPTION_IMAGE_CACHE:
+                options->imageCache = optarg;
+                break;
+
+            case OPTION_IMAGE_ROOT:
+                options->imageRoot = optarg;
+                break;
+
+            case OPTION_BACKLOG:
+            case OPTION_FASTOPEN:
+            case OPTION_DEFER_ACCEPT:
+            case OPTION_SNDBUF:
+            case OPTION_RCVBUF:
+            case OPTION_BUSY_POLL:
+            case OPTION_RETAIN:
+            case OPTION_IMAGE_MEMORY:
+            case OPTION_KEEP_ALIVE:
+            case OPTION_MAX_CONNECTIONS:
+            case OPTION_MAX_REQUEST:
+            case OPTION_IO_TIMEOUT:
+                // The case labels above are exactly the options of the table
+                for(i = 0; numericOptions[i].option != c; i++)
+                {
+                }
+                if(ParseNumber(optarg, numericOptions[i].minimum, numericOptions[i].maximum,
+                				numericOptions[i].number) == EXIT_FAILURE)
+                {
+                	fprintf(stderr, "%s" ,usageText);
+                	return EXIT_FAILURE;
+                }
                 break;
 
             case 'h':
@@ -144,8 +445,40 @@ int ParseCommandLine(int argc, const char * const argv[], const char **port)
         }
     }
 
-    if ( (optind != argc) || (*port == NULL) )
+    if ( (optind != argc) || (options->port == NULL && options->unixPath == NULL) )
+    {
+    	fprintf(stderr, "%s" ,usageText);
+    	return EXIT_FAILURE;
+    }
+
+    // The board of the threaded server lives in its process, worker processes would not share it
+    if (options->threads > 0 && options->workers > 1)
+    {
+    	fprintf(stderr, "--threads allows at most one worker process\n");
+    	fprintf(stderr, "%s" ,usageText);
+    	return EXIT_FAILURE;
+    }
+
+    // The store belongs to the process handling the requests in-process
+    if (options->dataDirectory != NULL && options->threads == 0)
+    {
+    	fprintf(stderr, "--data-dir needs --threads\n");
+    	fprintf(stderr, "%s" ,usageText);
+    	return EXIT_FAILURE;
+    }
+
+    // Forked logic processes answer with their own image
+    if ((options->imageRoot != NULL || options->imageCache != NULL) && options->threads == 0)
+    {
+    	fprintf(stderr, "--image-root and --image-cache need --threads\n");
+    	fprintf(stderr, "%s" ,usageText);
+    	return EXIT_FAILURE;
+    }
+
+    // Only connections served in-process take an object of the pool
+    if (options->maxConnections > 0 && options->threads == 0)
     {
+    	fprintf(stderr, "--max-connections needs --threads\n");
     	fprintf(stderr, "%s" ,usageText);
     	return EXIT_FAILURE;
     }
@@ -182,9 +515,16 @@ int CreateSignalHandler()
  */
 void SignalHandler(int signal)
 {
-	while (waitpid(-1, NULL, WNOHANG) > 0);
+	pid_t pid = 0;
+	int status = 0;
+
+	(void) signal;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+	{
+		PROBE2(spawn_exit, pid, status);
+	}
 	// -1 ... any child process
-	// NULL ... we don't need detailed information from waitpid
+	// status ... only passed on to the spawn_exit probe
 	// WNNOHANG ... waitpid returns immediately if no child has exited
 }
 
@@ -231,6 +571,81 @@ int CloseSocketDescriptor(int socketDescriptor)
 	return EXIT_FAILURE;
 }
 
+/**
+ *
+ * \brief Function for setting an integer socket option
+ *
+ * \param socketDescriptor the descriptor of the socket
+ * \param level the protocol level of the option
+ * \param name the name of the option
+ * \param value the value of the option
+ * \param funcName the name of the option used in error messages
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int SetSocketOption(int socketDescriptor, int level, int name, int value, char * funcName)
+{
+	if(setsockopt(socketDescriptor, level, name, &value, sizeof(value)) == -1)
+	{
+		PrintError(funcName, true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for applying the tuning options to a listening socket
+ *
+ * The options are set before listen() so accepted connections inherit
+ * them (buffer sizes, TCP_NODELAY, SO_BUSY_POLL).
+ *
+ * \param socketDescriptor the descriptor of the listening socket
+ * \param tcp true for a TCP socket, false for a Unix domain socket
+ * \param options the parsed command line options
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ApplySocketOptions(int socketDescriptor, bool tcp, const ServerOptions * options)
+{
+	int r = EXIT_SUCCESS;
+
+	if(options->sendBuffer > 0)
+	{
+		r |= SetSocketOption(socketDescriptor, SOL_SOCKET, SO_SNDBUF, options->sendBuffer, "ApplySocketOptions() -> setsockopt(SO_SNDBUF)");
+	}
+	if(options->receiveBuffer > 0)
+	{
+		r |= SetSocketOption(socketDescriptor, SOL_SOCKET, SO_RCVBUF, options->receiveBuffer, "ApplySocketOptions() -> setsockopt(SO_RCVBUF)");
+	}
+	if(!tcp)
+	{
+		return r;
+	}
+
+	if(options->noDelay)
+	{
+		r |= SetSocketOption(socketDescriptor, IPPROTO_TCP, TCP_NODELAY, 1, "ApplySocketOptions() -> setsockopt(TCP_NODELAY)");
+	}
+	if(options->fastOpen > 0)
+	{
+		r |= SetSocketOption(socketDescriptor, IPPROTO_TCP, TCP_FASTOPEN, options->fastOpen, "ApplySocketOptions() -> setsockopt(TCP_FASTOPEN)");
+	}
+	if(options->deferAccept > 0)
+	{
+		r |= SetSocketOption(socketDescriptor, IPPROTO_TCP, TCP_DEFER_ACCEPT, options->deferAccept, "ApplySocketOptions() -> setsockopt(TCP_DEFER_ACCEPT)");
+	}
+	if(options->busyPoll > 0)
+	{
+		r |= SetSocketOption(socketDescriptor, SOL_SOCKET, SO_BUSY_POLL, options->busyPoll, "ApplySocketOptions() -> setsockopt(SO_BUSY_POLL)");
+	}
+	return r;
+}
+
 /**
  *
  * \brief Function for creating and binding a listening socket
@@ -238,12 +653,13 @@ int CloseSocketDescriptor(int socketDescriptor)
  * \param port of the server
  * \param socketDescriptor the descriptor of the socket that shall be bound
  * \param addrInfoResultsPtr the pointer to the address info results
+ * \param options the parsed command line options
  *
  * \return EXIT_SUCCESS in case of success
  * \return EXIT_FAILURE in case of failure
  *
  */
-int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, struct addrinfo ** addrInfoResultsPtr)
+int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, struct addrinfo ** addrInfoResultsPtr, const ServerOptions * options)
 {
 	struct addrinfo addrInfoSettings;
 	struct addrinfo * addrInfoResults;
@@ -266,8 +682,9 @@ int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, stru
 		*addrInfoResultsPtr != NULL;
 		*addrInfoResultsPtr = (*addrInfoResultsPtr)->ai_next)
 	{
+		// Listeners are polled (non-blocking) and must not leak into the logic process
 		*socketDescriptor = socket((*addrInfoResultsPtr)->ai_family,
-									(*addrInfoResultsPtr)->ai_socktype,
+									(*addrInfoResultsPtr)->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
 									(*addrInfoResultsPtr)->ai_protocol);
 		if(*socketDescriptor == -1)
 		{
@@ -299,7 +716,13 @@ int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, stru
 	freeaddrinfo(addrInfoResults);
 	addrInfoResults = NULL;
 
-	if(listen(*socketDescriptor, BACKLOG) == -1)
+	if(ApplySocketOptions(*socketDescriptor, true, options) == EXIT_FAILURE)
+	{
+		PrintError("CreateAndBindSocket() -> ApplySocketOptions()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	if(listen(*socketDescriptor, options->backlog) == -1)
 	{
 		PrintError("CreateAndBindSocket() -> listen()", true, NULL);
 		return EXIT_FAILURE;
@@ -308,33 +731,190 @@ int CreateAndBindListeningSocket(const char * port, int * socketDescriptor, stru
 	return EXIT_SUCCESS;
 }
 
+/**
+ *
+ * \brief Function for creating and binding a listening Unix domain socket
+ *
+ * A stale socket file of a previous run is removed before binding.
+ *
+ * \param path the file system path of the socket
+ * \param socketDescriptor the descriptor of the socket that shall be bound
+ * \param options the parsed command line options
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int CreateAndBindUnixSocket(const char * path, int * socketDescriptor, const ServerOptions * options)
+{
+	struct sockaddr_un address;
+	struct stat fileStatus;
+
+	if(strlen(path) >= sizeof(address.sun_path))
+	{
+		PrintError("CreateAndBindUnixSocket()", false, "Path of the socket is too long");
+		return EXIT_FAILURE;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if(lstat(path, &fileStatus) == 0 && S_ISSOCK(fileStatus.st_mode))
+	{
+		unlink(path);
+	}
+
+	*socketDescriptor = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(*socketDescriptor == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> socket()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	if(bind(*socketDescriptor, (struct sockaddr *) &address, sizeof(address)) == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> bind()", true, path);
+		CloseSocketDescriptor(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	if(ApplySocketOptions(*socketDescriptor, false, options) == EXIT_FAILURE)
+	{
+		PrintError("CreateAndBindUnixSocket() -> ApplySocketOptions()", false, NULL);
+		CloseSocketDescriptor(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	if(listen(*socketDescriptor, options->backlog) == -1)
+	{
+		PrintError("CreateAndBindUnixSocket() -> listen()", true, NULL);
+		CloseSocketDescriptor(*socketDescriptor);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for accepting the next connection on any listener
+ *
+ * Several acceptors may wait on the same listeners, so a listener that is
+ * already drained by someone else (EAGAIN) is simply polled again. In
+ * threaded mode the parked keep-alive connections are polled as well, one
+ * that became readable is returned like a new one.
+ *
+ * \param listeners the listening sockets
+ * \param listeningSocketDescriptor the listener the connection came from, -1 for a parked one
+ *
+ * \return the descriptor of the accepted connection
+ * \return -1 in case of failure or if a graceful stop was requested
+ *
+ */
+int AcceptConnection(const Listeners * listeners, int * listeningSocketDescriptor)
+{
+	struct pollfd pollDescriptors[MAX_LISTENERS + 2];
+	int acceptedSocketDescriptor = -1;
+
+	for(int i = 0; i < listeners->count; i++)
+	{
+		pollDescriptors[i].fd = listeners->descriptors[i];
+		pollDescriptors[i].events = POLLIN;
+	}
+	// The stop pipe (if any) wakes up all acceptors on a graceful stop
+	pollDescriptors[listeners->count].fd = GetStopDescriptor();
+	pollDescriptors[listeners->count].events = POLLIN;
+	// The parked connections (if any), a negative descriptor is ignored
+	pollDescriptors[listeners->count + 1].fd = ParkDescriptor();
+	pollDescriptors[listeners->count + 1].events = POLLIN;
+
+	for(;;)
+	{
+		if(StopRequested())
+		{
+			return -1;
+		}
+
+		if(poll(pollDescriptors, listeners->count + 2, -1) == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PrintError("AcceptConnection() -> poll()", true, NULL);
+			return -1;
+		}
+
+		if((pollDescriptors[listeners->count + 1].revents & POLLIN) != 0)
+		{
+			acceptedSocketDescriptor = ParkResume();
+			if(acceptedSocketDescriptor != -1)
+			{
+				PROBE1(connection_resumed, acceptedSocketDescriptor);
+				*listeningSocketDescriptor = -1;
+				return acceptedSocketDescriptor;
+			}
+		}
+
+		for(int i = 0; i < listeners->count; i++)
+		{
+			if((pollDescriptors[i].revents & POLLIN) == 0)
+			{
+				continue;
+			}
+
+			acceptedSocketDescriptor = accept(pollDescriptors[i].fd, NULL, NULL);
+			if(acceptedSocketDescriptor != -1)
+			{
+				PROBE1(server_accept, acceptedSocketDescriptor);
+				MetricsAdd(METRIC_CONNECTIONS_ACCEPTED, 1);
+				*listeningSocketDescriptor = pollDescriptors[i].fd;
+				return acceptedSocketDescriptor;
+			}
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+			{
+				PrintError("AcceptConnection() -> accept()", true, NULL);
+				return -1;
+			}
+		}
+	}
+}
+
 /**
  *
  * \brief Function for accepting incoming connections
  *
- * \param socketDescriptor the descriptor of the bound socket
- * \param addrInfoResultsPtr the pointer to the address info results
+ * \param listeners the listening sockets
+ * \param options the parsed command line options
  *
  * \return EXIT_SUCCESS in case of success
  * \return EXIT_FAILURE in case of failure
  *
  */
-int AcceptIncomingConnections(int socketDescriptor , struct addrinfo ** addrInfoResultsPtr)
+int AcceptIncomingConnections(const Listeners * listeners, const ServerOptions * options)
 {
 	int acceptedSocketDescriptor = 0;
+	int socketDescriptor = -1;
 
 	for(;;)
 	{
 		// Accept incoming connection
-		acceptedSocketDescriptor = accept(socketDescriptor, (*addrInfoResultsPtr)->ai_addr, &((*addrInfoResultsPtr)->ai_addrlen));
+		acceptedSocketDescriptor = AcceptConnection(listeners, &socketDescriptor);
+		if(acceptedSocketDescriptor == -1 && StopRequested())
+		{
+			// Graceful stop -> let the running logic processes finish
+			WaitForChildren();
+			return EXIT_SUCCESS;
+		}
 		if(acceptedSocketDescriptor == -1)
 		{
-			PrintError("AcceptIncomingConnections() -> accept()", true, NULL);
+			PrintError("AcceptIncomingConnections() -> AcceptConnection()", false, NULL);
 			return EXIT_FAILURE;
 		}
 
 		// Fork new process and execute business logic
-		if(Spawn(socketDescriptor, acceptedSocketDescriptor) == EXIT_FAILURE)
+		if(Spawn(socketDescriptor, acceptedSocketDescriptor, options) == EXIT_FAILURE)
 		{
 			PrintError("AcceptIncomingConnections() -> Spawn()", false, NULL);
 			return EXIT_FAILURE;
@@ -345,81 +925,428 @@ int AcceptIncomingConnections(int socketDescriptor , struct addrinfo ** addrInfo
 
 /**
  *
- * \brief Spawn function for executing server logic in a forked process
+ * \brief Function for choosing the CPUs a spawned logic process may run on
+ *
+ * With --incoming-cpu the child follows the CPU that received the
+ * connection, as long as that CPU is part of --child-cpus (if given).
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ * \param options the parsed command line options
+ * \param cpus the CPUs for the child
+ *
+ * \return true if the child shall be pinned
+ *
+ */
+bool ChildCpuSet(int acceptedSocketDescriptor, const ServerOptions * options, cpu_set_t * cpus)
+{
+	int incomingCpu = -1;
+
+	if(options->incomingCpu)
+	{
+		incomingCpu = GetIncomingCpu(acceptedSocketDescriptor);
+		if(incomingCpu >= 0 && incomingCpu < CPU_SETSIZE &&
+			(CPU_COUNT(&options->childCpus) == 0 || CPU_ISSET(incomingCpu, &options->childCpus)))
+		{
+			CPU_ZERO(cpus);
+			CPU_SET(incomingCpu, cpus);
+			return true;
+		}
+	}
+
+	*cpus = options->childCpus;
+	return CPU_COUNT(cpus) > 0;
+}
+
+/**
+ *
+ * \brief Spawn function for executing server logic in a new process
+ *
+ * posix_spawn() creates the process without copying the page tables of
+ * the server (vfork semantics), so the cost stays the same when the
+ * server grows. The redirection of stdin/stdout is done by file actions,
+ * the listening sockets are closed on exec (SOCK_CLOEXEC).
  *
  * \param socketDescriptor the descriptor of the bound socket
  * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ * \param options the parsed command line options
  *
  * \return EXIT_SUCCESS in case of success
  * \return EXIT_FAILURE in case of failure
  *
  */
-int Spawn(int socketDescriptor, int acceptedSocketDescriptor)
+int Spawn(int socketDescriptor, int acceptedSocketDescriptor, const ServerOptions * options)
 {
 	pid_t pid = -1;
-	pid = fork();
+	cpu_set_t childCpus;
+	cpu_set_t ownCpus;
+	bool pinChild = ChildCpuSet(acceptedSocketDescriptor, options, &childCpus);
+	posix_spawn_file_actions_t fileActions;
+	posix_spawnattr_t attributes;
+	sigset_t signalMask;
+	char * const arguments[] = { SERVER_LOGIC_FILE, NULL };
+	AccessRecord record;
+	int r = 0;
+
+	// The logic process handles the request, so only the hand over is logged
+	AccessLogBegin(&record, acceptedSocketDescriptor);
 
-	if(pid == -1)
+	if(posix_spawn_file_actions_init(&fileActions) != 0)
+	{
+		PrintError("Spawn() -> posix_spawn_file_actions_init()", false, NULL);
+		CloseSocketDescriptor(acceptedSocketDescriptor);
+		CloseSocketDescriptor(socketDescriptor);
+		return EXIT_FAILURE;
+	}
+	if(posix_spawnattr_init(&attributes) != 0)
 	{
-		PrintError("main() -> fork()", true, NULL);
+		PrintError("Spawn() -> posix_spawnattr_init()", false, NULL);
+		posix_spawn_file_actions_destroy(&fileActions);
 		CloseSocketDescriptor(acceptedSocketDescriptor);
 		CloseSocketDescriptor(socketDescriptor);
 		return EXIT_FAILURE;
 	}
 
-	if(pid == 0) 	// Child process
+	// Redirect stdin and stdout, then close the unneeded descriptor
+	r |= posix_spawn_file_actions_adddup2(&fileActions, acceptedSocketDescriptor, STDIN_FILENO);
+	r |= posix_spawn_file_actions_adddup2(&fileActions, acceptedSocketDescriptor, STDOUT_FILENO);
+	if(acceptedSocketDescriptor > STDERR_FILENO)
+	{
+		r |= posix_spawn_file_actions_addclose(&fileActions, acceptedSocketDescriptor);
+	}
+
+	// The logic process starts with no blocked signals, whatever the calling thread blocks,
+	// and with default dispositions for the signals a worker ignores
+	sigemptyset(&signalMask);
+	r |= posix_spawnattr_setsigmask(&attributes, &signalMask);
+	sigaddset(&signalMask, SIGHUP);
+	sigaddset(&signalMask, SIGUSR1);
+	sigaddset(&signalMask, SIGUSR2);
+	sigaddset(&signalMask, SIGPIPE);
+	r |= posix_spawnattr_setsigdefault(&attributes, &signalMask);
+	r |= posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	// The logic process inherits the CPUs of the (single threaded) accepting process,
+	// so it runs on the configured ones from its first instruction (failure is not fatal)
+	if(pinChild && (sched_getaffinity(0, sizeof(ownCpus), &ownCpus) == -1 || PinProcess(0, &childCpus) == EXIT_FAILURE))
+	{
+		pinChild = false;
+	}
+
+	if(r == 0)
+	{
+		// Execute server logic program
+		PROBE1(spawn_start, acceptedSocketDescriptor);
+		r = posix_spawn(&pid, SERVER_LOGIC_PATH, &fileActions, &attributes, arguments, environ);
+	}
+	if(pinChild)
+	{
+		PinProcess(0, &ownCpus);
+	}
+	posix_spawn_file_actions_destroy(&fileActions);
+	posix_spawnattr_destroy(&attributes);
+
+	if(r != 0)
+	{
+		// Like a failing exec in a forked child this only costs this connection
+		errno = r;
+		PrintError("Spawn() -> posix_spawn()", true, SERVER_LOGIC_PATH);
+		MetricsAdd(METRIC_REQUESTS_FAILED, 1);
+	}
+	else
+	{
+		// posix_spawn() returns once the logic program is executed
+		PROBE2(spawn_exec, acceptedSocketDescriptor, pid);
+	}
+
+	if(AccessLogEnabled())
+	{
+		record.status = r == 0 ? ACCESS_STATUS_SPAWNED : EXIT_FAILURE;
+		AccessLogCommit(&record);
+	}
+
+	// Parent process -> close unneeded descriptor
+	if (close(acceptedSocketDescriptor) == -1)
+	{
+		PrintError("Spawn() -> close()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Main function of an accepting thread in threaded mode
+ *
+ * \param argument the AcceptorArguments of the thread
+ *
+ * \return always NULL, the thread only returns if accept() fails
+ *
+ */
+void * AcceptorMain(void * argument)
+{
+	AcceptorArguments * arguments = argument;
+	int acceptedSocketDescriptor = -1;
+	int socketDescriptor = -1;
+	int incomingCpu = -1;
+	int r = 0;
+
+	for(;;)
 	{
-		// Close unneeded descriptor
-		if (CloseSocketDescriptor(socketDescriptor) == EXIT_FAILURE)
+		acceptedSocketDescriptor = AcceptConnection(arguments->listeners, &socketDescriptor);
+		if(acceptedSocketDescriptor == -1)
 		{
-			PrintError("Child process: Spawn() -> CloseSocketDescriptor(socketDescriptor)", true, NULL);
-			CloseSocketDescriptor(acceptedSocketDescriptor);
-			_Exit(EXIT_FAILURE);
+			if(!StopRequested())
+			{
+				PrintError("AcceptorMain() -> AcceptConnection()", false, NULL);
+			}
+			return NULL;
 		}
 
-		// Redirect stdin
-		if (dup2(acceptedSocketDescriptor, STDIN_FILENO) == -1)
+		// Hand the connection to the worker on the CPU that received it, if any
+		incomingCpu = arguments->options->incomingCpu ? GetIncomingCpu(acceptedSocketDescriptor) : -1;
+		if(incomingCpu >= 0 && incomingCpu < CPU_SETSIZE && arguments->cpuToWorker[incomingCpu] >= 0)
 		{
-			PrintError("Child process: Spawn() -> dup2()", true, NULL);
-			CloseSocketDescriptor(acceptedSocketDescriptor);
-			CloseSocketDescriptor(socketDescriptor);
-			_Exit(EXIT_FAILURE);
+			r = ThreadPoolSubmitTo(arguments->pool, arguments->cpuToWorker[incomingCpu], acceptedSocketDescriptor);
+		}
+		else
+		{
+			r = ThreadPoolSubmit(arguments->pool, acceptedSocketDescriptor);
 		}
 
-		// Redirect stdout
-		if (dup2(acceptedSocketDescriptor, STDOUT_FILENO) == -1)
+		if(r == EXIT_FAILURE)
 		{
-			PrintError("Child process: Spawn() -> dup2()", true, NULL);
+			PrintError("AcceptorMain() -> ThreadPoolSubmit()", false, NULL);
+			ParkTake(acceptedSocketDescriptor);
 			CloseSocketDescriptor(acceptedSocketDescriptor);
-			CloseSocketDescriptor(socketDescriptor);
-			close(STDIN_FILENO);
-			_Exit(EXIT_FAILURE);
 		}
+	}
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for serving connections in-process with a work stealing thread pool
+ *
+ * The acceptor threads push accepted connections round robin into the
+ * deques of the workers, idle workers steal from busy ones.
+ *
+ * \param listeners the listening sockets
+ * \param options the parsed command line options
+ *
+ * \return EXIT_SUCCESS after a graceful stop
+ * \return EXIT_FAILURE if all acceptors failed
+ *
+ */
+int AcceptIncomingConnectionsThreaded(const Listeners * listeners, const ServerOptions * options)
+{
+	ThreadPool pool;
+	AcceptorArguments * arguments = NULL;
+	pthread_t acceptors[options->acceptors];
+	int started = 0;
+	int r = 0;
+
+	if(ThreadPoolCreate(&pool, options->threads, HandleConnection) == EXIT_FAILURE)
+	{
+		PrintError("AcceptIncomingConnectionsThreaded() -> ThreadPoolCreate()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	// Idle keep-alive connections wait with the acceptors, not in a worker
+	if(options->keepAlive > 0 && ParkOpen(options->keepAlive) == EXIT_FAILURE)
+	{
+		PrintError("AcceptIncomingConnectionsThreaded() -> ParkOpen()", false, NULL);
+		ThreadPoolDestroy(&pool);
+		return EXIT_FAILURE;
+	}
+
+	arguments = malloc(sizeof(AcceptorArguments));
+	if(arguments == NULL)
+	{
+		PrintError("AcceptIncomingConnectionsThreaded() -> malloc()", true, NULL);
+		ThreadPoolDestroy(&pool);
+		ParkClose();
+		return EXIT_FAILURE;
+	}
+	arguments->listeners = listeners;
+	arguments->pool = &pool;
+	arguments->options = options;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		arguments->cpuToWorker[cpu] = -1;
+	}
 
-		// Close unneeded descriptor
-		if (CloseSocketDescriptor(acceptedSocketDescriptor) == EXIT_FAILURE)
+	// Pin every worker to one CPU and remember which worker owns which CPU
+	if(CPU_COUNT(&options->workerCpus) > 0)
+	{
+		for(int i = 0; i < pool.workerCount; i++)
 		{
-			PrintError("Child process: Spawn() -> CloseSocketDescriptor(acceptedSocketDescriptor)", true, NULL);
-			CloseSocketDescriptor(socketDescriptor);
-			close(STDIN_FILENO);
-			close(STDOUT_FILENO);
-			_Exit(EXIT_FAILURE);
+			int cpu = NthCpu(&options->workerCpus, i);
+			if(PinThreadToCpu(pool.workers[i].thread, cpu) == EXIT_SUCCESS && arguments->cpuToWorker[cpu] == -1)
+			{
+				arguments->cpuToWorker[cpu] = i;
+			}
 		}
+	}
 
-		// Execute server logic program
-		execl(SERVER_LOGIC_PATH, SERVER_LOGIC_FILE, (char *) NULL);
+	for(started = 0; started < options->acceptors; started++)
+	{
+		r = pthread_create(&acceptors[started], NULL, AcceptorMain, arguments);
+		if(r != 0)
+		{
+			errno = r;
+			PrintError("AcceptIncomingConnectionsThreaded() -> pthread_create()", true, NULL);
+			break;
+		}
+		if(CPU_COUNT(&options->acceptorCpus) > 0)
+		{
+			PinThread(acceptors[started], &options->acceptorCpus);
+		}
+	}
 
-		// Child process is not allowed to reach this point
-		PrintError("Spawn()", true, "Child process reached unallowed code region");
-		_Exit(EXIT_FAILURE);
+	// Acceptors only return on a graceful stop or a fatal accept() error
+	for(int i = 0; i < started; i++)
+	{
+		pthread_join(acceptors[i], NULL);
 	}
 
-	// No error and not child process -> parent process -> close unneeded descriptor
-	if (close(acceptedSocketDescriptor) == -1)
+	// Serves the connections that are still queued, then drops the parked ones
+	ThreadPoolDestroy(&pool);
+	ParkClose();
+	free(arguments);
+	return StopRequested() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Function for serving the listeners until a graceful stop
+ *
+ * Runs in the server process itself or in each worker of the master.
+ *
+ * \param listeners the listening sockets
+ * \param argument the parsed command line options (ServerOptions)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ServeListeners(const Listeners * listeners, void * argument)
+{
+	const ServerOptions * options = argument;
+	int r = EXIT_SUCCESS;
+
+	// Create signal handler to prevent child processes from becoming zombie processes
+	if(CreateSignalHandler() == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> CreateSignalHandler()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// SIGTERM/SIGINT stop accepting and finish the running connections
+	if(CreateStopHandler() == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> CreateStopHandler()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// SIGUSR1 dumps the counters of this process
+	if(CreateMetricsHandler() == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> CreateMetricsHandler()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// Every serving process has its own writer, lines are appended atomically
+	if(options->accessLog != NULL && AccessLogOpen(options->accessLog) == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> AccessLogOpen()", false, options->accessLog);
+		return EXIT_FAILURE;
+	}
+
+	// The disk cache is shared by the workers, entries are published by rename()
+	if(options->threads > 0 && ImageOpen(options->imageCache, options->imageRoot,
+			options->imageMemory > 0 ? (size_t) options->imageMemory * 1024 * 1024 : IMAGE_DEFAULT_MEMORY) == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> ImageOpen()", false, NULL);
+		AccessLogClose();
+		return EXIT_FAILURE;
+	}
+
+	// A worker thread serves one connection at a time, subscriptions give theirs back
+	if(options->threads > 0 &&
+		ConnectionPoolOpen((size_t) (options->maxConnections > 0 ? options->maxConnections : options->threads)) == EXIT_FAILURE)
 	{
-		PrintError("main() -> close()", true, NULL);
+		PrintError("ServeListeners() -> ConnectionPoolOpen()", false, NULL);
+		ImageClose();
+		AccessLogClose();
 		return EXIT_FAILURE;
 	}
+
+	// The old worker keeps the store until it drained, an upgrade waiting for this one goes ahead first
+	if(options->dataDirectory != NULL)
+	{
+		NotifyServing();
+	}
+
+	// A worker of an upgraded binary waits here until the old one released the store
+	if(options->threads > 0 && BoardOpen(options->dataDirectory, (size_t) options->retain) == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> BoardOpen()", false, NULL);
+		ConnectionPoolClose();
+		ImageClose();
+		AccessLogClose();
+		return EXIT_FAILURE;
+	}
+
+	// Subscriptions are pushed by one publisher thread per serving process
+	if(options->threads > 0 && SubscribeOpen(options->ioTimeout) == EXIT_FAILURE)
+	{
+		PrintError("ServeListeners() -> SubscribeOpen()", false, NULL);
+		BoardClose();
+		ConnectionPoolClose();
+		ImageClose();
+		AccessLogClose();
+		return EXIT_FAILURE;
+	}
+
+	// Set up, an upgrade waiting for this process may go ahead
+	if(options->dataDirectory == NULL)
+	{
+		NotifyServing();
+	}
+
+	// Accept incoming connections
+	if(options->threads > 0)
+	{
+		HandlerKeepAlive(options->keepAlive);
+		HandlerLimits((size_t) options->maxRequest, options->ioTimeout);
+		if(AcceptIncomingConnectionsThreaded(listeners, options) == EXIT_FAILURE)
+		{
+			PrintError("ServeListeners() -> AcceptIncomingConnectionsThreaded()", false, NULL);
+			r = EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		// In fork mode the main thread is the acceptor
+		if(CPU_COUNT(&options->acceptorCpus) > 0 && PinProcess(0, &options->acceptorCpus) == EXIT_FAILURE)
+		{
+			PrintError("ServeListeners() -> PinProcess()", false, NULL);
+		}
+		if(AcceptIncomingConnections(listeners, options) == EXIT_FAILURE)
+		{
+			PrintError("ServeListeners() -> AcceptIncomingConnections()", false, NULL);
+			r = EXIT_FAILURE;
+		}
+	}
+
+	if(options->threads > 0)
+	{
+		SubscribeClose();
+		BoardClose();
+		ConnectionPoolClose();
+		ImageClose();
+	}
+	AccessLogClose();
+	return r;
 }
 
 /**
@@ -437,44 +1364,75 @@ int main(int argc, const char * const argv[])
 {
 	struct addrinfo * addrInfoResultsPtr;
 	int socketDescriptor = 0;
-	const struct sockaddr sockAddr;
-	const char * port;
+	ServerOptions options;
+	Listeners listeners;
+	bool inherited = false;
 
 	programName = argv[0];
 
 	// ParseArguments
-	if(ParseCommandLine(argc, argv, &port) == EXIT_FAILURE)
+	if(ParseCommandLine(argc, argv, &options) == EXIT_FAILURE)
 	{
 		PrintError("main() -> ParseCommandLine()", false, NULL);
 		return EXIT_FAILURE;
 	}
 
-	// Create signal handler to prevent child processes from becoming zombie processes
-	if(CreateSignalHandler() == EXIT_FAILURE)
+	// Take over the listeners of the previous binary after a hot upgrade
+	if(ReceiveInheritedListeners(&listeners, &inherited) == EXIT_FAILURE)
 	{
-		PrintError("main() -> CreateSignalHandler()", false, NULL);
+		PrintError("main() -> ReceiveInheritedListeners()", false, NULL);
 		return EXIT_FAILURE;
 	}
 
-	// Set up and bind socket
-	if(CreateAndBindListeningSocket(port, &socketDescriptor, &addrInfoResultsPtr) == EXIT_FAILURE)
+	// Set up and bind sockets
+	if(!inherited)
 	{
-		PrintError("main() -> CreateAndBindSocket()", false, NULL);
-		return EXIT_FAILURE;
+		listeners.count = 0;
+		if(options.port != NULL)
+		{
+			if(CreateAndBindListeningSocket(options.port, &socketDescriptor, &addrInfoResultsPtr, &options) == EXIT_FAILURE)
+			{
+				PrintError("main() -> CreateAndBindSocket()", false, NULL);
+				return EXIT_FAILURE;
+			}
+			listeners.descriptors[listeners.count++] = socketDescriptor;
+		}
+		if(options.unixPath != NULL)
+		{
+			if(CreateAndBindUnixSocket(options.unixPath, &socketDescriptor, &options) == EXIT_FAILURE)
+			{
+				PrintError("main() -> CreateAndBindUnixSocket()", false, NULL);
+				return EXIT_FAILURE;
+			}
+			listeners.descriptors[listeners.count++] = socketDescriptor;
+		}
 	}
 
-	// Accept incoming connections
-	if(AcceptIncomingConnections(socketDescriptor, &addrInfoResultsPtr) == EXIT_FAILURE)
+	if(options.workers > 0)
 	{
-		PrintError("main() -> AcceptIncomingConnections()", false, NULL);
-		return EXIT_FAILURE;
+		if(RunMaster(&listeners, options.workers, argv, ServeListeners, &options) == EXIT_FAILURE)
+		{
+			PrintError("main() -> RunMaster()", false, NULL);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		if(ServeListeners(&listeners, &options) == EXIT_FAILURE)
+		{
+			PrintError("main() -> ServeListeners()", false, NULL);
+			return EXIT_FAILURE;
+		}
 	}
 
-	// Close socket descriptor
-	if(CloseSocketDescriptor(socketDescriptor) == EXIT_FAILURE)
+	// Close socket descriptors
+	for(int i = 0; i < listeners.count; i++)
 	{
-		PrintError("main() -> CloseSocketDescriptor(socketDescriptor)", true, NULL);
-		return EXIT_FAILURE;
+		if(CloseSocketDescriptor(listeners.descriptors[i]) == EXIT_FAILURE)
+		{
+			PrintError("main() -> CloseSocketDescriptor(socketDescriptor)", true, NULL);
+			return EXIT_FAILURE;
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,58 @@
+/*
+ * @file simple_message_server.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_H
+#define SIMPLE_MESSAGE_SERVER_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#ifndef EXIT_SUCCESS
+#define EXIT_SUCCESS 0
+#endif
+#ifndef EXIT_FAILURE
+#define EXIT_FAILURE 1
+#endif
+#define MAX_LISTENERS 2
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* The listening sockets of the server (TCP and/or Unix domain) */
+typedef struct
+{
+	int descriptors[MAX_LISTENERS];
+	int count;
+} Listeners;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+extern const char * programName;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void PrintError(char * funcName, bool evalErrno, const char * message);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,498 @@
+/*
+ * @file simple_message_server_accesslog.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Asynchronous access log: every producing thread owns a single producer /
+ * single consumer ring of fixed-size records, a background writer formats
+ * the records and appends them to the log with one writev() per batch.
+ * A full ring drops the record (and counts it) instead of blocking the
+ * request path.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "simple_message_server.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_accesslog.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define ACCESS_LOG_RING_MASK (ACCESS_LOG_RING_SIZE - 1)
+#define ACCESS_LOG_BATCH 64
+#define ACCESS_LOG_LINE_LENGTH 192
+#define ACCESS_LOG_IDLE_NANOSECONDS 10000000L
+#define CACHE_LINE 64
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* Ring of one producing thread; head is advanced by the writer only, tail by the producer only */
+typedef struct AccessRing
+{
+	AccessRecord records[ACCESS_LOG_RING_SIZE];
+	_Alignas(CACHE_LINE) atomic_size_t head;
+	_Alignas(CACHE_LINE) atomic_size_t tail;
+	struct AccessRing * next;
+} AccessRing;
+
+/* Formatted lines waiting for the next writev() */
+typedef struct
+{
+	char lines[ACCESS_LOG_BATCH][ACCESS_LOG_LINE_LENGTH];
+	struct iovec vector[ACCESS_LOG_BATCH];
+	int count;
+} AccessBatch;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static int logDescriptor = -1;
+static _Atomic(AccessRing *) rings = NULL;
+static __thread AccessRing * threadRing = NULL;
+static pthread_t writerThread;
+static atomic_bool writerStop = false;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint64_t MonotonicNanoseconds(void);
+static AccessRing * RegisterRing(void);
+static void FormatRecord(const AccessRecord * record, AccessBatch * batch);
+static void FlushBatch(AccessBatch * batch);
+static bool DrainRings(AccessBatch * batch);
+static void * WriterMain(void * argument);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for reading the monotonic clock
+ *
+ * \return the monotonic time in nanoseconds
+ *
+ */
+static uint64_t MonotonicNanoseconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+ *
+ * \brief Function for creating the ring of the calling thread
+ *
+ * The ring is published on a lock free list the writer walks; rings live
+ * until the log is closed.
+ *
+ * \return the ring or NULL if no memory is available
+ *
+ */
+static AccessRing * RegisterRing(void)
+{
+	AccessRing * ring = aligned_alloc(CACHE_LINE, sizeof(AccessRing));
+
+	if(ring == NULL)
+	{
+		return NULL;
+	}
+
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+	while(!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring, memory_order_release, memory_order_relaxed))
+	{
+	}
+
+	threadRing = ring;
+	return ring;
+}
+
+/**
+ *
+ * \brief Function for checking whether the access log is written
+ *
+ * \return true if the access log was opened
+ *
+ */
+bool AccessLogEnabled(void)
+{
+	return logDescriptor != -1;
+}
+
+/**
+ *
+ * \brief Function for starting a record when a connection is taken over
+ *
+ * Fills in the start time and the peer; until AccessLogCommit() the latency
+ * field holds the monotonic start time.
+ *
+ * \param record the record that shall be started
+ * \param socketDescriptor the accepted connection
+ *
+ */
+void AccessLogBegin(AccessRecord * record, int socketDescriptor)
+{
+	struct sockaddr_storage peer;
+	socklen_t peerLength = sizeof(peer);
+
+	if(!AccessLogEnabled())
+	{
+		return;
+	}
+
+	memset(record, 0, sizeof(*record));
+	clock_gettime(CLOCK_REALTIME, &record->start);
+	record->latency = MonotonicNanoseconds();
+
+	if(getpeername(socketDescriptor, (struct sockaddr *) &peer, &peerLength) == -1)
+	{
+		return;
+	}
+
+	record->family = peer.ss_family;
+	if(peer.ss_family == AF_INET)
+	{
+		struct sockaddr_in * address = (struct sockaddr_in *) &peer;
+
+		memcpy(record->address, &address->sin_addr, sizeof(address->sin_addr));
+		record->port = ntohs(address->sin_port);
+	}
+	else if(peer.ss_family == AF_INET6)
+	{
+		struct sockaddr_in6 * address = (struct sockaddr_in6 *) &peer;
+
+		memcpy(record->address, &address->sin6_addr, sizeof(address->sin6_addr));
+		record->port = ntohs(address->sin6_port);
+	}
+}
+
+/**
+ *
+ * \brief Function for handing a finished record to the writer
+ *
+ * Never blocks: if the ring of the calling thread is full the record is
+ * dropped and counted.
+ *
+ * \param record the record that shall be logged
+ *
+ */
+void AccessLogCommit(AccessRecord * record)
+{
+	AccessRing * ring = threadRing;
+	size_t tail = 0;
+
+	if(!AccessLogEnabled())
+	{
+		return;
+	}
+
+	record->latency = MonotonicNanoseconds() - record->latency;
+
+	if(ring == NULL && (ring = RegisterRing()) == NULL)
+	{
+		MetricsAdd(METRIC_ACCESS_LOG_DROPPED, 1);
+		return;
+	}
+
+	tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	if(tail - atomic_load_explicit(&ring->head, memory_order_acquire) == ACCESS_LOG_RING_SIZE)
+	{
+		MetricsAdd(METRIC_ACCESS_LOG_DROPPED, 1);
+		return;
+	}
+
+	ring->records[tail & ACCESS_LOG_RING_MASK] = *record;
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+/**
+ *
+ * \brief Function for formatting a record as one log line
+ *
+ * Line format: time peer user status bytes-in bytes-out latency-in-us
+ *
+ * \param record the record that shall be formatted
+ * \param batch the batch receiving the line
+ *
+ */
+static void FormatRecord(const AccessRecord * record, AccessBatch * batch)
+{
+	char * line = batch->lines[batch->count];
+	char time[32];
+	char address[INET6_ADDRSTRLEN];
+	char peer[INET6_ADDRSTRLEN + 8];
+	char user[ACCESS_LOG_USER_LENGTH];
+	char status[16];
+	struct tm broken;
+	size_t userLength = strnlen(record->user, sizeof(record->user));
+	int length = 0;
+
+	gmtime_r(&record->start.tv_sec, &broken);
+	strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &broken);
+
+	if((record->family == AF_INET || record->family == AF_INET6) &&
+		inet_ntop(record->family, record->address, address, sizeof(address)) != NULL)
+	{
+		snprintf(peer, sizeof(peer), record->family == AF_INET6 ? "[%s]:%u" : "%s:%u", address, (unsigned) record->port);
+	}
+	else
+	{
+		strcpy(peer, record->family == AF_UNIX ? "unix" : "-");
+	}
+
+	/* user names come from the network: keep the line one token per field */
+	for(size_t i = 0; i < userLength; i++)
+	{
+		unsigned char character = (unsigned char) record->user[i];
+
+		user[i] = (character <= ' ' || character >= 0x7f) ? '_' : (char) character;
+	}
+	user[userLength] = '\0';
+
+	if(record->status == ACCESS_STATUS_SPAWNED)
+	{
+		strcpy(status, "spawned");
+	}
+	else
+	{
+		snprintf(status, sizeof(status), "%d", (int) record->status);
+	}
+
+	length = snprintf(line, ACCESS_LOG_LINE_LENGTH, "%s.%03ldZ %s %s %s %llu %llu %llu\n",
+		time, record->start.tv_nsec / 1000000L, peer, userLength > 0 ? user : "-", status,
+		(unsigned long long) record->bytesIn, (unsigned long long) record->bytesOut,
+		(unsigned long long) (record->latency / 1000));
+	if(length >= ACCESS_LOG_LINE_LENGTH)
+	{
+		length = ACCESS_LOG_LINE_LENGTH - 1;
+		line[length - 1] = '\n';
+	}
+
+	batch->vector[batch->count].iov_base = line;
+	batch->vector[batch->count].iov_len = (size_t) length;
+	batch->count++;
+}
+
+/**
+ *
+ * \brief Function for appending the formatted lines with one writev()
+ *
+ * \param batch the batch that shall be written
+ *
+ */
+static void FlushBatch(AccessBatch * batch)
+{
+	struct iovec * vector = batch->vector;
+	int count = batch->count;
+	int lines = batch->count;
+	ssize_t written = 0;
+
+	while(count > 0)
+	{
+		written = writev(logDescriptor, vector, count);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PrintError("FlushBatch() -> writev()", true, NULL);
+			lines = 0;
+			break;
+		}
+
+		while(count > 0 && (size_t) written >= vector->iov_len)
+		{
+			written -= (ssize_t) vector->iov_len;
+			vector++;
+			count--;
+		}
+		if(count > 0)
+		{
+			vector->iov_base = (char *) vector->iov_base + written;
+			vector->iov_len -= (size_t) written;
+		}
+	}
+
+	MetricsAdd(METRIC_ACCESS_LOG_WRITTEN, (unsigned long) lines);
+	batch->count = 0;
+}
+
+/**
+ *
+ * \brief Function for moving all pending records of all rings to the log
+ *
+ * \param batch the batch used for formatting
+ *
+ * \return true if at least one record was written
+ *
+ */
+static bool DrainRings(AccessBatch * batch)
+{
+	bool drained = false;
+
+	for(AccessRing * ring = atomic_load_explicit(&rings, memory_order_acquire); ring != NULL; ring = ring->next)
+	{
+		size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+		while(head != tail)
+		{
+			FormatRecord(&ring->records[head & ACCESS_LOG_RING_MASK], batch);
+			head++;
+			/* release the slot before the (slow) write so producers keep going */
+			atomic_store_explicit(&ring->head, head, memory_order_release);
+
+			if(batch->count == ACCESS_LOG_BATCH)
+			{
+				FlushBatch(batch);
+			}
+			drained = true;
+		}
+	}
+
+	if(batch->count > 0)
+	{
+		FlushBatch(batch);
+	}
+	return drained;
+}
+
+/**
+ *
+ * \brief Main function of the background writer
+ *
+ * Polls the rings and sleeps briefly while they are empty, so producers
+ * never have to wake it up.
+ *
+ * \param argument unused
+ *
+ * \return NULL
+ *
+ */
+static void * WriterMain(void * argument)
+{
+	struct timespec idle = { 0, ACCESS_LOG_IDLE_NANOSECONDS };
+	AccessBatch * batch = malloc(sizeof(AccessBatch));
+
+	(void) argument;
+	if(batch == NULL)
+	{
+		PrintError("WriterMain() -> malloc()", true, NULL);
+		return NULL;
+	}
+	batch->count = 0;
+
+	while(!atomic_load_explicit(&writerStop, memory_order_acquire))
+	{
+		if(!DrainRings(batch))
+		{
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	DrainRings(batch);
+	free(batch);
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for opening the access log and starting the writer
+ *
+ * \param path the file the log is appended to
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int AccessLogOpen(const char * path)
+{
+	int error = 0;
+
+	logDescriptor = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if(logDescriptor == -1)
+	{
+		PrintError("AccessLogOpen() -> open()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	atomic_store(&writerStop, false);
+	error = pthread_create(&writerThread, NULL, WriterMain, NULL);
+	if(error != 0)
+	{
+		errno = error;
+		PrintError("AccessLogOpen() -> pthread_create()", true, NULL);
+		close(logDescriptor);
+		logDescriptor = -1;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for writing the remaining records and closing the log
+ *
+ * Must be called after all producers have finished.
+ *
+ */
+void AccessLogClose(void)
+{
+	AccessRing * ring = NULL;
+
+	if(!AccessLogEnabled())
+	{
+		return;
+	}
+
+	atomic_store_explicit(&writerStop, true, memory_order_release);
+	pthread_join(writerThread, NULL);
+
+	ring = atomic_exchange(&rings, NULL);
+	while(ring != NULL)
+	{
+		AccessRing * next = ring->next;
+
+		free(ring);
+		ring = next;
+	}
+	threadRing = NULL;
+
+	if(close(logDescriptor) == -1)
+	{
+		PrintError("AccessLogClose() -> close()", true, NULL);
+	}
+	logDescriptor = -1;
+}
+
+/*
+ * =================================================================== eof ==
+ */
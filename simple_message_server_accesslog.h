@@ -0,0 +1,64 @@
+/*
+ * @file simple_message_server_accesslog.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_ACCESSLOG_H
+#define SIMPLE_MESSAGE_SERVER_ACCESSLOG_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+/* Records per producer ring (power of two) */
+#define ACCESS_LOG_RING_SIZE 1024
+#define ACCESS_LOG_USER_LENGTH 32
+
+/* Status of a connection that was handed to a spawned logic process */
+#define ACCESS_STATUS_SPAWNED (-1)
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* One access log entry as written by the hot path (formatted by the writer) */
+typedef struct
+{
+	struct timespec start;
+	uint64_t latency;
+	uint64_t bytesIn;
+	uint64_t bytesOut;
+	int32_t status;
+	uint16_t family;
+	uint16_t port;
+	uint8_t address[16];
+	char user[ACCESS_LOG_USER_LENGTH];
+} AccessRecord;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int AccessLogOpen(const char * path);
+bool AccessLogEnabled(void);
+void AccessLogBegin(AccessRecord * record, int socketDescriptor);
+void AccessLogCommit(AccessRecord * record);
+void AccessLogClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
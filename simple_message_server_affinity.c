@@ -0,0 +1,279 @@
+/*
+ * @file simple_message_server_affinity.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include "simple_message_server_affinity.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define NUMA_NODE_PREFIX "node:"
+#define NUMA_NODE_CPULIST "/sys/devices/system/node/node%d/cpulist"
+#define CPULIST_SIZE 4096
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int ReadNodeCpuList(const char * node, char * cpuList, size_t size);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for reading the CPU list of a NUMA node from sysfs
+ *
+ * \param node the number of the node as text
+ * \param cpuList the buffer receiving the list (e.g. "0-7,16-23")
+ * \param size the size of the buffer
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int ReadNodeCpuList(const char * node, char * cpuList, size_t size)
+{
+	char path[64];
+	char * end = NULL;
+	long nodeNumber = strtol(node, &end, 10);
+	FILE * file = NULL;
+
+	if(end == node || *end != '\0' || nodeNumber < 0)
+	{
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), NUMA_NODE_CPULIST, (int) nodeNumber);
+	file = fopen(path, "r");
+	if(file == NULL)
+	{
+		PrintError("ReadNodeCpuList() -> fopen()", true, path);
+		return EXIT_FAILURE;
+	}
+	if(fgets(cpuList, size, file) == NULL)
+	{
+		fclose(file);
+		return EXIT_FAILURE;
+	}
+	fclose(file);
+
+	cpuList[strcspn(cpuList, "\n")] = '\0';
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for parsing a CPU list like "0-3,8,10-11" or "node:1"
+ *
+ * "node:<n>" selects all CPUs of NUMA node n, so workers and their
+ * children can be kept on the socket the NIC is attached to.
+ *
+ * \param text the CPU list
+ * \param cpus the resulting CPU set
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ParseCpuList(const char * text, cpu_set_t * cpus)
+{
+	char nodeCpuList[CPULIST_SIZE];
+	const char * cursor = text;
+	char * end = NULL;
+
+	CPU_ZERO(cpus);
+
+	if(strncmp(text, NUMA_NODE_PREFIX, strlen(NUMA_NODE_PREFIX)) == 0)
+	{
+		if(ReadNodeCpuList(text + strlen(NUMA_NODE_PREFIX), nodeCpuList, sizeof(nodeCpuList)) == EXIT_FAILURE)
+		{
+			return EXIT_FAILURE;
+		}
+		cursor = nodeCpuList;
+	}
+
+	while(*cursor != '\0')
+	{
+		long first = strtol(cursor, &end, 10);
+		long last = first;
+
+		if(end == cursor || first < 0)
+		{
+			return EXIT_FAILURE;
+		}
+		cursor = end;
+
+		if(*cursor == '-')
+		{
+			cursor++;
+			last = strtol(cursor, &end, 10);
+			if(end == cursor || last < first)
+			{
+				return EXIT_FAILURE;
+			}
+			cursor = end;
+		}
+
+		if(last >= CPU_SETSIZE)
+		{
+			return EXIT_FAILURE;
+		}
+		for(long cpu = first; cpu <= last; cpu++)
+		{
+			CPU_SET(cpu, cpus);
+		}
+
+		if(*cursor == ',')
+		{
+			cursor++;
+		}
+		else if(*cursor != '\0')
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return CPU_COUNT(cpus) > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Function for picking the n-th CPU of a set (wrapping around)
+ *
+ * \param cpus the CPU set
+ * \param n the index of the wanted CPU
+ *
+ * \return the number of the CPU or -1 if the set is empty
+ *
+ */
+int NthCpu(const cpu_set_t * cpus, int n)
+{
+	int count = CPU_COUNT(cpus);
+
+	if(count == 0)
+	{
+		return -1;
+	}
+
+	n %= count;
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	{
+		if(CPU_ISSET(cpu, cpus) && n-- == 0)
+		{
+			return cpu;
+		}
+	}
+	return -1;
+}
+
+/**
+ *
+ * \brief Function for restricting a thread to a CPU set
+ *
+ * \param thread the thread that shall be pinned
+ * \param cpus the allowed CPUs
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int PinThread(pthread_t thread, const cpu_set_t * cpus)
+{
+	int r = pthread_setaffinity_np(thread, sizeof(cpu_set_t), cpus);
+	if(r != 0)
+	{
+		errno = r;
+		PrintError("PinThread() -> pthread_setaffinity_np()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for pinning a thread to exactly one CPU
+ *
+ * \param thread the thread that shall be pinned
+ * \param cpu the number of the CPU
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int PinThreadToCpu(pthread_t thread, int cpu)
+{
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	return PinThread(thread, &cpus);
+}
+
+/**
+ *
+ * \brief Function for restricting a process to a CPU set
+ *
+ * \param pid the process that shall be pinned (0 for the calling process)
+ * \param cpus the allowed CPUs
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int PinProcess(pid_t pid, const cpu_set_t * cpus)
+{
+	if(sched_setaffinity(pid, sizeof(cpu_set_t), cpus) == -1)
+	{
+		PrintError("PinProcess() -> sched_setaffinity()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for querying the CPU that received the connection from the NIC
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ *
+ * \return the number of the CPU or -1 if it is unknown
+ *
+ */
+int GetIncomingCpu(int acceptedSocketDescriptor)
+{
+#ifdef SO_INCOMING_CPU
+	int cpu = -1;
+	socklen_t length = sizeof(cpu);
+
+	if(getsockopt(acceptedSocketDescriptor, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == -1)
+	{
+		return -1;
+	}
+	return cpu;
+#else
+	(void) acceptedSocketDescriptor;
+	return -1;
+#endif
+}
+
+/*
+ * =================================================================== eof ==
+ */
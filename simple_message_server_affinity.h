@@ -0,0 +1,39 @@
+/*
+ * @file simple_message_server_affinity.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_AFFINITY_H
+#define SIMPLE_MESSAGE_SERVER_AFFINITY_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int ParseCpuList(const char * text, cpu_set_t * cpus);
+int NthCpu(const cpu_set_t * cpus, int n);
+int PinThread(pthread_t thread, const cpu_set_t * cpus);
+int PinThreadToCpu(pthread_t thread, int cpu);
+int PinProcess(pid_t pid, const cpu_set_t * cpus);
+int GetIncomingCpu(int acceptedSocketDescriptor);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,1066 @@
+/*
+ * @file simple_message_server_handler.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * In-process request handling for the threaded server. It speaks the same
+ * protocol as the external business logic: the request is "user=<name>\n",
+ * an optional "img=<url>\n" and the message up to EOF, the response is
+ * "status=<n>\n" followed by the HTML and the PNG file, each announced by
+ * "file=<name>\n" and "len=<bytes>\n".
+ *
+ * Everything beyond that is negotiated in a header block in front of the
+ * request, so the text of a message is never taken for a header:
+ *
+ *   "version=1\n" { "<key>=<value>\n" } "\n" [<image>] <request>
+ *
+ * The block starts with its version, ends with an empty line, and unknown
+ * keys are skipped. "imglen=<bytes>" uploads an image, its bytes follow
+ * the block. "accept=<feature>,..." lists optional features of the
+ * response: with "deflate" the HTML file may come as zlib stream,
+ * announced by "enc=deflate\n", with "crc32c" every file is announced with
+ * "crc=<CRC-32C in hex>\n" of its bytes as sent. Both lines come before
+ * the "len=" of the file. A request without the block is served as it is.
+ *
+ * Instead of shutting down its writing side a client may put the request
+ * into a frame "reqlen=<bytes>\n<request>". The connection then stays open
+ * after the response for the next frame, as long as the client sends it
+ * within the keep-alive time. Frames must not be pipelined: the next one
+ * is sent once the response of the last one was read. While it waits for
+ * the next frame the connection is parked with the acceptors and gives
+ * its worker back (see simple_message_server_park.c).
+ *
+ * A request may not be larger than --max-request bytes, a frame announcing
+ * more is refused before its body is read. The request buffer grows with
+ * the bytes that arrived, never with the announced length. A request must
+ * have arrived, just like its response must have been sent, within
+ * --io-timeout seconds. Otherwise the connection is dropped, so neither a client that
+ * trickles its request nor one that never reads can keep a worker thread.
+ *
+ * A request with "subscribe=page" or "subscribe=messages" in the header
+ * block posts nothing; its connection is handed to the publisher, which
+ * pushes updates of the board (see simple_message_server_subscribe.c).
+ *
+ * A connection is served with an object of the connection pool: the
+ * request buffer and the list of the response are taken from its arena,
+ * which is reset after every request (see simple_message_server_pool.c).
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include "simple_message_server.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_server_accesslog.h"
+#include "simple_message_server_store.h"
+#include "simple_message_server_render.h"
+#include "simple_message_server_image.h"
+#include "simple_message_server_master.h"
+#include "simple_message_server_pool.h"
+#include "simple_message_server_park.h"
+#include "simple_message_crc32c.h"
+#include "simple_message_probes.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define REQUEST_INITIAL_SIZE 4096
+#define RESPONSE_HEADER_SIZE 512
+#define REQUEST_FRAME_PREFIX "reqlen="
+#define REQUEST_FRAME_HEADER_SIZE 32
+#define REQUEST_HEADER_PREFIX "version="
+#define REQUEST_HEADER_VERSION 1
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+/* Placeholder image (1x1 transparent PNG) until the image stage produces one */
+static const unsigned char placeholderPng[] =
+{
+	0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D,
+	0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+	0x08, 0x06, 0x00, 0x00, 0x00, 0x1F, 0x15, 0xC4, 0x89, 0x00, 0x00, 0x00,
+	0x0A, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0x00, 0x01, 0x00, 0x00,
+	0x05, 0x00, 0x01, 0x0D, 0x0A, 0x2D, 0xB4, 0x00, 0x00, 0x00, 0x00, 0x49,
+	0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82
+};
+
+/* Sequence numbers of posts when the board is kept in memory only */
+static atomic_uint_fast64_t boardSequence = 0;
+
+/* Seconds a framed connection is kept open for the next request */
+static int keepAliveSeconds = KEEP_ALIVE_DEFAULT;
+
+/* Limits of a request and its response */
+static size_t maxRequestSize = REQUEST_MAX_DEFAULT;
+static int ioTimeoutSeconds = IO_TIMEOUT_DEFAULT;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int SendResponse(int socketDescriptor, Arena * arena, int status, Page * page, const DeflatedPage * deflated, const Image * image, bool checksum, size_t * sent);
+static void StartDeadline(struct timespec * deadline);
+static bool WaitForSocket(int socketDescriptor, short events, const struct timespec * deadline);
+static int ParseFrameHeader(const char * buffer, size_t length, size_t * headerLength, size_t * frameLength);
+static char * ParseHeaderBlock(char * buffer, char * end, Request * request);
+static bool WaitForRequest(int socketDescriptor, int timeout);
+static int HandleSubscription(int acceptedSocketDescriptor, const Request * request, bool framed, size_t * sent);
+static int HandleRequest(int acceptedSocketDescriptor, Arena * arena, bool first, bool * framed, bool * handedOver);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for setting how long a framed connection waits for the next request
+ *
+ * \param seconds the idle time, 0 -> the connection is closed after one request
+ *
+ */
+void HandlerKeepAlive(int seconds)
+{
+	keepAliveSeconds = seconds;
+}
+
+/**
+ *
+ * \brief Function for setting the limits of a request
+ *
+ * \param maxRequest the largest request accepted in bytes
+ * \param ioTimeout the seconds to read a whole request and to send a whole response
+ *
+ */
+void HandlerLimits(size_t maxRequest, int ioTimeout)
+{
+	maxRequestSize = maxRequest;
+	ioTimeoutSeconds = ioTimeout;
+}
+
+/**
+ *
+ * \brief Function for starting the time a request or a response may take
+ *
+ * \param deadline receives the end of the I/O timeout
+ *
+ */
+static void StartDeadline(struct timespec * deadline)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += ioTimeoutSeconds;
+}
+
+/**
+ *
+ * \brief Function for waiting until a non-blocking socket is ready, at most until the deadline
+ *
+ * \param socketDescriptor the descriptor of the connection
+ * \param events POLLIN or POLLOUT
+ * \param deadline the end of the I/O timeout
+ *
+ * \return true if the socket is ready (or failed, the next call reports it)
+ * \return false if the deadline passed
+ *
+ */
+static bool WaitForSocket(int socketDescriptor, short events, const struct timespec * deadline)
+{
+	struct pollfd pollDescriptor;
+	struct timespec now;
+	long remaining = 0;
+	int r = 0;
+
+	pollDescriptor.fd = socketDescriptor;
+	pollDescriptor.events = events;
+	do
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		remaining = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+		if(remaining <= 0)
+		{
+			return false;
+		}
+		r = poll(&pollDescriptor, 1, (int) remaining);
+	} while(r == -1 && errno == EINTR);
+
+	return r != 0;
+}
+
+/**
+ *
+ * \brief Function for recognising the "reqlen=<bytes>\n" in front of a framed request
+ *
+ * \param buffer the bytes read so far
+ * \param length the number of bytes read so far
+ * \param headerLength receives the length of the line
+ * \param frameLength receives the length of the request behind the line
+ *
+ * \return 1 if the request is framed, 0 if it is not, -1 if more bytes are needed
+ * \return -2 if the line is malformed, -3 if the request is larger than --max-request
+ *
+ */
+static int ParseFrameHeader(const char * buffer, size_t length, size_t * headerLength, size_t * frameLength)
+{
+	size_t prefixLength = strlen(REQUEST_FRAME_PREFIX);
+	const char * newline = NULL;
+	char * end = NULL;
+
+	if(memcmp(buffer, REQUEST_FRAME_PREFIX, length < prefixLength ? length : prefixLength) != 0)
+	{
+		return 0;
+	}
+	newline = memchr(buffer, '\n', length);
+	if(newline == NULL)
+	{
+		return length < REQUEST_FRAME_HEADER_SIZE ? -1 : -2;
+	}
+	errno = 0;
+	*frameLength = strtoull(buffer + prefixLength, &end, 10);
+	if(errno != 0 || end == buffer + prefixLength || end != newline)
+	{
+		return -2;
+	}
+	if(*frameLength > maxRequestSize)
+	{
+		return -3;
+	}
+	*headerLength = newline - buffer + 1;
+	return 1;
+}
+
+/**
+ *
+ * \brief Function for reading a whole request (up to EOF or the end of its frame) into memory
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ * \param arena the arena of the connection the buffer is taken from
+ * \param buffer the buffer holding the request (zero terminated)
+ * \param length the number of bytes read
+ * \param framed set if the request came in a frame, the connection stays usable then
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ReadRequest(int acceptedSocketDescriptor, Arena * arena, char ** buffer, size_t * length, bool * framed)
+{
+	size_t capacity = REQUEST_INITIAL_SIZE;
+	size_t headerLength = 0;
+	size_t frameEnd = 0;	// 0 -> the request ends with EOF
+	int frame = -1;
+	ssize_t r = 0;
+	struct timespec deadline;
+
+	*length = 0;
+	*framed = false;
+	StartDeadline(&deadline);
+	*buffer = ArenaAlloc(arena, capacity);
+	if(*buffer == NULL)
+	{
+		PrintError("ReadRequest() -> ArenaAlloc()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	for(;;)
+	{
+		if(*length + 1 == capacity)
+		{
+			char * grown = ArenaGrow(arena, *buffer, capacity, 2 * capacity);
+			if(grown == NULL)
+			{
+				PrintError("ReadRequest() -> ArenaGrow()", false, NULL);
+				*buffer = NULL;
+				return EXIT_FAILURE;
+			}
+			*buffer = grown;
+			capacity *= 2;
+		}
+
+		r = read(acceptedSocketDescriptor, *buffer + *length,
+				frameEnd > 0 && frameEnd - *length < capacity - *length - 1 ? frameEnd - *length : capacity - *length - 1);
+		if(r == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				if(WaitForSocket(acceptedSocketDescriptor, POLLIN, &deadline))
+				{
+					continue;
+				}
+				PrintError("ReadRequest()", false, "Timeout while reading the request");
+				*buffer = NULL;
+				return EXIT_FAILURE;
+			}
+			PrintError("ReadRequest() -> read()", true, NULL);
+			*buffer = NULL;
+			return EXIT_FAILURE;
+		}
+		if(r == 0)
+		{
+			if(frameEnd > 0)
+			{
+				PrintError("ReadRequest()", false, "Connection closed within a frame");
+				*buffer = NULL;
+				return EXIT_FAILURE;
+			}
+			break;	// Client shut down its writing side
+		}
+		*length += r;
+		if(frameEnd == 0 && *length > maxRequestSize)
+		{
+			PrintError("ReadRequest()", false, "Request too large");
+			*buffer = NULL;
+			return EXIT_FAILURE;
+		}
+
+		if(frame == -1)
+		{
+			size_t frameLength = 0;
+
+			frame = ParseFrameHeader(*buffer, *length, &headerLength, &frameLength);
+			if(frame == -2 || (frame == 1 && *length > headerLength + frameLength))
+			{
+				// Pipelined frames would be lost, they are refused
+				PrintError("ReadRequest()", false, "Malformed frame");
+				*buffer = NULL;
+				return EXIT_FAILURE;
+			}
+			if(frame == -3)
+			{
+				PrintError("ReadRequest()", false, "Request too large");
+				*buffer = NULL;
+				return EXIT_FAILURE;
+			}
+			if(frame == 1)
+			{
+				// The buffer keeps doubling with the bytes read, the length is only announced
+				frameEnd = headerLength + frameLength;
+			}
+		}
+		if(frameEnd > 0 && *length == frameEnd)
+		{
+			*framed = true;
+			*length -= headerLength;
+			memmove(*buffer, *buffer + headerLength, *length);
+			break;
+		}
+	}
+
+	(*buffer)[*length] = '\0';
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for parsing the header block in front of a request
+ *
+ * \param buffer the request buffer, starting with the version line
+ * \param end the end of the request buffer
+ * \param request receives the negotiated features and the uploaded image
+ *
+ * \return the start of the request behind the block and the image
+ * \return NULL in case of a malformed block or an unknown version
+ *
+ */
+static char * ParseHeaderBlock(char * buffer, char * end, Request * request)
+{
+	char * line = buffer;
+	char * newline = NULL;
+	char * digitsEnd = NULL;
+	unsigned long long imgLength = 0;
+	bool upload = false;
+
+	newline = memchr(line, '\n', end - line);
+	if(newline == NULL)
+	{
+		return NULL;
+	}
+	*newline = '\0';
+	errno = 0;
+	if(strtol(line + strlen(REQUEST_HEADER_PREFIX), &digitsEnd, 10) != REQUEST_HEADER_VERSION ||
+		errno != 0 || *digitsEnd != '\0')
+	{
+		return NULL;
+	}
+
+	for(line = newline + 1; ; line = newline + 1)
+	{
+		newline = memchr(line, '\n', end - line);
+		if(newline == NULL)
+		{
+			return NULL;	// The block was not terminated
+		}
+		*newline = '\0';
+		if(line == newline)
+		{
+			break;
+		}
+
+		if(strncmp(line, "subscribe=", 10) == 0)
+		{
+			if(strcmp(line + 10, "page") == 0)
+			{
+				request->subscribe = SUBSCRIBE_PAGE;
+			}
+			else if(strcmp(line + 10, "messages") == 0)
+			{
+				request->subscribe = SUBSCRIBE_MESSAGES;
+			}
+			else
+			{
+				return NULL;
+			}
+		}
+		else if(strncmp(line, "imglen=", 7) == 0)
+		{
+			errno = 0;
+			imgLength = strtoull(line + 7, &digitsEnd, 10);
+			if(line[7] < '0' || line[7] > '9' || errno != 0 || *digitsEnd != '\0')
+			{
+				return NULL;
+			}
+			upload = true;
+		}
+		else if(strncmp(line, "accept=", 7) == 0)
+		{
+			char * position = NULL;
+
+			for(char * encoding = strtok_r(line + 7, ",", &position); encoding != NULL;
+					encoding = strtok_r(NULL, ",", &position))
+			{
+				if(strcmp(encoding, "deflate") == 0)
+				{
+					request->deflate = true;
+				}
+				else if(strcmp(encoding, "crc32c") == 0)
+				{
+					request->crc = true;
+				}
+			}
+		}
+	}
+
+	line = newline + 1;
+	if(upload)
+	{
+		if(imgLength > (unsigned long long) (end - line))
+		{
+			return NULL;
+		}
+		request->imgData = (const unsigned char *) line;
+		request->imgDataLength = imgLength;
+		line += imgLength;
+	}
+	return line;
+}
+
+/**
+ *
+ * \brief Function for splitting a request into user, image, encodings and message
+ *
+ * \param buffer the request buffer, line ends are replaced by '\0'
+ * \param length the number of bytes in the buffer
+ * \param request the parsed request
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of a malformed request
+ *
+ */
+int ParseRequest(char * buffer, size_t length, Request * request)
+{
+	char * end = buffer + length;
+	char * line = buffer;
+	char * newline = NULL;
+
+	memset(request, 0, sizeof(Request));
+
+	if((size_t) (end - line) >= strlen(REQUEST_HEADER_PREFIX) &&
+		strncmp(line, REQUEST_HEADER_PREFIX, strlen(REQUEST_HEADER_PREFIX)) == 0)
+	{
+		line = ParseHeaderBlock(line, end, request);
+		if(line == NULL)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	newline = memchr(line, '\n', end - line);
+	if(newline == NULL || strncmp(line, "user=", 5) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	*newline = '\0';
+	request->user = line + 5;
+	line = newline + 1;
+
+	newline = memchr(line, '\n', end - line);
+	if(newline != NULL && strncmp(line, "img=", 4) == 0)
+	{
+		*newline = '\0';
+		request->img = line + 4;
+		line = newline + 1;
+	}
+
+	// The message is everything up to EOF without the final newline
+	request->message = line;
+	request->messageLength = end - line;
+	if(request->messageLength > 0 && line[request->messageLength - 1] == '\n')
+	{
+		request->messageLength--;
+	}
+	line[request->messageLength] = '\0';
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for preparing the bulletin board
+ *
+ * \param dataDirectory the directory of the store, NULL -> the board is kept in memory
+ * \param retain the number of newest messages on the board, 0 -> all
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int BoardOpen(const char * dataDirectory, size_t retain)
+{
+	StoredMessage message;
+	size_t first = 0;
+	int r = EXIT_SUCCESS;
+
+	if(RenderOpen(retain) == EXIT_FAILURE)
+	{
+		PrintError("BoardOpen() -> RenderOpen()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	if(dataDirectory == NULL)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	if(StoreOpen(dataDirectory, retain) == EXIT_FAILURE)
+	{
+		PrintError("BoardOpen() -> StoreOpen()", false, dataDirectory);
+		RenderClose();
+		return EXIT_FAILURE;
+	}
+
+	// The fragments of the stored messages are rendered once at startup, into one page version
+	StoreBeginRead();
+	first = retain > 0 && StoreCount() > retain ? StoreCount() - retain : 0;
+	for(size_t i = first; i < StoreCount() && r == EXIT_SUCCESS; i++)
+	{
+		StoreGet(i, &message);
+		r = RenderLoad(&message);
+	}
+	StoreEndRead();
+
+	if(r == EXIT_FAILURE)
+	{
+		PrintError("BoardOpen() -> RenderLoad()", false, NULL);
+		BoardClose();
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for adding a message to the bulletin board
+ *
+ * \param request the parsed request carrying the message
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int BoardPost(const Request * request)
+{
+	StoredMessage message;
+
+	message.user = request->user;
+	message.userLength = strlen(request->user);
+	message.img = request->img;
+	message.imgLength = request->img != NULL ? strlen(request->img) : 0;
+	message.message = request->message;
+	message.messageLength = request->messageLength;
+
+	// With a data directory the post is on disk before it is shown
+	if(StoreIsOpen())
+	{
+		if(StoreAppend(request->user, request->img, request->message, request->messageLength,
+						&message.sequence, &message.time) == EXIT_FAILURE)
+		{
+			PrintError("BoardPost() -> StoreAppend()", false, NULL);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		message.sequence = atomic_fetch_add(&boardSequence, 1) + 1;
+		message.time = time(NULL);
+	}
+
+	if(RenderAppend(&message) == EXIT_FAILURE)
+	{
+		PrintError("BoardPost() -> RenderAppend()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	SubscribeNotify();
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for closing the bulletin board
+ *
+ * Must be called after all requests have finished.
+ *
+ */
+void BoardClose(void)
+{
+	if(StoreIsOpen())
+	{
+		StoreClose();
+	}
+	RenderClose();
+}
+
+/**
+ *
+ * \brief Function for sending a complete iovec array
+ *
+ * Partial writes are continued. SIGPIPE is suppressed because a vanished
+ * client must not terminate the whole threaded server. On a non-blocking
+ * socket the whole array must be sent within the I/O timeout.
+ *
+ * \param socketDescriptor the descriptor of the connection
+ * \param iov the buffers that shall be sent (they are modified)
+ * \param iovcnt the number of buffers
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int SendAll(int socketDescriptor, struct iovec * iov, int iovcnt)
+{
+	struct msghdr messageHeader;
+	struct timespec deadline;
+	ssize_t r = 0;
+	bool first = true;
+
+	StartDeadline(&deadline);
+	while(iovcnt > 0)
+	{
+		memset(&messageHeader, 0, sizeof(messageHeader));
+		messageHeader.msg_iov = iov;
+		messageHeader.msg_iovlen = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+
+		// A long list goes out in chunks of IOV_MAX buffers, MSG_MORE avoids sending partial segments between them
+		r = sendmsg(socketDescriptor, &messageHeader, MSG_NOSIGNAL | (iovcnt > IOV_MAX ? MSG_MORE : 0));
+		if(r == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				if(WaitForSocket(socketDescriptor, POLLOUT, &deadline))
+				{
+					continue;
+				}
+				errno = ETIMEDOUT;
+			}
+			return EXIT_FAILURE;
+		}
+		if(first)
+		{
+			PROBE2(response_first_byte, socketDescriptor, r);
+			first = false;
+		}
+
+		// Skip the buffers that are completely sent
+		while(iovcnt > 0 && (size_t) r >= iov->iov_len)
+		{
+			r -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if(iovcnt > 0)
+		{
+			iov->iov_base = (char *) iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for sending the response of a request
+ *
+ * The page goes out as the list of its fragments, nothing is copied.
+ *
+ * \param socketDescriptor the descriptor of the connection
+ * \param arena the arena of the connection the list of the response is taken from
+ * \param status the status reported to the client
+ * \param page the current bulletin board page
+ * \param deflated the compressed page, NULL -> the page is sent as it is
+ * \param image the processed image of the post, NULL -> placeholder
+ * \param checksum announce the CRC-32C of the files
+ * \param sent receives the number of bytes of the complete response
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int SendResponse(int socketDescriptor, Arena * arena, int status, Page * page, const DeflatedPage * deflated, const Image * image, bool checksum, size_t * sent)
+{
+	char htmlHeader[RESPONSE_HEADER_SIZE];
+	char pngHeader[RESPONSE_HEADER_SIZE];
+	size_t count = (deflated != NULL ? deflated->count : page->count) + 3;
+	struct iovec * iov = ArenaAlloc(arena, count * sizeof(struct iovec));
+
+	if(iov == NULL)
+	{
+		PrintError("SendResponse() -> ArenaAlloc()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// SendAll() consumes the list, so the fragments are referenced from a private one
+	iov[0].iov_base = htmlHeader;
+	iov[0].iov_len = snprintf(htmlHeader, sizeof(htmlHeader), "status=%d\nfile=%s\n", status, RESPONSE_HTML_FILE);
+	if(deflated != NULL)
+	{
+		iov[0].iov_len += snprintf(htmlHeader + iov[0].iov_len, sizeof(htmlHeader) - iov[0].iov_len, "enc=deflate\n");
+		memcpy(&iov[1], deflated->vector, deflated->count * sizeof(struct iovec));
+	}
+	else
+	{
+		RenderVector(page, &iov[1]);
+	}
+	if(checksum)
+	{
+		iov[0].iov_len += snprintf(htmlHeader + iov[0].iov_len, sizeof(htmlHeader) - iov[0].iov_len, "crc=%08" PRIx32 "\n",
+									deflated != NULL ? deflated->crc : RenderChecksum(page));
+	}
+	iov[0].iov_len += snprintf(htmlHeader + iov[0].iov_len, sizeof(htmlHeader) - iov[0].iov_len, "len=%zu\n",
+								deflated != NULL ? deflated->length : page->length);
+
+	iov[count - 2].iov_base = pngHeader;
+	iov[count - 2].iov_len = snprintf(pngHeader, sizeof(pngHeader), "file=%s\n", RESPONSE_PNG_FILE);
+	if(checksum)
+	{
+		iov[count - 2].iov_len += snprintf(pngHeader + iov[count - 2].iov_len, sizeof(pngHeader) - iov[count - 2].iov_len,
+									"crc=%08" PRIx32 "\n", image != NULL ? image->crc : Crc32c(0, placeholderPng, sizeof(placeholderPng)));
+	}
+	iov[count - 2].iov_len += snprintf(pngHeader + iov[count - 2].iov_len, sizeof(pngHeader) - iov[count - 2].iov_len,
+								"len=%zu\n", image != NULL ? image->length : sizeof(placeholderPng));
+	iov[count - 1].iov_base = image != NULL ? (void *) image->data : (void *) placeholderPng;
+	iov[count - 1].iov_len = image != NULL ? image->length : sizeof(placeholderPng);
+	*sent = iov[0].iov_len + (deflated != NULL ? deflated->length : page->length) +
+			iov[count - 2].iov_len + iov[count - 1].iov_len;
+
+	if(SendAll(socketDescriptor, iov, (int) count) == EXIT_FAILURE)
+	{
+		PrintError("SendResponse() -> SendAll()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for waiting until the next framed request arrives
+ *
+ * \param socketDescriptor the descriptor of the connection
+ * \param timeout the milliseconds to wait, 0 -> only checks
+ *
+ * \return true if the client sent something (or closed the connection)
+ * \return false on the time running out or a graceful stop
+ *
+ */
+static bool WaitForRequest(int socketDescriptor, int timeout)
+{
+	struct pollfd pollDescriptors[2];
+	int r = 0;
+
+	pollDescriptors[0].fd = socketDescriptor;
+	pollDescriptors[0].events = POLLIN;
+	// The stop pipe (if any) ends idle connections on a graceful stop
+	pollDescriptors[1].fd = GetStopDescriptor();
+	pollDescriptors[1].events = POLLIN;
+
+	do
+	{
+		r = poll(pollDescriptors, 2, timeout);
+	} while(r == -1 && errno == EINTR);
+
+	return r > 0 && pollDescriptors[1].revents == 0 && !StopRequested();
+}
+
+/**
+ *
+ * \brief Function for turning a connection into a subscription
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ * \param request the parsed subscription request
+ * \param framed set if the request came in a frame, the client did not shut down its writing side then
+ * \param sent the number of bytes sent
+ *
+ * \return EXIT_SUCCESS if the publisher owns the connection now
+ * \return EXIT_FAILURE otherwise, the connection has to be closed if sent is set
+ *
+ */
+static int HandleSubscription(int acceptedSocketDescriptor, const Request * request, bool framed, size_t * sent)
+{
+	char statusLine[] = "status=0\n";
+	struct iovec iov;
+
+	iov.iov_base = statusLine;
+	iov.iov_len = strlen(statusLine);
+	if(SendAll(acceptedSocketDescriptor, &iov, 1) == EXIT_FAILURE)
+	{
+		PrintError("HandleSubscription() -> SendAll()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	*sent = strlen(statusLine);
+
+	// The publisher may write to the connection as soon as it is added, the status goes first
+	if(SubscribeAdd(acceptedSocketDescriptor, request->subscribe, request->deflate, request->crc, framed) == EXIT_FAILURE)
+	{
+		// The client took the status as the start of the stream, no second response may follow
+		PrintError("HandleSubscription() -> SubscribeAdd()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for serving one request of a connection
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ * \param arena the arena of the connection, reset once the request is served
+ * \param first set for the first request of the connection
+ * \param framed set if the request came in a frame
+ * \param handedOver set if a subscription took the connection over
+ *
+ * \return EXIT_SUCCESS if the connection may serve another request
+ * \return EXIT_FAILURE otherwise
+ *
+ */
+static int HandleRequest(int acceptedSocketDescriptor, Arena * arena, bool first, bool * framed, bool * handedOver)
+{
+	char * buffer = NULL;
+	size_t length = 0;
+	Page * page = NULL;
+	const DeflatedPage * deflated = NULL;
+	Image * image = NULL;
+	char uploadUrl[IMAGE_UPLOAD_URL_SIZE];
+	size_t sent = 0;
+	Request request;
+	AccessRecord record;
+	int status = EXIT_SUCCESS;
+	bool abandoned = false;
+
+	AccessLogBegin(&record, acceptedSocketDescriptor);
+
+	if(ReadRequest(acceptedSocketDescriptor, arena, &buffer, &length, framed) == EXIT_FAILURE)
+	{
+		PrintError("HandleRequest() -> ReadRequest()", false, NULL);
+		MetricsAdd(METRIC_REQUESTS_FAILED, 1);
+		ArenaReset(arena);
+		return EXIT_FAILURE;
+	}
+	if(!first && length == 0)
+	{
+		// The client closed the kept connection
+		ArenaReset(arena);
+		return EXIT_FAILURE;
+	}
+
+	status = ParseRequest(buffer, length, &request);
+	PROBE3(request_parsed, acceptedSocketDescriptor, length, status);
+	if(status == EXIT_FAILURE)
+	{
+		PrintError("HandleRequest() -> ParseRequest()", false, "Malformed request");
+	}
+	else if(request.subscribe != SUBSCRIBE_NONE)
+	{
+		*handedOver = HandleSubscription(acceptedSocketDescriptor, &request, *framed, &sent) == EXIT_SUCCESS;
+		status = *handedOver ? EXIT_SUCCESS : EXIT_FAILURE;
+		abandoned = !*handedOver && sent > 0;
+	}
+	else
+	{
+		// The board refers to an upload by the URL of its content
+		if(request.imgData != NULL)
+		{
+			image = ImagePut(request.imgData, request.imgDataLength, uploadUrl, sizeof(uploadUrl));
+			request.img = image != NULL ? uploadUrl : request.img;
+		}
+
+		if(BoardPost(&request) == EXIT_FAILURE)
+		{
+			PrintError("HandleRequest() -> BoardPost()", false, NULL);
+			status = EXIT_FAILURE;
+		}
+		else if(image == NULL && request.img != NULL)
+		{
+			// An image that cannot be loaded is answered with the placeholder
+			image = ImageGet(request.img);
+		}
+	}
+
+	// A subscription that answered its status but could not be handed over is closed unanswered
+	if(!*handedOver && !abandoned)
+	{
+		page = RenderAcquire();
+		if(request.deflate)
+		{
+			// Small pages may not get smaller, they are sent as they are then
+			deflated = RenderDeflate(page);
+			if(deflated != NULL && deflated->length >= page->length)
+			{
+				deflated = NULL;
+			}
+		}
+		if(SendResponse(acceptedSocketDescriptor, arena, status, page, deflated, image, request.crc, &sent) == EXIT_FAILURE)
+		{
+			PrintError("HandleRequest() -> SendResponse()", false, NULL);
+			status = EXIT_FAILURE;
+			sent = 0;
+		}
+	}
+
+	PROBE3(response_complete, acceptedSocketDescriptor, status, sent);
+	MetricsAdd(status == EXIT_SUCCESS ? METRIC_REQUESTS_HANDLED : METRIC_REQUESTS_FAILED, 1);
+	MetricsAdd(METRIC_BYTES_IN, length);
+	MetricsAdd(METRIC_BYTES_OUT, sent);
+
+	if(AccessLogEnabled())
+	{
+		record.status = status;
+		record.bytesIn = length;
+		record.bytesOut = sent;
+		if(request.user != NULL)
+		{
+			strncpy(record.user, request.user, sizeof(record.user) - 1);
+		}
+		AccessLogCommit(&record);
+	}
+
+	if(page != NULL)
+	{
+		RenderRelease(page);
+	}
+	if(image != NULL)
+	{
+		ImageRelease(image);
+	}
+	ArenaReset(arena);
+	return sent > 0 && !*handedOver && !abandoned ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Function for serving one accepted connection in-process
+ *
+ * A connection carrying framed requests serves them one after another
+ * until the client closes it or stays idle for the keep-alive time. As
+ * soon as no next frame is waiting, the connection is parked with the
+ * acceptors, which submit it again once it is readable. It is closed
+ * unless it was parked or a subscription took it over. Without a park
+ * (outside the threaded server) the worker waits for the next frame.
+ *
+ * \param acceptedSocketDescriptor the descriptor of the accepted or resumed connection
+ *
+ */
+void HandleConnection(int acceptedSocketDescriptor)
+{
+	Connection * connection = ConnectionAcquire();
+	bool framed = false;
+	bool first = !ParkTake(acceptedSocketDescriptor);
+	bool handedOver = false;
+	bool kept = false;
+	int r = EXIT_SUCCESS;
+
+	if(connection == NULL)
+	{
+		PrintError("HandleConnection() -> ConnectionAcquire()", false, NULL);
+		MetricsAdd(METRIC_REQUESTS_FAILED, 1);
+		if(close(acceptedSocketDescriptor) == -1)
+		{
+			PrintError("HandleConnection() -> close()", true, NULL);
+		}
+		return;
+	}
+
+	// Reads and sends wait in poll() with the deadline of the request
+	if(first && fcntl(acceptedSocketDescriptor, F_SETFL, O_NONBLOCK) == -1)
+	{
+		PrintError("HandleConnection() -> fcntl()", true, NULL);
+	}
+
+	for(;;)
+	{
+		r = HandleRequest(acceptedSocketDescriptor, &connection->arena, first, &framed, &handedOver);
+		first = false;
+		if(r == EXIT_FAILURE || !framed || keepAliveSeconds == 0)
+		{
+			break;
+		}
+		if(WaitForRequest(acceptedSocketDescriptor, 0))
+		{
+			continue;
+		}
+		if(ParkDescriptor() != -1)
+		{
+			kept = ParkConnection(acceptedSocketDescriptor) == EXIT_SUCCESS;
+			break;
+		}
+		if(!WaitForRequest(acceptedSocketDescriptor, keepAliveSeconds * 1000))
+		{
+			break;
+		}
+	}
+	ConnectionRelease(connection);
+
+	if(!handedOver && !kept && close(acceptedSocketDescriptor) == -1)
+	{
+		PrintError("HandleConnection() -> close()", true, NULL);
+	}
+}
+
+/*
+ * =================================================================== eof ==
+ */
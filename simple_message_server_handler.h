@@ -0,0 +1,69 @@
+/*
+ * @file simple_message_server_handler.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_HANDLER_H
+#define SIMPLE_MESSAGE_SERVER_HANDLER_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+#include "simple_message_server_subscribe.h"
+#include "simple_message_server_pool.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define RESPONSE_HTML_FILE "bulletin_board.html"
+#define RESPONSE_PNG_FILE "bulletin_board.png"
+#define KEEP_ALIVE_DEFAULT 5
+#define REQUEST_MAX_DEFAULT (16 * 1024 * 1024)
+#define IO_TIMEOUT_DEFAULT 30
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* One parsed request, the strings point into the request buffer */
+typedef struct
+{
+	const char * user;
+	const char * img;	/* NULL if the client sent no image URL */
+	const unsigned char * imgData;	/* the uploaded image, NULL if none */
+	size_t imgDataLength;
+	bool deflate;		/* the client accepts a compressed HTML file */
+	bool crc;			/* the client checks the files with CRC-32C */
+	SubscribeMode subscribe;	/* SUBSCRIBE_NONE for a post */
+	const char * message;
+	size_t messageLength;
+} Request;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void HandlerKeepAlive(int seconds);
+void HandlerLimits(size_t maxRequest, int ioTimeout);
+void HandleConnection(int acceptedSocketDescriptor);
+int ReadRequest(int acceptedSocketDescriptor, Arena * arena, char ** buffer, size_t * length, bool * framed);
+int ParseRequest(char * buffer, size_t length, Request * request);
+int BoardOpen(const char * dataDirectory, size_t retain);
+int BoardPost(const Request * request);
+void BoardClose(void);
+int SendAll(int socketDescriptor, struct iovec * iov, int iovcnt);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,999 @@
+/*
+ * @file simple_message_server_image.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Image stage of the in-process handler: the image URL of a post is
+ * fetched, resized and returned as the PNG of the response.
+ *
+ * Processed images are addressed by the content of their source (SHA-256
+ * and length), so URLs with the same picture share one image in memory and
+ * one file in the cache directory ("<sha256>-<length>.png"). The directory
+ * also remembers which content a URL had ("url-<sha256 of the URL>"
+ * symbolic links), so a restarted server neither fetches nor resizes known
+ * images again. The hash is cryptographic because clients choose the
+ * content: nobody can make up a source that takes the place of another.
+ *
+ * Only one thread fetches a URL at a time, the others wait for its result.
+ * Failures are remembered for a while. The memory cache is bounded, least
+ * recently used URLs are dropped first.
+ *
+ * Images uploaded with the post get the URL "upload:<sha256>-<length>" of
+ * their content and are cached like fetched ones.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if defined(__has_include)
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#endif
+#include "simple_message_server.h"
+#include "simple_message_server_image.h"
+#include "simple_message_crc32c.h"
+#include "simple_message_sha256.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define IMAGE_BUCKETS 1024
+#define IMAGE_MAX_ENTRIES 4096
+#define IMAGE_MAX_FETCHERS 8
+#define IMAGE_MAX_SIZE (16UL * 1024 * 1024)
+#define IMAGE_RETRY_SECONDS 10
+#define IMAGE_FILE_NAME_SIZE 128
+#define IMAGE_UPLOAD_PREFIX "upload:"
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+typedef enum
+{
+	IMAGE_FETCHING,
+	IMAGE_READY,
+	IMAGE_FAILED
+} ImageState;
+
+/* What is known about a URL */
+typedef struct ImageEntry
+{
+	struct ImageEntry * next;		/* chain of the URL table */
+	struct ImageEntry * older;		/* LRU list */
+	struct ImageEntry * newer;
+	char * url;
+	uint64_t urlHash;
+	ImageState state;
+	time_t failedAt;
+	Image * image;					/* one reference while READY */
+} ImageEntry;
+
+typedef struct
+{
+	const char * prefix;
+	ImageFetcher fetcher;
+} FetcherEntry;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static pthread_mutex_t imageLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t imageCondition = PTHREAD_COND_INITIALIZER;
+static ImageEntry * urlTable[IMAGE_BUCKETS];
+static Image * contentTable[IMAGE_BUCKETS];
+static ImageEntry * oldestEntry = NULL;
+static ImageEntry * newestEntry = NULL;
+static size_t entryCount = 0;
+static size_t memoryUsed = 0;
+static size_t memoryLimit = IMAGE_DEFAULT_MEMORY;
+static int cacheDescriptor = -1;
+static int rootDescriptor = -1;
+static FetcherEntry fetchers[IMAGE_MAX_FETCHERS];
+static int fetcherCount = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint64_t Hash(const void * data, size_t length);
+static size_t ContentBucket(const unsigned char * digest);
+static void ContentName(const unsigned char * digest, size_t sourceLength, char * name, size_t nameSize);
+static void UrlLinkName(const char * url, char * name, size_t nameSize);
+static int OpenBeneath(int directory, const char * path);
+static int ReadWholeFile(int directory, const char * path, bool beneath, unsigned char ** data, size_t * length);
+static int FetchLocalFile(const char * url, unsigned char ** data, size_t * length);
+static Image * ResizeImage(const unsigned char * data, size_t length, const unsigned char * digest);
+static Image * ReadCachedImage(const char * name);
+static void WriteCachedImage(const Image * image, const char * url);
+static Image * LoadImage(const char * url, const unsigned char * source, size_t sourceLength, const unsigned char * sourceDigest);
+static Image * AcquireImage(const char * url, const unsigned char * source, size_t sourceLength, const unsigned char * sourceDigest);
+static Image * InternImage(Image * image);
+static void DropImage(Image * image);
+static void UnlinkEntry(ImageEntry * entry);
+static void TouchEntry(ImageEntry * entry);
+static void EvictEntry(ImageEntry * entry);
+static void EvictEntries(void);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for hashing bytes (FNV-1a, 64 bit)
+ *
+ * \param data the bytes
+ * \param length the number of bytes
+ *
+ * \return the hash
+ *
+ */
+static uint64_t Hash(const void * data, size_t length)
+{
+	const unsigned char * bytes = data;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ *
+ * \brief Function for getting the bucket of the content table of a source
+ *
+ * \param digest the SHA-256 of the source
+ *
+ * \return the index of the bucket
+ *
+ */
+static size_t ContentBucket(const unsigned char * digest)
+{
+	uint64_t bits = 0;
+
+	memcpy(&bits, digest, sizeof(bits));
+	return bits % IMAGE_BUCKETS;
+}
+
+/**
+ *
+ * \brief Function for getting the cache file name of a source
+ *
+ * \param digest the SHA-256 of the source
+ * \param sourceLength the number of bytes of the source
+ * \param name receives "<sha256>-<length>.png"
+ * \param nameSize the size of name
+ *
+ */
+static void ContentName(const unsigned char * digest, size_t sourceLength, char * name, size_t nameSize)
+{
+	char hex[SHA256_HEX_SIZE];
+
+	Sha256Hex(digest, hex);
+	snprintf(name, nameSize, "%s-%zu.png", hex, sourceLength);
+}
+
+/**
+ *
+ * \brief Function for getting the name of the cache link of a URL
+ *
+ * \param url the URL
+ * \param name receives "url-<sha256 of the URL>"
+ * \param nameSize the size of name
+ *
+ */
+static void UrlLinkName(const char * url, char * name, size_t nameSize)
+{
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	char hex[SHA256_HEX_SIZE];
+
+	Sha256(url, strlen(url), digest);
+	Sha256Hex(digest, hex);
+	snprintf(name, nameSize, "url-%s", hex);
+}
+
+/**
+ *
+ * \brief Function for opening a file that must lie below a directory
+ *
+ * Neither ".." nor a symbolic link may lead out of the directory. The
+ * kernel resolves the path with openat2(RESOLVE_BENEATH |
+ * RESOLVE_NO_SYMLINKS); where that is unavailable the path is walked one
+ * component after the other with O_NOFOLLOW.
+ *
+ * \param directory the directory
+ * \param path the relative path of the file
+ *
+ * \return the read only descriptor of the file, -1 in case of failure
+ *
+ */
+static int OpenBeneath(int directory, const char * path)
+{
+	char component[NAME_MAX + 1];
+	int current = directory;
+	int descriptor = -1;
+
+#ifdef RESOLVE_BENEATH
+	struct open_how how;
+
+	memset(&how, 0, sizeof(how));
+	how.flags = O_RDONLY | O_CLOEXEC;
+	how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+	descriptor = (int) syscall(SYS_openat2, directory, path, &how, sizeof(how));
+	if(descriptor != -1 || (errno != ENOSYS && errno != EPERM))
+	{
+		return descriptor;
+	}
+#endif
+
+	for(;;)
+	{
+		const char * slash = strchr(path, '/');
+		size_t length = slash != NULL ? (size_t) (slash - path) : strlen(path);
+
+		if(length == 0 || length > NAME_MAX || (length == 2 && path[0] == '.' && path[1] == '.'))
+		{
+			descriptor = -1;
+			errno = EACCES;
+			break;
+		}
+		memcpy(component, path, length);
+		component[length] = '\0';
+
+		descriptor = openat(current, component, O_NOFOLLOW | O_CLOEXEC | (slash != NULL ? O_PATH | O_DIRECTORY : O_RDONLY));
+		if(current != directory)
+		{
+			close(current);
+		}
+		if(descriptor == -1 || slash == NULL)
+		{
+			break;
+		}
+		current = descriptor;
+		path = slash + 1;
+	}
+	return descriptor;
+}
+
+/**
+ *
+ * \brief Function for reading a whole file into memory
+ *
+ * \param directory the directory relative paths are resolved against (or AT_FDCWD)
+ * \param path the file
+ * \param beneath set if the path must not lead out of the directory (see OpenBeneath())
+ * \param data receives the allocated contents
+ * \param length receives the number of bytes
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int ReadWholeFile(int directory, const char * path, bool beneath, unsigned char ** data, size_t * length)
+{
+	struct stat status;
+	size_t done = 0;
+	ssize_t r = 0;
+	int descriptor = beneath ? OpenBeneath(directory, path) : openat(directory, path, O_RDONLY | O_CLOEXEC);
+
+	if(descriptor == -1)
+	{
+		return EXIT_FAILURE;
+	}
+	if(fstat(descriptor, &status) == -1 || !S_ISREG(status.st_mode) || (size_t) status.st_size > IMAGE_MAX_SIZE)
+	{
+		close(descriptor);
+		return EXIT_FAILURE;
+	}
+
+	*length = (size_t) status.st_size;
+	*data = malloc(*length > 0 ? *length : 1);
+	if(*data == NULL)
+	{
+		close(descriptor);
+		return EXIT_FAILURE;
+	}
+
+	while(done < *length)
+	{
+		r = read(descriptor, *data + done, *length - done);
+		if(r == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r <= 0)
+		{
+			free(*data);
+			close(descriptor);
+			return EXIT_FAILURE;
+		}
+		done += (size_t) r;
+	}
+
+	close(descriptor);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Fetcher for file:// URLs and absolute paths (stand-in for remote fetchers)
+ *
+ * Paths are resolved below the image root, clients must not read arbitrary
+ * files of the server: neither ".." nor symbolic links may leave it.
+ *
+ * \param url the URL of the image
+ * \param data receives the allocated image
+ * \param length receives the number of bytes
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int FetchLocalFile(const char * url, unsigned char ** data, size_t * length)
+{
+	const char * path = strncmp(url, "file://", 7) == 0 ? url + 7 : url;
+
+	while(*path == '/')
+	{
+		path++;
+	}
+	if(*path == '\0')
+	{
+		return EXIT_FAILURE;
+	}
+	return ReadWholeFile(rootDescriptor, path, true, data, length);
+}
+
+/**
+ *
+ * \brief Function for registering a fetcher for URLs starting with a prefix
+ *
+ * Fetchers registered later take precedence.
+ *
+ * \param prefix the beginning of the URLs (e.g. "http://")
+ * \param fetcher the function loading such URLs
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ImageRegisterFetcher(const char * prefix, ImageFetcher fetcher)
+{
+	if(fetcherCount == IMAGE_MAX_FETCHERS)
+	{
+		PrintError("ImageRegisterFetcher()", false, "Too many fetchers");
+		return EXIT_FAILURE;
+	}
+	fetchers[fetcherCount].prefix = prefix;
+	fetchers[fetcherCount].fetcher = fetcher;
+	fetcherCount++;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for turning a fetched source into the image of the response
+ *
+ * Hook for scaling the image down to a thumbnail. The server has no image
+ * library, so PNG sources are passed through and everything else is
+ * rejected (the response announces a PNG file).
+ *
+ * \param data the fetched source
+ * \param length the number of bytes of the source
+ * \param digest the SHA-256 of the source
+ *
+ * \return the image (one reference) or NULL in case of failure
+ *
+ */
+static Image * ResizeImage(const unsigned char * data, size_t length, const unsigned char * digest)
+{
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	Image * image = NULL;
+
+	if(length < sizeof(signature) || memcmp(data, signature, sizeof(signature)) != 0)
+	{
+		return NULL;
+	}
+
+	image = malloc(sizeof(Image) + length);
+	if(image == NULL)
+	{
+		return NULL;
+	}
+	image->next = NULL;
+	memcpy(image->digest, digest, SHA256_DIGEST_SIZE);
+	image->sourceLength = length;
+	image->references = 1;
+	image->crc = Crc32c(0, data, length);
+	image->length = length;
+	memcpy(image->data, data, length);
+	return image;
+}
+
+/**
+ *
+ * \brief Function for reading a processed image from the cache directory
+ *
+ * \param name the file name ("<sha256>-<length>.png" or a URL link)
+ *
+ * \return the image (one reference) or NULL if it is not cached
+ *
+ */
+static Image * ReadCachedImage(const char * name)
+{
+	char target[IMAGE_FILE_NAME_SIZE];
+	char hex[SHA256_HEX_SIZE];
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	unsigned char * data = NULL;
+	size_t length = 0;
+	size_t sourceLength = 0;
+	int parsed = 0;
+	ssize_t targetLength = readlinkat(cacheDescriptor, name, target, sizeof(target) - 1);
+	Image * image = NULL;
+
+	// The content address is part of the (link target) name
+	if(targetLength > 0)
+	{
+		target[targetLength] = '\0';
+		name = target;
+	}
+	if(sscanf(name, "%64[0-9a-f]-%zu.png%n", hex, &sourceLength, &parsed) != 2 || parsed == 0 ||
+		name[parsed] != '\0' || strlen(hex) != 2 * SHA256_DIGEST_SIZE)
+	{
+		return NULL;	// Also the names of the former 64 bit hashes
+	}
+	for(int i = 0; i < SHA256_DIGEST_SIZE; i++)
+	{
+		sscanf(hex + 2 * i, "%2hhx", &digest[i]);
+	}
+	if(ReadWholeFile(cacheDescriptor, name, false, &data, &length) == EXIT_FAILURE)
+	{
+		return NULL;
+	}
+
+	image = malloc(sizeof(Image) + length);
+	if(image != NULL)
+	{
+		image->next = NULL;
+		memcpy(image->digest, digest, SHA256_DIGEST_SIZE);
+		image->sourceLength = sourceLength;
+		image->references = 1;
+		image->crc = Crc32c(0, data, length);
+		image->length = length;
+		memcpy(image->data, data, length);
+	}
+	free(data);
+	return image;
+}
+
+/**
+ *
+ * \brief Function for storing a processed image in the cache directory
+ *
+ * The image file and the URL link are written under temporary names and
+ * renamed, readers never see partial files. Failures only cost the cache.
+ *
+ * \param image the processed image
+ * \param url the URL the image was fetched from
+ *
+ */
+static void WriteCachedImage(const Image * image, const char * url)
+{
+	char name[IMAGE_FILE_NAME_SIZE];
+	char link[IMAGE_FILE_NAME_SIZE];
+	char temporary[IMAGE_FILE_NAME_SIZE + 16];
+	size_t done = 0;
+	ssize_t r = 0;
+	int descriptor = -1;
+
+	ContentName(image->digest, image->sourceLength, name, sizeof(name));
+	UrlLinkName(url, link, sizeof(link));
+
+	if(faccessat(cacheDescriptor, name, F_OK, 0) == -1)
+	{
+		snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", name, (long) gettid());
+		descriptor = openat(cacheDescriptor, temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if(descriptor == -1)
+		{
+			PrintError("WriteCachedImage() -> openat()", true, temporary);
+			return;
+		}
+		while(done < image->length)
+		{
+			r = write(descriptor, image->data + done, image->length - done);
+			if(r == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			if(r <= 0)
+			{
+				break;
+			}
+			done += (size_t) r;
+		}
+		close(descriptor);
+		if(done < image->length || renameat(cacheDescriptor, temporary, cacheDescriptor, name) == -1)
+		{
+			PrintError("WriteCachedImage() -> write()", true, temporary);
+			unlinkat(cacheDescriptor, temporary, 0);
+			return;
+		}
+	}
+
+	snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", link, (long) gettid());
+	if(symlinkat(name, cacheDescriptor, temporary) == -1 ||
+		renameat(cacheDescriptor, temporary, cacheDescriptor, link) == -1)
+	{
+		PrintError("WriteCachedImage() -> symlinkat()", true, link);
+		unlinkat(cacheDescriptor, temporary, 0);
+	}
+}
+
+/**
+ *
+ * \brief Function for producing the image of a URL (runs without the image lock)
+ *
+ * \param url the URL of the image
+ * \param source the uploaded source, NULL -> fetched from the URL
+ * \param sourceLength the number of bytes of the uploaded source
+ * \param sourceDigest the SHA-256 of the uploaded source
+ *
+ * \return the image (one reference) or NULL in case of failure
+ *
+ */
+static Image * LoadImage(const char * url, const unsigned char * source, size_t sourceLength, const unsigned char * sourceDigest)
+{
+	char name[IMAGE_FILE_NAME_SIZE];
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	unsigned char * data = NULL;
+	size_t length = 0;
+	ImageFetcher fetcher = NULL;
+	Image * image = NULL;
+
+	// Known URL -> no fetch and no resize
+	if(cacheDescriptor != -1)
+	{
+		UrlLinkName(url, name, sizeof(name));
+		image = ReadCachedImage(name);
+		if(image != NULL)
+		{
+			return image;
+		}
+	}
+
+	if(source == NULL)
+	{
+		for(int i = fetcherCount - 1; i >= 0 && fetcher == NULL; i--)
+		{
+			if(strncmp(url, fetchers[i].prefix, strlen(fetchers[i].prefix)) == 0)
+			{
+				fetcher = fetchers[i].fetcher;
+			}
+		}
+		if(fetcher == NULL || fetcher(url, &data, &length) == EXIT_FAILURE)
+		{
+			return NULL;
+		}
+		source = data;
+		sourceLength = length;
+		Sha256(source, sourceLength, digest);
+		sourceDigest = digest;
+	}
+
+	// Known content behind a new URL -> no resize
+	if(cacheDescriptor != -1)
+	{
+		ContentName(sourceDigest, sourceLength, name, sizeof(name));
+		image = ReadCachedImage(name);
+	}
+	if(image == NULL)
+	{
+		image = ResizeImage(source, sourceLength, sourceDigest);
+	}
+	free(data);
+
+	if(image != NULL && cacheDescriptor != -1)
+	{
+		WriteCachedImage(image, url);
+	}
+	return image;
+}
+
+/**
+ *
+ * \brief Function for sharing images with the same content (image lock held)
+ *
+ * \param image a freshly loaded image (one reference, taken over)
+ *
+ * \return the image in the content table (one reference)
+ *
+ */
+static Image * InternImage(Image * image)
+{
+	Image ** bucket = &contentTable[ContentBucket(image->digest)];
+
+	for(Image * known = *bucket; known != NULL; known = known->next)
+	{
+		if(known->sourceLength == image->sourceLength && memcmp(known->digest, image->digest, SHA256_DIGEST_SIZE) == 0)
+		{
+			free(image);
+			known->references++;
+			return known;
+		}
+	}
+
+	image->next = *bucket;
+	*bucket = image;
+	memoryUsed += image->length;
+	return image;
+}
+
+/**
+ *
+ * \brief Function for dropping a reference of an image (image lock held)
+ *
+ * \param image the image
+ *
+ */
+static void DropImage(Image * image)
+{
+	Image ** link = &contentTable[ContentBucket(image->digest)];
+
+	if(--image->references > 0)
+	{
+		return;
+	}
+
+	while(*link != image)
+	{
+		link = &(*link)->next;
+	}
+	*link = image->next;
+	memoryUsed -= image->length;
+	free(image);
+}
+
+/**
+ *
+ * \brief Function for removing an entry from the LRU list (image lock held)
+ *
+ * \param entry the entry
+ *
+ */
+static void UnlinkEntry(ImageEntry * entry)
+{
+	if(entry->older != NULL)
+	{
+		entry->older->newer = entry->newer;
+	}
+	else if(oldestEntry == entry)
+	{
+		oldestEntry = entry->newer;
+	}
+	if(entry->newer != NULL)
+	{
+		entry->newer->older = entry->older;
+	}
+	else if(newestEntry == entry)
+	{
+		newestEntry = entry->older;
+	}
+	entry->older = entry->newer = NULL;
+}
+
+/**
+ *
+ * \brief Function for marking an entry as most recently used (image lock held)
+ *
+ * \param entry the entry
+ *
+ */
+static void TouchEntry(ImageEntry * entry)
+{
+	UnlinkEntry(entry);
+	entry->older = newestEntry;
+	if(newestEntry != NULL)
+	{
+		newestEntry->newer = entry;
+	}
+	newestEntry = entry;
+	if(oldestEntry == NULL)
+	{
+		oldestEntry = entry;
+	}
+}
+
+/**
+ *
+ * \brief Function for forgetting a URL (image lock held)
+ *
+ * \param entry the entry of the URL, it must not be fetched right now
+ *
+ */
+static void EvictEntry(ImageEntry * entry)
+{
+	ImageEntry ** link = &urlTable[entry->urlHash % IMAGE_BUCKETS];
+
+	UnlinkEntry(entry);
+	while(*link != entry)
+	{
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+	if(entry->image != NULL)
+	{
+		DropImage(entry->image);
+	}
+	free(entry->url);
+	free(entry);
+	entryCount--;
+}
+
+/**
+ *
+ * \brief Function for dropping least recently used URLs over the limits (image lock held)
+ *
+ * Entries being fetched have waiters, they are not in the LRU list.
+ *
+ */
+static void EvictEntries(void)
+{
+	while((memoryUsed > memoryLimit || entryCount > IMAGE_MAX_ENTRIES) && oldestEntry != NULL)
+	{
+		EvictEntry(oldestEntry);
+	}
+}
+
+/**
+ *
+ * \brief Function for getting the image of a URL, loading it if it is unknown
+ *
+ * \param url the URL of the image
+ * \param source the uploaded source, NULL -> fetched from the URL
+ * \param sourceLength the number of bytes of the uploaded source
+ * \param sourceDigest the SHA-256 of the uploaded source
+ *
+ * \return the image (one reference) or NULL if none is available
+ *
+ */
+static Image * AcquireImage(const char * url, const unsigned char * source, size_t sourceLength, const unsigned char * sourceDigest)
+{
+	uint64_t urlHash = Hash(url, strlen(url));
+	ImageEntry * entry = NULL;
+	Image * image = NULL;
+
+	pthread_mutex_lock(&imageLock);
+	for(;;)
+	{
+		for(entry = urlTable[urlHash % IMAGE_BUCKETS]; entry != NULL; entry = entry->next)
+		{
+			if(entry->urlHash == urlHash && strcmp(entry->url, url) == 0)
+			{
+				break;
+			}
+		}
+		if(entry == NULL || entry->state != IMAGE_FETCHING)
+		{
+			break;
+		}
+		// Somebody else fetches the URL right now
+		pthread_cond_wait(&imageCondition, &imageLock);
+	}
+
+	if(entry != NULL && entry->state == IMAGE_READY)
+	{
+		TouchEntry(entry);
+		entry->image->references++;
+		image = entry->image;
+		pthread_mutex_unlock(&imageLock);
+		return image;
+	}
+	if(entry != NULL && time(NULL) - entry->failedAt < IMAGE_RETRY_SECONDS)
+	{
+		pthread_mutex_unlock(&imageLock);
+		return NULL;
+	}
+
+	if(entry == NULL)
+	{
+		entry = calloc(1, sizeof(ImageEntry));
+		if(entry == NULL || (entry->url = strdup(url)) == NULL)
+		{
+			pthread_mutex_unlock(&imageLock);
+			PrintError("AcquireImage() -> malloc()", true, NULL);
+			free(entry);
+			return NULL;
+		}
+		entry->urlHash = urlHash;
+		entry->next = urlTable[urlHash % IMAGE_BUCKETS];
+		urlTable[urlHash % IMAGE_BUCKETS] = entry;
+		entryCount++;
+	}
+	else
+	{
+		UnlinkEntry(entry);
+	}
+	entry->state = IMAGE_FETCHING;
+	pthread_mutex_unlock(&imageLock);
+
+	image = LoadImage(url, source, sourceLength, sourceDigest);
+
+	pthread_mutex_lock(&imageLock);
+	if(image != NULL)
+	{
+		image = InternImage(image);
+		image->references++;	// one for the entry, one for the caller
+		entry->image = image;
+		entry->state = IMAGE_READY;
+	}
+	else
+	{
+		entry->state = IMAGE_FAILED;
+		entry->failedAt = time(NULL);
+	}
+	TouchEntry(entry);
+	EvictEntries();
+	pthread_cond_broadcast(&imageCondition);
+	pthread_mutex_unlock(&imageLock);
+
+	return image;
+}
+
+/**
+ *
+ * \brief Function for getting the image of a URL
+ *
+ * \param url the URL of the image
+ *
+ * \return the image (release with ImageRelease()) or NULL if none is available
+ *
+ */
+Image * ImageGet(const char * url)
+{
+	return AcquireImage(url, NULL, 0, NULL);
+}
+
+/**
+ *
+ * \brief Function for getting the image of an uploaded source
+ *
+ * Uploads with the same content share one image, the source is neither
+ * fetched nor kept.
+ *
+ * \param source the uploaded bytes
+ * \param sourceLength the number of bytes
+ * \param url receives the URL the image is known by on the board
+ * \param urlSize the size of url (at least IMAGE_UPLOAD_URL_SIZE)
+ *
+ * \return the image (release with ImageRelease()) or NULL if the upload is not usable
+ *
+ */
+Image * ImagePut(const unsigned char * source, size_t sourceLength, char * url, size_t urlSize)
+{
+	unsigned char digest[SHA256_DIGEST_SIZE];
+	char hex[SHA256_HEX_SIZE];
+
+	Sha256(source, sourceLength, digest);
+	Sha256Hex(digest, hex);
+	snprintf(url, urlSize, IMAGE_UPLOAD_PREFIX "%s-%zu", hex, sourceLength);
+	if(sourceLength > IMAGE_MAX_SIZE)
+	{
+		return NULL;
+	}
+	return AcquireImage(url, source, sourceLength, digest);
+}
+
+/**
+ *
+ * \brief Function for giving back an image returned by ImageGet() or ImagePut()
+ *
+ * \param image the image
+ *
+ */
+void ImageRelease(Image * image)
+{
+	pthread_mutex_lock(&imageLock);
+	DropImage(image);
+	pthread_mutex_unlock(&imageLock);
+}
+
+/**
+ *
+ * \brief Function for preparing the image stage
+ *
+ * \param cacheDirectory the directory of the disk cache, NULL -> memory only
+ * \param root the directory local image URLs refer to, NULL -> no local images
+ * \param limit the bytes of images kept in memory
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ImageOpen(const char * cacheDirectory, const char * root, size_t limit)
+{
+	memoryLimit = limit;
+
+	if(cacheDirectory != NULL)
+	{
+		if(mkdir(cacheDirectory, 0755) == -1 && errno != EEXIST)
+		{
+			PrintError("ImageOpen() -> mkdir()", true, cacheDirectory);
+			return EXIT_FAILURE;
+		}
+		cacheDescriptor = open(cacheDirectory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(cacheDescriptor == -1)
+		{
+			PrintError("ImageOpen() -> open()", true, cacheDirectory);
+			return EXIT_FAILURE;
+		}
+	}
+
+	fetcherCount = 0;
+	if(root == NULL)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	rootDescriptor = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(rootDescriptor == -1)
+	{
+		PrintError("ImageOpen() -> open()", true, root);
+		return EXIT_FAILURE;
+	}
+	return ImageRegisterFetcher("/", FetchLocalFile) | ImageRegisterFetcher("file://", FetchLocalFile);
+}
+
+/**
+ *
+ * \brief Function for freeing the memory cache
+ *
+ * Must be called after all requests have finished.
+ *
+ */
+void ImageClose(void)
+{
+	pthread_mutex_lock(&imageLock);
+	while(oldestEntry != NULL)
+	{
+		EvictEntry(oldestEntry);
+	}
+	if(cacheDescriptor != -1)
+	{
+		close(cacheDescriptor);
+		cacheDescriptor = -1;
+	}
+	if(rootDescriptor != -1)
+	{
+		close(rootDescriptor);
+		rootDescriptor = -1;
+	}
+	pthread_mutex_unlock(&imageLock);
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,62 @@
+/*
+ * @file simple_message_server_image.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_IMAGE_H
+#define SIMPLE_MESSAGE_SERVER_IMAGE_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "simple_message_sha256.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define IMAGE_DEFAULT_MEMORY (64UL * 1024 * 1024)
+#define IMAGE_UPLOAD_URL_SIZE 96
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* A processed image, shared by all URLs with the same source content */
+typedef struct Image
+{
+	struct Image * next;		/* chain of the content table */
+	unsigned char digest[SHA256_DIGEST_SIZE];	/* content address: SHA-256 and length of the source */
+	size_t sourceLength;
+	int references;				/* protected by the image lock */
+	size_t length;
+	uint32_t crc;				/* CRC-32C of data */
+	unsigned char data[];
+} Image;
+
+/* Loads the bytes behind a URL (allocated with malloc) */
+typedef int (* ImageFetcher)(const char * url, unsigned char ** data, size_t * length);
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int ImageOpen(const char * cacheDirectory, const char * root, size_t memoryLimit);
+int ImageRegisterFetcher(const char * prefix, ImageFetcher fetcher);
+Image * ImageGet(const char * url);
+Image * ImagePut(const unsigned char * source, size_t sourceLength, char * url, size_t urlSize);
+void ImageRelease(Image * image);
+void ImageClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
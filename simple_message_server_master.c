@@ -0,0 +1,898 @@
+/*
+ * @file simple_message_server_master.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Master process owning the listening sockets. It starts the worker
+ * processes, respawns them when they die and upgrades the binary on
+ * SIGHUP/SIGUSR2: the new binary is executed as child of the master and
+ * receives the listeners over a Unix domain socket (SCM_RIGHTS), so the
+ * listen queue never disappears. The workers of the new master report
+ * over a pipe once they are set up to serve (the store may keep them
+ * waiting), and only when all of them did the new master reports to the
+ * old one. Then the old workers are stopped gracefully (they stop
+ * accepting and finish their connections) and the old master exits. The
+ * old master waits for that report in its main loop, so it goes on
+ * respawning its workers meanwhile.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "simple_message_server.h"
+#include "simple_message_server_master.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define UPGRADE_TIMEOUT 30		/* seconds the new binary has to report that it serves */
+#define UPGRADE_READY 'R'
+#define RESPAWN_MIN_LIFETIME 1	/* seconds, faster dying workers are respawned with delay */
+#define RESPAWN_MAX_DELAY 60	/* seconds, the delay doubles up to this for every quick death */
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+typedef struct
+{
+	pid_t pid;		/* 0 if the worker is not running */
+	time_t started;
+	bool respawn;	/* the worker is started again at respawnAt */
+	time_t respawnAt;
+	int delay;		/* seconds before the next respawn, 0 -> at once */
+} WorkerProcess;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static int stopPipe[2] = { -1, -1 };
+static volatile sig_atomic_t stopRequested = 0;
+
+static volatile sig_atomic_t childExited = 0;
+static volatile sig_atomic_t upgradeRequested = 0;
+static volatile sig_atomic_t terminateRequested = 0;
+
+static int upgradeDescriptor = -1;	/* connection to the old master after an upgrade */
+static int readyPipe[2] = { -1, -1 };	/* the workers of an upgraded master report over it */
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void StopSignalHandler(int signal);
+static void MasterSignalHandler(int signal);
+static int SendListeners(int socketDescriptor, const Listeners * listeners);
+static pid_t StartWorker(Listeners * listeners, ServeFunction serve, void * argument, const sigset_t * originalMask);
+static int NotifyUpgradeReady(void);
+static int StartUpgrade(const char * binaryPath, const Listeners * listeners, const char * const argv[], const sigset_t * originalMask, pid_t * pid);
+static int FinishUpgrade(int socketDescriptor, pid_t pid, bool reported);
+static void AbandonUpgrade(void);
+static void SignalWorkers(WorkerProcess * workers, int workerCount, int signal);
+static time_t Now(void);
+static void ScheduleRespawn(WorkerProcess * worker, bool quick);
+static int RespawnWorkers(WorkerProcess * workers, int workerCount, Listeners * listeners, ServeFunction serve, void * argument, const sigset_t * originalMask, time_t * next);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for processing SIGTERM/SIGINT in a serving process
+ *
+ * \param signal the signal that shall be handled
+ *
+ */
+static void StopSignalHandler(int signal)
+{
+	int savedErrno = errno;
+
+	(void) signal;
+	stopRequested = 1;
+	// Wake up every acceptor polling the stop pipe (the byte is never read)
+	if(write(stopPipe[1], "", 1) == -1)
+	{
+		// Pipe already full -> already woken up
+	}
+	errno = savedErrno;
+}
+
+/**
+ *
+ * \brief Function for creating the handler of a graceful stop (SIGTERM/SIGINT)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int CreateStopHandler(void)
+{
+	struct sigaction signalAction;
+
+	if(stopPipe[0] == -1 && pipe2(stopPipe, O_NONBLOCK | O_CLOEXEC) == -1)
+	{
+		PrintError("CreateStopHandler() -> pipe2()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	signalAction.sa_handler = StopSignalHandler;
+	sigemptyset(&signalAction.sa_mask);
+	signalAction.sa_flags = 0;	// Interrupt blocking calls
+
+	if(sigaction(SIGTERM, &signalAction, NULL) == -1 || sigaction(SIGINT, &signalAction, NULL) == -1)
+	{
+		PrintError("CreateStopHandler() -> sigaction()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for checking whether a graceful stop was requested
+ *
+ * \return true if the process shall stop accepting connections
+ *
+ */
+bool StopRequested(void)
+{
+	return stopRequested != 0;
+}
+
+/**
+ *
+ * \brief Function for getting the descriptor that becomes readable on a stop request
+ *
+ * \return the read end of the stop pipe or -1 if there is no stop handler
+ *
+ */
+int GetStopDescriptor(void)
+{
+	return stopPipe[0];
+}
+
+/**
+ *
+ * \brief Function for waiting until all child processes have exited
+ *
+ */
+void WaitForChildren(void)
+{
+	for(;;)
+	{
+		if(waitpid(-1, NULL, 0) > 0)
+		{
+			continue;
+		}
+		if(errno == EINTR)
+		{
+			continue;
+		}
+		break;	// ECHILD -> no children left
+	}
+}
+
+/**
+ *
+ * \brief Function for processing the signals of the master process
+ *
+ * \param signal the signal that shall be handled
+ *
+ */
+static void MasterSignalHandler(int signal)
+{
+	switch(signal)
+	{
+		case SIGCHLD:
+			childExited = 1;
+			break;
+		case SIGHUP:
+		case SIGUSR2:
+			upgradeRequested = 1;
+			break;
+		default:
+			terminateRequested = 1;
+			break;
+	}
+}
+
+/**
+ *
+ * \brief Function for taking over the listeners of the previous master
+ *
+ * \param listeners the received listening sockets
+ * \param inherited set to true if the process was started by an upgrade
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ReceiveInheritedListeners(Listeners * listeners, bool * inherited)
+{
+	const char * value = getenv(UPGRADE_ENVIRONMENT);
+	char controlBuffer[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+	struct msghdr message;
+	struct iovec iov;
+	struct cmsghdr * control = NULL;
+	int count = 0;
+	char * end = NULL;
+
+	*inherited = false;
+	if(value == NULL)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	upgradeDescriptor = (int) strtol(value, &end, 10);
+	unsetenv(UPGRADE_ENVIRONMENT);
+	if(end == value || *end != '\0' || upgradeDescriptor < 0)
+	{
+		PrintError("ReceiveInheritedListeners()", false, "Invalid " UPGRADE_ENVIRONMENT);
+		upgradeDescriptor = -1;
+		return EXIT_FAILURE;
+	}
+	fcntl(upgradeDescriptor, F_SETFD, FD_CLOEXEC);
+
+	memset(&message, 0, sizeof(message));
+	iov.iov_base = &count;
+	iov.iov_len = sizeof(count);
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = controlBuffer;
+	message.msg_controllen = sizeof(controlBuffer);
+
+	if(recvmsg(upgradeDescriptor, &message, MSG_CMSG_CLOEXEC) != sizeof(count))
+	{
+		PrintError("ReceiveInheritedListeners() -> recvmsg()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	control = CMSG_FIRSTHDR(&message);
+	if(control == NULL || control->cmsg_level != SOL_SOCKET || control->cmsg_type != SCM_RIGHTS ||
+		count < 1 || count > MAX_LISTENERS || control->cmsg_len != CMSG_LEN(sizeof(int) * count))
+	{
+		PrintError("ReceiveInheritedListeners()", false, "Unexpected listener message");
+		return EXIT_FAILURE;
+	}
+
+	memcpy(listeners->descriptors, CMSG_DATA(control), sizeof(int) * count);
+	listeners->count = count;
+	*inherited = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for telling the previous master that the new one is serving
+ *
+ * Does nothing if the process was not started by an upgrade.
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int NotifyUpgradeReady(void)
+{
+	char ready = UPGRADE_READY;
+
+	if(upgradeDescriptor == -1)
+	{
+		return EXIT_SUCCESS;
+	}
+	if(write(upgradeDescriptor, &ready, 1) != 1)
+	{
+		PrintError("NotifyUpgradeReady() -> write()", true, NULL);
+		close(upgradeDescriptor);
+		upgradeDescriptor = -1;
+		return EXIT_FAILURE;
+	}
+	close(upgradeDescriptor);
+	upgradeDescriptor = -1;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for reporting that the serving process is set up
+ *
+ * A worker reports to its master, which is waiting for all of its workers
+ * after an upgrade; a server without master reports to the previous one.
+ * Does nothing if no one is waiting.
+ *
+ */
+void NotifyServing(void)
+{
+	char ready = UPGRADE_READY;
+
+	if(readyPipe[1] != -1)
+	{
+		if(write(readyPipe[1], &ready, 1) != 1)
+		{
+			PrintError("NotifyServing() -> write()", true, NULL);
+		}
+		close(readyPipe[1]);
+		readyPipe[1] = -1;
+	}
+	if(NotifyUpgradeReady() == EXIT_FAILURE)
+	{
+		PrintError("NotifyServing() -> NotifyUpgradeReady()", false, NULL);
+	}
+}
+
+/**
+ *
+ * \brief Function for passing the listeners to another process (SCM_RIGHTS)
+ *
+ * \param socketDescriptor the connected Unix domain socket
+ * \param listeners the listening sockets
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int SendListeners(int socketDescriptor, const Listeners * listeners)
+{
+	char controlBuffer[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+	struct msghdr message;
+	struct iovec iov;
+	struct cmsghdr * control = NULL;
+	int count = listeners->count;
+
+	memset(controlBuffer, 0, sizeof(controlBuffer));
+	memset(&message, 0, sizeof(message));
+	iov.iov_base = &count;
+	iov.iov_len = sizeof(count);
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = controlBuffer;
+	message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+	control = CMSG_FIRSTHDR(&message);
+	control->cmsg_level = SOL_SOCKET;
+	control->cmsg_type = SCM_RIGHTS;
+	control->cmsg_len = CMSG_LEN(sizeof(int) * count);
+	memcpy(CMSG_DATA(control), listeners->descriptors, sizeof(int) * count);
+
+	if(sendmsg(socketDescriptor, &message, MSG_NOSIGNAL) != sizeof(count))
+	{
+		PrintError("SendListeners() -> sendmsg()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for starting one worker process
+ *
+ * \param listeners the listening sockets
+ * \param serve the function serving the listeners in the worker
+ * \param argument the argument passed to serve
+ * \param originalMask the signal mask the worker shall run with
+ *
+ * \return the pid of the worker or -1 in case of failure
+ *
+ */
+static pid_t StartWorker(Listeners * listeners, ServeFunction serve, void * argument, const sigset_t * originalMask)
+{
+	struct sigaction signalAction;
+	pid_t pid = fork();
+
+	if(pid == -1)
+	{
+		PrintError("StartWorker() -> fork()", true, NULL);
+		return -1;
+	}
+
+	if(pid == 0)	// Worker process
+	{
+		// The master signals are not for the worker, upgrades are the master's business
+		memset(&signalAction, 0, sizeof(signalAction));
+		signalAction.sa_handler = SIG_IGN;
+		sigemptyset(&signalAction.sa_mask);
+		sigaction(SIGHUP, &signalAction, NULL);
+		sigaction(SIGUSR2, &signalAction, NULL);
+		signalAction.sa_handler = SIG_DFL;
+		sigaction(SIGCHLD, &signalAction, NULL);
+		sigprocmask(SIG_SETMASK, originalMask, NULL);
+		if(upgradeDescriptor != -1)
+		{
+			close(upgradeDescriptor);
+			upgradeDescriptor = -1;
+		}
+		if(readyPipe[0] != -1)
+		{
+			close(readyPipe[0]);
+			readyPipe[0] = -1;
+		}
+
+		exit(serve(listeners, argument));
+	}
+	return pid;
+}
+
+/**
+ *
+ * \brief Function for executing a new binary that takes over the listeners
+ *
+ * \param binaryPath the path of the (new) server binary
+ * \param listeners the listening sockets
+ * \param argv the command line of the running master
+ * \param originalMask the signal mask the new binary shall run with
+ * \param pid receives the pid of the new master
+ *
+ * \return the descriptor the new master reports over, see FinishUpgrade()
+ * \return -1 if the upgrade failed and the old master keeps serving
+ *
+ */
+static int StartUpgrade(const char * binaryPath, const Listeners * listeners, const char * const argv[], const sigset_t * originalMask, pid_t * pid)
+{
+	int pair[2];
+	char descriptorText[16];
+
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1)
+	{
+		PrintError("StartUpgrade() -> socketpair()", true, NULL);
+		return -1;
+	}
+
+	*pid = fork();
+	if(*pid == -1)
+	{
+		PrintError("StartUpgrade() -> fork()", true, NULL);
+		close(pair[0]);
+		close(pair[1]);
+		return -1;
+	}
+
+	if(*pid == 0)	// New master
+	{
+		close(pair[0]);
+		fcntl(pair[1], F_SETFD, 0);	// Keep it across exec
+		snprintf(descriptorText, sizeof(descriptorText), "%d", pair[1]);
+		setenv(UPGRADE_ENVIRONMENT, descriptorText, 1);
+		sigprocmask(SIG_SETMASK, originalMask, NULL);
+
+		execv(binaryPath, (char * const *) argv);
+
+		PrintError("StartUpgrade() -> execv()", true, binaryPath);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(pair[1]);
+	if(SendListeners(pair[0], listeners) == EXIT_FAILURE)
+	{
+		PrintError("StartUpgrade() -> SendListeners()", false, NULL);
+		kill(*pid, SIGTERM);
+		close(pair[0]);
+		return -1;
+	}
+	return pair[0];
+}
+
+/**
+ *
+ * \brief Function for taking the report of the new master
+ *
+ * \param socketDescriptor the descriptor returned by StartUpgrade() (closed)
+ * \param pid the pid of the new master, stopped if it did not take over
+ * \param reported set if the descriptor is readable, clear if the new master ran out of time
+ *
+ * \return EXIT_SUCCESS if the new master is serving
+ * \return EXIT_FAILURE if the upgrade failed and the old master keeps serving
+ *
+ */
+static int FinishUpgrade(int socketDescriptor, pid_t pid, bool reported)
+{
+	char ready = 0;
+	ssize_t r = 0;
+
+	if(reported)
+	{
+		do
+		{
+			r = read(socketDescriptor, &ready, 1);
+		} while(r == -1 && errno == EINTR);
+	}
+	close(socketDescriptor);
+
+	// A new binary that failed or hangs before it reports must not take over
+	if(r != 1 || ready != UPGRADE_READY)
+	{
+		PrintError("FinishUpgrade()", false, "New binary did not take over, keep serving");
+		kill(pid, SIGTERM);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for giving up an upgrade before all workers reported
+ *
+ * The old master sees the connection close and keeps serving.
+ *
+ */
+static void AbandonUpgrade(void)
+{
+	close(readyPipe[0]);
+	close(readyPipe[1]);
+	readyPipe[0] = readyPipe[1] = -1;
+	close(upgradeDescriptor);
+	upgradeDescriptor = -1;
+}
+
+/**
+ *
+ * \brief Function for sending a signal to all running workers
+ *
+ * \param workers the worker table
+ * \param workerCount the number of entries in the table
+ * \param signal the signal that shall be sent
+ *
+ */
+static void SignalWorkers(WorkerProcess * workers, int workerCount, int signal)
+{
+	for(int i = 0; i < workerCount; i++)
+	{
+		if(workers[i].pid > 0)
+		{
+			kill(workers[i].pid, signal);
+		}
+	}
+}
+
+/**
+ *
+ * \brief Function for reading the monotonic clock in seconds
+ *
+ * \return the seconds since an arbitrary point, not affected by clock changes
+ *
+ */
+static time_t Now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+/**
+ *
+ * \brief Function for scheduling the respawn of a worker that is not running
+ *
+ * \param worker the worker
+ * \param quick set if the worker died at once or could not be started, the delay doubles then
+ *
+ */
+static void ScheduleRespawn(WorkerProcess * worker, bool quick)
+{
+	if(!quick)
+	{
+		worker->delay = 0;
+	}
+	else
+	{
+		worker->delay = worker->delay == 0 ? RESPAWN_MIN_LIFETIME : worker->delay * 2;
+		worker->delay = worker->delay > RESPAWN_MAX_DELAY ? RESPAWN_MAX_DELAY : worker->delay;
+	}
+	worker->respawn = true;
+	worker->respawnAt = Now() + worker->delay;
+}
+
+/**
+ *
+ * \brief Function for starting the workers whose respawn is due
+ *
+ * A worker that cannot be started is scheduled again with a longer delay.
+ *
+ * \param workers the worker table
+ * \param workerCount the number of entries in the table
+ * \param listeners the listening sockets
+ * \param serve the function serving the listeners in a worker
+ * \param argument the argument passed to serve
+ * \param originalMask the signal mask the worker shall run with
+ * \param next receives the time of the next pending respawn, 0 -> none
+ *
+ * \return the number of started workers
+ *
+ */
+static int RespawnWorkers(WorkerProcess * workers, int workerCount, Listeners * listeners, ServeFunction serve, void * argument, const sigset_t * originalMask, time_t * next)
+{
+	time_t now = Now();
+	int started = 0;
+
+	*next = 0;
+	for(int i = 0; i < workerCount; i++)
+	{
+		if(!workers[i].respawn)
+		{
+			continue;
+		}
+		if(workers[i].respawnAt <= now)
+		{
+			workers[i].pid = StartWorker(listeners, serve, argument, originalMask);
+			workers[i].started = now;
+			if(workers[i].pid > 0)
+			{
+				workers[i].respawn = false;
+				started++;
+				continue;
+			}
+			PrintError("RespawnWorkers()", false, "Worker not started, retrying");
+			workers[i].pid = 0;
+			ScheduleRespawn(&workers[i], true);
+		}
+		if(*next == 0 || workers[i].respawnAt < *next)
+		{
+			*next = workers[i].respawnAt;
+		}
+	}
+	return started;
+}
+
+/**
+ *
+ * \brief Function for running the master process
+ *
+ * \param listeners the listening sockets (owned by the master)
+ * \param workerCount the number of worker processes
+ * \param argv the command line, used again to execute an upgraded binary
+ * \param serve the function serving the listeners in a worker
+ * \param argument the argument passed to serve
+ *
+ * \return EXIT_SUCCESS after a graceful stop or a successful upgrade
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int RunMaster(Listeners * listeners, int workerCount, const char * const argv[], ServeFunction serve, void * argument)
+{
+	WorkerProcess workers[workerCount];
+	char binaryPath[PATH_MAX];
+	struct sigaction signalAction;
+	sigset_t blockedMask;
+	sigset_t originalMask;
+	ssize_t length = 0;
+	bool draining = false;
+	int running = 0;
+	int status = 0;
+	pid_t pid = -1;
+	time_t nextRespawn = 0;	/* 0 -> no respawn pending */
+	struct timespec timeout;
+	struct pollfd pollDescriptors[2];
+	int unready = 0;		/* workers that did not report yet while the old master waits */
+	int upgradeSocket = -1;	/* report of a new master, -1 -> no upgrade running */
+	pid_t upgradePid = -1;
+	time_t upgradeDeadline = 0;
+	time_t wakeAt = 0;
+	int result = EXIT_SUCCESS;
+
+	// Remember where the binary lives, a new one may be installed there later
+	length = readlink("/proc/self/exe", binaryPath, sizeof(binaryPath) - 1);
+	if(length == -1)
+	{
+		PrintError("RunMaster() -> readlink()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	binaryPath[length] = '\0';
+
+	// Signals are only delivered inside sigsuspend()
+	sigemptyset(&blockedMask);
+	sigaddset(&blockedMask, SIGCHLD);
+	sigaddset(&blockedMask, SIGHUP);
+	sigaddset(&blockedMask, SIGUSR2);
+	sigaddset(&blockedMask, SIGTERM);
+	sigaddset(&blockedMask, SIGINT);
+	sigprocmask(SIG_BLOCK, &blockedMask, &originalMask);
+
+	memset(&signalAction, 0, sizeof(signalAction));
+	signalAction.sa_handler = MasterSignalHandler;
+	sigemptyset(&signalAction.sa_mask);
+	signalAction.sa_flags = 0;
+	if(sigaction(SIGCHLD, &signalAction, NULL) == -1 || sigaction(SIGHUP, &signalAction, NULL) == -1 ||
+		sigaction(SIGUSR2, &signalAction, NULL) == -1 || sigaction(SIGTERM, &signalAction, NULL) == -1 ||
+		sigaction(SIGINT, &signalAction, NULL) == -1)
+	{
+		PrintError("RunMaster() -> sigaction()", true, NULL);
+		sigprocmask(SIG_SETMASK, &originalMask, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// The counters live in the workers, SIGUSR1 to the process group must not stop the master
+	signalAction.sa_handler = SIG_IGN;
+	sigaction(SIGUSR1, &signalAction, NULL);
+
+	// The old master is told once every worker of this one is set up
+	if(upgradeDescriptor != -1)
+	{
+		if(pipe2(readyPipe, O_CLOEXEC) == -1)
+		{
+			PrintError("RunMaster() -> pipe2()", true, NULL);
+			sigprocmask(SIG_SETMASK, &originalMask, NULL);
+			return EXIT_FAILURE;
+		}
+		unready = workerCount;
+	}
+
+	memset(workers, 0, sizeof(workers));
+	for(int i = 0; i < workerCount; i++)
+	{
+		workers[i].pid = StartWorker(listeners, serve, argument, &originalMask);
+		workers[i].started = Now();
+		if(workers[i].pid == -1)
+		{
+			SignalWorkers(workers, i, SIGTERM);
+			return EXIT_FAILURE;
+		}
+		running++;
+	}
+
+	while(running > 0 || nextRespawn != 0)
+	{
+		sigset_t waitMask = originalMask;
+		sigdelset(&waitMask, SIGCHLD);
+		sigdelset(&waitMask, SIGHUP);
+		sigdelset(&waitMask, SIGUSR2);
+		sigdelset(&waitMask, SIGTERM);
+		sigdelset(&waitMask, SIGINT);
+
+		// A negative descriptor is ignored by ppoll()
+		pollDescriptors[0].fd = readyPipe[0];
+		pollDescriptors[0].events = POLLIN;
+		pollDescriptors[0].revents = 0;
+		pollDescriptors[1].fd = upgradeSocket;
+		pollDescriptors[1].events = POLLIN;
+		pollDescriptors[1].revents = 0;
+		if(!childExited && !upgradeRequested && !terminateRequested)
+		{
+			// Sleep until the next respawn or the end of the upgrade is due, signals still wake the master
+			wakeAt = nextRespawn;
+			if(upgradeSocket != -1 && (wakeAt == 0 || upgradeDeadline < wakeAt))
+			{
+				wakeAt = upgradeDeadline;
+			}
+			timeout.tv_sec = wakeAt > Now() ? wakeAt - Now() : 0;
+			timeout.tv_nsec = 0;
+			if(ppoll(pollDescriptors, 2, wakeAt == 0 ? NULL : &timeout, &waitMask) == -1 && errno != EINTR)
+			{
+				PrintError("RunMaster() -> ppoll()", true, NULL);
+			}
+		}
+
+		if((pollDescriptors[0].revents & (POLLIN | POLLHUP)) != 0)
+		{
+			char reports[64];
+			ssize_t r = read(readyPipe[0], reports, sizeof(reports) < (size_t) unready ? sizeof(reports) : (size_t) unready);
+
+			unready -= r > 0 ? r : 0;
+			if(unready == 0)
+			{
+				close(readyPipe[0]);
+				close(readyPipe[1]);
+				readyPipe[0] = readyPipe[1] = -1;
+				if(!draining && NotifyUpgradeReady() == EXIT_FAILURE)
+				{
+					PrintError("RunMaster() -> NotifyUpgradeReady()", false, NULL);
+				}
+			}
+		}
+
+		if(childExited)
+		{
+			childExited = 0;
+			while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			{
+				for(int i = 0; i < workerCount; i++)
+				{
+					if(workers[i].pid != pid)
+					{
+						continue;
+					}
+
+					workers[i].pid = 0;
+					running--;
+					if(draining)
+					{
+						break;
+					}
+
+					// The old master keeps serving, this one gives up
+					if(readyPipe[0] != -1)
+					{
+						PrintError("RunMaster()", false, "Worker exited before it served, upgrade abandoned");
+						AbandonUpgrade();
+						draining = true;
+						result = EXIT_FAILURE;
+						SignalWorkers(workers, workerCount, SIGTERM);
+						break;
+					}
+
+					// Respawn, but do not spin on a worker that dies at once
+					PrintError("RunMaster()", false, "Worker exited, respawning");
+					ScheduleRespawn(&workers[i], Now() - workers[i].started < RESPAWN_MIN_LIFETIME);
+					break;
+				}
+			}
+		}
+
+		if(upgradeRequested)
+		{
+			upgradeRequested = 0;
+			if(!draining && upgradeSocket == -1 && readyPipe[0] == -1)
+			{
+				upgradeSocket = StartUpgrade(binaryPath, listeners, argv, &originalMask, &upgradePid);
+				upgradeDeadline = Now() + UPGRADE_TIMEOUT;
+			}
+		}
+
+		if(upgradeSocket != -1 && (pollDescriptors[1].revents != 0 || Now() >= upgradeDeadline))
+		{
+			if(FinishUpgrade(upgradeSocket, upgradePid, pollDescriptors[1].revents != 0) == EXIT_SUCCESS && !draining)
+			{
+				// The new master serves the listeners now -> drain the old workers
+				draining = true;
+				SignalWorkers(workers, workerCount, SIGTERM);
+			}
+			upgradeSocket = -1;
+		}
+
+		if(terminateRequested)
+		{
+			terminateRequested = 0;
+			// A stopped master neither hands over nor takes over
+			if(upgradeSocket != -1)
+			{
+				FinishUpgrade(upgradeSocket, upgradePid, false);
+				upgradeSocket = -1;
+			}
+			if(readyPipe[0] != -1)
+			{
+				AbandonUpgrade();
+				result = EXIT_FAILURE;
+			}
+			if(!draining)
+			{
+				draining = true;
+				SignalWorkers(workers, workerCount, SIGTERM);
+			}
+		}
+
+		if(draining)
+		{
+			// Pending respawns are dropped, the old workers are only drained
+			for(int i = 0; i < workerCount; i++)
+			{
+				workers[i].respawn = false;
+			}
+		}
+		running += RespawnWorkers(workers, workerCount, listeners, serve, argument, &originalMask, &nextRespawn);
+	}
+
+	sigprocmask(SIG_SETMASK, &originalMask, NULL);
+	return result;
+}
+
+/*
+ * =================================================================== eof ==
+ */
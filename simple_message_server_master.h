@@ -0,0 +1,50 @@
+/*
+ * @file simple_message_server_master.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_MASTER_H
+#define SIMPLE_MESSAGE_SERVER_MASTER_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+#include "simple_message_server.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+/* Environment variable telling an upgraded binary where to receive the listeners */
+#define UPGRADE_ENVIRONMENT "SIMPLE_MESSAGE_SERVER_UPGRADE_FD"
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* Serves the listeners in a worker process until a graceful stop is requested */
+typedef int (* ServeFunction)(const Listeners * listeners, void * argument);
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int CreateStopHandler(void);
+bool StopRequested(void);
+int GetStopDescriptor(void);
+void WaitForChildren(void);
+int ReceiveInheritedListeners(Listeners * listeners, bool * inherited);
+void NotifyServing(void);
+int RunMaster(Listeners * listeners, int workerCount, const char * const argv[], ServeFunction serve, void * argument);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,158 @@
+/*
+ * @file simple_message_server_metrics.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "simple_message_server.h"
+#include "simple_message_server_metrics.h"
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+atomic_ulong metrics[METRIC_COUNT];
+
+static const char * const metricNames[METRIC_COUNT] =
+{
+	"connections_accepted",
+	"requests_handled",
+	"requests_failed",
+	"bytes_in",
+	"bytes_out",
+	"access_log_written",
+	"access_log_dropped",
+	"subscribers",
+	"updates_sent",
+	"connections_pooled",
+	"connections_unpooled",
+	"connections_parked",
+	"arena_allocations",
+	"arena_overflows",
+	"board_allocations"
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void MetricsSignalHandler(int signal);
+static size_t FormatNumber(char * buffer, unsigned long value);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for formatting a number without stdio (async signal safe)
+ *
+ * \param buffer the buffer receiving the digits (at least 21 bytes)
+ * \param value the number that shall be formatted
+ *
+ * \return the number of digits written
+ *
+ */
+static size_t FormatNumber(char * buffer, unsigned long value)
+{
+	char digits[21];
+	size_t count = 0;
+	size_t length = 0;
+
+	do
+	{
+		digits[count++] = (char) ('0' + value % 10);
+		value /= 10;
+	} while(value != 0);
+
+	while(count > 0)
+	{
+		buffer[length++] = digits[--count];
+	}
+	return length;
+}
+
+/**
+ *
+ * \brief Function for writing all counters as "name value" lines
+ *
+ * Only uses write(2), so it may be called from a signal handler.
+ *
+ * \param fileDescriptor the descriptor the counters are written to
+ *
+ */
+void MetricsDump(int fileDescriptor)
+{
+	char line[128];
+	size_t length = 0;
+
+	for(int i = 0; i < METRIC_COUNT; i++)
+	{
+		length = strlen(metricNames[i]);
+		memcpy(line, metricNames[i], length);
+		line[length++] = ' ';
+		length += FormatNumber(line + length, atomic_load_explicit(&metrics[i], memory_order_relaxed));
+		line[length++] = '\n';
+
+		if(write(fileDescriptor, line, length) == -1)
+		{
+			return;
+		}
+	}
+}
+
+/**
+ *
+ * \brief Function for processing SIGUSR1
+ *
+ * \param signal the signal that shall be handled
+ *
+ */
+static void MetricsSignalHandler(int signal)
+{
+	int savedErrno = errno;
+
+	(void) signal;
+	MetricsDump(STDERR_FILENO);
+	errno = savedErrno;
+}
+
+/**
+ *
+ * \brief Function for creating the handler dumping the counters on SIGUSR1
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int CreateMetricsHandler(void)
+{
+	struct sigaction signalAction;
+
+	signalAction.sa_handler = MetricsSignalHandler;
+	sigemptyset(&signalAction.sa_mask);
+	signalAction.sa_flags = SA_RESTART;
+
+	if(sigaction(SIGUSR1, &signalAction, NULL) == -1)
+	{
+		PrintError("CreateMetricsHandler() -> sigaction()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,78 @@
+/*
+ * @file simple_message_server_metrics.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_METRICS_H
+#define SIMPLE_MESSAGE_SERVER_METRICS_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdatomic.h>
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* Counters of a serving process, dumped to stderr on SIGUSR1 */
+typedef enum
+{
+	METRIC_CONNECTIONS_ACCEPTED,
+	METRIC_REQUESTS_HANDLED,
+	METRIC_REQUESTS_FAILED,
+	METRIC_BYTES_IN,
+	METRIC_BYTES_OUT,
+	METRIC_ACCESS_LOG_WRITTEN,
+	METRIC_ACCESS_LOG_DROPPED,
+	METRIC_SUBSCRIBERS,			/* current number, not a counter */
+	METRIC_UPDATES_SENT,
+	METRIC_CONNECTIONS_POOLED,
+	METRIC_CONNECTIONS_UNPOOLED,	/* the connection pool was exhausted */
+	METRIC_CONNECTIONS_PARKED,	/* idle keep-alive connections handed to the acceptors */
+	METRIC_ARENA_ALLOCATIONS,
+	METRIC_ARENA_OVERFLOWS,		/* allocations passed on to malloc() */
+	METRIC_BOARD_ALLOCATIONS,	/* slabs and large blocks of board memory, allocated with malloc() */
+	METRIC_COUNT
+} Metric;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+extern atomic_ulong metrics[METRIC_COUNT];
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int CreateMetricsHandler(void);
+void MetricsDump(int fileDescriptor);
+
+/*
+ * ---------------------------------------------------------------- inline --
+ */
+
+/**
+ *
+ * \brief Function for adding to a counter (lock free, usable from any thread)
+ *
+ * \param metric the counter
+ * \param value the value that shall be added
+ *
+ */
+static inline void MetricsAdd(Metric metric, unsigned long value)
+{
+	atomic_fetch_add_explicit(&metrics[metric], value, memory_order_relaxed);
+}
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,436 @@
+/*
+ * @file simple_message_server_park.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Idle keep-alive connections of the threaded server. Between two framed
+ * requests a connection does not keep its worker: it is parked in an
+ * epoll set the acceptors poll along with their listeners, and the one
+ * that sees it become readable submits it to the pool again. A worker
+ * thread is thus only bound to connections that have a request to serve.
+ *
+ * All connections wait the same keep-alive time, so they expire in the
+ * order they were parked. A timerfd in the epoll set, armed for the
+ * oldest one, wakes an acceptor to close those that stayed idle. The
+ * parked connections are kept in a table indexed by descriptor that only
+ * ever grows, parking one makes no allocation in the steady state.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "simple_message_server.h"
+#include "simple_message_server_park.h"
+#include "simple_message_server_master.h"
+#include "simple_message_server_metrics.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define PARK_TIMER UINT64_MAX
+#define PARK_INITIAL_SLOTS 64
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* State of one descriptor, linked in park order while it is parked */
+typedef struct
+{
+	int older;
+	int newer;
+	uint32_t generation;	/* tells a stale epoll event from the current one */
+	bool parked;
+	bool resumed;			/* submitted again, not yet taken by its worker */
+	struct timespec deadline;
+} ParkedSlot;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static pthread_mutex_t parkLock = PTHREAD_MUTEX_INITIALIZER;
+static int parkDescriptor = -1;
+static int timerDescriptor = -1;
+static int idleSeconds = 0;
+static ParkedSlot * slots = NULL;
+static size_t slotCount = 0;
+static int oldestParked = -1;
+static int newestParked = -1;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void Unlink(int socketDescriptor);
+static void ArmTimer(void);
+static void ExpireConnections(void);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for preparing the epoll set of the parked connections
+ *
+ * \param seconds the keep-alive time of an idle connection
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ParkOpen(int seconds)
+{
+	struct epoll_event event;
+
+	parkDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	if(parkDescriptor == -1)
+	{
+		PrintError("ParkOpen() -> epoll_create1()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	timerDescriptor = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(timerDescriptor == -1)
+	{
+		PrintError("ParkOpen() -> timerfd_create()", true, NULL);
+		ParkClose();
+		return EXIT_FAILURE;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = PARK_TIMER;
+	if(epoll_ctl(parkDescriptor, EPOLL_CTL_ADD, timerDescriptor, &event) == -1)
+	{
+		PrintError("ParkOpen() -> epoll_ctl()", true, NULL);
+		ParkClose();
+		return EXIT_FAILURE;
+	}
+	idleSeconds = seconds;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for getting the descriptor the acceptors poll
+ *
+ * \return the descriptor of the epoll set, -1 if connections are not parked
+ *
+ */
+int ParkDescriptor(void)
+{
+	return parkDescriptor;
+}
+
+/**
+ *
+ * \brief Function for removing a connection from the park order
+ *
+ * Must be called with the park lock held.
+ *
+ * \param socketDescriptor the descriptor of the parked connection
+ *
+ */
+static void Unlink(int socketDescriptor)
+{
+	ParkedSlot * slot = &slots[socketDescriptor];
+
+	if(slot->older != -1)
+	{
+		slots[slot->older].newer = slot->newer;
+	}
+	else
+	{
+		oldestParked = slot->newer;
+	}
+	if(slot->newer != -1)
+	{
+		slots[slot->newer].older = slot->older;
+	}
+	else
+	{
+		newestParked = slot->older;
+	}
+	slot->parked = false;
+}
+
+/**
+ *
+ * \brief Function for arming the timer for the oldest parked connection
+ *
+ * Must be called with the park lock held. Disarms the timer if no
+ * connection is parked.
+ *
+ */
+static void ArmTimer(void)
+{
+	struct itimerspec timer;
+
+	memset(&timer, 0, sizeof(timer));
+	if(oldestParked != -1)
+	{
+		timer.it_value = slots[oldestParked].deadline;
+	}
+	if(timerfd_settime(timerDescriptor, TFD_TIMER_ABSTIME, &timer, NULL) == -1)
+	{
+		PrintError("ArmTimer() -> timerfd_settime()", true, NULL);
+	}
+}
+
+/**
+ *
+ * \brief Function for closing the connections that stayed idle for the keep-alive time
+ *
+ * Must be called with the park lock held.
+ *
+ */
+static void ExpireConnections(void)
+{
+	uint64_t expirations = 0;
+	struct timespec now;
+
+	// Only clears the readable state, the deadlines are checked below
+	if(read(timerDescriptor, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+	{
+		PrintError("ExpireConnections() -> read()", true, NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	while(oldestParked != -1)
+	{
+		int socketDescriptor = oldestParked;
+		const struct timespec * deadline = &slots[socketDescriptor].deadline;
+
+		if(deadline->tv_sec > now.tv_sec || (deadline->tv_sec == now.tv_sec && deadline->tv_nsec > now.tv_nsec))
+		{
+			break;
+		}
+		Unlink(socketDescriptor);
+		if(epoll_ctl(parkDescriptor, EPOLL_CTL_DEL, socketDescriptor, NULL) == -1)
+		{
+			PrintError("ExpireConnections() -> epoll_ctl()", true, NULL);
+		}
+		if(close(socketDescriptor) == -1)
+		{
+			PrintError("ExpireConnections() -> close()", true, NULL);
+		}
+	}
+	ArmTimer();
+}
+
+/**
+ *
+ * \brief Function for parking an idle keep-alive connection
+ *
+ * \param socketDescriptor the descriptor of the connection, owned by the park on success
+ *
+ * \return EXIT_SUCCESS if the connection is parked
+ * \return EXIT_FAILURE otherwise, the caller still owns the connection then
+ *
+ */
+int ParkConnection(int socketDescriptor)
+{
+	struct epoll_event event;
+	ParkedSlot * slot = NULL;
+
+	if(parkDescriptor == -1 || StopRequested())
+	{
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&parkLock);
+	if((size_t) socketDescriptor >= slotCount)
+	{
+		size_t count = slotCount > 0 ? slotCount : PARK_INITIAL_SLOTS;
+		ParkedSlot * grown = NULL;
+
+		while(count <= (size_t) socketDescriptor)
+		{
+			count *= 2;
+		}
+		grown = realloc(slots, count * sizeof(ParkedSlot));
+		if(grown == NULL)
+		{
+			pthread_mutex_unlock(&parkLock);
+			PrintError("ParkConnection() -> realloc()", true, NULL);
+			return EXIT_FAILURE;
+		}
+		memset(grown + slotCount, 0, (count - slotCount) * sizeof(ParkedSlot));
+		slots = grown;
+		slotCount = count;
+	}
+
+	slot = &slots[socketDescriptor];
+	slot->generation++;
+	slot->resumed = false;
+	clock_gettime(CLOCK_MONOTONIC, &slot->deadline);
+	slot->deadline.tv_sec += idleSeconds;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+	event.data.u64 = (uint64_t) slot->generation << 32 | (uint32_t) socketDescriptor;
+	if(epoll_ctl(parkDescriptor, EPOLL_CTL_ADD, socketDescriptor, &event) == -1)
+	{
+		pthread_mutex_unlock(&parkLock);
+		PrintError("ParkConnection() -> epoll_ctl()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	slot->parked = true;
+	slot->older = newestParked;
+	slot->newer = -1;
+	if(newestParked != -1)
+	{
+		slots[newestParked].newer = socketDescriptor;
+	}
+	newestParked = socketDescriptor;
+	if(oldestParked == -1)
+	{
+		oldestParked = socketDescriptor;
+		ArmTimer();
+	}
+	pthread_mutex_unlock(&parkLock);
+
+	MetricsAdd(METRIC_CONNECTIONS_PARKED, 1);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for taking the next parked connection that became readable
+ *
+ * Called by an acceptor whose poll() found the epoll set readable. Closes
+ * the connections whose keep-alive time ran out on the way.
+ *
+ * \return the descriptor of the connection, to be submitted to the pool
+ * \return -1 if no parked connection is readable
+ *
+ */
+int ParkResume(void)
+{
+	struct epoll_event event;
+	int socketDescriptor = -1;
+	uint32_t generation = 0;
+	int r = 0;
+
+	for(;;)
+	{
+		r = epoll_wait(parkDescriptor, &event, 1, 0);
+		if(r == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(r == -1)
+		{
+			PrintError("ParkResume() -> epoll_wait()", true, NULL);
+			return -1;
+		}
+		if(r == 0)
+		{
+			return -1;
+		}
+
+		pthread_mutex_lock(&parkLock);
+		if(event.data.u64 == PARK_TIMER)
+		{
+			ExpireConnections();
+			pthread_mutex_unlock(&parkLock);
+			continue;
+		}
+
+		// The connection may have expired and its descriptor been reused since
+		socketDescriptor = (int) (uint32_t) event.data.u64;
+		generation = (uint32_t) (event.data.u64 >> 32);
+		if((size_t) socketDescriptor < slotCount && slots[socketDescriptor].parked &&
+			slots[socketDescriptor].generation == generation)
+		{
+			Unlink(socketDescriptor);
+			slots[socketDescriptor].resumed = true;
+			if(epoll_ctl(parkDescriptor, EPOLL_CTL_DEL, socketDescriptor, NULL) == -1)
+			{
+				PrintError("ParkResume() -> epoll_ctl()", true, NULL);
+			}
+			pthread_mutex_unlock(&parkLock);
+			return socketDescriptor;
+		}
+		pthread_mutex_unlock(&parkLock);
+	}
+}
+
+/**
+ *
+ * \brief Function for telling whether a submitted connection was parked before
+ *
+ * \param socketDescriptor the descriptor of the connection
+ *
+ * \return true if the connection was resumed (the mark is cleared), false if it is new
+ *
+ */
+bool ParkTake(int socketDescriptor)
+{
+	bool resumed = false;
+
+	pthread_mutex_lock(&parkLock);
+	if((size_t) socketDescriptor < slotCount)
+	{
+		resumed = slots[socketDescriptor].resumed;
+		slots[socketDescriptor].resumed = false;
+	}
+	pthread_mutex_unlock(&parkLock);
+	return resumed;
+}
+
+/**
+ *
+ * \brief Function for closing all parked connections and the epoll set
+ *
+ * Must be called after the acceptors and the workers have finished.
+ *
+ */
+void ParkClose(void)
+{
+	while(oldestParked != -1)
+	{
+		int socketDescriptor = oldestParked;
+
+		Unlink(socketDescriptor);
+		if(close(socketDescriptor) == -1)
+		{
+			PrintError("ParkClose() -> close()", true, NULL);
+		}
+	}
+	if(timerDescriptor != -1 && close(timerDescriptor) == -1)
+	{
+		PrintError("ParkClose() -> close()", true, NULL);
+	}
+	if(parkDescriptor != -1 && close(parkDescriptor) == -1)
+	{
+		PrintError("ParkClose() -> close()", true, NULL);
+	}
+	timerDescriptor = -1;
+	parkDescriptor = -1;
+	free(slots);
+	slots = NULL;
+	slotCount = 0;
+	newestParked = -1;
+}
+
+/*
+ * =================================================================== eof ==
+ */
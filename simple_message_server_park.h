@@ -0,0 +1,34 @@
+/*
+ * @file simple_message_server_park.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_PARK_H
+#define SIMPLE_MESSAGE_SERVER_PARK_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int ParkOpen(int seconds);
+int ParkDescriptor(void);
+int ParkConnection(int socketDescriptor);
+int ParkResume(void);
+bool ParkTake(int socketDescriptor);
+void ParkClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
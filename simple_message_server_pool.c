@@ -0,0 +1,322 @@
+/*
+ * @file simple_message_server_pool.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Memory of the connections served in-process. The connection objects
+ * are carved from one slab mapped at startup (--max-connections of them),
+ * each with a bump arena for the request buffer and the response list.
+ * The arena is reset after every request, so a request that fits makes
+ * no call to malloc() or free() for itself. What a post adds to the board
+ * outlives the request and is taken from the free lists of the board
+ * memory (see simple_message_server_render.c); only the slabs refilling
+ * them are allocated, counted as board_allocations.
+ *
+ * Whatever does not fit is passed on to malloc() and counted: an arena
+ * that runs out allocates the block (arena_overflows), a connection
+ * finding the slab exhausted gets an object without arena
+ * (connections_unpooled). Both stay 0 in the steady state. The slab is
+ * mapped without reserving swap space: pages of an arena that are never
+ * touched cost no memory, and a large --max-connections is not refused
+ * by the overcommit accounting.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "simple_message_server.h"
+#include "simple_message_server_pool.h"
+#include "simple_message_server_metrics.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+#define ALIGN_UP(size, alignment) (((size) + (alignment) - 1) & ~((size_t) (alignment) - 1))
+#define CONNECTION_SLOT_SIZE (ALIGN_UP(sizeof(Connection), ARENA_ALIGNMENT) + CONNECTION_ARENA_SIZE)
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static void * slab = NULL;
+static size_t slabSize = 0;
+static Connection * freeConnections = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void ArenaInit(Arena * arena, unsigned char * base, size_t capacity);
+static void * ArenaOverflow(Arena * arena, size_t size);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for preparing an arena
+ *
+ * \param arena the arena
+ * \param base the memory of the arena, NULL -> every allocation overflows
+ * \param capacity the number of bytes at base
+ *
+ */
+static void ArenaInit(Arena * arena, unsigned char * base, size_t capacity)
+{
+	arena->base = base;
+	arena->capacity = capacity;
+	arena->used = 0;
+	arena->last = SIZE_MAX;
+	arena->overflow = NULL;
+}
+
+/**
+ *
+ * \brief Function for allocating a block the arena cannot hold
+ *
+ * \param arena the arena
+ * \param size the number of bytes
+ *
+ * \return the block, NULL in case of failure
+ *
+ */
+static void * ArenaOverflow(Arena * arena, size_t size)
+{
+	ArenaBlock * block = malloc(sizeof(ArenaBlock) + size);
+
+	if(block == NULL)
+	{
+		PrintError("ArenaOverflow() -> malloc()", true, NULL);
+		return NULL;
+	}
+	MetricsAdd(METRIC_ARENA_OVERFLOWS, 1);
+	block->next = arena->overflow;
+	arena->overflow = block;
+	return block->data;
+}
+
+/**
+ *
+ * \brief Function for allocating memory that lives until the arena is reset
+ *
+ * \param arena the arena
+ * \param size the number of bytes
+ *
+ * \return the memory (aligned like malloc()), NULL in case of failure
+ *
+ */
+void * ArenaAlloc(Arena * arena, size_t size)
+{
+	size_t offset = ALIGN_UP(arena->used, ARENA_ALIGNMENT);
+
+	if(offset > arena->capacity || size > arena->capacity - offset)
+	{
+		return ArenaOverflow(arena, size);
+	}
+	MetricsAdd(METRIC_ARENA_ALLOCATIONS, 1);
+	arena->last = offset;
+	arena->used = offset + size;
+	return arena->base + offset;
+}
+
+/**
+ *
+ * \brief Function for enlarging memory of the arena, like realloc()
+ *
+ * The last allocation grows in place as long as the arena has room, so a
+ * buffer growing by doubling is never copied within the arena.
+ *
+ * \param arena the arena
+ * \param pointer the memory, NULL -> like ArenaAlloc()
+ * \param oldSize the number of bytes allocated so far
+ * \param newSize the number of bytes needed
+ *
+ * \return the memory (the content is kept), NULL in case of failure
+ *
+ */
+void * ArenaGrow(Arena * arena, void * pointer, size_t oldSize, size_t newSize)
+{
+	void * grown = NULL;
+
+	if(pointer == NULL)
+	{
+		return ArenaAlloc(arena, newSize);
+	}
+	if(arena->last != SIZE_MAX && pointer == arena->base + arena->last && newSize <= arena->capacity - arena->last)
+	{
+		arena->used = arena->last + newSize;
+		return pointer;
+	}
+
+	// The newest overflow block is reallocated instead of copied
+	if(arena->overflow != NULL && pointer == arena->overflow->data)
+	{
+		ArenaBlock * block = realloc(arena->overflow, sizeof(ArenaBlock) + newSize);
+
+		if(block == NULL)
+		{
+			PrintError("ArenaGrow() -> realloc()", true, NULL);
+			return NULL;
+		}
+		MetricsAdd(METRIC_ARENA_OVERFLOWS, 1);
+		arena->overflow = block;
+		return block->data;
+	}
+
+	grown = ArenaAlloc(arena, newSize);
+	if(grown != NULL)
+	{
+		memcpy(grown, pointer, oldSize < newSize ? oldSize : newSize);
+	}
+	return grown;
+}
+
+/**
+ *
+ * \brief Function for giving back all memory of the arena
+ *
+ * \param arena the arena
+ *
+ */
+void ArenaReset(Arena * arena)
+{
+	while(arena->overflow != NULL)
+	{
+		ArenaBlock * next = arena->overflow->next;
+
+		free(arena->overflow);
+		arena->overflow = next;
+	}
+	arena->used = 0;
+	arena->last = SIZE_MAX;
+}
+
+/**
+ *
+ * \brief Function for mapping the slab of connection objects
+ *
+ * \param connections the number of connections served at the same time
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ConnectionPoolOpen(size_t connections)
+{
+	slabSize = connections * CONNECTION_SLOT_SIZE;
+	slab = mmap(NULL, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(slab == MAP_FAILED)
+	{
+		PrintError("ConnectionPoolOpen() -> mmap()", true, NULL);
+		slab = NULL;
+		return EXIT_FAILURE;
+	}
+
+	// The first slot ends up first in the free list, its pages stay warm
+	for(size_t i = connections; i > 0; i--)
+	{
+		Connection * connection = (Connection *) ((unsigned char *) slab + (i - 1) * CONNECTION_SLOT_SIZE);
+
+		connection->pooled = true;
+		ArenaInit(&connection->arena, (unsigned char *) connection + ALIGN_UP(sizeof(Connection), ARENA_ALIGNMENT),
+				CONNECTION_ARENA_SIZE);
+		connection->next = freeConnections;
+		freeConnections = connection;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for taking a connection object for a new connection
+ *
+ * \return the connection object, NULL in case of failure
+ *
+ */
+Connection * ConnectionAcquire(void)
+{
+	Connection * connection = NULL;
+
+	pthread_mutex_lock(&poolLock);
+	connection = freeConnections;
+	if(connection != NULL)
+	{
+		freeConnections = connection->next;
+	}
+	pthread_mutex_unlock(&poolLock);
+
+	if(connection != NULL)
+	{
+		MetricsAdd(METRIC_CONNECTIONS_POOLED, 1);
+		return connection;
+	}
+
+	// More connections than preallocated -> one without arena
+	connection = malloc(sizeof(Connection));
+	if(connection == NULL)
+	{
+		PrintError("ConnectionAcquire() -> malloc()", true, NULL);
+		return NULL;
+	}
+	MetricsAdd(METRIC_CONNECTIONS_UNPOOLED, 1);
+	connection->pooled = false;
+	ArenaInit(&connection->arena, NULL, 0);
+	return connection;
+}
+
+/**
+ *
+ * \brief Function for giving back the object of a finished connection
+ *
+ * \param connection the connection object
+ *
+ */
+void ConnectionRelease(Connection * connection)
+{
+	ArenaReset(&connection->arena);
+	if(!connection->pooled)
+	{
+		free(connection);
+		return;
+	}
+
+	pthread_mutex_lock(&poolLock);
+	connection->next = freeConnections;
+	freeConnections = connection;
+	pthread_mutex_unlock(&poolLock);
+}
+
+/**
+ *
+ * \brief Function for unmapping the slab
+ *
+ * Must be called after all connections have finished.
+ *
+ */
+void ConnectionPoolClose(void)
+{
+	if(slab != NULL && munmap(slab, slabSize) == -1)
+	{
+		PrintError("ConnectionPoolClose() -> munmap()", true, NULL);
+	}
+	slab = NULL;
+	freeConnections = NULL;
+}
+
+/*
+ * =================================================================== eof ==
+ */
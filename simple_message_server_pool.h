@@ -0,0 +1,72 @@
+/*
+ * @file simple_message_server_pool.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_POOL_H
+#define SIMPLE_MESSAGE_SERVER_POOL_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define CONNECTION_ARENA_SIZE (1024 * 1024)
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* Memory of a block the arena could not hold */
+typedef struct ArenaBlock
+{
+	struct ArenaBlock * next;
+	max_align_t data[];
+} ArenaBlock;
+
+/* Bump allocator, everything is given back at once by ArenaReset() */
+typedef struct
+{
+	unsigned char * base;
+	size_t capacity;
+	size_t used;
+	size_t last;			/* offset of the last allocation */
+	ArenaBlock * overflow;	/* allocated with malloc(), newest first */
+} Arena;
+
+/* A connection served in-process and the memory of its requests */
+typedef struct Connection
+{
+	struct Connection * next;	/* free list of the slab */
+	bool pooled;				/* false -> allocated, the slab was exhausted */
+	Arena arena;
+} Connection;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void * ArenaAlloc(Arena * arena, size_t size);
+void * ArenaGrow(Arena * arena, void * pointer, size_t oldSize, size_t newSize);
+void ArenaReset(Arena * arena);
+
+int ConnectionPoolOpen(size_t connections);
+Connection * ConnectionAcquire(void);
+void ConnectionRelease(Connection * connection);
+void ConnectionPoolClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,1598 @@
+/*
+ * @file simple_message_server_render.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Incremental rendering of the bulletin board. Every message is rendered
+ * once into an HTML fragment; the page is a list of iovecs pointing to the
+ * fragments, sent with one gather write. A post renders one fragment and
+ * publishes a new page version, requests keep the version they acquired
+ * until their response is sent.
+ *
+ * The fragments are listed in chunks of PAGE_CHUNK_SIZE entries, each one
+ * linked to the chunk before it. A version is its newest chunk and the
+ * number of its fragments, counted back from there, so versions share all
+ * chunks but the ones a post changed: it copies the newest chunk with the
+ * new fragment (or starts a new one) and does not depend on the size of
+ * the board. Requests build the iovecs of their version from the chunks.
+ *
+ * Page versions are freed as soon as nobody uses them, in any order: a
+ * version held for long (by a subscriber that stopped reading) does not
+ * keep the newer ones. Fragments dropped by the retain limit and chunks
+ * replaced or dropped are freed once no version from the first to the
+ * last one containing them is left.
+ *
+ * Every fragment is also compressed once when it is rendered, as raw
+ * deflate data ending with a sync flush. Such pieces can be concatenated,
+ * so the compressed variant of a version is a list of iovecs as well:
+ * the zlib header, the pieces and a final empty block with the Adler-32
+ * of the page, combined from the Adler-32 of the pieces. A post costs one
+ * compressed fragment, not a compressed page.
+ *
+ * The CRC-32C of the fragments (and of their compressed pieces) is kept
+ * with every version in the same way: a post combines the checksum of the
+ * new fragment into the one of the version before and takes the ones of
+ * the fragments dropped by the retain limit out again. Only a post that
+ * finished late and lands between older messages combines all fragments.
+ *
+ * Fragments, chunks, page versions and their compressed variants are
+ * blocks of board memory. Freed blocks are kept in a free list per size
+ * class (BOARD_CLASS_STEPS classes per power of two, so at most a quarter
+ * of a block is unused) and reused by the next post; an empty list is
+ * refilled with a slab of BOARD_SLAB_SIZE bytes. With a retain limit the
+ * board reaches a steady state in which a post makes no call to malloc().
+ * Blocks larger than BOARD_LARGE_SIZE are allocated one by one.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "simple_message_server.h"
+#include "simple_message_server_render.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_crc32c.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define BOARD_PAGE_PROLOGUE "<!DOCTYPE html>\n<html>\n<head><meta charset=\"utf-8\"><title>Bulletin Board</title></head>\n<body>\n"
+#define BOARD_PAGE_EPILOGUE "</body>\n</html>\n"
+#define PAGE_CHUNK_SIZE 64
+#define DEFLATE_WINDOW_BITS 15
+#define DEFLATE_SYNC_FLUSH_SIZE 16
+#define BOARD_MINIMUM_SHIFT 6		/* the smallest size class has 64 bytes */
+#define BOARD_CLASS_SHIFT 2
+#define BOARD_CLASS_STEPS (1 << BOARD_CLASS_SHIFT)
+#define BOARD_LARGE_SHIFT 20
+#define BOARD_LARGE_SIZE ((size_t) 1 << BOARD_LARGE_SHIFT)
+#define BOARD_CLASSES ((BOARD_LARGE_SHIFT - BOARD_MINIMUM_SHIFT) * BOARD_CLASS_STEPS + 1)
+#define BOARD_SLAB_SIZE (256 * 1024)
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* A block of board memory, in the free list of its size class while unused */
+typedef struct BoardBlock
+{
+	struct BoardBlock * next;
+	size_t sizeClass;			/* BOARD_CLASSES -> allocated on its own */
+	max_align_t data[];
+} BoardBlock;
+
+/* Memory carved into blocks of one size class, freed by RenderClose() */
+typedef struct BoardSlab
+{
+	struct BoardSlab * next;
+	max_align_t data[];
+} BoardSlab;
+
+/* Raw deflate data (RFC 1951) of one piece of the page, ending byte aligned */
+typedef struct
+{
+	unsigned char * data;		/* behind the HTML of a fragment, allocated for prologue and epilogue */
+	size_t length;
+	uint32_t adler;				/* Adler-32 of the uncompressed piece */
+	uint32_t crc;				/* CRC-32C of data */
+	uint32_t shift;				/* Crc32cShift() of length */
+} DeflatedPiece;
+
+/* The rendered HTML of one message */
+typedef struct Fragment
+{
+	struct Fragment * next;		/* list of retired fragments */
+	uint64_t sequence;
+	uint64_t addedAt;			/* first page version with the fragment */
+	uint64_t retiredAt;			/* first page version without the fragment */
+	DeflatedPiece deflated;
+	uint32_t crc;				/* CRC-32C of html */
+	uint32_t shift;				/* Crc32cShift() of length */
+	size_t length;
+	char html[];
+} Fragment;
+
+/* Fragments of the page in sequence order, never changed once published */
+typedef struct PageChunk
+{
+	struct PageChunk * older;	/* not read by versions that do not reach it */
+	struct PageChunk * next;	/* list of retired chunks */
+	uint64_t addedAt;			/* first page version with the chunk */
+	uint64_t retiredAt;			/* first page version without the chunk */
+	size_t count;
+	Fragment * fragments[PAGE_CHUNK_SIZE];
+} Chunk;
+
+/* Position in the fragments of a page version, walked from the newest one */
+typedef struct
+{
+	const Chunk * chunk;
+	size_t index;				/* entries of chunk before the position */
+	size_t remaining;			/* fragments of the version before the position */
+} Cursor;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static pthread_mutex_t renderLock = PTHREAD_MUTEX_INITIALIZER;
+static Page * currentPage = NULL;
+static Page * oldestPage = NULL;
+static Fragment * retiredFirst = NULL;
+static Fragment * retiredLast = NULL;
+static Chunk * retiredChunks = NULL;
+static size_t retainCount = 0;
+
+/* The chunks of the current version, oldest first */
+static Chunk ** chain = NULL;
+static size_t chainSlots = 0;
+static size_t chainFirst = 0;
+static size_t chainEnd = 0;
+static size_t headDropped = 0;	/* entries of the oldest chunk not in the current version */
+
+static DeflatedPiece prologueDeflated;
+static DeflatedPiece epilogueDeflated;
+static uint32_t prologueCrc = 0;
+static uint32_t epilogueCrc = 0;
+
+/* Board memory by size class, taken outside the render lock as well */
+static pthread_mutex_t blockLock = PTHREAD_MUTEX_INITIALIZER;
+static BoardBlock * freeBlocks[BOARD_CLASSES];
+static BoardSlab * slabs = NULL;
+
+/* One compressor per thread, reset for every piece */
+static pthread_once_t streamKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t streamKey;
+
+/* zlib header: deflate with a 32 KiB window, default level */
+static const unsigned char zlibHeader[] = { 0x78, 0x9c };
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static size_t SizeClass(size_t size);
+static size_t ClassSize(size_t sizeClass);
+static void * BoardAlloc(size_t size);
+static void BoardFree(void * data);
+static size_t EscapedLength(const char * text, size_t textLength);
+static void AppendBytes(char * html, size_t * length, const char * text, size_t textLength, bool escape);
+static void FreeStream(void * stream);
+static void CreateStreamKey(void);
+static z_stream * GetStream(void);
+static size_t DeflatedSize(z_stream * stream, size_t length);
+static int DeflatePiece(z_stream * stream, const void * data, size_t length, unsigned char * output, DeflatedPiece * piece);
+static int DeflateStatic(const char * text, DeflatedPiece * piece);
+static Fragment * RenderFragment(const StoredMessage * message);
+static void FreeFragment(Fragment * fragment);
+static void CursorStart(Cursor * cursor, const Page * page);
+static const Fragment * CursorPrevious(Cursor * cursor);
+static int ReserveChain(size_t chunks);
+static int Extend(Chunk ** newest, const Chunk * shared, Fragment * fragment, uint64_t version);
+static int InsertFragment(size_t position, size_t index, Fragment * fragment, uint64_t version);
+static const Fragment * OldestFragment(size_t position);
+static void RetireFragment(Fragment * fragment, uint64_t version);
+static void RetireChunk(Chunk * chunk, uint64_t version);
+static void UpdateChecksums(Page * page, const Fragment * added, size_t dropped);
+static bool Unused(uint64_t addedAt, uint64_t retiredAt);
+static void CollectPages(void);
+static void FreePage(Page * page);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for finding the size class of a block
+ *
+ * \param size the number of bytes of the block, at most BOARD_LARGE_SIZE
+ *
+ * \return the smallest size class the block fits in
+ *
+ */
+static size_t SizeClass(size_t size)
+{
+	size_t shift = BOARD_MINIMUM_SHIFT;
+
+	if(size <= ((size_t) 1 << BOARD_MINIMUM_SHIFT))
+	{
+		return 0;
+	}
+
+	// The power of two below the size and the step above it
+	while(((size - 1) >> (shift + 1)) > 0)
+	{
+		shift++;
+	}
+	return (shift - BOARD_MINIMUM_SHIFT) * BOARD_CLASS_STEPS + (((size - 1) >> (shift - BOARD_CLASS_SHIFT)) & (BOARD_CLASS_STEPS - 1)) + 1;
+}
+
+/**
+ *
+ * \brief Function for getting the number of bytes of the blocks of a size class
+ *
+ * \param sizeClass the size class
+ *
+ * \return the number of bytes
+ *
+ */
+static size_t ClassSize(size_t sizeClass)
+{
+	size_t shift = 0;
+	size_t step = 0;
+
+	if(sizeClass == 0)
+	{
+		return (size_t) 1 << BOARD_MINIMUM_SHIFT;
+	}
+	shift = BOARD_MINIMUM_SHIFT + (sizeClass - 1) / BOARD_CLASS_STEPS;
+	step = (sizeClass - 1) % BOARD_CLASS_STEPS;
+	return (BOARD_CLASS_STEPS + step + 1) << (shift - BOARD_CLASS_SHIFT);
+}
+
+/**
+ *
+ * \brief Function for allocating board memory
+ *
+ * A block is taken from the free list of its size class, a slab only has
+ * to be allocated (counted as board_allocations) when that list is empty.
+ *
+ * \param size the number of bytes
+ *
+ * \return the memory (aligned like malloc()), NULL in case of failure
+ *
+ */
+static void * BoardAlloc(size_t size)
+{
+	size_t total = offsetof(BoardBlock, data) + size;
+	size_t sizeClass = 0;
+	BoardBlock * block = NULL;
+
+	if(total > BOARD_LARGE_SIZE)
+	{
+		block = malloc(total);
+		if(block == NULL)
+		{
+			PrintError("BoardAlloc() -> malloc()", true, NULL);
+			return NULL;
+		}
+		MetricsAdd(METRIC_BOARD_ALLOCATIONS, 1);
+		block->sizeClass = BOARD_CLASSES;
+		return block->data;
+	}
+
+	sizeClass = SizeClass(total);
+	pthread_mutex_lock(&blockLock);
+	if(freeBlocks[sizeClass] == NULL)
+	{
+		size_t blockSize = ClassSize(sizeClass);
+		size_t blocks = blockSize < BOARD_SLAB_SIZE ? BOARD_SLAB_SIZE / blockSize : 1;
+		BoardSlab * slab = malloc(offsetof(BoardSlab, data) + blocks * blockSize);
+
+		if(slab == NULL)
+		{
+			pthread_mutex_unlock(&blockLock);
+			PrintError("BoardAlloc() -> malloc()", true, NULL);
+			return NULL;
+		}
+		MetricsAdd(METRIC_BOARD_ALLOCATIONS, 1);
+		slab->next = slabs;
+		slabs = slab;
+
+		// The first block of the slab ends up first in the free list
+		for(size_t i = blocks; i > 0; i--)
+		{
+			block = (BoardBlock *) ((unsigned char *) slab->data + (i - 1) * blockSize);
+			block->sizeClass = sizeClass;
+			block->next = freeBlocks[sizeClass];
+			freeBlocks[sizeClass] = block;
+		}
+	}
+	block = freeBlocks[sizeClass];
+	freeBlocks[sizeClass] = block->next;
+	pthread_mutex_unlock(&blockLock);
+
+	return block->data;
+}
+
+/**
+ *
+ * \brief Function for giving back board memory for the next post
+ *
+ * \param data the memory returned by BoardAlloc(), NULL -> nothing is done
+ *
+ */
+static void BoardFree(void * data)
+{
+	BoardBlock * block = NULL;
+
+	if(data == NULL)
+	{
+		return;
+	}
+	block = (BoardBlock *) ((unsigned char *) data - offsetof(BoardBlock, data));
+	if(block->sizeClass == BOARD_CLASSES)
+	{
+		free(block);
+		return;
+	}
+
+	pthread_mutex_lock(&blockLock);
+	block->next = freeBlocks[block->sizeClass];
+	freeBlocks[block->sizeClass] = block;
+	pthread_mutex_unlock(&blockLock);
+}
+
+/**
+ *
+ * \brief Function for getting the length of text once it is HTML escaped
+ *
+ * \param text the user supplied text
+ * \param textLength the number of bytes
+ *
+ * \return the number of bytes AppendBytes() appends for it
+ *
+ */
+static size_t EscapedLength(const char * text, size_t textLength)
+{
+	size_t length = textLength;
+
+	for(const char * end = text + textLength; text < end; text++)
+	{
+		switch(*text)
+		{
+			case '<':	length += strlen("&lt;") - 1;	break;
+			case '>':	length += strlen("&gt;") - 1;	break;
+			case '&':	length += strlen("&amp;") - 1;	break;
+			case '"':	length += strlen("&quot;") - 1;	break;
+		}
+	}
+	return length;
+}
+
+/**
+ *
+ * \brief Function for appending bytes to a buffer measured beforehand
+ *
+ * \param html the buffer, large enough for the bytes (see EscapedLength())
+ * \param length the used bytes of the buffer
+ * \param text the bytes that shall be appended
+ * \param textLength the number of bytes
+ * \param escape true if the text is user supplied and has to be HTML escaped
+ *
+ */
+static void AppendBytes(char * html, size_t * length, const char * text, size_t textLength, bool escape)
+{
+	if(!escape)
+	{
+		memcpy(html + *length, text, textLength);
+		*length += textLength;
+		return;
+	}
+
+	for(const char * end = text + textLength; text < end; text++)
+	{
+		const char * replacement = NULL;
+
+		switch(*text)
+		{
+			case '<':	replacement = "&lt;";	break;
+			case '>':	replacement = "&gt;";	break;
+			case '&':	replacement = "&amp;";	break;
+			case '"':	replacement = "&quot;";	break;
+			default:	html[(*length)++] = *text;	continue;
+		}
+		memcpy(html + *length, replacement, strlen(replacement));
+		*length += strlen(replacement);
+	}
+}
+
+/**
+ *
+ * \brief Function for freeing the compressor of a finished thread
+ *
+ * \param stream the compressor
+ *
+ */
+static void FreeStream(void * stream)
+{
+	deflateEnd(stream);
+	free(stream);
+}
+
+/**
+ *
+ * \brief Function for creating the key of the per-thread compressor
+ *
+ */
+static void CreateStreamKey(void)
+{
+	if(pthread_key_create(&streamKey, FreeStream) != 0)
+	{
+		PrintError("CreateStreamKey() -> pthread_key_create()", false, NULL);
+	}
+}
+
+/**
+ *
+ * \brief Function for getting the compressor of the calling thread
+ *
+ * \return the compressor, reset for a new piece
+ * \return NULL in case of failure
+ *
+ */
+static z_stream * GetStream(void)
+{
+	z_stream * stream = NULL;
+
+	pthread_once(&streamKeyOnce, CreateStreamKey);
+	stream = pthread_getspecific(streamKey);
+	if(stream != NULL)
+	{
+		deflateReset(stream);
+		return stream;
+	}
+
+	stream = calloc(1, sizeof(z_stream));
+	if(stream == NULL)
+	{
+		PrintError("GetStream() -> calloc()", true, NULL);
+		return NULL;
+	}
+	if(deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -DEFLATE_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		PrintError("GetStream() -> deflateInit2()", false, stream->msg);
+		free(stream);
+		return NULL;
+	}
+	pthread_setspecific(streamKey, stream);
+	return stream;
+}
+
+/**
+ *
+ * \brief Function for getting the room the compressed data of a piece may take
+ *
+ * \param stream the compressor
+ * \param length the number of bytes of the piece
+ *
+ * \return the number of bytes DeflatePiece() needs at output
+ *
+ */
+static size_t DeflatedSize(z_stream * stream, size_t length)
+{
+	return deflateBound(stream, length) + DEFLATE_SYNC_FLUSH_SIZE;
+}
+
+/**
+ *
+ * \brief Function for compressing one piece of the page
+ *
+ * The piece is compressed as raw deflate data ending with a sync flush, so
+ * it can be put in front of or behind any other such piece.
+ *
+ * \param stream the compressor of the thread (see GetStream())
+ * \param data the bytes that shall be compressed
+ * \param length the number of bytes
+ * \param output the memory for the compressed data, DeflatedSize() bytes
+ * \param piece receives the compressed data (pointing to output)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int DeflatePiece(z_stream * stream, const void * data, size_t length, unsigned char * output, DeflatedPiece * piece)
+{
+	size_t capacity = DeflatedSize(stream, length);
+
+	stream->next_in = (Bytef *) data;
+	stream->avail_in = length;
+	stream->next_out = output;
+	stream->avail_out = capacity;
+
+	// With output space left the flush is complete
+	if(deflate(stream, Z_SYNC_FLUSH) != Z_OK || stream->avail_in != 0 || stream->avail_out == 0)
+	{
+		PrintError("DeflatePiece() -> deflate()", false, stream->msg);
+		return EXIT_FAILURE;
+	}
+	piece->data = output;
+	piece->length = capacity - stream->avail_out;
+	piece->adler = adler32(adler32(0, NULL, 0), data, length);
+	piece->crc = Crc32c(0, piece->data, piece->length);
+	piece->shift = Crc32cShift(piece->length);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for compressing the prologue or the epilogue of the page
+ *
+ * \param text the piece
+ * \param piece receives the compressed data (allocated)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int DeflateStatic(const char * text, DeflatedPiece * piece)
+{
+	z_stream * stream = GetStream();
+	unsigned char * output = NULL;
+
+	if(stream == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+	output = malloc(DeflatedSize(stream, strlen(text)));
+	if(output == NULL)
+	{
+		PrintError("DeflateStatic() -> malloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	if(DeflatePiece(stream, text, strlen(text), output, piece) == EXIT_FAILURE)
+	{
+		free(output);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for rendering the HTML fragment of one message
+ *
+ * The length of the HTML is measured first, so the fragment, its HTML and
+ * the room for its compressed data are one block of board memory.
+ *
+ * \param message the message that shall be rendered
+ *
+ * \return the fragment or NULL in case of failure
+ *
+ */
+static Fragment * RenderFragment(const StoredMessage * message)
+{
+	static const char header[] = "<div class=\"message\">\n<p class=\"meta\">";
+	static const char userEnd[] = "</p>\n";
+	static const char imageStart[] = "<img src=\"";
+	static const char imageEnd[] = "\" alt=\"\">\n";
+	static const char textStart[] = "<p>";
+	static const char textEnd[] = "</p>\n</div>\n";
+	char timeText[32];
+	struct tm timeFields;
+	size_t timeLength = 0;
+	size_t htmlLength = 0;
+	size_t length = 0;
+	z_stream * stream = GetStream();
+	Fragment * fragment = NULL;
+
+	if(stream == NULL)
+	{
+		return NULL;
+	}
+
+	localtime_r(&message->time, &timeFields);
+	timeLength = strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", &timeFields);
+
+	htmlLength = strlen(header) + timeLength + 1 + EscapedLength(message->user, message->userLength) + strlen(userEnd) +
+				strlen(textStart) + EscapedLength(message->message, message->messageLength) + strlen(textEnd);
+	if(message->img != NULL)
+	{
+		htmlLength += strlen(imageStart) + EscapedLength(message->img, message->imgLength) + strlen(imageEnd);
+	}
+
+	// The compressed data follows the HTML
+	fragment = BoardAlloc(offsetof(Fragment, html) + htmlLength + DeflatedSize(stream, htmlLength));
+	if(fragment == NULL)
+	{
+		return NULL;
+	}
+
+	AppendBytes(fragment->html, &length, header, strlen(header), false);
+	AppendBytes(fragment->html, &length, timeText, timeLength, false);
+	AppendBytes(fragment->html, &length, " ", 1, false);
+	AppendBytes(fragment->html, &length, message->user, message->userLength, true);
+	AppendBytes(fragment->html, &length, userEnd, strlen(userEnd), false);
+	if(message->img != NULL)
+	{
+		AppendBytes(fragment->html, &length, imageStart, strlen(imageStart), false);
+		AppendBytes(fragment->html, &length, message->img, message->imgLength, true);
+		AppendBytes(fragment->html, &length, imageEnd, strlen(imageEnd), false);
+	}
+	AppendBytes(fragment->html, &length, textStart, strlen(textStart), false);
+	AppendBytes(fragment->html, &length, message->message, message->messageLength, true);
+	AppendBytes(fragment->html, &length, textEnd, strlen(textEnd), false);
+
+	fragment->next = NULL;
+	fragment->sequence = message->sequence;
+	fragment->addedAt = 0;
+	fragment->retiredAt = 0;
+	fragment->length = length;
+	fragment->crc = Crc32c(0, fragment->html, fragment->length);
+	fragment->shift = Crc32cShift(fragment->length);
+	if(DeflatePiece(stream, fragment->html, fragment->length, (unsigned char *) fragment->html + length,
+			&fragment->deflated) == EXIT_FAILURE)
+	{
+		BoardFree(fragment);
+		return NULL;
+	}
+	return fragment;
+}
+
+/**
+ *
+ * \brief Function for freeing a fragment, its compressed data is in the same block
+ *
+ * \param fragment the fragment that shall be freed
+ *
+ */
+static void FreeFragment(Fragment * fragment)
+{
+	BoardFree(fragment);
+}
+
+/**
+ *
+ * \brief Function for starting a walk through the fragments of a page version
+ *
+ * \param cursor receives the position behind the newest fragment
+ * \param page the page version
+ *
+ */
+static void CursorStart(Cursor * cursor, const Page * page)
+{
+	cursor->chunk = page->newest;
+	cursor->index = page->newest != NULL ? page->newest->count : 0;
+	cursor->remaining = page->count - 2;
+}
+
+/**
+ *
+ * \brief Function for stepping to the next older fragment of a page version
+ *
+ * A chunk is only left for the one before it while the version has
+ * fragments there, older chunks may be freed already.
+ *
+ * \param cursor the position, moved before the fragment
+ *
+ * \return the fragment or NULL if the version has no older one
+ *
+ */
+static const Fragment * CursorPrevious(Cursor * cursor)
+{
+	if(cursor->remaining == 0)
+	{
+		return NULL;
+	}
+	if(cursor->index == 0)
+	{
+		cursor->chunk = cursor->chunk->older;
+		cursor->index = cursor->chunk->count;
+	}
+	cursor->remaining--;
+	return cursor->chunk->fragments[--cursor->index];
+}
+
+/**
+ *
+ * \brief Function for making room for more chunks in the current version
+ *
+ * Called with the render lock held. The chunks dropped at the front are
+ * reused before the table grows.
+ *
+ * \param chunks the number of chunks that may be added
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int ReserveChain(size_t chunks)
+{
+	size_t slots = chainSlots > 0 ? chainSlots : PAGE_CHUNK_SIZE;
+	Chunk ** grown = NULL;
+
+	if(chainEnd + chunks <= chainSlots)
+	{
+		return EXIT_SUCCESS;
+	}
+	if(chainFirst > 0)
+	{
+		memmove(chain, chain + chainFirst, (chainEnd - chainFirst) * sizeof(Chunk *));
+		chainEnd -= chainFirst;
+		chainFirst = 0;
+		if(chainEnd + chunks <= chainSlots)
+		{
+			return EXIT_SUCCESS;
+		}
+	}
+
+	while(slots < chainEnd + chunks)
+	{
+		slots *= 2;
+	}
+	grown = realloc(chain, slots * sizeof(Chunk *));
+	if(grown == NULL)
+	{
+		PrintError("ReserveChain() -> realloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	chain = grown;
+	chainSlots = slots;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for adding a fragment behind the newest chunk of a list being built
+ *
+ * \param newest the newest chunk of the list (NULL -> the list is empty),
+ *               receives a new one if it is shared or full
+ * \param shared a chunk of the list that is published already and must not change
+ * \param fragment the fragment that shall be added
+ * \param version the first page version with a new chunk
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure, the list is unchanged
+ *
+ */
+static int Extend(Chunk ** newest, const Chunk * shared, Fragment * fragment, uint64_t version)
+{
+	Chunk * chunk = *newest;
+
+	if(chunk == NULL || chunk == shared || chunk->count == PAGE_CHUNK_SIZE)
+	{
+		chunk = BoardAlloc(sizeof(Chunk));
+		if(chunk == NULL)
+		{
+			PrintError("Extend() -> BoardAlloc()", false, NULL);
+			return EXIT_FAILURE;
+		}
+		chunk->older = *newest;
+		chunk->next = NULL;
+		chunk->addedAt = version;
+		chunk->retiredAt = 0;
+		chunk->count = 0;
+	}
+	chunk->fragments[chunk->count++] = fragment;
+	*newest = chunk;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for putting a fragment into the chunks of the current version
+ *
+ * Called with the render lock held, after ReserveChain(1). The chunks from
+ * the position on are copied with the fragment and retired, the ones
+ * before are shared with the older versions.
+ *
+ * \param position the chunk the fragment goes to, chainEnd -> a new one
+ * \param index the entries of that chunk before the fragment
+ * \param fragment the fragment
+ * \param version the first page version with the fragment
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure, the chunks are unchanged
+ *
+ */
+static int InsertFragment(size_t position, size_t index, Fragment * fragment, uint64_t version)
+{
+	Chunk * shared = position > chainFirst ? chain[position - 1] : NULL;
+	Chunk * newest = shared;
+	int r = EXIT_SUCCESS;
+
+	for(size_t k = position; k <= chainEnd && r == EXIT_SUCCESS; k++)
+	{
+		size_t count = k < chainEnd ? chain[k]->count : 0;
+
+		for(size_t i = 0; i <= count && r == EXIT_SUCCESS; i++)
+		{
+			if(k == position && i == index)
+			{
+				r = Extend(&newest, shared, fragment, version);
+			}
+			if(i < count && r == EXIT_SUCCESS)
+			{
+				r = Extend(&newest, shared, chain[k]->fragments[i], version);
+			}
+		}
+	}
+	if(r == EXIT_FAILURE)
+	{
+		while(newest != shared)
+		{
+			Chunk * older = newest->older;
+
+			BoardFree(newest);
+			newest = older;
+		}
+		return EXIT_FAILURE;
+	}
+
+	for(size_t k = position; k < chainEnd; k++)
+	{
+		RetireChunk(chain[k], version);
+	}
+	chainEnd = position;
+	for(const Chunk * chunk = newest; chunk != shared; chunk = chunk->older)
+	{
+		chainEnd++;
+	}
+	position = chainEnd;
+	for(Chunk * chunk = newest; chunk != shared; chunk = chunk->older)
+	{
+		chain[--position] = chunk;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for getting a fragment of the current version counted from the oldest one
+ *
+ * Called with the render lock held.
+ *
+ * \param position the number of older fragments in the current version
+ *
+ * \return the fragment
+ *
+ */
+static const Fragment * OldestFragment(size_t position)
+{
+	size_t chunk = chainFirst;
+
+	position += headDropped;
+	while(position >= chain[chunk]->count)
+	{
+		position -= chain[chunk]->count;
+		chunk++;
+	}
+	return chain[chunk]->fragments[position];
+}
+
+/**
+ *
+ * \brief Function for taking a fragment out of the newer page versions
+ *
+ * Called with the render lock held. The fragment is freed once the older
+ * versions are gone.
+ *
+ * \param fragment the fragment
+ * \param version the first page version without the fragment
+ *
+ */
+static void RetireFragment(Fragment * fragment, uint64_t version)
+{
+	fragment->retiredAt = version;
+	fragment->next = NULL;
+	if(retiredLast != NULL)
+	{
+		retiredLast->next = fragment;
+	}
+	else
+	{
+		retiredFirst = fragment;
+	}
+	retiredLast = fragment;
+}
+
+/**
+ *
+ * \brief Function for taking a chunk out of the newer page versions
+ *
+ * Called with the render lock held. The chunk is freed once the older
+ * versions are gone, its fragments are not.
+ *
+ * \param chunk the chunk
+ * \param version the first page version without the chunk
+ *
+ */
+static void RetireChunk(Chunk * chunk, uint64_t version)
+{
+	chunk->retiredAt = version;
+	chunk->next = retiredChunks;
+	retiredChunks = chunk;
+}
+
+/**
+ *
+ * \brief Function for creating the empty page
+ *
+ * \param retain the number of newest messages on the page, 0 -> all
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int RenderOpen(size_t retain)
+{
+	Page * page = BoardAlloc(sizeof(Page));
+
+	if(page == NULL)
+	{
+		PrintError("RenderOpen() -> BoardAlloc()", false, NULL);
+		return EXIT_FAILURE;
+	}
+	if(DeflateStatic(BOARD_PAGE_PROLOGUE, &prologueDeflated) == EXIT_FAILURE ||
+		DeflateStatic(BOARD_PAGE_EPILOGUE, &epilogueDeflated) == EXIT_FAILURE)
+	{
+		PrintError("RenderOpen() -> DeflateStatic()", false, NULL);
+		free(prologueDeflated.data);
+		prologueDeflated.data = NULL;
+		BoardFree(page);
+		return EXIT_FAILURE;
+	}
+
+	page->newer = NULL;
+	page->version = 1;
+	page->references = 1;	// held by the renderer until a newer version replaces it
+	atomic_init(&page->deflated, NULL);
+	page->crc = page->deflatedCrc = 0;
+	page->deflatedLength = 0;
+	page->count = 2;
+	page->newest = NULL;
+	page->length = strlen(BOARD_PAGE_PROLOGUE) + strlen(BOARD_PAGE_EPILOGUE);
+	prologueCrc = Crc32c(0, BOARD_PAGE_PROLOGUE, strlen(BOARD_PAGE_PROLOGUE));
+	epilogueCrc = Crc32c(0, BOARD_PAGE_EPILOGUE, strlen(BOARD_PAGE_EPILOGUE));
+
+	retainCount = retain;
+	currentPage = oldestPage = page;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for freeing a page version and its compressed variant
+ *
+ * \param page the page that shall be freed
+ *
+ */
+static void FreePage(Page * page)
+{
+	BoardFree(atomic_load(&page->deflated));
+	BoardFree(page);
+}
+
+/**
+ *
+ * \brief Function for computing the checksums of a new page version
+ *
+ * Called with the render lock held, before the version replaces the
+ * current one and before the fragments it dropped are retired.
+ *
+ * \param page the new version, its chunks complete
+ * \param added the fragment the version added
+ * \param dropped the number of oldest fragments of the current version
+ *                the new one dropped, SIZE_MAX -> added was not appended
+ *                at the end, all fragments are combined
+ *
+ */
+static void UpdateChecksums(Page * page, const Fragment * added, size_t dropped)
+{
+	size_t length = 0;
+	size_t deflatedLength = 0;
+
+	if(dropped == SIZE_MAX)
+	{
+		Cursor cursor;
+		uint32_t shift = Crc32cShift(0);
+		uint32_t deflatedShift = Crc32cShift(0);
+
+		// Walked from the newest fragment, the factor of the bytes behind grows by multiplying
+		page->crc = page->deflatedCrc = 0;
+		CursorStart(&cursor, page);
+		for(const Fragment * fragment = CursorPrevious(&cursor); fragment != NULL; fragment = CursorPrevious(&cursor))
+		{
+			page->crc = Crc32cCombine(fragment->crc, page->crc, shift);
+			page->deflatedCrc = Crc32cCombine(fragment->deflated.crc, page->deflatedCrc, deflatedShift);
+			shift = Crc32cCombine(shift, 0, fragment->shift);
+			deflatedShift = Crc32cCombine(deflatedShift, 0, fragment->deflated.shift);
+		}
+		return;
+	}
+
+	page->crc = Crc32cCombine(currentPage->crc, added->crc, added->shift);
+	page->deflatedCrc = Crc32cCombine(currentPage->deflatedCrc, added->deflated.crc, added->deflated.shift);
+	length = currentPage->length - strlen(BOARD_PAGE_PROLOGUE) - strlen(BOARD_PAGE_EPILOGUE) + added->length;
+	deflatedLength = currentPage->deflatedLength + added->deflated.length;
+
+	// Taking the oldest fragment away is combining it with the rest once more
+	for(size_t i = 0; i < dropped; i++)
+	{
+		const Fragment * fragment = OldestFragment(i);
+
+		length -= fragment->length;
+		deflatedLength -= fragment->deflated.length;
+		page->crc = Crc32cCombine(fragment->crc, page->crc, Crc32cShift(length));
+		page->deflatedCrc = Crc32cCombine(fragment->deflated.crc, page->deflatedCrc, Crc32cShift(deflatedLength));
+	}
+}
+
+/**
+ *
+ * \brief Function for telling whether no page version left contains an item
+ *
+ * Called with the render lock held.
+ *
+ * \param addedAt the first page version with the item
+ * \param retiredAt the first page version without the item
+ *
+ * \return true if the item can be freed
+ *
+ */
+static bool Unused(uint64_t addedAt, uint64_t retiredAt)
+{
+	const Page * page = oldestPage;
+
+	// The current version is newer than every retired item
+	while(page->version < addedAt)
+	{
+		page = page->newer;
+	}
+	return page->version >= retiredAt;
+}
+
+/**
+ *
+ * \brief Function for freeing the page versions, fragments and chunks nobody uses
+ *
+ * Called with the render lock held.
+ *
+ */
+static void CollectPages(void)
+{
+	bool freed = false;
+
+	for(Page ** link = &oldestPage; *link != currentPage; )
+	{
+		Page * page = *link;
+
+		if(page->references > 0)
+		{
+			link = &page->newer;
+			continue;
+		}
+		*link = page->newer;
+		FreePage(page);
+		freed = true;
+	}
+
+	// A retired fragment or chunk is only in older versions, one can only be freed with them
+	if(!freed)
+	{
+		return;
+	}
+	retiredLast = NULL;
+	for(Fragment ** link = &retiredFirst; *link != NULL; )
+	{
+		Fragment * fragment = *link;
+
+		if(Unused(fragment->addedAt, fragment->retiredAt))
+		{
+			*link = fragment->next;
+			FreeFragment(fragment);
+			continue;
+		}
+		retiredLast = fragment;
+		link = &fragment->next;
+	}
+	for(Chunk ** link = &retiredChunks; *link != NULL; )
+	{
+		Chunk * chunk = *link;
+
+		if(Unused(chunk->addedAt, chunk->retiredAt))
+		{
+			*link = chunk->next;
+			BoardFree(chunk);
+			continue;
+		}
+		link = &chunk->next;
+	}
+}
+
+/**
+ *
+ * \brief Function for adding a stored message to the page before it is served
+ *
+ * Builds the first version in place, one message after the other: the
+ * messages must come in sequence order, at most the retained number of
+ * them, and no request may have acquired the page yet.
+ *
+ * \param message the message that shall be added
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int RenderLoad(const StoredMessage * message)
+{
+	Fragment * fragment = RenderFragment(message);
+	Chunk * newest = NULL;
+
+	if(fragment == NULL)
+	{
+		PrintError("RenderLoad() -> RenderFragment()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	// Nothing is published yet, the newest chunk is filled in place
+	pthread_mutex_lock(&renderLock);
+	newest = chainEnd > chainFirst ? chain[chainEnd - 1] : NULL;
+	if(ReserveChain(1) == EXIT_FAILURE || Extend(&newest, NULL, fragment, currentPage->version) == EXIT_FAILURE)
+	{
+		pthread_mutex_unlock(&renderLock);
+		FreeFragment(fragment);
+		return EXIT_FAILURE;
+	}
+	if(newest != currentPage->newest)
+	{
+		chain[chainEnd++] = newest;
+	}
+
+	fragment->addedAt = currentPage->version;
+	currentPage->newest = newest;
+	currentPage->count++;
+	currentPage->length += fragment->length;
+	currentPage->deflatedLength += fragment->deflated.length;
+	currentPage->crc = Crc32cCombine(currentPage->crc, fragment->crc, fragment->shift);
+	currentPage->deflatedCrc = Crc32cCombine(currentPage->deflatedCrc, fragment->deflated.crc, fragment->deflated.shift);
+	pthread_mutex_unlock(&renderLock);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for adding a message to the page
+ *
+ * Renders the fragment of the message and publishes a page version that
+ * contains it, ordered by the sequence number of the message. The chunks
+ * from the one the fragment goes to on are copied, usually the newest one.
+ *
+ * \param message the message that shall be added
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int RenderAppend(const StoredMessage * message)
+{
+	Fragment * fragment = RenderFragment(message);
+	Page * page = NULL;
+	size_t fragments = 0;
+	size_t position = 0;
+	size_t index = 0;
+	size_t drop = 0;
+	bool appended = false;
+
+	if(fragment == NULL)
+	{
+		PrintError("RenderAppend() -> RenderFragment()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&renderLock);
+	fragments = currentPage->count - 2;
+	drop = (retainCount > 0 && fragments + 1 > retainCount) ? fragments + 1 - retainCount : 0;
+
+	// A post adds at most one chunk more than it copies
+	page = BoardAlloc(sizeof(Page));
+	if(page == NULL || ReserveChain(1) == EXIT_FAILURE)
+	{
+		pthread_mutex_unlock(&renderLock);
+		PrintError("RenderAppend() -> BoardAlloc()", false, NULL);
+		BoardFree(page);
+		FreeFragment(fragment);
+		return EXIT_FAILURE;
+	}
+
+	// Posts finish in nearly sequence order, the position is found from the end
+	position = chainEnd;
+	for(size_t passed = 0; passed < fragments; passed++)
+	{
+		if(index == 0)
+		{
+			position--;
+			index = chain[position]->count;
+		}
+		if(chain[position]->fragments[index - 1]->sequence < fragment->sequence)
+		{
+			break;
+		}
+		index--;
+	}
+	// Behind a full chunk or one that is not the newest nothing of it is copied
+	if(position < chainEnd && index == chain[position]->count && (index == PAGE_CHUNK_SIZE || position + 1 < chainEnd))
+	{
+		position++;
+		index = 0;
+	}
+	appended = position == chainEnd || index == chain[position]->count;
+
+	page->newer = NULL;
+	page->version = currentPage->version + 1;
+	page->references = 1;
+	fragment->addedAt = page->version;
+	atomic_init(&page->deflated, NULL);
+
+	if(InsertFragment(position, index, fragment, page->version) == EXIT_FAILURE)
+	{
+		pthread_mutex_unlock(&renderLock);
+		BoardFree(page);
+		FreeFragment(fragment);
+		return EXIT_FAILURE;
+	}
+
+	page->newest = chain[chainEnd - 1];
+	page->count = fragments + 3 - drop;
+	page->length = currentPage->length + fragment->length;
+	page->deflatedLength = currentPage->deflatedLength + fragment->deflated.length;
+	UpdateChecksums(page, fragment, appended ? drop : SIZE_MAX);
+
+	// Freed once the older versions are gone, the oldest chunk once none of its fragments is left
+	for(size_t i = 0; i < drop; i++)
+	{
+		Chunk * head = chain[chainFirst];
+		Fragment * dropped = head->fragments[headDropped++];
+
+		page->length -= dropped->length;
+		page->deflatedLength -= dropped->deflated.length;
+		RetireFragment(dropped, page->version);
+		if(headDropped == head->count)
+		{
+			RetireChunk(head, page->version);
+			chainFirst++;
+			headDropped = 0;
+		}
+	}
+
+	currentPage->newer = page;
+	currentPage->references--;
+	currentPage = page;
+	CollectPages();
+	pthread_mutex_unlock(&renderLock);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for getting the current page for a response
+ *
+ * \return the page, valid until RenderRelease()
+ *
+ */
+Page * RenderAcquire(void)
+{
+	Page * page = NULL;
+
+	pthread_mutex_lock(&renderLock);
+	page = currentPage;
+	page->references++;
+	pthread_mutex_unlock(&renderLock);
+
+	return page;
+}
+
+/**
+ *
+ * \brief Function for keeping a page that is already held for longer
+ *
+ * \param page a page returned by RenderAcquire() and not yet released
+ *
+ */
+void RenderRetain(Page * page)
+{
+	pthread_mutex_lock(&renderLock);
+	page->references++;
+	pthread_mutex_unlock(&renderLock);
+}
+
+/**
+ *
+ * \brief Function for getting the iovecs of a page
+ *
+ * \param page a held page version
+ * \param vector receives the prologue, the fragments and the epilogue,
+ *               page->count entries
+ *
+ * \return the number of entries, page->count
+ *
+ */
+size_t RenderVector(const Page * page, struct iovec * vector)
+{
+	Cursor cursor;
+	size_t i = page->count - 1;
+
+	vector[0].iov_base = BOARD_PAGE_PROLOGUE;
+	vector[0].iov_len = strlen(BOARD_PAGE_PROLOGUE);
+	vector[i].iov_base = BOARD_PAGE_EPILOGUE;
+	vector[i].iov_len = strlen(BOARD_PAGE_EPILOGUE);
+	CursorStart(&cursor, page);
+	for(const Fragment * fragment = CursorPrevious(&cursor); fragment != NULL; fragment = CursorPrevious(&cursor))
+	{
+		i--;
+		vector[i].iov_base = (void *) fragment->html;
+		vector[i].iov_len = fragment->length;
+	}
+	return page->count;
+}
+
+/**
+ *
+ * \brief Function for finding the messages a newer page version added
+ *
+ * Both versions are ordered by sequence number and share the fragments they
+ * have in common, so one merge pass from the newest fragments finds the new
+ * ones - including posts that finished late and were put between older
+ * messages. It stops where both read the same chunk, all older fragments
+ * are common from there.
+ *
+ * \param older a held page version
+ * \param newer a held page version, newer than older
+ * \param count receives the number of new fragments
+ *
+ * \return the allocated vector of the new fragments
+ * \return NULL if there is not enough memory
+ *
+ */
+struct iovec * RenderAdded(const Page * older, const Page * newer, size_t * count)
+{
+	struct iovec * added = malloc(newer->count * sizeof(struct iovec));
+	size_t first = newer->count;
+	Cursor olderCursor;
+	Cursor newerCursor;
+	const Fragment * kept = NULL;
+
+	*count = 0;
+	if(added == NULL)
+	{
+		PrintError("RenderAdded() -> malloc()", true, NULL);
+		return NULL;
+	}
+	CursorStart(&olderCursor, older);
+	CursorStart(&newerCursor, newer);
+	kept = CursorPrevious(&olderCursor);
+	for(const Fragment * fragment = CursorPrevious(&newerCursor); fragment != NULL; fragment = CursorPrevious(&newerCursor))
+	{
+		while(kept != NULL && kept->sequence > fragment->sequence)
+		{
+			kept = CursorPrevious(&olderCursor);
+		}
+		if(kept != fragment)
+		{
+			first--;
+			added[first].iov_base = (void *) fragment->html;
+			added[first].iov_len = fragment->length;
+			continue;
+		}
+		if(newerCursor.chunk == olderCursor.chunk && newerCursor.index == olderCursor.index &&
+			newerCursor.remaining <= olderCursor.remaining)
+		{
+			break;
+		}
+		kept = CursorPrevious(&olderCursor);
+	}
+
+	*count = newer->count - first;
+	memmove(added, added + first, *count * sizeof(struct iovec));
+	return added;
+}
+
+/**
+ *
+ * \brief Function for giving back a page after the response was sent
+ *
+ * \param page the page returned by RenderAcquire()
+ *
+ */
+void RenderRelease(Page * page)
+{
+	pthread_mutex_lock(&renderLock);
+	page->references--;
+	CollectPages();
+	pthread_mutex_unlock(&renderLock);
+}
+
+/**
+ *
+ * \brief Function for getting the compressed variant of a page
+ *
+ * Nothing is compressed here: the list of the compressed pieces is built
+ * once per version. Requests racing with the first one may build it as
+ * well, only one result is kept.
+ *
+ * \param page a page returned by RenderAcquire()
+ *
+ * \return the compressed page, valid until RenderRelease()
+ * \return NULL if there is not enough memory
+ *
+ */
+const DeflatedPage * RenderDeflate(Page * page)
+{
+	DeflatedPage * deflated = atomic_load_explicit(&page->deflated, memory_order_acquire);
+	DeflatedPage * expected = NULL;
+	uint32_t adler = epilogueDeflated.adler;
+	size_t adlerLength = strlen(BOARD_PAGE_EPILOGUE);
+	size_t count = page->count + 2;
+	Cursor cursor;
+
+	if(deflated != NULL)
+	{
+		return deflated;
+	}
+
+	deflated = BoardAlloc(sizeof(DeflatedPage) + count * sizeof(struct iovec));
+	if(deflated == NULL)
+	{
+		PrintError("RenderDeflate() -> BoardAlloc()", false, NULL);
+		return NULL;
+	}
+
+	// The zlib header, the pieces of prologue, fragments and epilogue, the trailer
+	deflated->vector[0].iov_base = (void *) zlibHeader;
+	deflated->vector[0].iov_len = sizeof(zlibHeader);
+	deflated->vector[1].iov_base = prologueDeflated.data;
+	deflated->vector[1].iov_len = prologueDeflated.length;
+	deflated->vector[count - 2].iov_base = epilogueDeflated.data;
+	deflated->vector[count - 2].iov_len = epilogueDeflated.length;
+	deflated->length = sizeof(zlibHeader) + prologueDeflated.length + page->deflatedLength + epilogueDeflated.length;
+
+	// Walked from the newest fragment, each Adler-32 is combined in front of the ones behind
+	CursorStart(&cursor, page);
+	for(size_t i = count - 2; i > 2; i--)
+	{
+		const Fragment * fragment = CursorPrevious(&cursor);
+
+		deflated->vector[i - 1].iov_base = fragment->deflated.data;
+		deflated->vector[i - 1].iov_len = fragment->deflated.length;
+		adler = adler32_combine(fragment->deflated.adler, adler, adlerLength);
+		adlerLength += fragment->length;
+	}
+	adler = adler32_combine(prologueDeflated.adler, adler, adlerLength);
+
+	// An empty final block with fixed codes, then the Adler-32 in network byte order
+	deflated->trailer[0] = 0x03;
+	deflated->trailer[1] = 0x00;
+	deflated->trailer[2] = (unsigned char) (adler >> 24);
+	deflated->trailer[3] = (unsigned char) (adler >> 16);
+	deflated->trailer[4] = (unsigned char) (adler >> 8);
+	deflated->trailer[5] = (unsigned char) adler;
+	deflated->vector[count - 1].iov_base = deflated->trailer;
+	deflated->vector[count - 1].iov_len = sizeof(deflated->trailer);
+	deflated->length += sizeof(deflated->trailer);
+	deflated->count = count;
+
+	deflated->crc = Crc32c(0, zlibHeader, sizeof(zlibHeader));
+	deflated->crc = Crc32cCombine(deflated->crc, prologueDeflated.crc, prologueDeflated.shift);
+	deflated->crc = Crc32cCombine(deflated->crc, page->deflatedCrc, Crc32cShift(page->deflatedLength));
+	deflated->crc = Crc32cCombine(deflated->crc, epilogueDeflated.crc, epilogueDeflated.shift);
+	deflated->crc = Crc32c(deflated->crc, deflated->trailer, sizeof(deflated->trailer));
+
+	if(!atomic_compare_exchange_strong_explicit(&page->deflated, &expected, deflated,
+			memory_order_acq_rel, memory_order_acquire))
+	{
+		BoardFree(deflated);
+		deflated = expected;
+	}
+	return deflated;
+}
+
+/**
+ *
+ * \brief Function for getting the checksum of a page
+ *
+ * Combined from the checksums of prologue, fragments and epilogue, the
+ * bytes of the page are not read.
+ *
+ * \param page a page returned by RenderAcquire()
+ *
+ * \return the CRC-32C of the page
+ *
+ */
+uint32_t RenderChecksum(const Page * page)
+{
+	size_t prologueLength = strlen(BOARD_PAGE_PROLOGUE);
+	size_t epilogueLength = strlen(BOARD_PAGE_EPILOGUE);
+	uint32_t crc = Crc32cCombine(prologueCrc, page->crc, Crc32cShift(page->length - prologueLength - epilogueLength));
+
+	return Crc32cCombine(crc, epilogueCrc, Crc32cShift(epilogueLength));
+}
+
+/**
+ *
+ * \brief Function for freeing all pages, fragments, chunks and the board memory
+ *
+ * Must be called after all requests have finished.
+ *
+ */
+void RenderClose(void)
+{
+	pthread_mutex_lock(&renderLock);
+
+	// The fragments the oldest chunk dropped are retired
+	for(size_t k = chainFirst; k < chainEnd; k++)
+	{
+		for(size_t i = k == chainFirst ? headDropped : 0; i < chain[k]->count; i++)
+		{
+			FreeFragment(chain[k]->fragments[i]);
+		}
+		BoardFree(chain[k]);
+	}
+	free(chain);
+	chain = NULL;
+	chainSlots = chainFirst = chainEnd = headDropped = 0;
+	while(oldestPage != NULL)
+	{
+		Page * newer = oldestPage->newer;
+
+		FreePage(oldestPage);
+		oldestPage = newer;
+	}
+	while(retiredFirst != NULL)
+	{
+		Fragment * next = retiredFirst->next;
+
+		FreeFragment(retiredFirst);
+		retiredFirst = next;
+	}
+	while(retiredChunks != NULL)
+	{
+		Chunk * next = retiredChunks->next;
+
+		BoardFree(retiredChunks);
+		retiredChunks = next;
+	}
+
+	// Every block is back in its free list, the slabs go with them
+	while(slabs != NULL)
+	{
+		BoardSlab * next = slabs->next;
+
+		free(slabs);
+		slabs = next;
+	}
+	memset(freeBlocks, 0, sizeof(freeBlocks));
+	free(prologueDeflated.data);
+	free(epilogueDeflated.data);
+	prologueDeflated.data = epilogueDeflated.data = NULL;
+	currentPage = NULL;
+	retiredLast = NULL;
+	pthread_mutex_unlock(&renderLock);
+}
+
+/*
+ * =================================================================== eof ==
+ */
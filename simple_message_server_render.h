@@ -0,0 +1,75 @@
+/*
+ * @file simple_message_server_render.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_RENDER_H
+#define SIMPLE_MESSAGE_SERVER_RENDER_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+#include "simple_message_server_store.h"
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* The page compressed as zlib stream (RFC 1950), made of the compressed pieces of the page */
+typedef struct
+{
+	size_t length;			/* bytes of the stream */
+	uint32_t crc;			/* CRC-32C of the stream */
+	size_t count;			/* entries of vector */
+	unsigned char trailer[6];	/* final block and Adler-32 of the page */
+	struct iovec vector[];	/* zlib header, one deflated piece per entry of the page, trailer */
+} DeflatedPage;
+
+/* A piece of the fragment list, shared by the page versions containing it */
+struct PageChunk;
+
+/* An immutable version of the bulletin board page */
+typedef struct Page
+{
+	struct Page * newer;
+	uint64_t version;
+	int references;			/* protected by the render lock */
+	_Atomic(DeflatedPage *) deflated;	/* built by the first request asking for it */
+	uint32_t crc;			/* CRC-32C of the fragments in order */
+	uint32_t deflatedCrc;	/* CRC-32C of the deflated fragments in order */
+	size_t deflatedLength;	/* bytes of the deflated fragments */
+	size_t length;			/* bytes of the whole page */
+	size_t count;			/* entries of its vector: prologue, one fragment per message, epilogue */
+	const struct PageChunk * newest;	/* holds the newest fragments, NULL -> none */
+} Page;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int RenderOpen(size_t retain);
+int RenderLoad(const StoredMessage * message);
+int RenderAppend(const StoredMessage * message);
+Page * RenderAcquire(void);
+void RenderRetain(Page * page);
+void RenderRelease(Page * page);
+size_t RenderVector(const Page * page, struct iovec * vector);
+struct iovec * RenderAdded(const Page * older, const Page * newer, size_t * count);
+const DeflatedPage * RenderDeflate(Page * page);
+uint32_t RenderChecksum(const Page * page);
+void RenderClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,1218 @@
+/*
+ * @file simple_message_server_store.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Persistent bulletin board store. Posts are appended to a log of
+ * numbered segment files (NNNNNNNN.seg), every record carries a CRC-32C.
+ * The file "index" is a mapped array with one fixed-size entry per record
+ * in posting order, so messages are located by position without reading
+ * the log. Segments are mapped read only and handed out to the renderer
+ * without copying; there is no limit on their number.
+ *
+ * Durability: the appending thread waits until its record is on disk. The
+ * first waiter runs fdatasync() for everybody that appended until then
+ * (group commit), so concurrent posts share one flush.
+ *
+ * Recovery: the index is derived data. Whenever all records are on disk
+ * (a segment is sealed, the store is opened or closed) the index is
+ * flushed and its entries so far are marked as checked. On open only the
+ * entries behind that checkpoint are checked against the records they
+ * point to (bounds, sequence, checksum), so at most about a segment is
+ * read; the records behind the last indexed one are scanned and a torn or
+ * corrupt tail is truncated. A damaged index is rebuilt.
+ *
+ * Compaction: with a retain limit only the newest messages stay visible,
+ * segments that only contain older messages are deleted and the index is
+ * rewritten once it is mostly dead entries.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include "simple_message_server.h"
+#include "simple_message_crc32c.h"
+#include "simple_message_server_store.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define STORE_RECORD_MAGIC 0x31534D53U			/* "SMS1" */
+#define STORE_INDEX_MAGIC 0x5844494D534D5331ULL	/* "1SMSMIDX" */
+#define STORE_INDEX_FILE "index"
+#define STORE_INDEX_TEMPORARY_FILE "index.tmp"
+#define STORE_LOCK_FILE "lock"
+#define STORE_LOCK_TIMEOUT_MS 30000		/* an upgraded worker waits this long for the old one */
+#define STORE_LOCK_RETRY_MS 100
+#define STORE_INDEX_INITIAL 1024
+#define STORE_SEGMENTS_INITIAL 64
+#define STORE_ALIGN(length) (((length) + 7) & ~(size_t) 7)
+#define SEGMENT(number) (&segments[(number) % segmentSlots])
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* Header of a record in a segment, followed by user, image URL and message */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t crc;			/* CRC-32C of the following header fields and the payload */
+	uint32_t length;		/* payload bytes, the record is padded to 8 bytes */
+	uint16_t userLength;
+	uint16_t imgLength;		/* 0 -> no image */
+	uint64_t sequence;
+	int64_t time;
+} RecordHeader;
+
+typedef struct
+{
+	uint64_t sequence;
+	int64_t time;
+	uint32_t segment;
+	uint32_t offset;
+	uint32_t length;		/* bytes of the padded record */
+	uint32_t reserved;
+} IndexEntry;
+
+/* First slot of the index file */
+typedef struct
+{
+	uint64_t magic;
+	uint64_t count;			/* entries in the file */
+	uint64_t first;			/* first entry that is not removed by retention */
+	uint64_t checked;		/* entries before it were checked against records on disk */
+} IndexHeader;
+
+typedef struct
+{
+	char * map;				/* STORE_SEGMENT_SIZE bytes, valid up to size */
+	size_t size;
+} Segment;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static bool storeOpen = false;
+static int directoryDescriptor = -1;
+static int lockDescriptor = -1;
+static int indexDescriptor = -1;
+static IndexHeader * indexHeader = NULL;
+static IndexEntry * indexEntries = NULL;
+static size_t indexCapacity = 0;
+static Segment * segments = NULL;
+static size_t segmentSlots = 0;			/* a power of 2, segment n lives in slot n % segmentSlots */
+static uint32_t firstSegment = 0;
+static uint32_t lastSegment = 0;
+static int segmentDescriptor = -1;		/* descriptor of the last (appended) segment */
+static size_t retainCount = 0;
+static uint64_t nextSequence = 1;
+static pthread_rwlock_t storeLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Group commit */
+static pthread_mutex_t commitLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t commitCondition = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t syncLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t syncedSequence = 0;
+static bool syncing = false;
+static atomic_bool syncFailed = false;
+static atomic_uint_fast64_t appendedSequence = 0;
+
+static const char padding[8];
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint32_t RecordChecksum(const RecordHeader * header, const char * payload);
+static const RecordHeader * CheckRecord(uint32_t number, size_t offset);
+static bool IndexMatchesSegments(void);
+static int LockDirectory(const char * directory);
+static int ReserveSegments(size_t count);
+static int OpenSegment(uint32_t number, bool create, int * descriptor);
+static int ResizeIndex(size_t capacity);
+static int OpenIndex(void);
+static bool IndexIsConsistent(void);
+static int AppendIndex(const IndexEntry * entry);
+static int RecoverSegment(uint32_t number, size_t offset);
+static int FindSegments(uint32_t * first, uint32_t * last);
+static int CompactIndex(void);
+static void CheckpointIndex(void);
+static void ApplyRetention(void);
+static int RollSegment(void);
+static int WaitDurable(uint64_t sequence);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for calculating the checksum of a record
+ *
+ * \param header the header of the record
+ * \param payload the user, image URL and message following the header
+ *
+ * \return the CRC-32C of the header fields behind the crc field and the payload
+ *
+ */
+static uint32_t RecordChecksum(const RecordHeader * header, const char * payload)
+{
+	uint32_t crc = Crc32c(0, (const char *) header + offsetof(RecordHeader, length),
+						sizeof(RecordHeader) - offsetof(RecordHeader, length));
+
+	return Crc32c(crc, payload, header->length);
+}
+
+/**
+ *
+ * \brief Function for checking a record in a segment
+ *
+ * \param number the number of the segment
+ * \param offset the offset of the record
+ *
+ * \return the header of the record if it is complete and intact, NULL otherwise
+ *
+ */
+static const RecordHeader * CheckRecord(uint32_t number, size_t offset)
+{
+	const Segment * segment = SEGMENT(number);
+	const RecordHeader * header = NULL;
+
+	if(number < firstSegment || number > lastSegment || offset % 8 != 0 || offset > segment->size ||
+		segment->size - offset < sizeof(RecordHeader))
+	{
+		return NULL;
+	}
+	header = (const RecordHeader *) (segment->map + offset);
+	if(header->magic != STORE_RECORD_MAGIC || header->length > segment->size - offset - sizeof(RecordHeader) ||
+		offset + STORE_ALIGN(sizeof(RecordHeader) + header->length) > segment->size ||
+		(size_t) header->userLength + header->imgLength > header->length ||
+		RecordChecksum(header, (const char *) (header + 1)) != header->crc)
+	{
+		return NULL;
+	}
+	return header;
+}
+
+/**
+ *
+ * \brief Function for making room for the mappings of more segments
+ *
+ * The open segments move to their slot in the larger table. Called before
+ * any segment is opened or with the store locked for writing.
+ *
+ * \param count the number of segments the table shall hold
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int ReserveSegments(size_t count)
+{
+	size_t slots = segmentSlots > 0 ? segmentSlots : STORE_SEGMENTS_INITIAL;
+	Segment * grown = NULL;
+
+	while(slots < count)
+	{
+		slots *= 2;
+	}
+	if(slots == segmentSlots)
+	{
+		return EXIT_SUCCESS;
+	}
+
+	grown = calloc(slots, sizeof(Segment));
+	if(grown == NULL)
+	{
+		PrintError("ReserveSegments() -> calloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	for(uint32_t number = firstSegment; segments != NULL && number != 0 && number <= lastSegment; number++)
+	{
+		grown[number % slots] = *SEGMENT(number);
+	}
+	free(segments);
+	segments = grown;
+	segmentSlots = slots;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for opening and mapping a segment
+ *
+ * \param number the number of the segment
+ * \param create true if the segment shall be created
+ * \param descriptor receives the (read/write) descriptor of the segment
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int OpenSegment(uint32_t number, bool create, int * descriptor)
+{
+	Segment * segment = SEGMENT(number);
+	char name[32];
+	struct stat status;
+
+	snprintf(name, sizeof(name), "%08" PRIu32 ".seg", number);
+	*descriptor = openat(directoryDescriptor, name, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+	if(*descriptor == -1)
+	{
+		PrintError("OpenSegment() -> openat()", true, name);
+		return EXIT_FAILURE;
+	}
+
+	if(fstat(*descriptor, &status) == -1)
+	{
+		PrintError("OpenSegment() -> fstat()", true, name);
+		close(*descriptor);
+		return EXIT_FAILURE;
+	}
+
+	// The mapping covers the whole segment, appended records become visible without remapping
+	segment->map = mmap(NULL, STORE_SEGMENT_SIZE, PROT_READ, MAP_SHARED, *descriptor, 0);
+	if(segment->map == MAP_FAILED)
+	{
+		PrintError("OpenSegment() -> mmap()", true, name);
+		segment->map = NULL;
+		close(*descriptor);
+		return EXIT_FAILURE;
+	}
+	segment->size = (size_t) status.st_size < STORE_SEGMENT_SIZE ? (size_t) status.st_size : STORE_SEGMENT_SIZE;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for growing the index file and its mapping
+ *
+ * \param capacity the number of entries the index shall hold
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int ResizeIndex(size_t capacity)
+{
+	size_t size = sizeof(IndexHeader) + capacity * sizeof(IndexEntry);
+	void * map = NULL;
+
+	if(ftruncate(indexDescriptor, (off_t) size) == -1)
+	{
+		PrintError("ResizeIndex() -> ftruncate()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	if(indexHeader == NULL)
+	{
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, indexDescriptor, 0);
+	}
+	else
+	{
+		map = mremap(indexHeader, sizeof(IndexHeader) + indexCapacity * sizeof(IndexEntry), size, MREMAP_MAYMOVE);
+	}
+	if(map == MAP_FAILED)
+	{
+		PrintError("ResizeIndex() -> mmap()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	indexHeader = map;
+	indexEntries = (IndexEntry *) (indexHeader + 1);
+	indexCapacity = capacity;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for opening the index, an unusable index is started anew
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int OpenIndex(void)
+{
+	struct stat status;
+	size_t capacity = STORE_INDEX_INITIAL;
+
+	indexDescriptor = openat(directoryDescriptor, STORE_INDEX_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(indexDescriptor == -1 || fstat(indexDescriptor, &status) == -1)
+	{
+		PrintError("OpenIndex() -> openat()", true, STORE_INDEX_FILE);
+		return EXIT_FAILURE;
+	}
+
+	if((size_t) status.st_size > sizeof(IndexHeader) + STORE_INDEX_INITIAL * sizeof(IndexEntry))
+	{
+		capacity = ((size_t) status.st_size - sizeof(IndexHeader)) / sizeof(IndexEntry);
+	}
+	if(ResizeIndex(capacity) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	if(indexHeader->magic != STORE_INDEX_MAGIC || !IndexIsConsistent())
+	{
+		// Rebuilt from the segments by the recovery
+		memset(indexHeader, 0, sizeof(IndexHeader));
+		indexHeader->magic = STORE_INDEX_MAGIC;
+	}
+	if(indexHeader->checked > indexHeader->count)
+	{
+		indexHeader->checked = indexHeader->count;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for checking the structure of the index
+ *
+ * Entries must be in posting order. Entries of deleted segments at the
+ * front and of lost records at the tail are dropped by StoreOpen().
+ *
+ * \return true if the index can be used
+ *
+ */
+static bool IndexIsConsistent(void)
+{
+	if(indexHeader->count > indexCapacity || indexHeader->first > indexHeader->count)
+	{
+		return false;
+	}
+
+	for(uint64_t i = indexHeader->first; i < indexHeader->count; i++)
+	{
+		const IndexEntry * entry = &indexEntries[i];
+
+		if(i > indexHeader->first && (entry->sequence <= indexEntries[i - 1].sequence || entry->segment < indexEntries[i - 1].segment))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ *
+ * \brief Function for checking the entries behind the checkpoint against their records
+ *
+ * An entry pointing outside its segment, or at a record that is not the
+ * one it describes, would send readers past the mapped records. The
+ * entries before the checkpoint were checked when the records they point
+ * to were already on disk.
+ *
+ * \return true if all entries describe intact records
+ *
+ */
+static bool IndexMatchesSegments(void)
+{
+	for(uint64_t i = indexHeader->checked > indexHeader->first ? indexHeader->checked : indexHeader->first;
+		i < indexHeader->count; i++)
+	{
+		const IndexEntry * entry = &indexEntries[i];
+		const RecordHeader * header = CheckRecord(entry->segment, entry->offset);
+
+		if(header == NULL || header->sequence != entry->sequence || header->time != entry->time ||
+			STORE_ALIGN(sizeof(RecordHeader) + header->length) != entry->length)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ *
+ * \brief Function for appending an entry to the index
+ *
+ * \param entry the entry that shall be appended
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int AppendIndex(const IndexEntry * entry)
+{
+	if(indexHeader->count == indexCapacity && ResizeIndex(2 * indexCapacity) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+
+	indexEntries[indexHeader->count] = *entry;
+	indexHeader->count++;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for indexing the records of a segment behind an offset
+ *
+ * The scan stops at the first record that is incomplete or fails its
+ * checksum; the segment is truncated there.
+ *
+ * \param number the number of the segment
+ * \param offset the offset of the first record that is not indexed
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int RecoverSegment(uint32_t number, size_t offset)
+{
+	Segment * segment = SEGMENT(number);
+	char name[32];
+	int descriptor = -1;
+	int r = EXIT_SUCCESS;
+
+	while(offset + sizeof(RecordHeader) <= segment->size)
+	{
+		const RecordHeader * header = CheckRecord(number, offset);
+		size_t recordLength = 0;
+		IndexEntry entry;
+
+		if(header == NULL || (indexHeader->count > 0 && header->sequence <= indexEntries[indexHeader->count - 1].sequence))
+		{
+			break;
+		}
+		recordLength = STORE_ALIGN(sizeof(RecordHeader) + header->length);
+
+		entry.sequence = header->sequence;
+		entry.time = header->time;
+		entry.segment = number;
+		entry.offset = (uint32_t) offset;
+		entry.length = (uint32_t) recordLength;
+		entry.reserved = 0;
+		if(AppendIndex(&entry) == EXIT_FAILURE)
+		{
+			return EXIT_FAILURE;
+		}
+		offset += recordLength;
+	}
+
+	if(offset < segment->size)
+	{
+		// Torn write of a crash (or a damaged record) -> drop the tail
+		snprintf(name, sizeof(name), "%08" PRIu32 ".seg", number);
+		fprintf(stderr, "%s: truncating segment %s from %zu to %zu bytes\n", programName, name, segment->size, offset);
+		descriptor = number == lastSegment ? segmentDescriptor : openat(directoryDescriptor, name, O_WRONLY | O_CLOEXEC);
+		if(descriptor == -1 || ftruncate(descriptor, (off_t) offset) == -1)
+		{
+			PrintError("RecoverSegment() -> ftruncate()", true, name);
+			r = EXIT_FAILURE;
+		}
+		if(descriptor != -1 && descriptor != segmentDescriptor)
+		{
+			close(descriptor);
+		}
+		segment->size = offset;
+	}
+	return r;
+}
+
+/**
+ *
+ * \brief Function for finding the numbers of the existing segments
+ *
+ * \param first receives the lowest segment number (0 if there is none)
+ * \param last receives the highest segment number (0 if there is none)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int FindSegments(uint32_t * first, uint32_t * last)
+{
+	int descriptor = dup(directoryDescriptor);
+	DIR * directory = descriptor != -1 ? fdopendir(descriptor) : NULL;
+	struct dirent * directoryEntry = NULL;
+	size_t found = 0;
+
+	*first = 0;
+	*last = 0;
+	if(directory == NULL)
+	{
+		PrintError("FindSegments() -> fdopendir()", true, NULL);
+		if(descriptor != -1)
+		{
+			close(descriptor);
+		}
+		return EXIT_FAILURE;
+	}
+
+	while((directoryEntry = readdir(directory)) != NULL)
+	{
+		uint32_t number = 0;
+		char suffix[8];
+
+		if(sscanf(directoryEntry->d_name, "%8" SCNu32 ".%4s", &number, suffix) != 2 || strcmp(suffix, "seg") != 0 || number == 0)
+		{
+			continue;
+		}
+		*first = (found == 0 || number < *first) ? number : *first;
+		*last = (found == 0 || number > *last) ? number : *last;
+		found++;
+	}
+	closedir(directory);
+
+	if(found > 0 && found != (size_t) (*last - *first) + 1)
+	{
+		PrintError("FindSegments()", false, "Segments are missing in the data directory");
+		return EXIT_FAILURE;
+	}
+	return ReserveSegments(found);
+}
+
+/**
+ *
+ * \brief Function for taking the lock of the data directory
+ *
+ * \param directory the data directory (for messages)
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE if the lock cannot be taken or another process keeps it
+ *
+ */
+static int LockDirectory(const char * directory)
+{
+	int waited = 0;
+
+	lockDescriptor = openat(directoryDescriptor, STORE_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if(lockDescriptor == -1)
+	{
+		PrintError("LockDirectory() -> openat()", true, directory);
+		return EXIT_FAILURE;
+	}
+
+	while(flock(lockDescriptor, LOCK_EX | LOCK_NB) == -1)
+	{
+		if(errno == EINTR)
+		{
+			continue;
+		}
+		if(errno != EWOULDBLOCK)
+		{
+			PrintError("LockDirectory() -> flock()", true, directory);
+			return EXIT_FAILURE;
+		}
+		if(waited >= STORE_LOCK_TIMEOUT_MS)
+		{
+			PrintError("LockDirectory()", false, "The data directory is in use by another server");
+			return EXIT_FAILURE;
+		}
+		usleep(STORE_LOCK_RETRY_MS * 1000);
+		waited += STORE_LOCK_RETRY_MS;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for opening (and recovering) the store
+ *
+ * Only one process may use a data directory; a second one waits for the
+ * lock for a while, e.g. the worker of an upgraded binary until the old
+ * one drained, and fails if the directory stays in use.
+ *
+ * \param directory the data directory, created if necessary
+ * \param retain the number of newest messages kept, 0 -> all
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int StoreOpen(const char * directory, size_t retain)
+{
+	size_t resumeOffset = 0;
+	uint32_t resumeSegment = 0;
+	int descriptor = -1;
+
+	if(mkdir(directory, 0755) == -1 && errno != EEXIST)
+	{
+		PrintError("StoreOpen() -> mkdir()", true, directory);
+		return EXIT_FAILURE;
+	}
+
+	directoryDescriptor = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(directoryDescriptor == -1)
+	{
+		PrintError("StoreOpen() -> open()", true, directory);
+		return EXIT_FAILURE;
+	}
+
+	if(LockDirectory(directory) == EXIT_FAILURE)
+	{
+		StoreClose();
+		return EXIT_FAILURE;
+	}
+
+	if(FindSegments(&firstSegment, &lastSegment) == EXIT_FAILURE)
+	{
+		StoreClose();
+		return EXIT_FAILURE;
+	}
+
+	if(firstSegment == 0)
+	{
+		firstSegment = lastSegment = 1;
+		if(OpenSegment(firstSegment, true, &segmentDescriptor) == EXIT_FAILURE)
+		{
+			StoreClose();
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		for(uint32_t number = firstSegment; number <= lastSegment; number++)
+		{
+			if(OpenSegment(number, false, &descriptor) == EXIT_FAILURE)
+			{
+				StoreClose();
+				return EXIT_FAILURE;
+			}
+			if(number == lastSegment)
+			{
+				segmentDescriptor = descriptor;
+			}
+			else
+			{
+				close(descriptor);
+			}
+		}
+	}
+
+	if(OpenIndex() == EXIT_FAILURE)
+	{
+		StoreClose();
+		return EXIT_FAILURE;
+	}
+
+	// Drop index entries of records that did not survive (torn tail, deleted segment)
+	while(indexHeader->count > indexHeader->first)
+	{
+		const IndexEntry * entry = &indexEntries[indexHeader->count - 1];
+
+		if(entry->segment <= lastSegment && (size_t) entry->offset + entry->length <= SEGMENT(entry->segment)->size)
+		{
+			break;
+		}
+		indexHeader->count--;
+	}
+	while(indexHeader->first < indexHeader->count && indexEntries[indexHeader->first].segment < firstSegment)
+	{
+		indexHeader->first++;
+	}
+	if(indexHeader->count == indexHeader->first)
+	{
+		indexHeader->count = indexHeader->first = 0;
+	}
+	if(indexHeader->checked > indexHeader->count)
+	{
+		indexHeader->checked = indexHeader->count;
+	}
+	if(!IndexMatchesSegments())
+	{
+		fprintf(stderr, "%s: the index does not match the segments, rebuilding it\n", programName);
+		indexHeader->count = indexHeader->first = indexHeader->checked = 0;
+	}
+
+	// Only the records behind the last indexed one have to be scanned
+	resumeSegment = firstSegment;
+	if(indexHeader->count > 0)
+	{
+		resumeSegment = indexEntries[indexHeader->count - 1].segment;
+		resumeOffset = (size_t) indexEntries[indexHeader->count - 1].offset + indexEntries[indexHeader->count - 1].length;
+	}
+	for(uint32_t number = resumeSegment; number <= lastSegment; number++)
+	{
+		if(RecoverSegment(number, number == resumeSegment ? resumeOffset : 0) == EXIT_FAILURE)
+		{
+			StoreClose();
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The recovered records may only be in the page cache of an earlier run
+	if(fdatasync(segmentDescriptor) == -1)
+	{
+		PrintError("StoreOpen() -> fdatasync()", true, NULL);
+		StoreClose();
+		return EXIT_FAILURE;
+	}
+	CheckpointIndex();
+
+	nextSequence = indexHeader->count > 0 ? indexEntries[indexHeader->count - 1].sequence + 1 : 1;
+	syncedSequence = nextSequence - 1;
+	atomic_store(&appendedSequence, nextSequence - 1);
+	syncFailed = false;
+	retainCount = retain;
+	ApplyRetention();
+
+	storeOpen = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for checking whether posts go to the store
+ *
+ * \return true if the store is open
+ *
+ */
+bool StoreIsOpen(void)
+{
+	return storeOpen;
+}
+
+/**
+ *
+ * \brief Function for replacing the index by one without removed entries
+ *
+ * The new index is written completely before it is renamed over the old
+ * one and the rename is flushed, a crash leaves either of both.
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int CompactIndex(void)
+{
+	size_t live = indexHeader->count - indexHeader->first;
+	size_t capacity = live * 2 > STORE_INDEX_INITIAL ? live * 2 : STORE_INDEX_INITIAL;
+	IndexHeader header = { STORE_INDEX_MAGIC, live, 0,
+						   indexHeader->checked > indexHeader->first ? indexHeader->checked - indexHeader->first : 0 };
+	struct iovec vector[2];
+	int descriptor = openat(directoryDescriptor, STORE_INDEX_TEMPORARY_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if(descriptor == -1)
+	{
+		PrintError("CompactIndex() -> openat()", true, STORE_INDEX_TEMPORARY_FILE);
+		return EXIT_FAILURE;
+	}
+
+	vector[0].iov_base = &header;
+	vector[0].iov_len = sizeof(header);
+	vector[1].iov_base = &indexEntries[indexHeader->first];
+	vector[1].iov_len = live * sizeof(IndexEntry);
+	if(ftruncate(descriptor, (off_t) (sizeof(IndexHeader) + capacity * sizeof(IndexEntry))) == -1 ||
+		pwritev(descriptor, vector, 2, 0) != (ssize_t) (vector[0].iov_len + vector[1].iov_len) ||
+		fdatasync(descriptor) == -1 ||
+		renameat(directoryDescriptor, STORE_INDEX_TEMPORARY_FILE, directoryDescriptor, STORE_INDEX_FILE) == -1)
+	{
+		PrintError("CompactIndex() -> pwritev()", true, STORE_INDEX_TEMPORARY_FILE);
+		close(descriptor);
+		unlinkat(directoryDescriptor, STORE_INDEX_TEMPORARY_FILE, 0);
+		return EXIT_FAILURE;
+	}
+
+	if(fsync(directoryDescriptor) == -1)
+	{
+		PrintError("CompactIndex() -> fsync()", true, NULL);
+	}
+
+	munmap(indexHeader, sizeof(IndexHeader) + indexCapacity * sizeof(IndexEntry));
+	close(indexDescriptor);
+	indexHeader = NULL;
+	indexDescriptor = descriptor;
+	return ResizeIndex(capacity);
+}
+
+/**
+ *
+ * \brief Function for marking the entries of the index as checked
+ *
+ * Must only be called when the records of all entries are on disk. The
+ * entries are flushed before the checkpoint moves, the checkpoint itself
+ * goes to disk with the next flush.
+ *
+ */
+static void CheckpointIndex(void)
+{
+	if(msync(indexHeader, sizeof(IndexHeader) + indexCapacity * sizeof(IndexEntry), MS_SYNC) == -1)
+	{
+		PrintError("CheckpointIndex() -> msync()", true, NULL);
+		return;
+	}
+	indexHeader->checked = indexHeader->count;
+}
+
+/**
+ *
+ * \brief Function for removing the messages behind the retain limit
+ *
+ * Called with the store locked for writing.
+ *
+ */
+static void ApplyRetention(void)
+{
+	char name[32];
+
+	if(retainCount == 0 || indexHeader->count - indexHeader->first <= retainCount)
+	{
+		return;
+	}
+	indexHeader->first = indexHeader->count - retainCount;
+
+	// Sealed segments without visible messages are deleted
+	while(firstSegment < lastSegment && indexEntries[indexHeader->first].segment > firstSegment)
+	{
+		snprintf(name, sizeof(name), "%08" PRIu32 ".seg", firstSegment);
+		munmap(SEGMENT(firstSegment)->map, STORE_SEGMENT_SIZE);
+		SEGMENT(firstSegment)->map = NULL;
+		if(unlinkat(directoryDescriptor, name, 0) == -1)
+		{
+			PrintError("ApplyRetention() -> unlinkat()", true, name);
+		}
+		firstSegment++;
+	}
+
+	if(indexHeader->first >= STORE_INDEX_INITIAL && indexHeader->first >= indexHeader->count - indexHeader->first)
+	{
+		// Failure only costs space, the old index stays valid
+		CompactIndex();
+	}
+}
+
+/**
+ *
+ * \brief Function for starting a new segment when the last one is full
+ *
+ * The full segment is flushed before it is sealed, so the group commit
+ * only ever has to flush the last segment.
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int RollSegment(void)
+{
+	int descriptor = -1;
+	int r = EXIT_SUCCESS;
+
+	if(ReserveSegments((size_t) (lastSegment + 2 - firstSegment)) == EXIT_FAILURE ||
+		OpenSegment(lastSegment + 1, true, &descriptor) == EXIT_FAILURE)
+	{
+		return EXIT_FAILURE;
+	}
+	if(fsync(directoryDescriptor) == -1)
+	{
+		PrintError("RollSegment() -> fsync()", true, NULL);
+	}
+
+	pthread_mutex_lock(&syncLock);
+	if(fdatasync(segmentDescriptor) == -1)
+	{
+		PrintError("RollSegment() -> fdatasync()", true, NULL);
+		r = EXIT_FAILURE;
+	}
+	close(segmentDescriptor);
+	segmentDescriptor = descriptor;
+	lastSegment++;
+	pthread_mutex_unlock(&syncLock);
+
+	// Every indexed record lies in a sealed segment now, all of them flushed
+	if(r == EXIT_SUCCESS)
+	{
+		CheckpointIndex();
+	}
+	return r;
+}
+
+/**
+ *
+ * \brief Function for waiting until a record is on disk
+ *
+ * One waiter flushes on behalf of all records appended until then, the
+ * others wait for that flush (or the next one).
+ *
+ * \param sequence the sequence number of the record
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE if the record could not be flushed
+ *
+ */
+static int WaitDurable(uint64_t sequence)
+{
+	uint64_t target = 0;
+	int r = 0;
+
+	pthread_mutex_lock(&commitLock);
+	while(syncedSequence < sequence && !syncFailed)
+	{
+		if(syncing)
+		{
+			pthread_cond_wait(&commitCondition, &commitLock);
+			continue;
+		}
+
+		syncing = true;
+		pthread_mutex_unlock(&commitLock);
+
+		pthread_mutex_lock(&syncLock);
+		target = atomic_load(&appendedSequence);
+		r = fdatasync(segmentDescriptor);
+		pthread_mutex_unlock(&syncLock);
+
+		pthread_mutex_lock(&commitLock);
+		if(r == -1)
+		{
+			// The page cache state is unknown after a failed flush, stop accepting posts
+			PrintError("WaitDurable() -> fdatasync()", true, NULL);
+			syncFailed = true;
+		}
+		else if(target > syncedSequence)
+		{
+			syncedSequence = target;
+		}
+		syncing = false;
+		pthread_cond_broadcast(&commitCondition);
+	}
+	r = syncedSequence >= sequence ? EXIT_SUCCESS : EXIT_FAILURE;
+	pthread_mutex_unlock(&commitLock);
+
+	return r;
+}
+
+/**
+ *
+ * \brief Function for appending a post to the store
+ *
+ * Returns when the post is on disk.
+ *
+ * \param user the user name
+ * \param img the image URL or NULL
+ * \param message the message
+ * \param messageLength the length of the message
+ * \param postedSequence receives the sequence number of the post
+ * \param postedTime receives the time of the post
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int StoreAppend(const char * user, const char * img, const char * message, size_t messageLength,
+				uint64_t * postedSequence, time_t * postedTime)
+{
+	RecordHeader header;
+	IndexEntry entry;
+	struct iovec vector[5];
+	Segment * segment = NULL;
+	size_t userLength = strlen(user);
+	size_t imgLength = img != NULL ? strlen(img) : 0;
+	size_t recordLength = STORE_ALIGN(sizeof(RecordHeader) + userLength + imgLength + messageLength);
+	uint64_t sequence = 0;
+
+	if(userLength > UINT16_MAX || imgLength > UINT16_MAX || recordLength > STORE_SEGMENT_SIZE)
+	{
+		PrintError("StoreAppend()", false, "Post is too large for the store");
+		return EXIT_FAILURE;
+	}
+
+	pthread_rwlock_wrlock(&storeLock);
+	if(syncFailed || (SEGMENT(lastSegment)->size + recordLength > STORE_SEGMENT_SIZE && RollSegment() == EXIT_FAILURE))
+	{
+		pthread_rwlock_unlock(&storeLock);
+		return EXIT_FAILURE;
+	}
+	segment = SEGMENT(lastSegment);
+	sequence = nextSequence;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = STORE_RECORD_MAGIC;
+	header.length = (uint32_t) (userLength + imgLength + messageLength);
+	header.userLength = (uint16_t) userLength;
+	header.imgLength = (uint16_t) imgLength;
+	header.sequence = sequence;
+	header.time = (int64_t) time(NULL);
+	header.crc = Crc32c(0, (const char *) &header + offsetof(RecordHeader, length), sizeof(RecordHeader) - offsetof(RecordHeader, length));
+	header.crc = Crc32c(header.crc, user, userLength);
+	header.crc = Crc32c(header.crc, img != NULL ? img : "", imgLength);
+	header.crc = Crc32c(header.crc, message, messageLength);
+
+	vector[0].iov_base = &header;
+	vector[0].iov_len = sizeof(header);
+	vector[1].iov_base = (void *) user;
+	vector[1].iov_len = userLength;
+	vector[2].iov_base = (void *) (img != NULL ? img : "");
+	vector[2].iov_len = imgLength;
+	vector[3].iov_base = (void *) message;
+	vector[3].iov_len = messageLength;
+	vector[4].iov_base = (void *) padding;
+	vector[4].iov_len = recordLength - sizeof(header) - header.length;
+
+	entry.sequence = sequence;
+	entry.time = header.time;
+	entry.segment = lastSegment;
+	entry.offset = (uint32_t) segment->size;
+	entry.length = (uint32_t) recordLength;
+	entry.reserved = 0;
+
+	if(pwritev(segmentDescriptor, vector, 5, (off_t) segment->size) != (ssize_t) recordLength || AppendIndex(&entry) == EXIT_FAILURE)
+	{
+		PrintError("StoreAppend() -> pwritev()", true, NULL);
+		if(ftruncate(segmentDescriptor, (off_t) segment->size) == -1)
+		{
+			PrintError("StoreAppend() -> ftruncate()", true, NULL);
+		}
+		pthread_rwlock_unlock(&storeLock);
+		return EXIT_FAILURE;
+	}
+
+	segment->size += recordLength;
+	nextSequence++;
+	atomic_store(&appendedSequence, sequence);
+	*postedSequence = sequence;
+	*postedTime = (time_t) header.time;
+	ApplyRetention();
+	pthread_rwlock_unlock(&storeLock);
+
+	return WaitDurable(sequence);
+}
+
+/**
+ *
+ * \brief Function for locking the store for reading
+ *
+ * Messages returned by StoreGet() stay valid until StoreEndRead().
+ *
+ */
+void StoreBeginRead(void)
+{
+	pthread_rwlock_rdlock(&storeLock);
+}
+
+/**
+ *
+ * \brief Function for unlocking the store after reading
+ *
+ */
+void StoreEndRead(void)
+{
+	pthread_rwlock_unlock(&storeLock);
+}
+
+/**
+ *
+ * \brief Function for counting the visible messages (store locked for reading)
+ *
+ * \return the number of messages
+ *
+ */
+size_t StoreCount(void)
+{
+	return indexHeader->count - indexHeader->first;
+}
+
+/**
+ *
+ * \brief Function for reading a message by its position (store locked for reading)
+ *
+ * \param position the position of the message in posting order [0..StoreCount())
+ * \param message receives the message, pointing into the mapped segment
+ *
+ */
+void StoreGet(size_t position, StoredMessage * message)
+{
+	const IndexEntry * entry = &indexEntries[indexHeader->first + position];
+	const RecordHeader * header = (const RecordHeader *) (SEGMENT(entry->segment)->map + entry->offset);
+	const char * payload = (const char *) (header + 1);
+
+	message->sequence = header->sequence;
+	message->time = (time_t) header->time;
+	message->user = payload;
+	message->userLength = header->userLength;
+	message->img = header->imgLength > 0 ? payload + header->userLength : NULL;
+	message->imgLength = header->imgLength;
+	message->message = payload + header->userLength + header->imgLength;
+	message->messageLength = header->length - header->userLength - header->imgLength;
+}
+
+/**
+ *
+ * \brief Function for flushing and closing the store
+ *
+ */
+void StoreClose(void)
+{
+	pthread_rwlock_wrlock(&storeLock);
+
+	if(segmentDescriptor != -1)
+	{
+		if(fdatasync(segmentDescriptor) == -1)
+		{
+			PrintError("StoreClose() -> fdatasync()", true, NULL);
+		}
+		else if(storeOpen && !syncFailed && indexHeader != NULL)
+		{
+			CheckpointIndex();
+		}
+		close(segmentDescriptor);
+		segmentDescriptor = -1;
+	}
+	storeOpen = false;
+	for(size_t i = 0; i < segmentSlots; i++)
+	{
+		if(segments[i].map != NULL)
+		{
+			munmap(segments[i].map, STORE_SEGMENT_SIZE);
+		}
+	}
+	free(segments);
+	segments = NULL;
+	segmentSlots = 0;
+	if(indexHeader != NULL)
+	{
+		munmap(indexHeader, sizeof(IndexHeader) + indexCapacity * sizeof(IndexEntry));
+		indexHeader = NULL;
+		indexEntries = NULL;
+		indexCapacity = 0;
+	}
+	if(indexDescriptor != -1)
+	{
+		close(indexDescriptor);
+		indexDescriptor = -1;
+	}
+	// Closing the lock file hands the directory to a waiting process
+	if(lockDescriptor != -1)
+	{
+		close(lockDescriptor);
+		lockDescriptor = -1;
+	}
+	if(directoryDescriptor != -1)
+	{
+		close(directoryDescriptor);
+		directoryDescriptor = -1;
+	}
+	firstSegment = lastSegment = 0;
+
+	pthread_rwlock_unlock(&storeLock);
+}
+
+/*
+ * =================================================================== eof ==
+ */
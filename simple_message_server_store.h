@@ -0,0 +1,63 @@
+/*
+ * @file simple_message_server_store.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_STORE_H
+#define SIMPLE_MESSAGE_SERVER_STORE_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+/* Size of one segment of the log, a segment is mapped as a whole */
+#define STORE_SEGMENT_SIZE (64UL * 1024 * 1024)
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* A stored message; the pointers refer to the mapped segment and are not zero terminated */
+typedef struct
+{
+	uint64_t sequence;
+	time_t time;
+	const char * user;
+	size_t userLength;
+	const char * img;		/* NULL if the post has no image */
+	size_t imgLength;
+	const char * message;
+	size_t messageLength;
+} StoredMessage;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int StoreOpen(const char * directory, size_t retain);
+bool StoreIsOpen(void);
+int StoreAppend(const char * user, const char * img, const char * message, size_t messageLength, uint64_t * postedSequence, time_t * postedTime);
+void StoreBeginRead(void);
+void StoreEndRead(void);
+size_t StoreCount(void);
+void StoreGet(size_t position, StoredMessage * message);
+void StoreClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
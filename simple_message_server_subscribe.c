@@ -0,0 +1,748 @@
+/*
+ * @file simple_message_server_subscribe.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * Push subscriptions to the bulletin board. A request with the line
+ * "subscribe=page" or "subscribe=messages" in its header block is answered
+ * with "status=0\n" and then stays open; the connection is handed to the
+ * publisher thread.
+ *
+ * On every new page version the publisher sends each subscriber an update
+ * frame bringing it from the version it has to the current one:
+ *
+ *   page:     "file=<name>\n" [enc=deflate\n] [crc=<hex>\n] "len=<bytes>\n" <page>
+ *   messages: "messages=<n>\n" [crc=<hex>\n] "len=<bytes>\n" <new fragments>
+ *
+ * A messages subscriber gets the whole page as first frame. Frames point
+ * into the rendered page version and are built once per variant, all
+ * subscribers in step share them. The sockets are non-blocking: a slow
+ * subscriber keeps its frame until it can take more and then skips the
+ * versions it missed, nobody waits for it.
+ *
+ * A subscriber holds the versions it has and gets, so one that stops
+ * reading is dropped: when its frame did not move for the I/O timeout,
+ * or when the board moved on by more than SUBSCRIBER_MAX_LAG versions
+ * meanwhile. All subscribers are polled for a hangup, idle ones as well;
+ * a client that sent its subscription in a frame has not shut down its
+ * writing side, so its EOF (POLLRDHUP) means it is gone.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "simple_message_server.h"
+#include "simple_message_server_subscribe.h"
+#include "simple_message_server_handler.h"
+#include "simple_message_server_render.h"
+#include "simple_message_server_metrics.h"
+#include "simple_message_crc32c.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define FRAME_HEADER_SIZE 128
+#define FRAME_CACHE_SIZE 8
+#define SUBSCRIBER_MAX_LAG 1024
+#define SUBSCRIBER_CHECK_INTERVAL 1000	/* milliseconds between checks for stalled frames */
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* An update frame, shared by the subscribers it is sent to */
+typedef struct
+{
+	int references;			/* only touched by the publisher thread */
+	Page * page;			/* held, the version the frame brings a subscriber to */
+	struct iovec * added;	/* the new fragments of a messages frame (allocated) */
+	size_t length;			/* bytes of the whole frame */
+	size_t count;			/* entries of vector */
+	char header[FRAME_HEADER_SIZE];
+	struct iovec vector[];	/* header and body */
+} Frame;
+
+/* A frame built for the current version */
+typedef struct
+{
+	const Page * from;		/* NULL -> the whole page */
+	bool deflate;
+	bool checksum;
+	Frame * frame;
+} CachedFrame;
+
+typedef struct Subscriber
+{
+	struct Subscriber * next;
+	int descriptor;
+	SubscribeMode mode;
+	bool deflate;
+	bool checksum;
+	bool framed;			/* the client keeps its writing side open, EOF means it left */
+	Page * delivered;		/* held, the version the subscriber has (NULL -> none) */
+	Frame * sending;		/* NULL -> nothing in flight */
+	size_t offset;			/* bytes of the frame already sent */
+	struct timespec progress;	/* the frame in flight last moved */
+} Subscriber;
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static pthread_t publisher;
+static bool publisherRunning = false;
+static atomic_bool stopping = false;
+static int wakeDescriptor = -1;
+static int stallSeconds = 0;
+
+/* New subscribers, handed over by the worker threads */
+static pthread_mutex_t incomingLock = PTHREAD_MUTEX_INITIALIZER;
+static Subscriber * incoming = NULL;
+
+/* Owned by the publisher thread */
+static Subscriber * subscribers = NULL;
+static size_t subscriberCount = 0;
+static Page * target = NULL;
+static CachedFrame frameCache[FRAME_CACHE_SIZE];
+static int cachedFrames = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void Wake(void);
+static Frame * BuildFrame(const Page * from, bool deflate, bool checksum);
+static Frame * GetFrame(const Subscriber * subscriber);
+static void ReleaseFrame(Frame * frame);
+static void ClearFrames(void);
+static void UpdateTarget(void);
+static int Pump(Subscriber * subscriber);
+static bool Stalled(const Subscriber * subscriber, const struct timespec * now);
+static void DropSubscriber(Subscriber * subscriber);
+static void * PublisherMain(void * argument);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for waking up the publisher thread
+ *
+ */
+static void Wake(void)
+{
+	uint64_t one = 1;
+
+	// A full counter wakes up the publisher as well
+	if(write(wakeDescriptor, &one, sizeof(one)) == -1 && errno != EAGAIN)
+	{
+		PrintError("Wake() -> write()", true, NULL);
+	}
+}
+
+/**
+ *
+ * \brief Function for building an update frame to the current version
+ *
+ * \param from the version the subscriber has (NULL -> the whole page is sent)
+ * \param deflate send the whole page compressed if it gets smaller
+ * \param checksum announce the CRC-32C of the body
+ *
+ * \return the frame with one reference
+ * \return NULL in case of failure
+ *
+ */
+static Frame * BuildFrame(const Page * from, bool deflate, bool checksum)
+{
+	const DeflatedPage * deflated = NULL;
+	struct iovec * added = NULL;
+	size_t bodyCount = target->count;
+	size_t bodyLength = target->length;
+	uint32_t crc = 0;
+	Frame * frame = NULL;
+	int length = 0;
+
+	if(from != NULL)
+	{
+		added = RenderAdded(from, target, &bodyCount);
+		if(added == NULL)
+		{
+			return NULL;
+		}
+		bodyLength = 0;
+		for(size_t i = 0; i < bodyCount; i++)
+		{
+			bodyLength += added[i].iov_len;
+			crc = checksum ? Crc32c(crc, added[i].iov_base, added[i].iov_len) : 0;
+		}
+	}
+	else if(deflate)
+	{
+		// Small pages may not get smaller, they are sent as they are then
+		deflated = RenderDeflate(target);
+		if(deflated != NULL && deflated->length >= target->length)
+		{
+			deflated = NULL;
+		}
+	}
+
+	frame = malloc(sizeof(Frame) + ((deflated != NULL ? deflated->count : bodyCount) + 1) * sizeof(struct iovec));
+	if(frame == NULL)
+	{
+		PrintError("BuildFrame() -> malloc()", true, NULL);
+		free(added);
+		return NULL;
+	}
+
+	if(from != NULL)
+	{
+		length = snprintf(frame->header, sizeof(frame->header), "messages=%zu\n", bodyCount);
+	}
+	else
+	{
+		length = snprintf(frame->header, sizeof(frame->header), "file=%s\n%s", RESPONSE_HTML_FILE,
+						deflated != NULL ? "enc=deflate\n" : "");
+		crc = !checksum ? 0 : deflated != NULL ? deflated->crc : RenderChecksum(target);
+	}
+	if(checksum)
+	{
+		length += snprintf(frame->header + length, sizeof(frame->header) - length, "crc=%08" PRIx32 "\n", crc);
+	}
+	length += snprintf(frame->header + length, sizeof(frame->header) - length, "len=%zu\n",
+					deflated != NULL ? deflated->length : bodyLength);
+
+	frame->references = 1;
+	frame->page = target;
+	frame->added = added;
+	frame->vector[0].iov_base = frame->header;
+	frame->vector[0].iov_len = length;
+	if(deflated != NULL)
+	{
+		memcpy(frame->vector + 1, deflated->vector, deflated->count * sizeof(struct iovec));
+		frame->count = deflated->count + 1;
+		frame->length = length + deflated->length;
+	}
+	else
+	{
+		if(added != NULL)
+		{
+			memcpy(frame->vector + 1, added, bodyCount * sizeof(struct iovec));
+		}
+		else
+		{
+			RenderVector(target, frame->vector + 1);
+		}
+		frame->count = bodyCount + 1;
+		frame->length = length + bodyLength;
+	}
+	RenderRetain(target);
+	return frame;
+}
+
+/**
+ *
+ * \brief Function for getting the next frame of a subscriber, built once per variant
+ *
+ * \param subscriber the subscriber
+ *
+ * \return the frame with a reference for the subscriber
+ * \return NULL in case of failure
+ *
+ */
+static Frame * GetFrame(const Subscriber * subscriber)
+{
+	const Page * from = subscriber->mode == SUBSCRIBE_MESSAGES ? subscriber->delivered : NULL;
+	bool deflate = from == NULL && subscriber->deflate;
+	Frame * frame = NULL;
+
+	for(int i = 0; i < cachedFrames; i++)
+	{
+		if(frameCache[i].from == from && frameCache[i].deflate == deflate && frameCache[i].checksum == subscriber->checksum)
+		{
+			frameCache[i].frame->references++;
+			return frameCache[i].frame;
+		}
+	}
+
+	frame = BuildFrame(from, deflate, subscriber->checksum);
+	if(frame != NULL && cachedFrames < FRAME_CACHE_SIZE)
+	{
+		frameCache[cachedFrames].from = from;
+		frameCache[cachedFrames].deflate = deflate;
+		frameCache[cachedFrames].checksum = subscriber->checksum;
+		frameCache[cachedFrames].frame = frame;
+		cachedFrames++;
+		frame->references++;
+	}
+	return frame;
+}
+
+/**
+ *
+ * \brief Function for dropping a reference to a frame
+ *
+ * \param frame the frame
+ *
+ */
+static void ReleaseFrame(Frame * frame)
+{
+	if(--frame->references == 0)
+	{
+		RenderRelease(frame->page);
+		free(frame->added);
+		free(frame);
+	}
+}
+
+/**
+ *
+ * \brief Function for dropping the frames built for the previous version
+ *
+ */
+static void ClearFrames(void)
+{
+	for(int i = 0; i < cachedFrames; i++)
+	{
+		ReleaseFrame(frameCache[i].frame);
+	}
+	cachedFrames = 0;
+}
+
+/**
+ *
+ * \brief Function for moving the publisher on to the current page version
+ *
+ */
+static void UpdateTarget(void)
+{
+	Page * page = RenderAcquire();
+
+	if(page == target)
+	{
+		RenderRelease(page);
+		return;
+	}
+	ClearFrames();
+	if(target != NULL)
+	{
+		RenderRelease(target);
+	}
+	target = page;
+}
+
+/**
+ *
+ * \brief Function for sending a subscriber as much as its socket takes
+ *
+ * \param subscriber the subscriber
+ *
+ * \return EXIT_SUCCESS if the subscriber is up to date or its socket is full
+ * \return EXIT_FAILURE if the subscriber is gone
+ *
+ */
+static int Pump(Subscriber * subscriber)
+{
+	struct iovec window[IOV_MAX];
+	struct msghdr messageHeader;
+
+	for(;;)
+	{
+		Frame * frame = subscriber->sending;
+		size_t skip = subscriber->offset;
+		size_t count = 0;
+		ssize_t r = 0;
+
+		if(frame == NULL)
+		{
+			if(subscriber->delivered == target)
+			{
+				return EXIT_SUCCESS;
+			}
+			frame = subscriber->sending = GetFrame(subscriber);
+			subscriber->offset = 0;
+			if(frame == NULL)
+			{
+				return EXIT_FAILURE;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &subscriber->progress);
+			skip = 0;
+		}
+
+		for(size_t i = 0; i < frame->count && count < IOV_MAX; i++)
+		{
+			if(skip >= frame->vector[i].iov_len)
+			{
+				skip -= frame->vector[i].iov_len;
+				continue;
+			}
+			window[count].iov_base = (char *) frame->vector[i].iov_base + skip;
+			window[count].iov_len = frame->vector[i].iov_len - skip;
+			skip = 0;
+			count++;
+		}
+
+		memset(&messageHeader, 0, sizeof(messageHeader));
+		messageHeader.msg_iov = window;
+		messageHeader.msg_iovlen = count;
+		r = sendmsg(subscriber->descriptor, &messageHeader, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if(r == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		subscriber->offset += r;
+		clock_gettime(CLOCK_MONOTONIC, &subscriber->progress);
+		MetricsAdd(METRIC_BYTES_OUT, r);
+
+		if(subscriber->offset == frame->length)
+		{
+			RenderRetain(frame->page);
+			if(subscriber->delivered != NULL)
+			{
+				RenderRelease(subscriber->delivered);
+			}
+			subscriber->delivered = frame->page;
+			subscriber->sending = NULL;
+			ReleaseFrame(frame);
+			MetricsAdd(METRIC_UPDATES_SENT, 1);
+		}
+	}
+}
+
+/**
+ *
+ * \brief Function for telling whether a subscriber stopped reading
+ *
+ * \param subscriber the subscriber
+ * \param now the current time (CLOCK_MONOTONIC)
+ *
+ * \return true if its frame did not move for the I/O timeout or it lags too many versions behind
+ * \return false otherwise
+ *
+ */
+static bool Stalled(const Subscriber * subscriber, const struct timespec * now)
+{
+	const struct timespec * progress = &subscriber->progress;
+
+	if(subscriber->sending == NULL)
+	{
+		return false;
+	}
+	if(target->version - subscriber->sending->page->version > SUBSCRIBER_MAX_LAG)
+	{
+		return true;
+	}
+	return now->tv_sec - progress->tv_sec > stallSeconds ||
+		(now->tv_sec - progress->tv_sec == stallSeconds && now->tv_nsec >= progress->tv_nsec);
+}
+
+/**
+ *
+ * \brief Function for closing the connection of a subscriber and freeing it
+ *
+ * \param subscriber the subscriber
+ *
+ */
+static void DropSubscriber(Subscriber * subscriber)
+{
+	if(subscriber->sending != NULL)
+	{
+		ReleaseFrame(subscriber->sending);
+	}
+	if(subscriber->delivered != NULL)
+	{
+		RenderRelease(subscriber->delivered);
+	}
+	close(subscriber->descriptor);
+	free(subscriber);
+	MetricsAdd(METRIC_SUBSCRIBERS, (unsigned long) -1);
+}
+
+/**
+ *
+ * \brief Function for the publisher thread
+ *
+ * Waits for new versions, new subscribers, hangups and sockets taking
+ * more data; every subscriber is pumped once per round. While frames are
+ * in flight it wakes up regularly to drop stalled subscribers.
+ *
+ * \param argument unused
+ *
+ * \return NULL
+ *
+ */
+static void * PublisherMain(void * argument)
+{
+	struct pollfd * pollDescriptors = NULL;
+	size_t capacity = 0;
+
+	(void) argument;
+	while(!atomic_load(&stopping))
+	{
+		size_t count = 1;
+		bool inFlight = false;
+		struct timespec now;
+
+		if(capacity < subscriberCount + 1)
+		{
+			struct pollfd * grown = realloc(pollDescriptors, 2 * (subscriberCount + 1) * sizeof(struct pollfd));
+			if(grown == NULL)
+			{
+				PrintError("PublisherMain() -> realloc()", true, NULL);
+				break;
+			}
+			pollDescriptors = grown;
+			capacity = 2 * (subscriberCount + 1);
+		}
+
+		pollDescriptors[0].fd = wakeDescriptor;
+		pollDescriptors[0].events = POLLIN;
+		// Subscribers never send, so a hangup shows up at once, even while idle
+		for(Subscriber * subscriber = subscribers; subscriber != NULL; subscriber = subscriber->next)
+		{
+			pollDescriptors[count].fd = subscriber->descriptor;
+			pollDescriptors[count].events = (subscriber->framed ? POLLRDHUP : 0) | (subscriber->sending != NULL ? POLLOUT : 0);
+			inFlight = inFlight || subscriber->sending != NULL;
+			count++;
+		}
+
+		if(poll(pollDescriptors, count, inFlight ? SUBSCRIBER_CHECK_INTERVAL : -1) == -1)
+		{
+			if(errno != EINTR)
+			{
+				PrintError("PublisherMain() -> poll()", true, NULL);
+			}
+			continue;
+		}
+
+		// Same order as above, the list is changed below only
+		count = 1;
+		for(Subscriber ** link = &subscribers; *link != NULL; count++)
+		{
+			Subscriber * subscriber = *link;
+
+			if(pollDescriptors[count].revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL))
+			{
+				*link = subscriber->next;
+				subscriberCount--;
+				DropSubscriber(subscriber);
+				continue;
+			}
+			link = &subscriber->next;
+		}
+
+		if(pollDescriptors[0].revents & POLLIN)
+		{
+			uint64_t wakeups = 0;
+
+			if(read(wakeDescriptor, &wakeups, sizeof(wakeups)) == -1 && errno != EAGAIN)
+			{
+				PrintError("PublisherMain() -> read()", true, NULL);
+			}
+
+			pthread_mutex_lock(&incomingLock);
+			while(incoming != NULL)
+			{
+				Subscriber * subscriber = incoming;
+
+				incoming = subscriber->next;
+				subscriber->next = subscribers;
+				subscribers = subscriber;
+				subscriberCount++;
+			}
+			pthread_mutex_unlock(&incomingLock);
+
+			UpdateTarget();
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for(Subscriber ** link = &subscribers; *link != NULL; )
+		{
+			Subscriber * subscriber = *link;
+
+			if(Stalled(subscriber, &now) || Pump(subscriber) == EXIT_FAILURE)
+			{
+				*link = subscriber->next;
+				subscriberCount--;
+				DropSubscriber(subscriber);
+				continue;
+			}
+			link = &subscriber->next;
+		}
+	}
+
+	free(pollDescriptors);
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for starting the publisher thread
+ *
+ * \param ioTimeout the seconds a frame may not move before its subscriber is dropped
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int SubscribeOpen(int ioTimeout)
+{
+	wakeDescriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(wakeDescriptor == -1)
+	{
+		PrintError("SubscribeOpen() -> eventfd()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	stallSeconds = ioTimeout;
+	atomic_store(&stopping, false);
+	if(pthread_create(&publisher, NULL, PublisherMain, NULL) != 0)
+	{
+		PrintError("SubscribeOpen() -> pthread_create()", false, NULL);
+		close(wakeDescriptor);
+		wakeDescriptor = -1;
+		return EXIT_FAILURE;
+	}
+	publisherRunning = true;
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for handing a connection over to the publisher
+ *
+ * The first update is sent by the publisher as well, so the subscriber
+ * misses no version published in between.
+ *
+ * \param socketDescriptor the connection, owned by the publisher on success
+ * \param mode what the subscriber receives
+ * \param deflate the subscriber accepts a compressed page
+ * \param checksum the subscriber checks the frames with CRC-32C
+ * \param framed the subscription came in a frame, the client did not shut down its writing side
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int SubscribeAdd(int socketDescriptor, SubscribeMode mode, bool deflate, bool checksum, bool framed)
+{
+	Subscriber * subscriber = NULL;
+	int flags = fcntl(socketDescriptor, F_GETFL);
+
+	if(!publisherRunning)
+	{
+		return EXIT_FAILURE;
+	}
+	if(flags == -1 || fcntl(socketDescriptor, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		PrintError("SubscribeAdd() -> fcntl()", true, NULL);
+		return EXIT_FAILURE;
+	}
+
+	subscriber = calloc(1, sizeof(Subscriber));
+	if(subscriber == NULL)
+	{
+		PrintError("SubscribeAdd() -> calloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	subscriber->descriptor = socketDescriptor;
+	subscriber->mode = mode;
+	subscriber->deflate = deflate;
+	subscriber->checksum = checksum;
+	subscriber->framed = framed;
+	MetricsAdd(METRIC_SUBSCRIBERS, 1);
+
+	pthread_mutex_lock(&incomingLock);
+	subscriber->next = incoming;
+	incoming = subscriber;
+	pthread_mutex_unlock(&incomingLock);
+
+	Wake();
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for telling the publisher about a new page version
+ *
+ */
+void SubscribeNotify(void)
+{
+	if(publisherRunning)
+	{
+		Wake();
+	}
+}
+
+/**
+ *
+ * \brief Function for stopping the publisher and closing all subscriptions
+ *
+ * Called before the renderer is closed.
+ *
+ */
+void SubscribeClose(void)
+{
+	if(!publisherRunning)
+	{
+		return;
+	}
+
+	atomic_store(&stopping, true);
+	Wake();
+	pthread_join(publisher, NULL);
+	publisherRunning = false;
+
+	while(subscribers != NULL)
+	{
+		Subscriber * next = subscribers->next;
+
+		DropSubscriber(subscribers);
+		subscribers = next;
+	}
+	while(incoming != NULL)
+	{
+		Subscriber * next = incoming->next;
+
+		DropSubscriber(incoming);
+		incoming = next;
+	}
+	subscriberCount = 0;
+	ClearFrames();
+	if(target != NULL)
+	{
+		RenderRelease(target);
+		target = NULL;
+	}
+	close(wakeDescriptor);
+	wakeDescriptor = -1;
+}
+
+/*
+ * =================================================================== eof ==
+ */
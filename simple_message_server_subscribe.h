@@ -0,0 +1,44 @@
+/*
+ * @file simple_message_server_subscribe.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_SUBSCRIBE_H
+#define SIMPLE_MESSAGE_SERVER_SUBSCRIBE_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* What a subscriber receives on every change of the board */
+typedef enum
+{
+	SUBSCRIBE_NONE,
+	SUBSCRIBE_PAGE,			/* the whole page */
+	SUBSCRIBE_MESSAGES		/* the whole page once, then only the new messages */
+} SubscribeMode;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int SubscribeOpen(int ioTimeout);
+int SubscribeAdd(int socketDescriptor, SubscribeMode mode, bool deflate, bool checksum, bool framed);
+void SubscribeNotify(void);
+void SubscribeClose(void);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,407 @@
+/*
+ * @file simple_message_server_threadpool.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "simple_message_server.h"
+#include "simple_message_server_threadpool.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static int DequeInit(WorkDeque * deque);
+static void DequeDestroy(WorkDeque * deque);
+static int DequePushBottom(WorkDeque * deque, int acceptedSocketDescriptor);
+static bool DequePopBottom(WorkDeque * deque, int * acceptedSocketDescriptor);
+static bool DequeStealTop(WorkDeque * deque, int * acceptedSocketDescriptor);
+static bool FindWork(Worker * worker, int * acceptedSocketDescriptor);
+static void * WorkerMain(void * argument);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for initialising an empty deque
+ *
+ * \param deque the deque that shall be initialised
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int DequeInit(WorkDeque * deque)
+{
+	deque->items = malloc(DEQUE_INITIAL_CAPACITY * sizeof(int));
+	if(deque->items == NULL)
+	{
+		PrintError("DequeInit() -> malloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	deque->capacity = DEQUE_INITIAL_CAPACITY;
+	deque->top = 0;
+	deque->bottom = 0;
+	pthread_mutex_init(&deque->lock, NULL);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for releasing a deque and closing connections left in it
+ *
+ * \param deque the deque that shall be released
+ *
+ */
+static void DequeDestroy(WorkDeque * deque)
+{
+	while(deque->top != deque->bottom)
+	{
+		close(deque->items[deque->top & (deque->capacity - 1)]);
+		deque->top++;
+	}
+	free(deque->items);
+	deque->items = NULL;
+	pthread_mutex_destroy(&deque->lock);
+}
+
+/**
+ *
+ * \brief Function for pushing a connection to the bottom of a deque
+ *
+ * \param deque the deque of the target worker
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+static int DequePushBottom(WorkDeque * deque, int acceptedSocketDescriptor)
+{
+	pthread_mutex_lock(&deque->lock);
+
+	if(deque->bottom - deque->top == deque->capacity)
+	{
+		// Full -> double the ring and unroll the old content
+		int * items = malloc(2 * deque->capacity * sizeof(int));
+		if(items == NULL)
+		{
+			pthread_mutex_unlock(&deque->lock);
+			PrintError("DequePushBottom() -> malloc()", true, NULL);
+			return EXIT_FAILURE;
+		}
+		for(size_t i = deque->top; i != deque->bottom; i++)
+		{
+			items[i & (2 * deque->capacity - 1)] = deque->items[i & (deque->capacity - 1)];
+		}
+		free(deque->items);
+		deque->items = items;
+		deque->capacity *= 2;
+	}
+
+	deque->items[deque->bottom & (deque->capacity - 1)] = acceptedSocketDescriptor;
+	deque->bottom++;
+
+	pthread_mutex_unlock(&deque->lock);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for popping the newest connection (owner side)
+ *
+ * \param deque the deque of the calling worker
+ * \param acceptedSocketDescriptor the popped descriptor
+ *
+ * \return true if a connection was popped
+ *
+ */
+static bool DequePopBottom(WorkDeque * deque, int * acceptedSocketDescriptor)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&deque->lock);
+	if(deque->bottom != deque->top)
+	{
+		deque->bottom--;
+		*acceptedSocketDescriptor = deque->items[deque->bottom & (deque->capacity - 1)];
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return found;
+}
+
+/**
+ *
+ * \brief Function for stealing the oldest connection (thief side)
+ *
+ * \param deque the deque of the victim worker
+ * \param acceptedSocketDescriptor the stolen descriptor
+ *
+ * \return true if a connection was stolen
+ *
+ */
+static bool DequeStealTop(WorkDeque * deque, int * acceptedSocketDescriptor)
+{
+	bool found = false;
+
+	// Never wait for a busy victim, just try the next one
+	if(pthread_mutex_trylock(&deque->lock) != 0)
+	{
+		return false;
+	}
+	if(deque->bottom != deque->top)
+	{
+		*acceptedSocketDescriptor = deque->items[deque->top & (deque->capacity - 1)];
+		deque->top++;
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->lock);
+
+	return found;
+}
+
+/**
+ *
+ * \brief Function for fetching the next connection of a worker
+ *
+ * First the own deque is drained, then the other workers are visited
+ * starting with the right neighbour.
+ *
+ * \param worker the calling worker
+ * \param acceptedSocketDescriptor the descriptor of the found connection
+ *
+ * \return true if a connection was found
+ *
+ */
+static bool FindWork(Worker * worker, int * acceptedSocketDescriptor)
+{
+	ThreadPool * pool = worker->pool;
+
+	if(DequePopBottom(&worker->deque, acceptedSocketDescriptor))
+	{
+		return true;
+	}
+
+	for(int i = 1; i < pool->allocatedWorkers; i++)
+	{
+		Worker * victim = &pool->workers[(worker->index + i) % pool->allocatedWorkers];
+		if(DequeStealTop(&victim->deque, acceptedSocketDescriptor))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ *
+ * \brief Main function of a worker thread
+ *
+ * \param argument the worker structure of the thread
+ *
+ * \return always NULL
+ *
+ */
+static void * WorkerMain(void * argument)
+{
+	Worker * worker = argument;
+	ThreadPool * pool = worker->pool;
+	int acceptedSocketDescriptor = -1;
+
+	for(;;)
+	{
+		if(FindWork(worker, &acceptedSocketDescriptor))
+		{
+			atomic_fetch_sub(&pool->pending, 1);
+			pool->handler(acceptedSocketDescriptor);
+			continue;
+		}
+
+		// Nothing to pop or steal -> sleep until an acceptor submits new work.
+		// A failed trylock may hide work, so only sleep if nothing is pending.
+		// On stop the queued connections are still served (graceful drain).
+		pthread_mutex_lock(&pool->sleepLock);
+		while(atomic_load(&pool->pending) == 0 && !atomic_load(&pool->stop))
+		{
+			pthread_cond_wait(&pool->sleepCondition, &pool->sleepLock);
+		}
+		if(atomic_load(&pool->pending) == 0 && atomic_load(&pool->stop))
+		{
+			pthread_mutex_unlock(&pool->sleepLock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->sleepLock);
+	}
+	return NULL;
+}
+
+/**
+ *
+ * \brief Function for creating a work stealing thread pool
+ *
+ * \param pool the pool that shall be created
+ * \param workerCount the number of worker threads
+ * \param handler the function that serves one accepted connection
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ThreadPoolCreate(ThreadPool * pool, int workerCount, ConnectionHandler handler)
+{
+	int r = 0;
+
+	memset(pool, 0, sizeof(ThreadPool));
+	pool->handler = handler;
+	atomic_init(&pool->pending, 0);
+	atomic_init(&pool->nextWorker, 0);
+	atomic_init(&pool->stop, false);
+	pthread_mutex_init(&pool->sleepLock, NULL);
+	pthread_cond_init(&pool->sleepCondition, NULL);
+
+	pool->workers = calloc(workerCount, sizeof(Worker));
+	if(pool->workers == NULL)
+	{
+		PrintError("ThreadPoolCreate() -> calloc()", true, NULL);
+		return EXIT_FAILURE;
+	}
+	pool->allocatedWorkers = workerCount;
+
+	for(int i = 0; i < workerCount; i++)
+	{
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		if(DequeInit(&pool->workers[i].deque) == EXIT_FAILURE)
+		{
+			PrintError("ThreadPoolCreate() -> DequeInit()", false, NULL);
+			ThreadPoolDestroy(pool);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// All deques have to exist before the first worker starts stealing
+	for(int i = 0; i < workerCount; i++)
+	{
+		r = pthread_create(&pool->workers[i].thread, NULL, WorkerMain, &pool->workers[i]);
+		if(r != 0)
+		{
+			errno = r;
+			PrintError("ThreadPoolCreate() -> pthread_create()", true, NULL);
+			ThreadPoolDestroy(pool);
+			return EXIT_FAILURE;
+		}
+		pool->workerCount++;
+	}
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for handing an accepted connection to a specific worker
+ *
+ * \param pool the thread pool
+ * \param workerIndex the index of the worker whose deque receives the connection
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ThreadPoolSubmitTo(ThreadPool * pool, int workerIndex, int acceptedSocketDescriptor)
+{
+	// Counted before the push, a worker popping it at once must not wrap the counter below 0
+	atomic_fetch_add(&pool->pending, 1);
+	if(DequePushBottom(&pool->workers[workerIndex % pool->workerCount].deque, acceptedSocketDescriptor) == EXIT_FAILURE)
+	{
+		atomic_fetch_sub(&pool->pending, 1);
+		PrintError("ThreadPoolSubmitTo() -> DequePushBottom()", false, NULL);
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_lock(&pool->sleepLock);
+	pthread_cond_signal(&pool->sleepCondition);
+	pthread_mutex_unlock(&pool->sleepLock);
+	return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Function for handing an accepted connection to the next worker (round robin)
+ *
+ * \param pool the thread pool
+ * \param acceptedSocketDescriptor the descriptor of the accepted connection
+ *
+ * \return EXIT_SUCCESS in case of success
+ * \return EXIT_FAILURE in case of failure
+ *
+ */
+int ThreadPoolSubmit(ThreadPool * pool, int acceptedSocketDescriptor)
+{
+	unsigned int workerIndex = atomic_fetch_add(&pool->nextWorker, 1);
+	return ThreadPoolSubmitTo(pool, (int) (workerIndex % (unsigned int) pool->workerCount), acceptedSocketDescriptor);
+}
+
+/**
+ *
+ * \brief Function for stopping all workers and releasing the pool
+ *
+ * Connections that are already queued are served before the workers stop.
+ *
+ * \param pool the thread pool
+ *
+ */
+void ThreadPoolDestroy(ThreadPool * pool)
+{
+	pthread_mutex_lock(&pool->sleepLock);
+	atomic_store(&pool->stop, true);
+	pthread_cond_broadcast(&pool->sleepCondition);
+	pthread_mutex_unlock(&pool->sleepLock);
+
+	for(int i = 0; i < pool->workerCount; i++)
+	{
+		pthread_join(pool->workers[i].thread, NULL);
+	}
+
+	if(pool->workers != NULL)
+	{
+		for(int i = 0; i < pool->allocatedWorkers; i++)
+		{
+			if(pool->workers[i].deque.items != NULL)
+			{
+				DequeDestroy(&pool->workers[i].deque);
+			}
+		}
+	}
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->workerCount = 0;
+	pool->allocatedWorkers = 0;
+	pthread_mutex_destroy(&pool->sleepLock);
+	pthread_cond_destroy(&pool->sleepCondition);
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,78 @@
+/*
+ * @file simple_message_server_threadpool.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_THREADPOOL_H
+#define SIMPLE_MESSAGE_SERVER_THREADPOOL_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+typedef void (* ConnectionHandler)(int acceptedSocketDescriptor);
+
+/*
+ * Double ended queue of accepted connections owned by one worker.
+ * The owner pops from the bottom (most recently pushed, still warm in cache),
+ * idle workers steal from the top (oldest connection).
+ */
+typedef struct
+{
+	int * items;
+	size_t capacity;	/* always a power of two */
+	size_t top;
+	size_t bottom;
+	pthread_mutex_t lock;
+} WorkDeque;
+
+struct ThreadPool;
+
+typedef struct
+{
+	struct ThreadPool * pool;
+	int index;
+	pthread_t thread;
+	WorkDeque deque;
+} Worker;
+
+typedef struct ThreadPool
+{
+	Worker * workers;
+	int workerCount;		/* running worker threads */
+	int allocatedWorkers;
+	ConnectionHandler handler;
+	atomic_size_t pending;		/* connections queued in any deque */
+	atomic_uint nextWorker;		/* round robin cursor of the acceptors */
+	atomic_bool stop;
+	pthread_mutex_t sleepLock;
+	pthread_cond_t sleepCondition;
+} ThreadPool;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int ThreadPoolCreate(ThreadPool * pool, int workerCount, ConnectionHandler handler);
+int ThreadPoolSubmit(ThreadPool * pool, int acceptedSocketDescriptor);
+int ThreadPoolSubmitTo(ThreadPool * pool, int workerIndex, int acceptedSocketDescriptor);
+void ThreadPoolDestroy(ThreadPool * pool);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
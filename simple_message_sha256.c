@@ -0,0 +1,178 @@
+/*
+ * @file simple_message_sha256.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * SHA-256 (FIPS 180-4). Used where content is addressed by its hash and
+ * somebody else chooses the content, so two different contents must never
+ * end up with the same name.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include "simple_message_sha256.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define SHA256_BLOCK_SIZE 64
+
+#define ROTATE(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
+
+/*
+ * --------------------------------------------------------------- globals --
+ */
+
+static const uint32_t roundConstants[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static void Compress(uint32_t state[8], const unsigned char * block);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for mixing one block of 64 bytes into the state
+ *
+ * \param state the eight words of the state
+ * \param block the block
+ *
+ */
+static void Compress(uint32_t state[8], const unsigned char * block)
+{
+	uint32_t schedule[64];
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+	for(int i = 0; i < 16; i++)
+	{
+		schedule[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 |
+					(uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+	}
+	for(int i = 16; i < 64; i++)
+	{
+		uint32_t s0 = ROTATE(schedule[i - 15], 7) ^ ROTATE(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+		uint32_t s1 = ROTATE(schedule[i - 2], 17) ^ ROTATE(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+
+		schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+	}
+
+	for(int i = 0; i < 64; i++)
+	{
+		uint32_t t1 = h + (ROTATE(e, 6) ^ ROTATE(e, 11) ^ ROTATE(e, 25)) + ((e & f) ^ (~e & g)) +
+					roundConstants[i] + schedule[i];
+		uint32_t t2 = (ROTATE(a, 2) ^ ROTATE(a, 13) ^ ROTATE(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+/**
+ *
+ * \brief Function for hashing bytes
+ *
+ * \param data the bytes
+ * \param length the number of bytes
+ * \param digest receives the 32 bytes of the hash
+ *
+ */
+void Sha256(const void * data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+	uint32_t state[8] =
+	{
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	unsigned char last[2 * SHA256_BLOCK_SIZE];
+	const unsigned char * bytes = data;
+	uint64_t bits = (uint64_t) length * 8;
+	size_t rest = length % SHA256_BLOCK_SIZE;
+	size_t padded = rest < SHA256_BLOCK_SIZE - 8 ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+
+	for(size_t i = 0; i + SHA256_BLOCK_SIZE <= length; i += SHA256_BLOCK_SIZE)
+	{
+		Compress(state, bytes + i);
+	}
+
+	// The rest, a 1 bit, zeros and the length in bits fill one or two blocks
+	memset(last, 0, sizeof(last));
+	memcpy(last, bytes + length - rest, rest);
+	last[rest] = 0x80;
+	for(int i = 0; i < 8; i++)
+	{
+		last[padded - 1 - i] = (unsigned char) (bits >> (8 * i));
+	}
+	for(size_t i = 0; i < padded; i += SHA256_BLOCK_SIZE)
+	{
+		Compress(state, last + i);
+	}
+
+	for(int i = 0; i < 8; i++)
+	{
+		digest[4 * i] = (unsigned char) (state[i] >> 24);
+		digest[4 * i + 1] = (unsigned char) (state[i] >> 16);
+		digest[4 * i + 2] = (unsigned char) (state[i] >> 8);
+		digest[4 * i + 3] = (unsigned char) state[i];
+	}
+}
+
+/**
+ *
+ * \brief Function for writing a hash as lower case hex digits
+ *
+ * \param digest the 32 bytes of the hash
+ * \param text receives the 64 digits and the terminating '\0'
+ *
+ */
+void Sha256Hex(const unsigned char digest[SHA256_DIGEST_SIZE], char text[SHA256_HEX_SIZE])
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for(int i = 0; i < SHA256_DIGEST_SIZE; i++)
+	{
+		text[2 * i] = digits[digest[i] >> 4];
+		text[2 * i + 1] = digits[digest[i] & 0x0f];
+	}
+	text[2 * SHA256_DIGEST_SIZE] = '\0';
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,38 @@
+/*
+ * @file simple_message_sha256.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_SHA256_H
+#define SIMPLE_MESSAGE_SHA256_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void Sha256(const void * data, size_t length, unsigned char digest[SHA256_DIGEST_SIZE]);
+void Sha256Hex(const unsigned char digest[SHA256_DIGEST_SIZE], char text[SHA256_HEX_SIZE]);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */
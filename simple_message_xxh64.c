@@ -0,0 +1,243 @@
+/*
+ * @file simple_message_xxh64.c
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ *
+ * XXH64, the 64 bit variant of xxHash by Yann Collet. Fast and not
+ * cryptographic: good for telling whether content changed, not against
+ * somebody forging content.
+ */
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include "simple_message_xxh64.h"
+
+/*
+ * --------------------------------------------------------------- defines --
+ */
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+#define ROTATE(value, bits) (((value) << (bits)) | ((value) >> (64 - (bits))))
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+static uint64_t Read64(const unsigned char * bytes);
+static uint32_t Read32(const unsigned char * bytes);
+static uint64_t Round(uint64_t lane, uint64_t input);
+static uint64_t MergeRound(uint64_t hash, uint64_t lane);
+
+/*
+ * ------------------------------------------------------------- functions --
+ */
+
+/**
+ *
+ * \brief Function for reading 8 bytes in little endian order
+ *
+ * \param bytes the bytes
+ *
+ * \return the value
+ *
+ */
+static uint64_t Read64(const unsigned char * bytes)
+{
+	uint64_t value = 0;
+
+	for(int i = 7; i >= 0; i--)
+	{
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+/**
+ *
+ * \brief Function for reading 4 bytes in little endian order
+ *
+ * \param bytes the bytes
+ *
+ * \return the value
+ *
+ */
+static uint32_t Read32(const unsigned char * bytes)
+{
+	return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+/**
+ *
+ * \brief Function for mixing 8 bytes into a lane
+ *
+ * \param lane the lane
+ * \param input the bytes
+ *
+ * \return the new lane
+ *
+ */
+static uint64_t Round(uint64_t lane, uint64_t input)
+{
+	lane += input * PRIME2;
+	lane = ROTATE(lane, 31);
+	return lane * PRIME1;
+}
+
+/**
+ *
+ * \brief Function for mixing a lane into the final hash
+ *
+ * \param hash the hash
+ * \param lane the lane
+ *
+ * \return the new hash
+ *
+ */
+static uint64_t MergeRound(uint64_t hash, uint64_t lane)
+{
+	hash ^= Round(0, lane);
+	return hash * PRIME1 + PRIME4;
+}
+
+/**
+ *
+ * \brief Function for starting a hash
+ *
+ * \param state the state of the hash
+ * \param seed the seed (0 unless hashes shall differ on purpose)
+ *
+ */
+void Xxh64Reset(Xxh64State * state, uint64_t seed)
+{
+	memset(state, 0, sizeof(Xxh64State));
+	state->seed = seed;
+	state->lanes[0] = seed + PRIME1 + PRIME2;
+	state->lanes[1] = seed + PRIME2;
+	state->lanes[2] = seed;
+	state->lanes[3] = seed - PRIME1;
+}
+
+/**
+ *
+ * \brief Function for feeding the next bytes to a hash
+ *
+ * \param state the state of the hash
+ * \param data the next bytes
+ * \param length the number of bytes
+ *
+ */
+void Xxh64Update(Xxh64State * state, const void * data, size_t length)
+{
+	const unsigned char * bytes = data;
+
+	state->total += length;
+
+	if(state->buffered > 0)
+	{
+		size_t take = sizeof(state->buffer) - state->buffered < length ? sizeof(state->buffer) - state->buffered : length;
+
+		memcpy(state->buffer + state->buffered, bytes, take);
+		state->buffered += take;
+		bytes += take;
+		length -= take;
+		if(state->buffered < sizeof(state->buffer))
+		{
+			return;
+		}
+		for(int i = 0; i < 4; i++)
+		{
+			state->lanes[i] = Round(state->lanes[i], Read64(state->buffer + 8 * i));
+		}
+		state->buffered = 0;
+	}
+
+	while(length >= sizeof(state->buffer))
+	{
+		for(int i = 0; i < 4; i++)
+		{
+			state->lanes[i] = Round(state->lanes[i], Read64(bytes + 8 * i));
+		}
+		bytes += sizeof(state->buffer);
+		length -= sizeof(state->buffer);
+	}
+
+	memcpy(state->buffer, bytes, length);
+	state->buffered = length;
+}
+
+/**
+ *
+ * \brief Function for getting the hash of the bytes fed so far
+ *
+ * The state is not changed, more bytes may follow.
+ *
+ * \param state the state of the hash
+ *
+ * \return the hash
+ *
+ */
+uint64_t Xxh64Digest(const Xxh64State * state)
+{
+	const unsigned char * bytes = state->buffer;
+	size_t length = state->buffered;
+	uint64_t hash = 0;
+
+	if(state->total >= sizeof(state->buffer))
+	{
+		hash = ROTATE(state->lanes[0], 1) + ROTATE(state->lanes[1], 7) +
+				ROTATE(state->lanes[2], 12) + ROTATE(state->lanes[3], 18);
+		for(int i = 0; i < 4; i++)
+		{
+			hash = MergeRound(hash, state->lanes[i]);
+		}
+	}
+	else
+	{
+		hash = state->seed + PRIME5;
+	}
+	hash += state->total;
+
+	while(length >= 8)
+	{
+		hash ^= Round(0, Read64(bytes));
+		hash = ROTATE(hash, 27) * PRIME1 + PRIME4;
+		bytes += 8;
+		length -= 8;
+	}
+	if(length >= 4)
+	{
+		hash ^= (uint64_t) Read32(bytes) * PRIME1;
+		hash = ROTATE(hash, 23) * PRIME2 + PRIME3;
+		bytes += 4;
+		length -= 4;
+	}
+	while(length > 0)
+	{
+		hash ^= *bytes * PRIME5;
+		hash = ROTATE(hash, 11) * PRIME1;
+		bytes++;
+		length--;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+/*
+ * =================================================================== eof ==
+ */
@@ -0,0 +1,46 @@
+/*
+ * @file simple_message_xxh64.h
+ * Verteilte Systeme - TCP/IP
+ * @author Thomas Stummer <ic15b079@technikum-wien.at>
+ * @author Patrick Matula <ic15b008@technikum-wien.at>
+ * @date 2026/10/18
+ * @version 1.0
+ */
+
+#ifndef SIMPLE_MESSAGE_XXH64_H
+#define SIMPLE_MESSAGE_XXH64_H
+
+/*
+ * -------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * -------------------------------------------------------------- typedefs --
+ */
+
+/* State of a hash fed in pieces */
+typedef struct
+{
+	uint64_t total;				/* bytes fed so far */
+	uint64_t lanes[4];
+	unsigned char buffer[32];	/* bytes not making up a full stripe yet */
+	size_t buffered;
+	uint64_t seed;
+} Xxh64State;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void Xxh64Reset(Xxh64State * state, uint64_t seed);
+void Xxh64Update(Xxh64State * state, const void * data, size_t length);
+uint64_t Xxh64Digest(const Xxh64State * state);
+
+#endif
+
+/*
+ * =================================================================== eof ==
+ */